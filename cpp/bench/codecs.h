@@ -0,0 +1,666 @@
+#ifndef SBON_BENCH_CODECS_H
+#define SBON_BENCH_CODECS_H
+
+// Minimal encoders and decoders for the formats SBON is compared with.
+// The decoders work like the SBON Reader: they walk the input once,
+// decoding every value (including unescaping strings into a reused buffer),
+// without building a tree.
+
+#include "corpus.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace bench {
+
+class DecodeError: public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
+namespace json {
+
+inline void encodeString(std::string &out, std::string_view str) {
+	out += '"';
+	for (char ch: str) {
+		if (ch == '"' || ch == '\\') {
+			out += '\\';
+			out += ch;
+		} else if ((unsigned char)ch < 0x20) {
+			static const char digits[] = "0123456789abcdef";
+			out += "\\u00";
+			out += digits[(unsigned char)ch >> 4];
+			out += digits[ch & 0x0f];
+		} else {
+			out += ch;
+		}
+	}
+	out += '"';
+}
+
+inline void encode(std::string &out, const Value &val) {
+	char buf[32];
+	switch (val.kind) {
+	case Value::Kind::NIL:
+		out += "null";
+		break;
+	case Value::Kind::BOOL:
+		out += val.b ? "true" : "false";
+		break;
+	case Value::Kind::INT:
+		out.append(buf, std::to_chars(buf, buf + sizeof(buf), val.i).ptr - buf);
+		break;
+	case Value::Kind::DOUBLE: {
+		size_t len = std::to_chars(buf, buf + sizeof(buf), val.d).ptr - buf;
+		out.append(buf, len);
+
+		// Keep doubles distinguishable from integers
+		if (std::string_view(buf, len).find_first_of(".en") == std::string_view::npos) {
+			out += ".0";
+		}
+		break;
+	}
+	case Value::Kind::STRING:
+		encodeString(out, val.str);
+		break;
+	case Value::Kind::ARRAY:
+		out += '[';
+		for (size_t i = 0; i < val.elems.size(); ++i) {
+			if (i > 0) {
+				out += ',';
+			}
+			encode(out, val.elems[i]);
+		}
+		out += ']';
+		break;
+	case Value::Kind::OBJECT:
+		out += '{';
+		for (size_t i = 0; i < val.members.size(); ++i) {
+			if (i > 0) {
+				out += ',';
+			}
+			encodeString(out, val.members[i].first);
+			out += ':';
+			encode(out, val.members[i].second);
+		}
+		out += '}';
+		break;
+	}
+}
+
+class Decoder {
+public:
+	Decoder(const char *p, const char *end, Stats &stats): p_(p), end_(end), stats_(stats) {}
+
+	bool hasNext() {
+		skipSpace();
+		return p_ < end_;
+	}
+
+	void value() {
+		skipSpace();
+		need(1);
+		stats_.values += 1;
+		char ch = *p_;
+		if (ch == '{') {
+			p_ += 1;
+			if (peek() == '}') {
+				p_ += 1;
+				return;
+			}
+			while (true) {
+				skipSpace();
+				string(key_);
+				skipSpace();
+				expect(':');
+				value();
+				skipSpace();
+				if (peek() == ',') {
+					p_ += 1;
+				} else {
+					expect('}');
+					return;
+				}
+			}
+		} else if (ch == '[') {
+			p_ += 1;
+			if (peek() == ']') {
+				p_ += 1;
+				return;
+			}
+			while (true) {
+				value();
+				skipSpace();
+				if (peek() == ',') {
+					p_ += 1;
+				} else {
+					expect(']');
+					return;
+				}
+			}
+		} else if (ch == '"') {
+			string(str_);
+			stats_.stringBytes += str_.size();
+		} else if (ch == 't') {
+			literal("true");
+		} else if (ch == 'f') {
+			literal("false");
+		} else if (ch == 'n') {
+			literal("null");
+		} else {
+			number();
+		}
+	}
+
+private:
+	void need(size_t n) {
+		if ((size_t)(end_ - p_) < n) {
+			throw DecodeError("JSON: Unexpected EOF");
+		}
+	}
+
+	char peek() {
+		skipSpace();
+		need(1);
+		return *p_;
+	}
+
+	void expect(char ch) {
+		if (peek() != ch) {
+			throw DecodeError(std::string("JSON: Expected '") + ch + "'");
+		}
+		p_ += 1;
+	}
+
+	void skipSpace() {
+		while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+			p_ += 1;
+		}
+	}
+
+	void literal(std::string_view lit) {
+		need(lit.size());
+		if (std::string_view(p_, lit.size()) != lit) {
+			throw DecodeError("JSON: Bad literal");
+		}
+		p_ += lit.size();
+	}
+
+	void number() {
+		const char *start = p_;
+		bool isDouble = false;
+		while (p_ < end_) {
+			char ch = *p_;
+			if (ch == '.' || ch == 'e' || ch == 'E') {
+				isDouble = true;
+			} else if (!((ch >= '0' && ch <= '9') || ch == '-' || ch == '+')) {
+				break;
+			}
+			p_ += 1;
+		}
+
+		std::from_chars_result res;
+		if (isDouble) {
+			double d = 0;
+			res = std::from_chars(start, p_, d);
+			stats_.numberSum += d;
+		} else {
+			int64_t i = 0;
+			res = std::from_chars(start, p_, i);
+			stats_.numberSum += (double)i;
+		}
+
+		if (res.ec != std::errc() || res.ptr != p_) {
+			throw DecodeError("JSON: Bad number");
+		}
+	}
+
+	static int hexDigit(char ch) {
+		if (ch >= '0' && ch <= '9') {
+			return ch - '0';
+		} else if (ch >= 'a' && ch <= 'f') {
+			return ch - 'a' + 10;
+		} else if (ch >= 'A' && ch <= 'F') {
+			return ch - 'A' + 10;
+		}
+		throw DecodeError("JSON: Bad escape");
+	}
+
+	void appendUtf8(std::string &out, uint32_t cp) {
+		if (cp < 0x80) {
+			out += (char)cp;
+		} else if (cp < 0x800) {
+			out += (char)(0xc0 | (cp >> 6));
+			out += (char)(0x80 | (cp & 0x3f));
+		} else {
+			out += (char)(0xe0 | (cp >> 12));
+			out += (char)(0x80 | ((cp >> 6) & 0x3f));
+			out += (char)(0x80 | (cp & 0x3f));
+		}
+	}
+
+	// Copy runs of plain characters in bulk, and unescape the rest
+	void string(std::string &out) {
+		expect('"');
+		out.clear();
+		while (true) {
+			const char *run = p_;
+			while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+				p_ += 1;
+			}
+			out.append(run, p_ - run);
+			need(1);
+
+			if (*p_ == '"') {
+				p_ += 1;
+				return;
+			}
+
+			need(2);
+			char esc = p_[1];
+			p_ += 2;
+			switch (esc) {
+			case 'n': out += '\n'; break;
+			case 't': out += '\t'; break;
+			case 'r': out += '\r'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'u': {
+				need(4);
+				uint32_t cp = 0;
+				for (int i = 0; i < 4; ++i) {
+					cp = cp * 16 + hexDigit(p_[i]);
+				}
+				p_ += 4;
+				appendUtf8(out, cp);
+				break;
+			}
+			default: out += esc; break;
+			}
+		}
+	}
+
+	const char *p_;
+	const char *end_;
+	Stats &stats_;
+	std::string key_;
+	std::string str_;
+};
+
+}
+
+// MessagePack and CBOR both store multi-byte integers big-endian.
+inline void appendBigEndian(std::string &out, uint64_t num, int bytes) {
+	for (int i = bytes - 1; i >= 0; --i) {
+		out += (char)(num >> (i * 8));
+	}
+}
+
+inline uint64_t readBigEndian(const char *&p, const char *end, int bytes) {
+	if (end - p < bytes) {
+		throw DecodeError("Unexpected EOF");
+	}
+
+	uint64_t num = 0;
+	for (int i = 0; i < bytes; ++i) {
+		num = (num << 8) | (unsigned char)*p++;
+	}
+	return num;
+}
+
+namespace msgpack {
+
+inline void encodeLength(std::string &out, size_t len, uint8_t fix, size_t fixMax, uint8_t base16) {
+	if (len <= fixMax) {
+		out += (char)(fix | len);
+	} else if (len <= 0xffff) {
+		out += (char)base16;
+		appendBigEndian(out, len, 2);
+	} else {
+		out += (char)(base16 + 1);
+		appendBigEndian(out, len, 4);
+	}
+}
+
+inline void encodeString(std::string &out, std::string_view str) {
+	if (str.size() <= 31) {
+		out += (char)(0xa0 | str.size());
+	} else if (str.size() <= 0xff) {
+		out += (char)0xd9;
+		out += (char)str.size();
+	} else {
+		encodeLength(out, str.size(), 0, 0, 0xda);
+	}
+	out += str;
+}
+
+inline void encode(std::string &out, const Value &val) {
+	switch (val.kind) {
+	case Value::Kind::NIL:
+		out += (char)0xc0;
+		break;
+	case Value::Kind::BOOL:
+		out += (char)(val.b ? 0xc3 : 0xc2);
+		break;
+	case Value::Kind::INT: {
+		int64_t i = val.i;
+		if (i >= 0 && i <= 127) {
+			out += (char)i;
+		} else if (i < 0 && i >= -32) {
+			out += (char)(uint8_t)i;
+		} else if (i >= 0) {
+			if (i <= 0xff) {
+				out += (char)0xcc;
+				appendBigEndian(out, i, 1);
+			} else if (i <= 0xffff) {
+				out += (char)0xcd;
+				appendBigEndian(out, i, 2);
+			} else if (i <= 0xffffffffll) {
+				out += (char)0xce;
+				appendBigEndian(out, i, 4);
+			} else {
+				out += (char)0xcf;
+				appendBigEndian(out, i, 8);
+			}
+		} else {
+			if (i >= -128) {
+				out += (char)0xd0;
+				appendBigEndian(out, (uint64_t)i, 1);
+			} else if (i >= -32768) {
+				out += (char)0xd1;
+				appendBigEndian(out, (uint64_t)i, 2);
+			} else if (i >= -2147483648ll) {
+				out += (char)0xd2;
+				appendBigEndian(out, (uint64_t)i, 4);
+			} else {
+				out += (char)0xd3;
+				appendBigEndian(out, (uint64_t)i, 8);
+			}
+		}
+		break;
+	}
+	case Value::Kind::DOUBLE: {
+		uint64_t bits;
+		std::memcpy(&bits, &val.d, 8);
+		out += (char)0xcb;
+		appendBigEndian(out, bits, 8);
+		break;
+	}
+	case Value::Kind::STRING:
+		encodeString(out, val.str);
+		break;
+	case Value::Kind::ARRAY:
+		encodeLength(out, val.elems.size(), 0x90, 15, 0xdc);
+		for (auto &el: val.elems) {
+			encode(out, el);
+		}
+		break;
+	case Value::Kind::OBJECT:
+		encodeLength(out, val.members.size(), 0x80, 15, 0xde);
+		for (auto &[key, el]: val.members) {
+			encodeString(out, key);
+			encode(out, el);
+		}
+		break;
+	}
+}
+
+class Decoder {
+public:
+	Decoder(const char *p, const char *end, Stats &stats): p_(p), end_(end), stats_(stats) {}
+
+	bool hasNext() {
+		return p_ < end_;
+	}
+
+	void value() {
+		stats_.values += 1;
+		item(true);
+	}
+
+private:
+	// Decode one item. Strings which aren't values are keys.
+	void item(bool isValue) {
+		if (p_ >= end_) {
+			throw DecodeError("MessagePack: Unexpected EOF");
+		}
+
+		uint8_t ch = *p_++;
+		if (ch <= 0x7f) {
+			stats_.numberSum += ch;
+		} else if (ch >= 0xe0) {
+			stats_.numberSum += (int8_t)ch;
+		} else if ((ch & 0xf0) == 0x80) {
+			map(ch & 0x0f);
+		} else if ((ch & 0xf0) == 0x90) {
+			array(ch & 0x0f);
+		} else if ((ch & 0xe0) == 0xa0) {
+			string(ch & 0x1f, isValue);
+		} else {
+			switch (ch) {
+			case 0xc0: case 0xc2: case 0xc3: break;
+			case 0xcb: {
+				uint64_t bits = readBigEndian(p_, end_, 8);
+				double d;
+				std::memcpy(&d, &bits, 8);
+				stats_.numberSum += d;
+				break;
+			}
+			case 0xcc: stats_.numberSum += (double)readBigEndian(p_, end_, 1); break;
+			case 0xcd: stats_.numberSum += (double)readBigEndian(p_, end_, 2); break;
+			case 0xce: stats_.numberSum += (double)readBigEndian(p_, end_, 4); break;
+			case 0xcf: stats_.numberSum += (double)readBigEndian(p_, end_, 8); break;
+			case 0xd0: stats_.numberSum += (int8_t)readBigEndian(p_, end_, 1); break;
+			case 0xd1: stats_.numberSum += (int16_t)readBigEndian(p_, end_, 2); break;
+			case 0xd2: stats_.numberSum += (int32_t)readBigEndian(p_, end_, 4); break;
+			case 0xd3: stats_.numberSum += (double)(int64_t)readBigEndian(p_, end_, 8); break;
+			case 0xd9: string(readBigEndian(p_, end_, 1), isValue); break;
+			case 0xda: string(readBigEndian(p_, end_, 2), isValue); break;
+			case 0xdb: string(readBigEndian(p_, end_, 4), isValue); break;
+			case 0xdc: array(readBigEndian(p_, end_, 2)); break;
+			case 0xdd: array(readBigEndian(p_, end_, 4)); break;
+			case 0xde: map(readBigEndian(p_, end_, 2)); break;
+			case 0xdf: map(readBigEndian(p_, end_, 4)); break;
+			default: throw DecodeError("MessagePack: Unsupported type");
+			}
+		}
+	}
+
+	void string(uint64_t len, bool isValue) {
+		if ((uint64_t)(end_ - p_) < len) {
+			throw DecodeError("MessagePack: Unexpected EOF");
+		}
+
+		str_.assign(p_, len);
+		p_ += len;
+		if (isValue) {
+			stats_.stringBytes += len;
+		}
+	}
+
+	void array(uint64_t count) {
+		for (uint64_t i = 0; i < count; ++i) {
+			value();
+		}
+	}
+
+	void map(uint64_t count) {
+		for (uint64_t i = 0; i < count; ++i) {
+			item(false);
+			value();
+		}
+	}
+
+	const char *p_;
+	const char *end_;
+	Stats &stats_;
+	std::string str_;
+};
+
+}
+
+namespace cbor {
+
+inline void encodeHead(std::string &out, uint8_t major, uint64_t num) {
+	major <<= 5;
+	if (num < 24) {
+		out += (char)(major | num);
+	} else if (num <= 0xff) {
+		out += (char)(major | 24);
+		appendBigEndian(out, num, 1);
+	} else if (num <= 0xffff) {
+		out += (char)(major | 25);
+		appendBigEndian(out, num, 2);
+	} else if (num <= 0xffffffffull) {
+		out += (char)(major | 26);
+		appendBigEndian(out, num, 4);
+	} else {
+		out += (char)(major | 27);
+		appendBigEndian(out, num, 8);
+	}
+}
+
+inline void encode(std::string &out, const Value &val) {
+	switch (val.kind) {
+	case Value::Kind::NIL:
+		out += (char)0xf6;
+		break;
+	case Value::Kind::BOOL:
+		out += (char)(val.b ? 0xf5 : 0xf4);
+		break;
+	case Value::Kind::INT:
+		if (val.i >= 0) {
+			encodeHead(out, 0, val.i);
+		} else {
+			encodeHead(out, 1, (uint64_t)(-1 - val.i));
+		}
+		break;
+	case Value::Kind::DOUBLE: {
+		uint64_t bits;
+		std::memcpy(&bits, &val.d, 8);
+		out += (char)0xfb;
+		appendBigEndian(out, bits, 8);
+		break;
+	}
+	case Value::Kind::STRING:
+		encodeHead(out, 3, val.str.size());
+		out += val.str;
+		break;
+	case Value::Kind::ARRAY:
+		encodeHead(out, 4, val.elems.size());
+		for (auto &el: val.elems) {
+			encode(out, el);
+		}
+		break;
+	case Value::Kind::OBJECT:
+		encodeHead(out, 5, val.members.size());
+		for (auto &[key, el]: val.members) {
+			encodeHead(out, 3, key.size());
+			out += key;
+			encode(out, el);
+		}
+		break;
+	}
+}
+
+class Decoder {
+public:
+	Decoder(const char *p, const char *end, Stats &stats): p_(p), end_(end), stats_(stats) {}
+
+	bool hasNext() {
+		return p_ < end_;
+	}
+
+	void value() {
+		stats_.values += 1;
+		item(true);
+	}
+
+private:
+	uint64_t argument(uint8_t info) {
+		if (info < 24) {
+			return info;
+		} else if (info == 24) {
+			return readBigEndian(p_, end_, 1);
+		} else if (info == 25) {
+			return readBigEndian(p_, end_, 2);
+		} else if (info == 26) {
+			return readBigEndian(p_, end_, 4);
+		} else if (info == 27) {
+			return readBigEndian(p_, end_, 8);
+		}
+		throw DecodeError("CBOR: Unsupported length");
+	}
+
+	void item(bool isValue) {
+		if (p_ >= end_) {
+			throw DecodeError("CBOR: Unexpected EOF");
+		}
+
+		uint8_t ch = *p_++;
+		uint8_t major = ch >> 5;
+		uint8_t info = ch & 0x1f;
+		switch (major) {
+		case 0:
+			stats_.numberSum += (double)argument(info);
+			break;
+		case 1:
+			stats_.numberSum += (double)(-1 - (int64_t)argument(info));
+			break;
+		case 3: {
+			uint64_t len = argument(info);
+			if ((uint64_t)(end_ - p_) < len) {
+				throw DecodeError("CBOR: Unexpected EOF");
+			}
+			str_.assign(p_, len);
+			p_ += len;
+			if (isValue) {
+				stats_.stringBytes += len;
+			}
+			break;
+		}
+		case 4: {
+			uint64_t count = argument(info);
+			for (uint64_t i = 0; i < count; ++i) {
+				value();
+			}
+			break;
+		}
+		case 5: {
+			uint64_t count = argument(info);
+			for (uint64_t i = 0; i < count; ++i) {
+				item(false);
+				value();
+			}
+			break;
+		}
+		case 7:
+			if (info == 27) {
+				uint64_t bits = readBigEndian(p_, end_, 8);
+				double d;
+				std::memcpy(&d, &bits, 8);
+				stats_.numberSum += d;
+			} else if (info < 20 || info > 22) {
+				throw DecodeError("CBOR: Unsupported simple value");
+			}
+			break;
+		default:
+			throw DecodeError("CBOR: Unsupported type");
+		}
+	}
+
+	const char *p_;
+	const char *end_;
+	Stats &stats_;
+	std::string str_;
+};
+
+}
+
+}
+
+#endif
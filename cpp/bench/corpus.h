@@ -0,0 +1,295 @@
+#ifndef SBON_BENCH_CORPUS_H
+#define SBON_BENCH_CORPUS_H
+
+// Generated test data for the benchmarks, as a simple value tree
+// which every format's encoder can write.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+struct Value {
+	enum class Kind {
+		NIL,
+		BOOL,
+		INT,
+		DOUBLE,
+		STRING,
+		ARRAY,
+		OBJECT,
+	};
+
+	Kind kind = Kind::NIL;
+	bool b = false;
+	int64_t i = 0;
+	double d = 0;
+	std::string str;
+	std::vector<Value> elems;
+	std::vector<std::pair<std::string, Value>> members;
+
+	static Value nil() {
+		return Value();
+	}
+
+	static Value boolean(bool b) {
+		Value v;
+		v.kind = Kind::BOOL;
+		v.b = b;
+		return v;
+	}
+
+	static Value integer(int64_t i) {
+		Value v;
+		v.kind = Kind::INT;
+		v.i = i;
+		return v;
+	}
+
+	static Value number(double d) {
+		Value v;
+		v.kind = Kind::DOUBLE;
+		v.d = d;
+		return v;
+	}
+
+	static Value string(std::string str) {
+		Value v;
+		v.kind = Kind::STRING;
+		v.str = std::move(str);
+		return v;
+	}
+
+	static Value array() {
+		Value v;
+		v.kind = Kind::ARRAY;
+		return v;
+	}
+
+	static Value object() {
+		Value v;
+		v.kind = Kind::OBJECT;
+		return v;
+	}
+
+	Value &add(Value val) {
+		elems.push_back(std::move(val));
+		return elems.back();
+	}
+
+	Value &add(std::string key, Value val) {
+		members.emplace_back(std::move(key), std::move(val));
+		return members.back().second;
+	}
+};
+
+// What a decoder saw, used both to check that every format decodes
+// the same data, and to keep the compiler from optimising decoding away.
+struct Stats {
+	uint64_t values = 0;
+	uint64_t stringBytes = 0;
+	double numberSum = 0;
+
+	// Number sums are compared with a tolerance, since decoders which
+	// reorder object members (like jsoncpp) add them in a different order
+	bool operator==(const Stats &other) const {
+		double diff = numberSum > other.numberSum ?
+			numberSum - other.numberSum : other.numberSum - numberSum;
+		double mag = numberSum > 0 ? numberSum : -numberSum;
+		return values == other.values && stringBytes == other.stringBytes &&
+			diff <= mag * 1e-12;
+	}
+};
+
+inline void collectStats(const Value &val, Stats &stats) {
+	stats.values += 1;
+	switch (val.kind) {
+	case Value::Kind::NIL:
+	case Value::Kind::BOOL:
+		break;
+	case Value::Kind::INT:
+		stats.numberSum += (double)val.i;
+		break;
+	case Value::Kind::DOUBLE:
+		stats.numberSum += val.d;
+		break;
+	case Value::Kind::STRING:
+		stats.stringBytes += val.str.size();
+		break;
+	case Value::Kind::ARRAY:
+		for (auto &el: val.elems) {
+			collectStats(el, stats);
+		}
+		break;
+	case Value::Kind::OBJECT:
+		for (auto &[key, el]: val.members) {
+			collectStats(el, stats);
+		}
+		break;
+	}
+}
+
+// A small deterministic PRNG, so that every run uses the same data
+class Random {
+public:
+	explicit Random(uint64_t seed): state_(seed) {}
+
+	uint64_t next() {
+		state_ ^= state_ << 13;
+		state_ ^= state_ >> 7;
+		state_ ^= state_ << 17;
+		return state_;
+	}
+
+	uint64_t below(uint64_t n) {
+		return next() % n;
+	}
+
+	double unit() {
+		return (double)(next() >> 11) / (double)(1ull << 53);
+	}
+
+	template<typename T, size_t N>
+	const T &pick(const T (&arr)[N]) {
+		return arr[below(N)];
+	}
+
+private:
+	uint64_t state_;
+};
+
+struct Corpus {
+	std::string name;
+	std::string description;
+
+	// The top-level values; decoders read them as a stream of records
+	std::vector<Value> records;
+	Stats stats;
+};
+
+inline Corpus finish(Corpus corpus) {
+	for (auto &rec: corpus.records) {
+		collectStats(rec, corpus.stats);
+	}
+	return corpus;
+}
+
+// HTTP access log records with short strings and small integers.
+inline Corpus makeLogs(size_t count) {
+	static const char *methods[] = {"GET", "GET", "GET", "POST", "PUT", "DELETE"};
+	static const char *paths[] = {
+		"/api/v1/users", "/api/v1/orders", "/api/v2/search", "/static/app.js",
+		"/health", "/api/v1/users/settings", "/login",
+	};
+	static const char *agents[] = {
+		"Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36",
+		"curl/8.4.0",
+		"Go-http-client/2.0",
+	};
+	static const int statuses[] = {200, 200, 200, 200, 201, 204, 301, 404, 500, 503};
+
+	Random rand(1);
+	Corpus corpus;
+	corpus.name = "logs";
+	corpus.description = "HTTP access log records";
+	for (size_t i = 0; i < count; ++i) {
+		Value rec = Value::object();
+		rec.add("ts", Value::integer(1700000000000 + i * 37));
+		rec.add("method", Value::string(rand.pick(methods)));
+		rec.add("path", Value::string(rand.pick(paths)));
+		rec.add("status", Value::integer(rand.pick(statuses)));
+		rec.add("ms", Value::number((double)rand.below(100000) / 100));
+		rec.add("bytes", Value::integer(rand.below(1 << 20)));
+		rec.add("user", rand.below(4) == 0 ?
+			Value::nil() : Value::string("user" + std::to_string(rand.below(10000))));
+		rec.add("agent", Value::string(rand.pick(agents)));
+		rec.add("cached", Value::boolean(rand.below(2)));
+		corpus.records.push_back(std::move(rec));
+	}
+
+	return finish(std::move(corpus));
+}
+
+// Time series with long arrays of integers and doubles.
+inline Corpus makeMetrics(size_t count) {
+	Random rand(2);
+	Corpus corpus;
+	corpus.name = "metrics";
+	corpus.description = "Metric series with arrays of numbers";
+	for (size_t i = 0; i < count; ++i) {
+		Value rec = Value::object();
+		rec.add("name", Value::string("host" + std::to_string(i % 50) + ".cpu.load"));
+		rec.add("start", Value::integer(1700000000 + i * 60));
+		Value times = Value::array();
+		Value values = Value::array();
+		Value counts = Value::array();
+		for (int j = 0; j < 256; ++j) {
+			times.add(Value::integer(j * 10 + rand.below(3)));
+			values.add(Value::number(rand.unit() * 100));
+			counts.add(Value::integer(rand.below(1 << (rand.below(24) + 1))));
+		}
+		rec.add("offsets", std::move(times));
+		rec.add("values", std::move(values));
+		rec.add("counts", std::move(counts));
+		corpus.records.push_back(std::move(rec));
+	}
+
+	return finish(std::move(corpus));
+}
+
+// Nested API responses with objects in arrays in objects.
+inline Corpus makeNested(size_t count) {
+	static const char *cities[] = {"Oslo", "Berlin", "Lisbon", "Toronto", "Osaka"};
+	static const char *roles[] = {"admin", "editor", "viewer"};
+
+	Random rand(3);
+	Corpus corpus;
+	corpus.name = "nested";
+	corpus.description = "Nested API responses";
+	for (size_t i = 0; i < count; ++i) {
+		Value rec = Value::object();
+		rec.add("requestId", Value::string("req-" + std::to_string(rand.next() % 1000000000)));
+		Value page = Value::object();
+		page.add("offset", Value::integer(i * 20));
+		page.add("limit", Value::integer(20));
+		page.add("hasMore", Value::boolean(i + 1 < count));
+		rec.add("page", std::move(page));
+
+		// Children are filled in before they're added, since adding
+		// to a parent can move its earlier children
+		Value users = Value::array();
+		for (int j = 0; j < 20; ++j) {
+			Value user = Value::object();
+			user.add("id", Value::integer(rand.below(10000000)));
+			user.add("name", Value::string("User Name " + std::to_string(rand.below(100000))));
+			user.add("email", Value::string("user" + std::to_string(j) + "@example.com"));
+			user.add("score", Value::number(rand.unit()));
+			Value address = Value::object();
+			address.add("city", Value::string(rand.pick(cities)));
+			address.add("zip", Value::string(std::to_string(10000 + rand.below(90000))));
+			Value geo = Value::array();
+			geo.add(Value::number(rand.unit() * 180 - 90));
+			geo.add(Value::number(rand.unit() * 360 - 180));
+			address.add("geo", std::move(geo));
+			user.add("address", std::move(address));
+			Value userRoles = Value::array();
+			for (uint64_t k = 0; k < 1 + rand.below(3); ++k) {
+				userRoles.add(Value::string(rand.pick(roles)));
+			}
+			user.add("roles", std::move(userRoles));
+			user.add("manager", rand.below(3) == 0 ? Value::nil() : Value::integer(rand.below(1000)));
+			users.add(std::move(user));
+		}
+		rec.add("users", std::move(users));
+		corpus.records.push_back(std::move(rec));
+	}
+
+	return finish(std::move(corpus));
+}
+
+}
+
+#endif
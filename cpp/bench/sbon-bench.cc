@@ -0,0 +1,476 @@
+// Encode and decode the same generated corpora with SBON and other formats,
+// and report the encoded sizes and throughput side by side.
+//
+// MessagePack, CBOR and JSON use the minimal codecs in codecs.h.
+// If jsoncpp was found when building, it's measured as well.
+
+#include <sbon.h>
+#include <sbon-buffer.h>
+#include <sbon-records.h>
+
+#include "codecs.h"
+#include "corpus.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef SBON_BENCH_JSONCPP
+#include <json/json.h>
+#endif
+
+using bench::Corpus;
+using bench::Stats;
+using bench::Value;
+
+struct Format {
+	std::string name;
+
+	// Prepare for encoding 'corpus', outside of the timed part
+	std::function<void(const Corpus &)> prepare;
+
+	std::function<void(const Corpus &, std::string &)> encode;
+	std::function<void(const std::string &, Stats &)> decode;
+};
+
+static void writeValue(sbon::Writer &w, const Value &val) {
+	switch (val.kind) {
+	case Value::Kind::NIL:
+		w.writeNull();
+		break;
+	case Value::Kind::BOOL:
+		w.writeBool(val.b);
+		break;
+	case Value::Kind::INT:
+		w.writeInt(val.i);
+		break;
+	case Value::Kind::DOUBLE:
+		w.writeDouble(val.d);
+		break;
+	case Value::Kind::STRING:
+		w.writeString(val.str);
+		break;
+	case Value::Kind::ARRAY:
+		w.writeArray([&](sbon::Writer w) {
+			for (auto &el: val.elems) {
+				writeValue(w, el);
+			}
+		});
+		break;
+	case Value::Kind::OBJECT:
+		w.writeObject([&](sbon::ObjectWriter w) {
+			for (auto &[key, el]: val.members) {
+				sbon::Writer kw = w.key(key.c_str());
+				writeValue(kw, el);
+			}
+		});
+		break;
+	}
+}
+
+// Decodes with a Reader, reusing its string buffers like a typical consumer would
+struct ReaderVisitor {
+	Stats &stats;
+	std::string key;
+	std::string str;
+
+	void visit(sbon::Reader r) {
+		stats.values += 1;
+		switch (r.getType()) {
+		case sbon::Type::BOOL:
+			r.getBool();
+			break;
+		case sbon::Type::NIL:
+			r.getNil();
+			break;
+		case sbon::Type::STRING:
+			r.getString(str);
+			stats.stringBytes += str.size();
+			break;
+		case sbon::Type::BINARY:
+			r.skipBinary();
+			break;
+		case sbon::Type::FLOAT:
+			stats.numberSum += r.getFloat();
+			break;
+		case sbon::Type::DOUBLE:
+			stats.numberSum += r.getDouble();
+			break;
+		case sbon::Type::INT:
+			stats.numberSum += (double)r.getInt();
+			break;
+		case sbon::Type::UINT:
+			stats.numberSum += (double)r.getUInt();
+			break;
+		case sbon::Type::ARRAY:
+			r.getArray([&](sbon::ArrayReader arr) {
+				while (arr.hasNext()) {
+					visit(arr.next());
+				}
+			});
+			break;
+		case sbon::Type::OBJECT:
+			r.getObject([&](sbon::ObjectReader obj) {
+				while (obj.hasNext()) {
+					visit(obj.next(key));
+				}
+			});
+			break;
+		}
+	}
+};
+
+static void visitRaw(sbon::RawValue val, Stats &stats) {
+	stats.values += 1;
+	switch (val.getType()) {
+	case sbon::Type::BOOL:
+		val.getBool();
+		break;
+	case sbon::Type::NIL:
+	case sbon::Type::BINARY:
+		break;
+	case sbon::Type::STRING:
+		stats.stringBytes += val.getString().size();
+		break;
+	case sbon::Type::FLOAT:
+		stats.numberSum += val.getFloat();
+		break;
+	case sbon::Type::DOUBLE:
+		stats.numberSum += val.getDouble();
+		break;
+	case sbon::Type::INT:
+		stats.numberSum += (double)val.getInt();
+		break;
+	case sbon::Type::UINT:
+		stats.numberSum += (double)val.getUInt();
+		break;
+	case sbon::Type::ARRAY:
+		val.forEachElement([&](sbon::RawValue el) {
+			visitRaw(el, stats);
+		});
+		break;
+	case sbon::Type::OBJECT:
+		val.forEachMember([&](std::string_view, sbon::RawValue el) {
+			visitRaw(el, stats);
+		});
+		break;
+	}
+}
+
+static void encodeSbon(const Corpus &corpus, std::string &out) {
+	static sbon::BufferStream bs;
+	bs.reset();
+	sbon::Writer w(&bs);
+	for (auto &rec: corpus.records) {
+		writeValue(w, rec);
+	}
+	out.assign(bs.view());
+}
+
+template<typename Decoder>
+static void decodeWith(const std::string &data, Stats &stats) {
+	Decoder dec(data.data(), data.data() + data.size(), stats);
+	while (dec.hasNext()) {
+		dec.value();
+	}
+}
+
+#ifdef SBON_BENCH_JSONCPP
+static Json::Value toJsonCpp(const Value &val) {
+	switch (val.kind) {
+	case Value::Kind::NIL:
+		return Json::Value();
+	case Value::Kind::BOOL:
+		return Json::Value(val.b);
+	case Value::Kind::INT:
+		return Json::Value((Json::Int64)val.i);
+	case Value::Kind::DOUBLE:
+		return Json::Value(val.d);
+	case Value::Kind::STRING:
+		return Json::Value(val.str);
+	case Value::Kind::ARRAY: {
+		Json::Value arr(Json::arrayValue);
+		for (auto &el: val.elems) {
+			arr.append(toJsonCpp(el));
+		}
+		return arr;
+	}
+	case Value::Kind::OBJECT: {
+		Json::Value obj(Json::objectValue);
+		for (auto &[key, el]: val.members) {
+			obj[key] = toJsonCpp(el);
+		}
+		return obj;
+	}
+	}
+	return Json::Value();
+}
+
+static void visitJsonCpp(const Json::Value &val, Stats &stats) {
+	stats.values += 1;
+	switch (val.type()) {
+	case Json::intValue:
+		stats.numberSum += (double)val.asInt64();
+		break;
+	case Json::uintValue:
+		stats.numberSum += (double)val.asUInt64();
+		break;
+	case Json::realValue:
+		stats.numberSum += val.asDouble();
+		break;
+	case Json::stringValue: {
+		const char *begin, *end;
+		val.getString(&begin, &end);
+		stats.stringBytes += end - begin;
+		break;
+	}
+	case Json::arrayValue:
+	case Json::objectValue:
+		for (auto &el: val) {
+			visitJsonCpp(el, stats);
+		}
+		break;
+	default:
+		break;
+	}
+}
+#endif
+
+static std::vector<Format> makeFormats() {
+	std::vector<Format> formats;
+
+	formats.push_back({"sbon Reader (stringstream)", nullptr, encodeSbon,
+		[](const std::string &data, Stats &stats) {
+			std::istringstream is(data);
+			ReaderVisitor v{stats, {}, {}};
+			sbon::Reader r(&is);
+			while (r.hasNext()) {
+				v.visit(r);
+			}
+		}});
+
+	formats.push_back({"sbon Reader (MemoryStream)", nullptr, encodeSbon,
+		[](const std::string &data, Stats &stats) {
+			sbon::MemoryStream ms(data.data(), data.size());
+			ReaderVisitor v{stats, {}, {}};
+			sbon::Reader r(&ms);
+			while (r.hasNext()) {
+				v.visit(r);
+			}
+		}});
+
+	formats.push_back({"sbon RawValue", nullptr, encodeSbon,
+		[](const std::string &data, Stats &stats) {
+			sbon::forEachRecord({data.data(), data.data() + data.size()}, [&](sbon::Span rec) {
+				visitRaw(sbon::RawValue(rec), stats);
+			});
+		}});
+
+	formats.push_back({"json", nullptr,
+		[](const Corpus &corpus, std::string &out) {
+			out.clear();
+			for (auto &rec: corpus.records) {
+				bench::json::encode(out, rec);
+				out += '\n';
+			}
+		},
+		decodeWith<bench::json::Decoder>});
+
+#ifdef SBON_BENCH_JSONCPP
+	// jsoncpp builds a tree, so encoding is measured from a prepared tree
+	static std::vector<Json::Value> trees;
+	formats.push_back({"jsoncpp",
+		[](const Corpus &corpus) {
+			trees.clear();
+			for (auto &rec: corpus.records) {
+				trees.push_back(toJsonCpp(rec));
+			}
+		},
+		[](const Corpus &, std::string &out) {
+			Json::StreamWriterBuilder builder;
+			builder["indentation"] = "";
+			std::ostringstream os;
+			std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+			for (auto &tree: trees) {
+				writer->write(tree, &os);
+				os << '\n';
+			}
+			out = os.str();
+		},
+		[](const std::string &data, Stats &stats) {
+			Json::CharReaderBuilder builder;
+			std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+			const char *p = data.data();
+			const char *end = p + data.size();
+			Json::Value tree;
+			std::string err;
+			while (p < end) {
+				const char *eol = (const char *)memchr(p, '\n', end - p);
+				if (!eol) {
+					eol = end;
+				}
+				if (!reader->parse(p, eol, &tree, &err)) {
+					throw bench::DecodeError("jsoncpp: " + err);
+				}
+				visitJsonCpp(tree, stats);
+				p = eol + 1;
+			}
+		}});
+#endif
+
+	formats.push_back({"msgpack", nullptr,
+		[](const Corpus &corpus, std::string &out) {
+			out.clear();
+			for (auto &rec: corpus.records) {
+				bench::msgpack::encode(out, rec);
+			}
+		},
+		decodeWith<bench::msgpack::Decoder>});
+
+	formats.push_back({"cbor", nullptr,
+		[](const Corpus &corpus, std::string &out) {
+			out.clear();
+			for (auto &rec: corpus.records) {
+				bench::cbor::encode(out, rec);
+			}
+		},
+		decodeWith<bench::cbor::Decoder>});
+
+	return formats;
+}
+
+// Run 'func' repeatedly for at least 'minTime' seconds,
+// and return the average time per run in seconds.
+template<typename Func>
+static double measure(double minTime, Func func) {
+	using Clock = std::chrono::steady_clock;
+
+	func();
+	size_t runs = 0;
+	auto start = Clock::now();
+	double elapsed = 0;
+	do {
+		func();
+		runs += 1;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < minTime || runs < 3);
+
+	return elapsed / runs;
+}
+
+static void usage(const char *argv0) {
+	std::cerr << "Usage: " << argv0 << " [options] [corpus...]\n";
+	std::cerr << '\n';
+	std::cerr << "Corpora: logs, metrics, nested (default: all)\n";
+	std::cerr << '\n';
+	std::cerr << "Options:\n";
+	std::cerr << "  -t <seconds>  Minimum time per measurement (default: 0.5)\n";
+	std::cerr << "  -s <scale>    Multiply the corpus sizes by <scale> (default: 1)\n";
+}
+
+int main(int argc, char **argv) {
+	double minTime = 0.5;
+	double scale = 1;
+	std::vector<std::string> names;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string_view arg = argv[i];
+		if ((arg == "-t" || arg == "-s") && i + 1 < argc) {
+			double num = std::atof(argv[++i]);
+			if (num <= 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			(arg == "-t" ? minTime : scale) = num;
+		} else if (arg == "-h" || arg == "--help") {
+			usage(argv[0]);
+			return 0;
+		} else if (arg.size() > 0 && arg[0] == '-') {
+			usage(argv[0]);
+			return 1;
+		} else {
+			names.emplace_back(arg);
+		}
+	}
+
+	if (names.empty()) {
+		names = {"logs", "metrics", "nested"};
+	}
+
+	std::vector<Format> formats = makeFormats();
+	bool ok = true;
+	for (auto &name: names) {
+		Corpus corpus;
+		if (name == "logs") {
+			corpus = bench::makeLogs(20000 * scale);
+		} else if (name == "metrics") {
+			corpus = bench::makeMetrics(200 * scale);
+		} else if (name == "nested") {
+			corpus = bench::makeNested(1000 * scale);
+		} else {
+			std::cerr << "Unknown corpus: " << name << '\n';
+			return 1;
+		}
+
+		std::printf("\n%s: %s, %zu records, %llu values\n",
+			corpus.name.c_str(), corpus.description.c_str(),
+			corpus.records.size(), (unsigned long long)corpus.stats.values);
+		std::printf("%-28s %12s %8s %12s %12s %12s\n",
+			"format", "size", "vs json", "encode MB/s", "decode MB/s", "ns/value");
+
+		std::string json;
+		for (auto &rec: corpus.records) {
+			bench::json::encode(json, rec);
+			json += '\n';
+		}
+
+		for (auto &fmt: formats) {
+			if (fmt.prepare) {
+				fmt.prepare(corpus);
+			}
+
+			std::string data;
+			double encodeTime = measure(minTime, [&] {
+				fmt.encode(corpus, data);
+			});
+
+			Stats stats;
+			try {
+				fmt.decode(data, stats);
+			} catch (std::exception &ex) {
+				std::printf("%-28s decoding failed: %s\n", fmt.name.c_str(), ex.what());
+				ok = false;
+				continue;
+			}
+
+			if (!(stats == corpus.stats)) {
+				std::printf("%-28s decoded data doesn't match the corpus\n", fmt.name.c_str());
+				ok = false;
+				continue;
+			}
+
+			double decodeTime = measure(minTime, [&] {
+				Stats stats;
+				fmt.decode(data, stats);
+			});
+
+			double mb = data.size() / 1e6;
+			std::string vsJson =
+				std::to_string((int)(100.0 * data.size() / json.size() + 0.5)) + "%";
+			std::printf("%-28s %12zu %8s %12.1f %12.1f %12.1f\n",
+				fmt.name.c_str(), data.size(), vsJson.c_str(),
+				mb / encodeTime, mb / decodeTime,
+				decodeTime * 1e9 / corpus.stats.values);
+		}
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Parsing the values of the example tools' command line options.
+
+#include <charconv>
+#include <cstring>
+#include <type_traits>
+
+// Parse a decimal number, such as a thread count, into 'out'.
+// Returns false, leaving 'out' unchanged, if 'str' isn't a number
+// or it's out of range, so that the tool can print its usage.
+template<typename T>
+bool parseOption(const char *str, T &out) {
+	static_assert(std::is_unsigned_v<T>);
+	T val;
+	const char *end = str + std::strlen(str);
+	auto res = std::from_chars(str, end, val);
+	if (res.ec != std::errc() || res.ptr != end) {
+		return false;
+	}
+
+	out = val;
+	return true;
+}
@@ -0,0 +1,72 @@
+#include <sbon-agg.h>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "options.h"
+
+static void usage(const char *argv0) {
+	std::cerr
+		<< "Usage: " << argv0 << " [options] [infile]\n"
+		<< "\n"
+		<< "Aggregate a stream of records, and write one record per group.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  -g <path>   Group by the value at <path> (may be repeated)\n"
+		<< "  -a <aggr>   Compute an aggregate (may be repeated). One of:\n"
+		<< "              count, sum:<path>, min:<path>, max:<path>,\n"
+		<< "              avg:<path>, p<percentile>:<path>\n"
+		<< "  -j <count>  Number of threads to use\n";
+}
+
+int main(int argc, char **argv) {
+	std::vector<std::string> groupBy;
+	std::vector<std::string> aggs;
+	unsigned threads = sbon::defaultThreads();
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+		std::string_view arg = argv[argi];
+		if (arg == "-g" && argi + 1 < argc) {
+			groupBy.push_back(argv[++argi]);
+		} else if (arg == "-a" && argi + 1 < argc) {
+			aggs.push_back(argv[++argi]);
+		} else if (arg == "-j" && argi + 1 < argc && parseOption(argv[argi + 1], threads)) {
+			argi += 1;
+		} else if (arg == "--") {
+			argi += 1;
+			break;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - argi > 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (aggs.empty()) {
+		aggs.push_back("count");
+	}
+
+	try {
+		std::vector<sbon::AggregateSpec> specs;
+		for (auto &agg: aggs) {
+			specs.push_back(sbon::AggregateSpec::parse(agg));
+		}
+
+		sbon::Aggregation aggregation(groupBy, specs);
+		sbon::MappedFile input(argi < argc ? argv[argi] : nullptr);
+
+		auto table = sbon::aggregateRecords(aggregation, input.span(), threads);
+		sbon::Writer w(&std::cout);
+		table.write(w);
+		std::cout.flush();
+	} catch (std::exception &ex) {
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+}
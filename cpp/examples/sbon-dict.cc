@@ -0,0 +1,103 @@
+#include <sbon-dict.h>
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "options.h"
+
+static void usage(const char *argv0) {
+	std::cerr
+		<< "Usage: " << argv0 << " -t <dict> [-s <size>] [infile]\n"
+		<< "       " << argv0 << " -D <dict> [-x] [-v] [infile]\n"
+		<< "\n"
+		<< "Compress a stream of small records with a dictionary trained from\n"
+		<< "records like them. Each record is compressed on its own, and written\n"
+		<< "as a binary value, so records can still be read one at a time.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  -t <dict>   Train a dictionary from the records, and write it to <dict>\n"
+		<< "  -s <size>   With -t, the maximum size of the dictionary (default "
+		<< sbon::Dictionary::DEFAULT_SIZE << ")\n"
+		<< "  -D <dict>   Compress the records with the dictionary in <dict>\n"
+		<< "  -x          With -D, decompress a compressed stream instead\n"
+		<< "  -v          With -D, print the compression ratio\n";
+}
+
+int main(int argc, char **argv) {
+	const char *trainPath = nullptr;
+	const char *dictPath = nullptr;
+	size_t size = sbon::Dictionary::DEFAULT_SIZE;
+	bool extract = false;
+	bool verbose = false;
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+		std::string_view arg = argv[argi];
+		if (arg == "-t" && argi + 1 < argc) {
+			trainPath = argv[++argi];
+		} else if (arg == "-s" && argi + 1 < argc && parseOption(argv[argi + 1], size)) {
+			argi += 1;
+		} else if (arg == "-D" && argi + 1 < argc) {
+			dictPath = argv[++argi];
+		} else if (arg == "-x") {
+			extract = true;
+		} else if (arg == "-v") {
+			verbose = true;
+		} else if (arg == "--") {
+			argi += 1;
+			break;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - argi > 1 || !trainPath == !dictPath || size == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		sbon::MappedFile input(argi < argc ? argv[argi] : nullptr);
+
+		if (trainPath) {
+			sbon::Dictionary dict = sbon::Dictionary::train(input.span(), size);
+			std::ofstream out(trainPath, std::ios::binary);
+			out.write(dict.bytes().data(), dict.size());
+			if (!out.flush()) {
+				throw std::system_error(errno, std::generic_category(), trainPath);
+			}
+			return 0;
+		}
+
+		sbon::MappedFile dictFile(dictPath);
+		sbon::Dictionary dict(std::string(dictFile.span().view()));
+
+		if (extract) {
+			std::string buf;
+			sbon::forEachRecord(input.span(), [&](sbon::Span rec) {
+				dict.decompress(sbon::RawValue(rec).getBinary(), buf);
+				std::cout.write(buf.data(), buf.size());
+			});
+			return 0;
+		}
+
+		sbon::CompressedWriter writer(dict, &std::cout);
+		sbon::forEachRecord(input.span(), [&](sbon::Span rec) {
+			writer.writeRaw(rec.view());
+		});
+		if (verbose) {
+			std::cerr
+				<< writer.rawBytes() << " -> " << writer.compressedBytes() << " bytes ("
+				<< (double)writer.rawBytes() / std::max<uint64_t>(writer.compressedBytes(), 1)
+				<< "x)\n";
+		}
+	} catch (std::exception &ex) {
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+}
@@ -0,0 +1,63 @@
+#include <sbon-filter.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include "options.h"
+
+static void usage(const char *argv0) {
+	std::cerr
+		<< "Usage: " << argv0 << " [options] <expression> [infile]\n"
+		<< "\n"
+		<< "Write the records which match <expression> to standard output.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  -c          Print the number of matching records instead\n"
+		<< "  -j <count>  Number of threads to use\n";
+}
+
+int main(int argc, char **argv) {
+	bool countOnly = false;
+	unsigned threads = sbon::defaultThreads();
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+		std::string_view arg = argv[argi];
+		if (arg == "-c") {
+			countOnly = true;
+		} else if (arg == "-j" && argi + 1 < argc && parseOption(argv[argi + 1], threads)) {
+			argi += 1;
+		} else if (arg == "--") {
+			argi += 1;
+			break;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - argi < 1 || argc - argi > 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		sbon::Filter filter(argv[argi]);
+		sbon::MappedFile input(argi + 1 < argc ? argv[argi + 1] : nullptr);
+
+		auto matches = sbon::filterRecords(filter, input.span(), threads);
+		if (countOnly) {
+			std::cout << matches.size() << '\n';
+			return 0;
+		}
+
+		for (auto &rec: matches) {
+			std::cout.write(rec.begin, rec.size());
+		}
+		std::cout.flush();
+	} catch (std::exception &ex) {
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+}
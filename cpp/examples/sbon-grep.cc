@@ -0,0 +1,74 @@
+#include <sbon-grep.h>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "options.h"
+
+static void usage(const char *argv0) {
+	std::cerr
+		<< "Usage: " << argv0 << " [options] <pattern> [infile]\n"
+		<< "\n"
+		<< "Search the string values in a stream of records.\n"
+		<< "Each match is printed as '<record index>:<key path>: <string>'.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  -E          Treat <pattern> as a regular expression\n"
+		<< "  -k          Search object keys too\n"
+		<< "  -c          Print the number of matches instead\n"
+		<< "  -j <count>  Number of threads to use\n";
+}
+
+int main(int argc, char **argv) {
+	bool regex = false;
+	bool keys = false;
+	bool countOnly = false;
+	unsigned threads = sbon::defaultThreads();
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+		std::string_view arg = argv[argi];
+		if (arg == "-E") {
+			regex = true;
+		} else if (arg == "-k") {
+			keys = true;
+		} else if (arg == "-c") {
+			countOnly = true;
+		} else if (arg == "-j" && argi + 1 < argc && parseOption(argv[argi + 1], threads)) {
+			argi += 1;
+		} else if (arg == "--") {
+			argi += 1;
+			break;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - argi < 1 || argc - argi > 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		auto pat = regex ?
+			sbon::GrepPattern::regex(argv[argi]) :
+			sbon::GrepPattern::literal(argv[argi]);
+		sbon::MappedFile input(argi + 1 < argc ? argv[argi + 1] : nullptr);
+
+		auto matches = sbon::grepRecords(pat, input.span(), keys, threads);
+		if (countOnly) {
+			std::cout << matches.size() << '\n';
+			return 0;
+		}
+
+		for (auto &match: matches) {
+			std::cout
+				<< match.record << ':' << match.path
+				<< (match.isKey ? " (key)" : "") << ": " << match.text << '\n';
+		}
+	} catch (std::exception &ex) {
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+}
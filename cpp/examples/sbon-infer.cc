@@ -0,0 +1,66 @@
+#include <sbon-infer.h>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "options.h"
+
+static void usage(const char *argv0) {
+	std::cerr
+		<< "Usage: " << argv0 << " [options] [infile]\n"
+		<< "\n"
+		<< "Infer the schema of a stream of records, and write a C++ header\n"
+		<< "with structs for it and functions to decode and encode them.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  -r <name>   The name of the records' struct (default Record)\n"
+		<< "  -n <name>   Put the generated code in a namespace\n"
+		<< "  -s          Write the inferred schema as SBON instead,\n"
+		<< "              in the form accepted by sbon-schema.h\n"
+		<< "  -j <count>  Number of threads to use\n";
+}
+
+int main(int argc, char **argv) {
+	sbon::BindingOptions opts;
+	bool schemaOnly = false;
+	unsigned threads = sbon::defaultThreads();
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+		std::string_view arg = argv[argi];
+		if (arg == "-r" && argi + 1 < argc) {
+			opts.rootName = argv[++argi];
+		} else if (arg == "-n" && argi + 1 < argc) {
+			opts.ns = argv[++argi];
+		} else if (arg == "-s") {
+			schemaOnly = true;
+		} else if (arg == "-j" && argi + 1 < argc && parseOption(argv[argi + 1], threads)) {
+			argi += 1;
+		} else if (arg == "--") {
+			argi += 1;
+			break;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - argi > 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		sbon::MappedFile input(argi < argc ? argv[argi] : nullptr);
+		sbon::InferredValue schema = sbon::inferSchema(input.span(), threads);
+
+		if (schemaOnly) {
+			schema.writeSchema(sbon::Writer(&std::cout));
+		} else {
+			sbon::generateBindings(schema, opts, std::cout);
+		}
+	} catch (std::exception &ex) {
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+}
@@ -0,0 +1,60 @@
+#include <sbon-sort.h>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "options.h"
+
+static void usage(const char *argv0) {
+	std::cerr
+		<< "Usage: " << argv0 << " [options] -k <path> [-k <path>...] [infile]\n"
+		<< "\n"
+		<< "Sort a stream of records by the values at the given key paths.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  -k <path>   Sort by the value at <path> (may be repeated)\n"
+		<< "  -m <MiB>    Memory limit in MiB (default 256)\n"
+		<< "  -T <dir>    Directory for temporary files\n"
+		<< "  -j <count>  Number of threads to use\n";
+}
+
+int main(int argc, char **argv) {
+	sbon::SortOptions opts;
+	size_t memoryMB = 0;
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+		std::string_view arg = argv[argi];
+		if (arg == "-k" && argi + 1 < argc) {
+			opts.keys.push_back(argv[++argi]);
+		} else if (arg == "-m" && argi + 1 < argc && parseOption(argv[argi + 1], memoryMB) &&
+				memoryMB <= SIZE_MAX / (1024 * 1024)) {
+			opts.memoryLimit = memoryMB * 1024 * 1024;
+			argi += 1;
+		} else if (arg == "-T" && argi + 1 < argc) {
+			opts.tempDir = argv[++argi];
+		} else if (arg == "-j" && argi + 1 < argc && parseOption(argv[argi + 1], opts.threads)) {
+			argi += 1;
+		} else if (arg == "--") {
+			argi += 1;
+			break;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (opts.keys.empty() || argc - argi > 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		sbon::MappedFile input(argi < argc ? argv[argi] : nullptr);
+		sbon::sortRecords(input.span(), std::cout, opts);
+		std::cout.flush();
+	} catch (std::exception &ex) {
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+}
@@ -0,0 +1,91 @@
+#include <sbon-split.h>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "options.h"
+
+static void usage(const char *argv0) {
+	std::cerr
+		<< "Usage: " << argv0 << " [options] [infile]\n"
+		<< "\n"
+		<< "Split a stream of records into shard files.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  -n <count>     Number of shards (default 2)\n"
+		<< "  -b <mode>      Balance by 'bytes' (default), 'count' or 'hash:<path>'\n"
+		<< "  -a             Split the elements of one top-level array,\n"
+		<< "                 writing each shard as an array\n"
+		<< "  -o <prefix>    Prefix of the shard file names (default 'shard-')\n"
+		<< "  -j <count>     Number of threads to use\n";
+}
+
+int main(int argc, char **argv) {
+	size_t count = 2;
+	sbon::ShardMode mode = sbon::ShardMode::BYTES;
+	std::string keyPath;
+	bool array = false;
+	std::string prefix = "shard-";
+	unsigned threads = sbon::defaultThreads();
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+		std::string_view arg = argv[argi];
+		if (arg == "-n" && argi + 1 < argc && parseOption(argv[argi + 1], count)) {
+			argi += 1;
+		} else if (arg == "-b" && argi + 1 < argc) {
+			std::string_view m = argv[++argi];
+			if (m == "bytes") {
+				mode = sbon::ShardMode::BYTES;
+			} else if (m == "count") {
+				mode = sbon::ShardMode::COUNT;
+			} else if (m.substr(0, 5) == "hash:" && m.size() > 5) {
+				mode = sbon::ShardMode::HASH;
+				keyPath = m.substr(5);
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (arg == "-a") {
+			array = true;
+		} else if (arg == "-o" && argi + 1 < argc) {
+			prefix = argv[++argi];
+		} else if (arg == "-j" && argi + 1 < argc && parseOption(argv[argi + 1], threads)) {
+			argi += 1;
+		} else if (arg == "--") {
+			argi += 1;
+			break;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (count == 0 || argc - argi > 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		sbon::MappedFile input(argi < argc ? argv[argi] : nullptr);
+
+		std::vector<sbon::Span> records;
+		std::string storage;
+		if (array) {
+			records = sbon::arrayElements(input.span(), storage);
+		} else {
+			sbon::forEachRecord(input.span(), [&](sbon::Span rec) {
+				records.push_back(rec);
+			});
+		}
+
+		auto shards = sbon::shardRecords(records, count, mode, keyPath);
+		auto names = sbon::writeShards(shards, prefix, ".sbon", array, threads);
+		for (size_t i = 0; i < names.size(); ++i) {
+			std::cout << names[i] << ": " << shards[i].size() << " records\n";
+		}
+	} catch (std::exception &ex) {
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+}
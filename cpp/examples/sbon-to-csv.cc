@@ -0,0 +1,68 @@
+#include <sbon-csv.h>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "options.h"
+
+static void usage(const char *argv0) {
+	std::cerr
+		<< "Usage: " << argv0 << " [options] <path>[,<path>...] [infile]\n"
+		<< "\n"
+		<< "Convert a stream of records to CSV, with one column per key path.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  -t          Write TSV instead of CSV\n"
+		<< "  -n          Don't write a header row\n"
+		<< "  -j <count>  Number of threads to use\n";
+}
+
+int main(int argc, char **argv) {
+	sbon::CsvOptions opts;
+	unsigned threads = sbon::defaultThreads();
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+		std::string_view arg = argv[argi];
+		if (arg == "-t") {
+			opts.delimiter = '\t';
+		} else if (arg == "-n") {
+			opts.header = false;
+		} else if (arg == "-j" && argi + 1 < argc && parseOption(argv[argi + 1], threads)) {
+			argi += 1;
+		} else if (arg == "--") {
+			argi += 1;
+			break;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - argi < 1 || argc - argi > 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<std::string> columns;
+	std::string_view cols = argv[argi];
+	while (true) {
+		size_t comma = cols.find(',');
+		columns.emplace_back(cols.substr(0, comma));
+		if (comma == std::string_view::npos) {
+			break;
+		}
+		cols = cols.substr(comma + 1);
+	}
+
+	try {
+		sbon::CsvFormatter fmt(columns, opts);
+		sbon::MappedFile input(argi + 1 < argc ? argv[argi + 1] : nullptr);
+		sbon::writeCsv(fmt, input.span(), std::cout, threads);
+		std::cout.flush();
+	} catch (std::exception &ex) {
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+}
@@ -0,0 +1,417 @@
+#include <sbon-view.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "options.h"
+
+static void usage(const char *argv0) {
+	std::cerr
+		<< "Usage: " << argv0 << " [options] [infile]\n"
+		<< "\n"
+		<< "View a stream of records, expanding values as they're needed,\n"
+		<< "so that even very large files open instantly.\n"
+		<< "Paths start with the record index, e.g. '0.users.3.name'.\n"
+		<< "\n"
+		<< "Options:\n"
+		<< "  -p <path>   Start at the value at <path>\n"
+		<< "  -d          Print the outline instead of viewing it interactively\n"
+		<< "  -e <depth>  With -d, expand containers up to <depth> levels (default 1)\n"
+		<< "  -n <lines>  With -d, print at most <lines> lines\n"
+		<< "  -w <width>  With -d, cut lines to <width> bytes (default 120)\n"
+		<< "\n"
+		<< "Keys:\n"
+		<< "  j, k, Down, Up         Move down or up\n"
+		<< "  Space, b, PgDn, PgUp   Move a page down or up\n"
+		<< "  g, G, Home, End        Go to the first or last line\n"
+		<< "  Enter, l, Right        Expand or collapse a value\n"
+		<< "  h, Left                Collapse a value, or go to its container\n"
+		<< "  /                      Go to a path\n"
+		<< "  q                      Quit\n";
+}
+
+// Print the lines of the outline, starting at 'start', and only those of
+// the value at 'start' if it was given by a path.
+static void dump(
+		sbon::Outline &outline, sbon::Outline::Line start, bool subtree,
+		unsigned expandDepth, size_t maxLines, size_t width) {
+	uint32_t startDepth = outline.depth(start);
+	std::string out;
+	size_t count = 0;
+	for (auto line = start; line && count < maxLines; line = outline.next(line), ++count) {
+		uint32_t depth = outline.depth(line);
+		if (subtree && !(line == start) &&
+				(depth < startDepth || (depth == startDepth && line.index != sbon::Outline::CLOSE))) {
+			break;
+		}
+
+		if (depth < expandDepth && outline.isContainer(line)) {
+			outline.expand(line);
+		}
+
+		out += outline.render(line, width);
+		out += '\n';
+		if (out.size() > 64 * 1024) {
+			std::cout << out;
+			out.clear();
+		}
+	}
+	std::cout << out;
+}
+
+class Terminal {
+public:
+	Terminal() {
+		fd_ = ::open("/dev/tty", O_RDWR);
+		if (fd_ < 0) {
+			throw std::system_error(errno, std::generic_category(), "/dev/tty");
+		}
+
+		tcgetattr(fd_, &saved_);
+		termios raw = saved_;
+		raw.c_iflag &= ~(IXON | ICRNL);
+		raw.c_lflag &= ~(ECHO | ICANON | ISIG);
+		raw.c_cc[VMIN] = 1;
+		raw.c_cc[VTIME] = 0;
+		tcsetattr(fd_, TCSAFLUSH, &raw);
+
+		// Use the alternate screen, and hide the cursor
+		write("\x1b[?1049h\x1b[?25l");
+	}
+
+	~Terminal() {
+		write("\x1b[?25h\x1b[?1049l");
+		tcsetattr(fd_, TCSAFLUSH, &saved_);
+		::close(fd_);
+	}
+
+	void size(size_t &rows, size_t &cols) const {
+		winsize ws;
+		if (ioctl(fd_, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+			rows = ws.ws_row;
+			cols = ws.ws_col;
+		} else {
+			rows = 24;
+			cols = 80;
+		}
+	}
+
+	void write(std::string_view str) {
+		while (!str.empty()) {
+			ssize_t n = ::write(fd_, str.data(), str.size());
+			if (n < 0 && errno != EINTR) {
+				return;
+			} else if (n > 0) {
+				str.remove_prefix(n);
+			}
+		}
+	}
+
+	// Read a key press; escape sequences are returned whole.
+	// Returns an empty string if interrupted, e.g. by a resize.
+	std::string readKey() {
+		if (pending_.empty()) {
+			char buf[256];
+			ssize_t n = ::read(fd_, buf, sizeof(buf));
+			if (n <= 0) {
+				return {};
+			}
+			pending_.assign(buf, n);
+		}
+
+		// An escape sequence is ESC '[', parameters, and a final byte
+		size_t size = 1;
+		if (pending_.size() > 2 && pending_[0] == '\x1b' && pending_[1] == '[') {
+			size = 2;
+			while (size < pending_.size() && !(pending_[size] >= 0x40 && pending_[size] <= 0x7e)) {
+				size += 1;
+			}
+			size = std::min(size + 1, pending_.size());
+		}
+
+		std::string key = pending_.substr(0, size);
+		pending_.erase(0, size);
+		return key;
+	}
+
+private:
+	int fd_;
+	termios saved_;
+
+	// Bytes read but not returned yet, e.g. when typing ahead
+	std::string pending_;
+};
+
+class Viewer {
+public:
+	Viewer(sbon::Outline &outline, sbon::Outline::Line start, Terminal &term):
+		outline_(outline), term_(term), top_(start), cursor_(start) {}
+
+	void run() {
+		while (true) {
+			draw();
+			std::string key = term_.readKey();
+			message_.clear();
+			try {
+				if (!handle(key)) {
+					return;
+				}
+			} catch (sbon::ParseError &err) {
+				message_ = err.what();
+			}
+		}
+	}
+
+private:
+	size_t pageRows() const {
+		size_t rows, cols;
+		term_.size(rows, cols);
+		return rows > 1 ? rows - 1 : 1;
+	}
+
+	bool handle(const std::string &key) {
+		if (key == "q" || key == "\x03") {
+			return false;
+		} else if (key == "j" || key == "\x1b[B") {
+			down(1);
+		} else if (key == "k" || key == "\x1b[A") {
+			up(1);
+		} else if (key == " " || key == "\x1b[6~") {
+			down(pageRows());
+		} else if (key == "b" || key == "\x1b[5~") {
+			up(pageRows());
+		} else if (key == "g" || key == "\x1b[H" || key == "\x1b[1~") {
+			top_ = cursor_ = outline_.first();
+			row_ = 0;
+		} else if (key == "G" || key == "\x1b[F" || key == "\x1b[4~") {
+			cursor_ = outline_.last();
+			bottom();
+		} else if (key == "\r" || key == "l" || key == "\x1b[C") {
+			if (outline_.isExpanded(cursor_)) {
+				outline_.collapse(cursor_);
+			} else if (!outline_.expand(cursor_)) {
+				message_ = "Can't expand this value";
+			}
+		} else if (key == "h" || key == "\x1b[D") {
+			if (outline_.isExpanded(cursor_)) {
+				outline_.collapse(cursor_);
+			} else if (auto parent = outline_.enclosing(cursor_)) {
+				cursor_ = parent;
+				outline_.collapse(cursor_);
+			}
+			top_ = outline_.reveal(top_);
+		} else if (key == "/") {
+			std::string path = prompt("/");
+			if (auto line = outline_.find(path)) {
+				top_ = cursor_ = line;
+				row_ = 0;
+			} else if (!path.empty()) {
+				message_ = "Not found: " + path;
+			}
+		}
+
+		// Keep the cursor on the screen, e.g. after a collapse
+		size_t rows = pageRows();
+		auto line = top_;
+		for (row_ = 0; row_ < rows && line && !(line == cursor_); ++row_) {
+			line = outline_.next(line);
+		}
+		if (row_ == rows || !line) {
+			top_ = cursor_;
+			row_ = 0;
+		}
+		return true;
+	}
+
+	void down(size_t count) {
+		size_t rows = pageRows();
+		for (size_t i = 0; i < count; ++i) {
+			auto next = outline_.next(cursor_);
+			if (!next) {
+				break;
+			}
+
+			cursor_ = next;
+			if (++row_ >= rows) {
+				top_ = outline_.next(top_);
+				row_ -= 1;
+			}
+		}
+	}
+
+	void up(size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			auto prev = outline_.prev(cursor_);
+			if (!prev) {
+				break;
+			}
+
+			if (cursor_ == top_) {
+				top_ = prev;
+			} else {
+				row_ -= 1;
+			}
+			cursor_ = prev;
+		}
+	}
+
+	// Put the cursor on the last row of the screen
+	void bottom() {
+		size_t rows = pageRows();
+		top_ = cursor_;
+		for (row_ = 0; row_ + 1 < rows; ++row_) {
+			auto prev = outline_.prev(top_);
+			if (!prev) {
+				break;
+			}
+			top_ = prev;
+		}
+	}
+
+	std::string prompt(const std::string &label) {
+		std::string input;
+		while (true) {
+			size_t rows, cols;
+			term_.size(rows, cols);
+			term_.write("\x1b[" + std::to_string(rows) + ";1H\x1b[K" + label + input);
+
+			std::string key = term_.readKey();
+			if (key == "\r") {
+				return input;
+			} else if (key == "\x1b" || key == "\x03") {
+				return {};
+			} else if (key == "\x7f" || key == "\b") {
+				if (!input.empty()) {
+					input.pop_back();
+				}
+			} else if (key.size() == 1 && (unsigned char)key[0] >= 0x20) {
+				input += key;
+			}
+		}
+	}
+
+	void draw() {
+		size_t rows, cols;
+		term_.size(rows, cols);
+
+		std::string screen = "\x1b[H";
+		auto line = top_;
+		for (size_t row = 0; row + 1 < rows; ++row) {
+			if (line) {
+				std::string text;
+				try {
+					text = outline_.render(line, cols);
+				} catch (sbon::ParseError &err) {
+					text = err.what();
+				}
+
+				if (line == cursor_) {
+					screen += "\x1b[7m" + text + "\x1b[0m";
+				} else {
+					screen += text;
+				}
+
+				try {
+					line = outline_.next(line);
+				} catch (sbon::ParseError &err) {
+					message_ = err.what();
+					line = {};
+				}
+			} else {
+				screen += '~';
+			}
+			screen += "\x1b[K\r\n";
+		}
+
+		std::string status = message_;
+		if (status.empty() && cursor_) {
+			status = outline_.path(cursor_) + "  @" + std::to_string(outline_.offset(cursor_));
+		}
+		if (status.size() > cols) {
+			status.resize(cols);
+		}
+		screen += "\x1b[7m" + status + "\x1b[K\x1b[0m";
+		term_.write(screen);
+	}
+
+	sbon::Outline &outline_;
+	Terminal &term_;
+	sbon::Outline::Line top_;
+	sbon::Outline::Line cursor_;
+
+	// The row of the cursor on the screen
+	size_t row_ = 0;
+
+	std::string message_;
+};
+
+static void onResize(int) {}
+
+int main(int argc, char **argv) {
+	const char *path = nullptr;
+	bool dumpMode = false;
+	unsigned expandDepth = 1;
+	size_t maxLines = SIZE_MAX;
+	size_t width = 120;
+
+	int argi = 1;
+	for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+		std::string_view arg = argv[argi];
+		if (arg == "-p" && argi + 1 < argc) {
+			path = argv[++argi];
+		} else if (arg == "-d") {
+			dumpMode = true;
+		} else if (arg == "-e" && argi + 1 < argc && parseOption(argv[argi + 1], expandDepth)) {
+			argi += 1;
+		} else if (arg == "-n" && argi + 1 < argc && parseOption(argv[argi + 1], maxLines)) {
+			argi += 1;
+		} else if (arg == "-w" && argi + 1 < argc && parseOption(argv[argi + 1], width)) {
+			argi += 1;
+		} else if (arg == "--") {
+			argi += 1;
+			break;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - argi > 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	try {
+		sbon::MappedFile input(argi < argc ? argv[argi] : nullptr);
+		sbon::Outline outline(input.span());
+
+		auto start = path ? outline.find(path) : outline.first();
+		if (!start) {
+			std::cerr << (path ? "No value at the path " + std::string(path) : "No records") << '\n';
+			return 1;
+		}
+
+		if (dumpMode) {
+			dump(outline, start, path != nullptr, expandDepth, maxLines, width);
+			return 0;
+		}
+
+		// Interrupt reads on resizes, so that the screen is redrawn
+		struct sigaction sa = {};
+		sa.sa_handler = onResize;
+		sigaction(SIGWINCH, &sa, nullptr);
+
+		Terminal term;
+		Viewer(outline, start, term).run();
+	} catch (std::exception &ex) {
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+}
@@ -0,0 +1,584 @@
+#ifndef SBON_AGG_H
+#define SBON_AGG_H
+
+// Group-by and aggregation over streams of records.
+//
+// Records are processed in batches: the group-by keys and aggregated values
+// of a batch are first extracted into columns, and each aggregate is then
+// computed by one loop over its column. Chunks of the input are aggregated
+// in parallel, and the partial results are merged at the end.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace sbon {
+
+// An approximate quantile sketch with bounded relative error.
+// Values are counted in logarithmically sized buckets,
+// so sketches can be merged by adding bucket counts.
+class QuantileSketch {
+public:
+	explicit QuantileSketch(double relativeError = 0.01):
+		gamma_((1 + relativeError) / (1 - relativeError)),
+		logGamma_(std::log(gamma_)) {}
+
+	void add(double val) {
+		count_ += 1;
+		if (val > minValue) {
+			positive_[bucket(val)] += 1;
+		} else if (val < -minValue) {
+			negative_[bucket(-val)] += 1;
+		} else {
+			zeros_ += 1;
+		}
+	}
+
+	void merge(const QuantileSketch &other) {
+		count_ += other.count_;
+		zeros_ += other.zeros_;
+		for (auto &[idx, count]: other.positive_) {
+			positive_[idx] += count;
+		}
+		for (auto &[idx, count]: other.negative_) {
+			negative_[idx] += count;
+		}
+	}
+
+	uint64_t count() const {
+		return count_;
+	}
+
+	// Get the approximate value at quantile 'q', where 0 <= q <= 1.
+	double quantile(double q) const {
+		if (count_ == 0) {
+			return std::numeric_limits<double>::quiet_NaN();
+		}
+
+		uint64_t rank = (uint64_t)(q * (count_ - 1));
+		uint64_t seen = 0;
+
+		// Negative values, from the most negative (largest bucket) up
+		for (auto it = negative_.rbegin(); it != negative_.rend(); ++it) {
+			seen += it->second;
+			if (seen > rank) {
+				return -value(it->first);
+			}
+		}
+
+		seen += zeros_;
+		if (seen > rank) {
+			return 0;
+		}
+
+		for (auto &[idx, count]: positive_) {
+			seen += count;
+			if (seen > rank) {
+				return value(idx);
+			}
+		}
+
+		return value(positive_.rbegin()->first);
+	}
+
+private:
+	static constexpr double minValue = 1e-9;
+
+	int32_t bucket(double val) const {
+		return (int32_t)std::ceil(std::log(val) / logGamma_);
+	}
+
+	double value(int32_t idx) const {
+		return 2 * std::pow(gamma_, idx) / (gamma_ + 1);
+	}
+
+	double gamma_;
+	double logGamma_;
+	uint64_t count_ = 0;
+	uint64_t zeros_ = 0;
+	std::map<int32_t, uint64_t> positive_;
+	std::map<int32_t, uint64_t> negative_;
+};
+
+class AggregateError: public std::exception {
+public:
+	AggregateError(const char *str, std::string_view spec) {
+		str_ = "SBON aggregate error: ";
+		str_ += str;
+		str_ += ": ";
+		str_ += spec;
+	}
+
+	const char *what() const noexcept override {
+		return str_.c_str();
+	}
+
+private:
+	std::string str_;
+};
+
+// One aggregate to compute per group.
+struct AggregateSpec {
+	enum class Kind {
+		COUNT, SUM, MIN, MAX, AVG, QUANTILE,
+	};
+
+	Kind kind;
+	std::string path;
+	double quantile = 0;
+
+	// Parse "count", "sum:<path>", "min:<path>", "max:<path>",
+	// "avg:<path>" or "p<percentile>:<path>" (e.g "p99:latency").
+	static AggregateSpec parse(std::string_view str) {
+		AggregateSpec spec;
+		if (str == "count") {
+			spec.kind = Kind::COUNT;
+			return spec;
+		}
+
+		size_t colon = str.find(':');
+		if (colon == std::string_view::npos || colon + 1 == str.size()) {
+			throw AggregateError("Expected <function>:<path>", str);
+		}
+
+		std::string_view func = str.substr(0, colon);
+		spec.path = str.substr(colon + 1);
+		if (func == "sum") {
+			spec.kind = Kind::SUM;
+		} else if (func == "min") {
+			spec.kind = Kind::MIN;
+		} else if (func == "max") {
+			spec.kind = Kind::MAX;
+		} else if (func == "avg") {
+			spec.kind = Kind::AVG;
+		} else if (func.size() > 1 && func[0] == 'p') {
+			spec.kind = Kind::QUANTILE;
+			std::string num(func.substr(1));
+			size_t len = 0;
+			try {
+				spec.quantile = std::stod(num, &len) / 100;
+			} catch (std::exception &) {
+				len = 0;
+			}
+
+			if (len != num.size() || spec.quantile < 0 || spec.quantile > 1) {
+				throw AggregateError("Invalid percentile", str);
+			}
+		} else {
+			throw AggregateError("Unknown function", str);
+		}
+
+		return spec;
+	}
+
+	// The name of the aggregate in the output, e.g "count" or "p99(latency)".
+	std::string name() const {
+		std::string fname;
+		switch (kind) {
+		case Kind::COUNT: return "count";
+		case Kind::SUM: fname = "sum"; break;
+		case Kind::MIN: fname = "min"; break;
+		case Kind::MAX: fname = "max"; break;
+		case Kind::AVG: fname = "avg"; break;
+		case Kind::QUANTILE: {
+			char buf[32];
+			std::snprintf(buf, sizeof(buf), "p%g", quantile * 100);
+			fname = buf;
+			break;
+		}
+		}
+
+		return fname + "(" + path + ")";
+	}
+};
+
+// The configuration of an aggregation: what to group by, and what to compute.
+class Aggregation {
+public:
+	Aggregation(std::vector<std::string> groupBy, std::vector<AggregateSpec> aggs):
+			groupBy_(std::move(groupBy)), aggs_(std::move(aggs)) {
+		for (auto &path: groupBy_) {
+			keyPaths_.push_back(paths_.add(path));
+		}
+
+		for (auto &agg: aggs_) {
+			if (agg.kind == AggregateSpec::Kind::COUNT) {
+				valuePaths_.push_back(NONE);
+				continue;
+			}
+
+			size_t id = paths_.add(agg.path);
+			auto it = std::find(columnPaths_.begin(), columnPaths_.end(), id);
+			valuePaths_.push_back(it - columnPaths_.begin());
+			if (it == columnPaths_.end()) {
+				columnPaths_.push_back(id);
+			}
+		}
+	}
+
+	const std::vector<std::string> &groupBy() const {
+		return groupBy_;
+	}
+
+	const std::vector<AggregateSpec> &aggregates() const {
+		return aggs_;
+	}
+
+private:
+	static constexpr size_t NONE = ~(size_t)0;
+
+	std::vector<std::string> groupBy_;
+	std::vector<AggregateSpec> aggs_;
+	PathSet paths_;
+
+	// PathSet IDs of the group-by keys
+	std::vector<size_t> keyPaths_;
+
+	// PathSet IDs of the value columns
+	std::vector<size_t> columnPaths_;
+
+	// For each aggregate, the index of its value column, or NONE for count
+	std::vector<size_t> valuePaths_;
+
+	friend class AggregateTable;
+};
+
+// The aggregated results for a set of groups.
+class AggregateTable {
+public:
+	static constexpr size_t BATCH_SIZE = 1024;
+
+	explicit AggregateTable(const Aggregation &agg): agg_(&agg) {}
+
+	// Aggregate all records in 'input'.
+	void add(Span input) {
+		const Aggregation &agg = *agg_;
+		size_t numColumns = agg.columnPaths_.size();
+		size_t numKeys = agg.keyPaths_.size();
+
+		// Map PathSet IDs to key slots and value columns
+		std::vector<size_t> keySlot(agg.paths_.size(), Aggregation::NONE);
+		std::vector<size_t> columnSlot(agg.paths_.size(), Aggregation::NONE);
+		for (size_t i = 0; i < numKeys; ++i) {
+			keySlot[agg.keyPaths_[i]] = i;
+		}
+		for (size_t i = 0; i < numColumns; ++i) {
+			columnSlot[agg.columnPaths_[i]] = i;
+		}
+
+		std::vector<uint32_t> groups;
+		groups.reserve(BATCH_SIZE);
+		std::vector<std::vector<double>> columns(numColumns);
+		for (auto &col: columns) {
+			col.reserve(BATCH_SIZE);
+		}
+
+		std::vector<std::string_view> keyVals(numKeys);
+		std::string groupKey;
+
+		auto flush = [&] {
+			aggregateBatch(groups, columns);
+			groups.clear();
+			for (auto &col: columns) {
+				col.clear();
+			}
+		};
+
+		forEachRecord(input, [&](Span rec) {
+			std::fill(keyVals.begin(), keyVals.end(), std::string_view("N"));
+			for (auto &col: columns) {
+				col.push_back(std::numeric_limits<double>::quiet_NaN());
+			}
+
+			agg.paths_.visit(rec, [&](size_t id, RawValue val) {
+				if (keySlot[id] != Aggregation::NONE) {
+					keyVals[keySlot[id]] = val.span().view();
+				}
+
+				if (columnSlot[id] != Aggregation::NONE) {
+					columns[columnSlot[id]].back() = toDouble(val);
+				}
+
+				return true;
+			});
+
+			// The group key is the concatenation of the encoded key values,
+			// which is unambiguous since SBON values are self-delimiting
+			groupKey.clear();
+			for (auto &kv: keyVals) {
+				groupKey += kv;
+			}
+
+			groups.push_back(findGroup(groupKey));
+			if (groups.size() == BATCH_SIZE) {
+				flush();
+			}
+		});
+
+		flush();
+	}
+
+	// Merge the results of another table with the same aggregation.
+	void merge(const AggregateTable &other) {
+		for (size_t g = 0; g < other.keys_.size(); ++g) {
+			uint32_t group = findGroup(other.keys_[g]);
+			const GroupState &src = other.states_[g];
+			GroupState &dst = states_[group];
+			dst.count += src.count;
+			for (size_t i = 0; i < dst.accs.size(); ++i) {
+				Accumulator &a = dst.accs[i];
+				const Accumulator &b = src.accs[i];
+				a.count += b.count;
+				a.sum += b.sum;
+				a.min = std::min(a.min, b.min);
+				a.max = std::max(a.max, b.max);
+				a.sketch.merge(b.sketch);
+			}
+		}
+	}
+
+	size_t size() const {
+		return keys_.size();
+	}
+
+	// Write one object per group, containing the group-by keys
+	// followed by the aggregates. Groups are written in order of appearance.
+	void write(Writer &w) const {
+		const Aggregation &agg = *agg_;
+		for (size_t g = 0; g < keys_.size(); ++g) {
+			const GroupState &state = states_[g];
+			w.writeObject([&](ObjectWriter ow) {
+				const char *p = keys_[g].data();
+				const char *end = p + keys_[g].size();
+				for (auto &path: agg.groupBy_) {
+					const char *next = skipValue(p, end);
+					ow.key(path.c_str()).writeRaw(std::string_view(p, next - p));
+					p = next;
+				}
+
+				for (size_t i = 0; i < agg.aggs_.size(); ++i) {
+					writeAggregate(
+						ow.key(agg.aggs_[i].name().c_str()), agg.aggs_[i],
+						state.count, state.accs[i]);
+				}
+			});
+		}
+	}
+
+private:
+	struct Accumulator {
+		uint64_t count = 0;
+		double sum = 0;
+		double min = std::numeric_limits<double>::infinity();
+		double max = -std::numeric_limits<double>::infinity();
+		QuantileSketch sketch;
+	};
+
+	struct GroupState {
+		uint64_t count = 0;
+		std::vector<Accumulator> accs;
+	};
+
+	static double toDouble(RawValue val) {
+		switch (val.getType()) {
+		case Type::INT:
+			return (double)val.getInt();
+		case Type::UINT:
+			return (double)val.getUInt();
+		case Type::FLOAT:
+			return val.getFloat();
+		case Type::DOUBLE:
+			return val.getDouble();
+		case Type::BOOL:
+			return val.getBool() ? 1 : 0;
+		default:
+			return std::numeric_limits<double>::quiet_NaN();
+		}
+	}
+
+	uint32_t findGroup(const std::string &key) {
+		auto it = index_.find(key);
+		if (it != index_.end()) {
+			return it->second;
+		}
+
+		uint32_t group = keys_.size();
+		index_.emplace(key, group);
+		keys_.push_back(key);
+		states_.emplace_back();
+		states_.back().accs.resize(agg_->aggs_.size());
+		return group;
+	}
+
+	void aggregateBatch(
+			const std::vector<uint32_t> &groups,
+			const std::vector<std::vector<double>> &columns) {
+		const Aggregation &agg = *agg_;
+		size_t rows = groups.size();
+		const uint32_t *gs = groups.data();
+
+		for (size_t r = 0; r < rows; ++r) {
+			states_[gs[r]].count += 1;
+		}
+
+		// Batches where every row belongs to the same group are common
+		// (no group-by keys, or input sorted by the group-by keys),
+		// and can be reduced without per-row group lookups
+		bool singleGroup = rows > 0 && std::all_of(gs, gs + rows, [&](uint32_t g) {
+			return g == gs[0];
+		});
+
+		for (size_t i = 0; i < agg.aggs_.size(); ++i) {
+			size_t col = agg.valuePaths_[i];
+			if (col == Aggregation::NONE) {
+				continue;
+			}
+
+			const double *vals = columns[col].data();
+			if (singleGroup && agg.aggs_[i].kind != AggregateSpec::Kind::QUANTILE) {
+				reduceColumn(vals, rows, states_[gs[0]].accs[i]);
+				continue;
+			}
+
+			switch (agg.aggs_[i].kind) {
+			case AggregateSpec::Kind::SUM:
+			case AggregateSpec::Kind::AVG:
+				for (size_t r = 0; r < rows; ++r) {
+					if (vals[r] == vals[r]) {
+						Accumulator &acc = states_[gs[r]].accs[i];
+						acc.sum += vals[r];
+						acc.count += 1;
+					}
+				}
+				break;
+
+			case AggregateSpec::Kind::MIN:
+				for (size_t r = 0; r < rows; ++r) {
+					if (vals[r] == vals[r]) {
+						Accumulator &acc = states_[gs[r]].accs[i];
+						acc.min = std::min(acc.min, vals[r]);
+						acc.count += 1;
+					}
+				}
+				break;
+
+			case AggregateSpec::Kind::MAX:
+				for (size_t r = 0; r < rows; ++r) {
+					if (vals[r] == vals[r]) {
+						Accumulator &acc = states_[gs[r]].accs[i];
+						acc.max = std::max(acc.max, vals[r]);
+						acc.count += 1;
+					}
+				}
+				break;
+
+			case AggregateSpec::Kind::QUANTILE:
+				for (size_t r = 0; r < rows; ++r) {
+					if (vals[r] == vals[r]) {
+						Accumulator &acc = states_[gs[r]].accs[i];
+						acc.sketch.add(vals[r]);
+						acc.count += 1;
+					}
+				}
+				break;
+
+			case AggregateSpec::Kind::COUNT:
+				break;
+			}
+		}
+	}
+
+	// Reduce a whole column into one accumulator.
+	// The loop is branch-free, with NaNs (missing values) masked out,
+	// so that the compiler can vectorise it.
+	static void reduceColumn(const double *vals, size_t rows, Accumulator &acc) {
+		double sum = 0;
+		double min = acc.min;
+		double max = acc.max;
+		uint64_t count = 0;
+		for (size_t r = 0; r < rows; ++r) {
+			double v = vals[r];
+			bool valid = v == v;
+			sum += valid ? v : 0;
+			min = v < min ? v : min;
+			max = v > max ? v : max;
+			count += valid;
+		}
+
+		acc.sum += sum;
+		acc.min = min;
+		acc.max = max;
+		acc.count += count;
+	}
+
+	static void writeAggregate(
+			Writer w, const AggregateSpec &spec,
+			uint64_t count, const Accumulator &acc) {
+		if (spec.kind == AggregateSpec::Kind::COUNT) {
+			w.writeUInt(count);
+			return;
+		} else if (spec.kind == AggregateSpec::Kind::SUM) {
+			w.writeDouble(acc.sum);
+			return;
+		}
+
+		if (acc.count == 0) {
+			w.writeNull();
+			return;
+		}
+
+		switch (spec.kind) {
+		case AggregateSpec::Kind::MIN:
+			w.writeDouble(acc.min);
+			break;
+		case AggregateSpec::Kind::MAX:
+			w.writeDouble(acc.max);
+			break;
+		case AggregateSpec::Kind::AVG:
+			w.writeDouble(acc.sum / acc.count);
+			break;
+		case AggregateSpec::Kind::QUANTILE:
+			w.writeDouble(acc.sketch.quantile(spec.quantile));
+			break;
+		default:
+			break;
+		}
+	}
+
+	const Aggregation *agg_;
+	std::unordered_map<std::string, uint32_t> index_;
+	std::vector<std::string> keys_;
+	std::vector<GroupState> states_;
+};
+
+// Aggregate all records in 'input', using up to 'threads' threads.
+inline AggregateTable aggregateRecords(
+		const Aggregation &agg, Span input, unsigned threads = defaultThreads()) {
+	std::vector<Span> chunks = splitChunks(input, threads > 1 ? threads * 4 : 1);
+	std::vector<AggregateTable> partials(chunks.size(), AggregateTable(agg));
+
+	parallelFor(chunks.size(), threads, [&](size_t i) {
+		partials[i].add(chunks[i]);
+	});
+
+	AggregateTable result(agg);
+	for (auto &partial: partials) {
+		result.merge(partial);
+	}
+
+	return result;
+}
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef SBON_APPENDER_H
+#define SBON_APPENDER_H
+
+// Appending top-level records to one file from many threads.
+
+#include "sbon.h"
+#include "sbon-buffer.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <string_view>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace sbon {
+
+// Appends records to a file from any number of threads without a lock.
+//
+// Each record is encoded into a pooled buffer owned by the calling thread.
+// Once it's complete, the appender reserves space for it at the end of
+// the file with an atomic fetch-add on the file size, and writes it there
+// with pwrite(2). Records are therefore never interleaved, although
+// records appended concurrently may be written in either order.
+//
+// While appends are in progress, a reader may see zero bytes where
+// a record has been reserved but not yet written. If a write fails,
+// its reserved space is left as a hole of zeroes.
+class RecordAppender {
+public:
+	// Append to 'fd', starting at its current end. The fd isn't closed by the appender,
+	// and must not be opened with O_APPEND, since that makes pwrite ignore the offset.
+	explicit RecordAppender(int fd): fd_(fd), ownsFd_(false) {
+		init();
+	}
+
+	// Append to the file at 'path', creating it if necessary.
+	explicit RecordAppender(const char *path):
+			fd_(::open(path, O_WRONLY | O_CREAT, 0666)), ownsFd_(true) {
+		if (fd_ < 0) {
+			throw std::system_error(errno, std::generic_category(), path);
+		}
+		init();
+	}
+
+	RecordAppender(const RecordAppender &) = delete;
+	RecordAppender &operator=(const RecordAppender &) = delete;
+
+	~RecordAppender() {
+		if (ownsFd_) {
+			::close(fd_);
+		}
+	}
+
+	// Encode one record by calling 'func' with a Writer, then append it.
+	// Throws std::system_error if the write fails.
+	template<typename Func>
+	void append(Func func) {
+		PooledBuffer buf = pool_.acquire();
+		Writer w(buf.os());
+		func(w);
+		appendRaw(buf.view());
+	}
+
+	// Append an already encoded record.
+	// Throws std::system_error if the write fails.
+	void appendRaw(std::string_view encoded) {
+		if (encoded.empty()) {
+			return;
+		}
+
+		uint64_t offset = end_.fetch_add(encoded.size(), std::memory_order_relaxed);
+		const char *data = encoded.data();
+		size_t size = encoded.size();
+		while (size > 0) {
+			ssize_t n = ::pwrite(fd_, data, size, offset);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::system_error(errno, std::generic_category(), "pwrite");
+			}
+
+			data += n;
+			size -= n;
+			offset += n;
+		}
+	}
+
+	// The file size once every append which has started has completed.
+	uint64_t size() const {
+		return end_.load(std::memory_order_relaxed);
+	}
+
+	// Flush appended records to stable storage.
+	void sync() {
+		if (::fdatasync(fd_) < 0) {
+			throw std::system_error(errno, std::generic_category(), "fdatasync");
+		}
+	}
+
+private:
+	void init() {
+		off_t end = ::lseek(fd_, 0, SEEK_END);
+		if (end < 0) {
+			int err = errno;
+			if (ownsFd_) {
+				::close(fd_);
+			}
+			throw std::system_error(err, std::generic_category(), "lseek");
+		}
+		end_.store(end, std::memory_order_relaxed);
+	}
+
+	int fd_;
+	bool ownsFd_;
+	std::atomic<uint64_t> end_{0};
+	BufferPool pool_;
+};
+
+}
+
+#endif
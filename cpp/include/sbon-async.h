@@ -0,0 +1,299 @@
+#ifndef SBON_ASYNC_H
+#define SBON_ASYNC_H
+
+// An output stream which writes to a file descriptor from a background thread,
+// so that encoding can continue while earlier output is being written.
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace sbon {
+
+// A streambuf with a set of fixed-size buffers. When the buffer being filled
+// is full, it's handed to a background thread to be written, and filling
+// continues in a free buffer. If every buffer is waiting to be written,
+// the producer blocks until one is free.
+//
+// Write errors are reported by finish(). Once a write has failed,
+// the remaining output is discarded and the stream goes bad.
+class AsyncFileBuf: public std::streambuf {
+public:
+	struct Options {
+		size_t bufferSize = 1024 * 1024;
+		size_t bufferCount = 2;
+	};
+
+	// Write to 'fd', which isn't closed by the AsyncFileBuf.
+	explicit AsyncFileBuf(int fd): AsyncFileBuf(fd, Options{}) {}
+
+	AsyncFileBuf(int fd, Options opts): fd_(fd) {
+		if (opts.bufferSize == 0) {
+			opts.bufferSize = 1;
+		}
+		if (opts.bufferCount < 2) {
+			opts.bufferCount = 2;
+		}
+
+		buffers_.resize(opts.bufferCount);
+		for (size_t i = 0; i < buffers_.size(); ++i) {
+			buffers_[i].data.resize(opts.bufferSize);
+			free_.push_back(i);
+		}
+
+		takeFree();
+		thread_ = std::thread([this] {
+			run();
+		});
+	}
+
+	AsyncFileBuf(const AsyncFileBuf &) = delete;
+	AsyncFileBuf &operator=(const AsyncFileBuf &) = delete;
+
+	// Destroying the streambuf without calling finish() writes any remaining
+	// output, but errors are ignored.
+	~AsyncFileBuf() {
+		try {
+			finish();
+		} catch (std::exception &) {
+		}
+	}
+
+	// Write all buffered output, wait for the background thread to complete,
+	// and throw a std::system_error if any write failed.
+	// Nothing may be written after finish().
+	void finish() {
+		if (finished_) {
+			return;
+		}
+
+		submit();
+
+		{
+			std::unique_lock<std::mutex> lock(mut_);
+			stop_ = true;
+		}
+		cond_.notify_all();
+		thread_.join();
+		finished_ = true;
+		setp(nullptr, nullptr);
+
+		if (error_) {
+			throw std::system_error(error_, std::generic_category(), "write");
+		}
+	}
+
+protected:
+	int_type overflow(int_type ch) override {
+		if (finished_) {
+			return traits_type::eof();
+		}
+
+		submit();
+		takeFree();
+		if (hasError()) {
+			return traits_type::eof();
+		}
+
+		if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+			*pptr() = traits_type::to_char_type(ch);
+			pbump(1);
+		}
+
+		return traits_type::not_eof(ch);
+	}
+
+	std::streamsize xsputn(const char *data, std::streamsize n) override {
+		std::streamsize written = 0;
+		while (written < n) {
+			std::streamsize room = epptr() - pptr();
+			if (room == 0) {
+				if (traits_type::eq_int_type(overflow(traits_type::eof()), traits_type::eof())) {
+					return written;
+				}
+				continue;
+			}
+
+			std::streamsize step = std::min(room, n - written);
+			std::memcpy(pptr(), data + written, step);
+			pbump((int)step);
+			written += step;
+		}
+
+		return written;
+	}
+
+	// Hand the current buffer to the background thread without waiting for it.
+	int sync() override {
+		if (finished_) {
+			return 0;
+		}
+
+		submit();
+		takeFree();
+		return hasError() ? -1 : 0;
+	}
+
+private:
+	struct Buffer {
+		std::vector<char> data;
+		size_t size = 0;
+	};
+
+	bool hasError() {
+		std::lock_guard<std::mutex> lock(mut_);
+		return error_ != 0;
+	}
+
+	// Queue the current buffer for writing.
+	void submit() {
+		if (current_ == NONE) {
+			return;
+		}
+
+		Buffer &buf = buffers_[current_];
+		buf.size = pptr() - pbase();
+		{
+			std::lock_guard<std::mutex> lock(mut_);
+			if (buf.size > 0) {
+				queue_.push_back(current_);
+			} else {
+				free_.push_back(current_);
+			}
+		}
+
+		cond_.notify_all();
+		current_ = NONE;
+		setp(nullptr, nullptr);
+	}
+
+	// Start filling a free buffer, waiting for one if necessary.
+	void takeFree() {
+		std::unique_lock<std::mutex> lock(mut_);
+		cond_.wait(lock, [&] {
+			return !free_.empty();
+		});
+
+		current_ = free_.front();
+		free_.pop_front();
+		Buffer &buf = buffers_[current_];
+		setp(buf.data.data(), buf.data.data() + buf.data.size());
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mut_);
+		while (true) {
+			cond_.wait(lock, [&] {
+				return stop_ || !queue_.empty();
+			});
+
+			if (queue_.empty()) {
+				return;
+			}
+
+			size_t idx = queue_.front();
+			queue_.pop_front();
+			bool failed = error_ != 0;
+			lock.unlock();
+
+			int err = failed ? 0 : writeAll(buffers_[idx]);
+
+			lock.lock();
+			if (err && !error_) {
+				error_ = err;
+			}
+			free_.push_back(idx);
+			cond_.notify_all();
+		}
+	}
+
+	int writeAll(const Buffer &buf) {
+		const char *data = buf.data.data();
+		size_t size = buf.size;
+		while (size > 0) {
+			ssize_t n = ::write(fd_, data, size);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return errno;
+			}
+
+			data += n;
+			size -= n;
+		}
+
+		return 0;
+	}
+
+	static constexpr size_t NONE = ~(size_t)0;
+
+	int fd_;
+	std::vector<Buffer> buffers_;
+	size_t current_ = NONE;
+
+	// Protected by mut_
+	std::deque<size_t> free_;
+	std::deque<size_t> queue_;
+	bool stop_ = false;
+	int error_ = 0;
+
+	std::mutex mut_;
+	std::condition_variable cond_;
+	std::thread thread_;
+	bool finished_ = false;
+};
+
+// An ostream which writes to a file through an AsyncFileBuf.
+class AsyncFileStream: public std::ostream {
+public:
+	// Create or truncate the file at 'path'.
+	explicit AsyncFileStream(const char *path):
+		AsyncFileStream(path, AsyncFileBuf::Options{}) {}
+
+	AsyncFileStream(const char *path, AsyncFileBuf::Options opts):
+			std::ostream(nullptr), fd_(open(path)), buf_(fd_, opts) {
+		rdbuf(&buf_);
+	}
+
+	~AsyncFileStream() {
+		try {
+			buf_.finish();
+		} catch (std::exception &) {
+		}
+		::close(fd_);
+	}
+
+	// Write all buffered output, and throw a std::system_error if any write failed.
+	void finish() {
+		buf_.finish();
+	}
+
+private:
+	static int open(const char *path) {
+		int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd < 0) {
+			throw std::system_error(errno, std::generic_category(), path);
+		}
+		return fd;
+	}
+
+	int fd_;
+	AsyncFileBuf buf_;
+};
+
+}
+
+#endif
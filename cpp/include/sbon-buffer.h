@@ -0,0 +1,446 @@
+#ifndef SBON_BUFFER_H
+#define SBON_BUFFER_H
+
+// In-memory output buffers for Writer, and a pool to reuse them.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace sbon {
+
+// A growable output streambuf which writes into one contiguous buffer.
+// Unlike std::stringbuf, clearing it keeps the allocated memory around.
+class OutputBuffer: public std::streambuf {
+public:
+	OutputBuffer() {
+		setp(buf_.data(), buf_.data());
+	}
+
+	OutputBuffer(const OutputBuffer &) = delete;
+	OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+	// The bytes written so far.
+	std::string_view view() const {
+		return std::string_view(pbase(), pptr() - pbase());
+	}
+
+	size_t size() const {
+		return pptr() - pbase();
+	}
+
+	size_t capacity() const {
+		return buf_.size();
+	}
+
+	// Discard the contents, keeping the memory.
+	void clear() {
+		setp(buf_.data(), buf_.data() + buf_.size());
+	}
+
+	// Make sure there's room for at least 'cap' bytes in total.
+	void reserve(size_t cap) {
+		if (cap > buf_.size()) {
+			resize(cap);
+		}
+	}
+
+	// Release memory beyond 'cap' bytes, or beyond the current size if that's larger.
+	void shrink(size_t cap) {
+		cap = std::max(cap, size());
+		if (cap < buf_.size()) {
+			size_t used = size();
+			buf_.resize(cap);
+			buf_.shrink_to_fit();
+			setp(buf_.data(), buf_.data() + buf_.size());
+			advance(used);
+		}
+	}
+
+protected:
+	int_type overflow(int_type ch) override {
+		if (traits_type::eq_int_type(ch, traits_type::eof())) {
+			return traits_type::not_eof(ch);
+		}
+
+		resize(std::max<size_t>(buf_.size() * 2, 64));
+		*pptr() = traits_type::to_char_type(ch);
+		advance(1);
+		return ch;
+	}
+
+	std::streamsize xsputn(const char *data, std::streamsize n) override {
+		if (epptr() - pptr() < n) {
+			resize(std::max<size_t>(buf_.size() * 2, size() + n));
+		}
+
+		std::copy(data, data + n, pptr());
+		advance(n);
+		return n;
+	}
+
+private:
+	// pbump takes an int, so advance in steps for huge writes
+	void advance(size_t n) {
+		while (n > 0) {
+			int step = (int)std::min<size_t>(n, 1 << 30);
+			pbump(step);
+			n -= step;
+		}
+	}
+
+	void resize(size_t cap) {
+		size_t used = size();
+		buf_.resize(cap);
+		setp(buf_.data(), buf_.data() + buf_.size());
+		advance(std::min(used, cap));
+	}
+
+	std::string buf_;
+};
+
+// An ostream which writes into an OutputBuffer, for use with Writer.
+class BufferStream: public std::ostream {
+public:
+	BufferStream(): std::ostream(nullptr) {
+		rdbuf(&buf_);
+	}
+
+	OutputBuffer &buffer() {
+		return buf_;
+	}
+
+	const OutputBuffer &buffer() const {
+		return buf_;
+	}
+
+	std::string_view view() const {
+		return buf_.view();
+	}
+
+	// Discard the contents and any error state, keeping the memory.
+	void reset() {
+		buf_.clear();
+		clear();
+	}
+
+private:
+	OutputBuffer buf_;
+};
+
+class BufferPool;
+
+// A buffer borrowed from a BufferPool, which is returned when destroyed.
+class PooledBuffer {
+public:
+	PooledBuffer() = default;
+
+	PooledBuffer(PooledBuffer &&other) noexcept:
+		pool_(other.pool_), buf_(std::move(other.buf_)) {}
+
+	PooledBuffer &operator=(PooledBuffer &&other) noexcept;
+
+	~PooledBuffer();
+
+	BufferStream &stream() {
+		return *buf_;
+	}
+
+	// The stream to give to a Writer.
+	std::ostream *os() {
+		return buf_.get();
+	}
+
+	std::string_view view() const {
+		return buf_->view();
+	}
+
+private:
+	PooledBuffer(BufferPool *pool, std::unique_ptr<BufferStream> buf):
+		pool_(pool), buf_(std::move(buf)) {}
+
+	BufferPool *pool_ = nullptr;
+	std::unique_ptr<BufferStream> buf_;
+
+	friend class BufferPool;
+};
+
+// A pool of reusable output buffers.
+//
+// Each thread keeps a few released buffers for itself, so acquiring and
+// releasing usually doesn't take a lock. Buffers beyond that go to a shared
+// overflow list. The pool tracks the sizes of released buffers in power-of-two
+// size classes, and pre-sizes buffers for what recent outputs needed,
+// so that encoding doesn't have to grow them. Buffers which grew much larger
+// than usual are trimmed when released.
+//
+// When a pool is destroyed, the threads which cached its buffers free them
+// the next time they use any pool, or when they exit.
+//
+// The pool must outlive every buffer acquired from it.
+class BufferPool {
+public:
+	struct Options {
+		// The number of free buffers each thread keeps for itself
+		size_t threadCacheSize = 4;
+
+		// The number of free buffers in the shared overflow list
+		size_t sharedSize = 64;
+
+		// Buffers are pre-sized to fit this fraction of recent outputs
+		double sizeQuantile = 0.9;
+
+		// Released buffers with more than this many times the pre-size are trimmed
+		size_t trimFactor = 4;
+
+		// Buffers are never pre-sized smaller than this
+		size_t minSize = 256;
+	};
+
+	BufferPool(): BufferPool(Options{}) {}
+
+	explicit BufferPool(Options opts): opts_(opts), id_(nextID()), target_(opts_.minSize) {
+		for (auto &count: classCounts_) {
+			count.store(0, std::memory_order_relaxed);
+		}
+
+		Registry &reg = registry();
+		std::lock_guard<std::mutex> lock(reg.mut);
+		reg.live.insert(id_);
+	}
+
+	BufferPool(const BufferPool &) = delete;
+	BufferPool &operator=(const BufferPool &) = delete;
+
+	~BufferPool() {
+		Registry &reg = registry();
+		{
+			std::lock_guard<std::mutex> lock(reg.mut);
+			reg.live.erase(id_);
+		}
+		reg.generation.fetch_add(1, std::memory_order_release);
+	}
+
+	PooledBuffer acquire() {
+		std::unique_ptr<BufferStream> buf = takeLocal();
+		if (!buf) {
+			std::lock_guard<std::mutex> lock(mut_);
+			if (!shared_.empty()) {
+				buf = std::move(shared_.back());
+				shared_.pop_back();
+			}
+		}
+
+		if (!buf) {
+			buf = std::make_unique<BufferStream>();
+		}
+
+		buf->buffer().reserve(targetSize());
+		return PooledBuffer(this, std::move(buf));
+	}
+
+	// The size new buffers are currently pre-sized to.
+	size_t targetSize() const {
+		return target_.load(std::memory_order_relaxed);
+	}
+
+	// The number of free buffers the calling thread keeps, for every pool.
+	static size_t localCacheSize() {
+		return localCache().entries.size();
+	}
+
+private:
+	static constexpr size_t NUM_CLASSES = 48;
+
+	// How many releases between each recomputation of the target size.
+	// The size class counts are halved at the same time,
+	// so that old history fades out.
+	static constexpr uint64_t UPDATE_INTERVAL = 64;
+
+	struct LocalEntry {
+		uint64_t pool;
+		std::unique_ptr<BufferStream> buf;
+	};
+
+	struct LocalCache {
+		std::vector<LocalEntry> entries;
+
+		// The registry generation the entries were last checked against
+		uint64_t generation = 0;
+	};
+
+	// The IDs of the pools which are alive. The generation changes whenever
+	// a pool is destroyed, so that threads know to look for entries of
+	// dead pools in their caches.
+	struct Registry {
+		std::mutex mut;
+		std::unordered_set<uint64_t> live;
+		std::atomic<uint64_t> generation{0};
+	};
+
+	static uint64_t nextID() {
+		static std::atomic<uint64_t> id{0};
+		return ++id;
+	}
+
+	static Registry &registry() {
+		static Registry reg;
+		return reg;
+	}
+
+	static LocalCache &localCache() {
+		thread_local LocalCache cache;
+		return cache;
+	}
+
+	// Free the buffers of destroyed pools, if any were destroyed
+	// since the cache was last checked.
+	static void purgeLocal(LocalCache &cache) {
+		Registry &reg = registry();
+		uint64_t generation = reg.generation.load(std::memory_order_acquire);
+		if (generation == cache.generation) {
+			return;
+		}
+
+		cache.generation = generation;
+		if (cache.entries.empty()) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(reg.mut);
+		cache.entries.erase(std::remove_if(
+			cache.entries.begin(), cache.entries.end(),
+			[&](const LocalEntry &entry) { return !reg.live.count(entry.pool); }),
+			cache.entries.end());
+	}
+
+	std::unique_ptr<BufferStream> takeLocal() {
+		auto &cache = localCache();
+		purgeLocal(cache);
+		auto &entries = cache.entries;
+		for (size_t i = entries.size(); i > 0; --i) {
+			if (entries[i - 1].pool == id_) {
+				std::unique_ptr<BufferStream> buf = std::move(entries[i - 1].buf);
+				entries.erase(entries.begin() + (i - 1));
+				return buf;
+			}
+		}
+
+		return nullptr;
+	}
+
+	static size_t sizeClass(size_t size) {
+		size_t cls = 0;
+		while (cls + 1 < NUM_CLASSES && ((size_t)1 << cls) < size) {
+			cls += 1;
+		}
+		return cls;
+	}
+
+	void recordSize(size_t size) {
+		classCounts_[sizeClass(size)].fetch_add(1, std::memory_order_relaxed);
+		if (releases_.fetch_add(1, std::memory_order_relaxed) % UPDATE_INTERVAL != 0) {
+			return;
+		}
+
+		uint64_t counts[NUM_CLASSES];
+		uint64_t total = 0;
+		for (size_t i = 0; i < NUM_CLASSES; ++i) {
+			counts[i] = classCounts_[i].load(std::memory_order_relaxed);
+			total += counts[i];
+			classCounts_[i].fetch_sub(counts[i] / 2, std::memory_order_relaxed);
+		}
+
+		uint64_t seen = 0;
+		for (size_t i = 0; i < NUM_CLASSES; ++i) {
+			seen += counts[i];
+			if (seen >= total * opts_.sizeQuantile) {
+				target_.store(
+					std::max(opts_.minSize, (size_t)1 << i), std::memory_order_relaxed);
+				break;
+			}
+		}
+	}
+
+	// Called from PooledBuffer's destructor and move assignment, so it
+	// mustn't throw: if keeping the buffer fails, it's freed instead.
+	void release(std::unique_ptr<BufferStream> buf) noexcept {
+		try {
+			keep(std::move(buf));
+		} catch (...) {
+		}
+	}
+
+	void keep(std::unique_ptr<BufferStream> &&buf) {
+		recordSize(buf->view().size());
+
+		size_t target = targetSize();
+		buf->reset();
+		if (buf->buffer().capacity() > target * opts_.trimFactor) {
+			buf->buffer().shrink(target);
+		}
+
+		auto &cache = localCache();
+		purgeLocal(cache);
+		size_t mine = 0;
+		for (auto &entry: cache.entries) {
+			mine += entry.pool == id_;
+		}
+
+		if (mine < opts_.threadCacheSize) {
+			cache.entries.push_back({id_, std::move(buf)});
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mut_);
+		if (shared_.size() < opts_.sharedSize) {
+			shared_.push_back(std::move(buf));
+		}
+	}
+
+	Options opts_;
+
+	// Thread caches identify their pool by ID rather than by address,
+	// so that a new pool at the address of a destroyed one
+	// never picks up the old pool's buffers
+	uint64_t id_;
+
+	std::mutex mut_;
+	std::vector<std::unique_ptr<BufferStream>> shared_;
+
+	std::atomic<uint64_t> classCounts_[NUM_CLASSES];
+	std::atomic<uint64_t> releases_{0};
+	std::atomic<size_t> target_;
+
+	friend class PooledBuffer;
+};
+
+inline PooledBuffer &PooledBuffer::operator=(PooledBuffer &&other) noexcept {
+	if (buf_) {
+		pool_->release(std::move(buf_));
+	}
+
+	pool_ = other.pool_;
+	buf_ = std::move(other.buf_);
+	return *this;
+}
+
+inline PooledBuffer::~PooledBuffer() {
+	if (buf_) {
+		pool_->release(std::move(buf_));
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef SBON_CSV_H
+#define SBON_CSV_H
+
+// Conversion of record streams to CSV or TSV, with one column per key path.
+//
+// Fields which aren't selected are skipped without being decoded.
+// Numbers are formatted with std::to_chars, and strings are only quoted
+// or escaped when a vectorised scan finds a character which needs it.
+// Missing values and null become empty fields, binaries are hex encoded,
+// and arrays and objects are written as compact JSON.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <charconv>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace sbon {
+
+struct CsvOptions {
+	// ',' for CSV, '\t' for TSV
+	char delimiter = ',';
+
+	// Whether to write a header row with the column paths
+	bool header = true;
+};
+
+namespace detail {
+
+// Check whether 'str' contains any of the characters in 'chars' (at most 4).
+inline bool containsAny(std::string_view str, const char chars[4]) {
+	const char *p = str.data();
+	size_t n = str.size();
+	size_t i = 0;
+
+#ifdef __SSE2__
+	__m128i c0 = _mm_set1_epi8(chars[0]);
+	__m128i c1 = _mm_set1_epi8(chars[1]);
+	__m128i c2 = _mm_set1_epi8(chars[2]);
+	__m128i c3 = _mm_set1_epi8(chars[3]);
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i eq = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, c2), _mm_cmpeq_epi8(v, c3)));
+		if (_mm_movemask_epi8(eq)) {
+			return true;
+		}
+	}
+#endif
+
+	for (; i < n; ++i) {
+		char ch = p[i];
+		if (ch == chars[0] || ch == chars[1] || ch == chars[2] || ch == chars[3]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+inline void appendHex(std::string &out, std::string_view bytes) {
+	static const char digits[] = "0123456789abcdef";
+	for (char ch: bytes) {
+		unsigned char u = (unsigned char)ch;
+		out += digits[u >> 4];
+		out += digits[u & 0x0f];
+	}
+}
+
+template<typename T>
+inline void appendNumber(std::string &out, T num) {
+	char buf[32];
+	auto res = std::to_chars(buf, buf + sizeof(buf), num);
+	out.append(buf, res.ptr - buf);
+}
+
+inline void appendJsonString(std::string &out, std::string_view str) {
+	out += '"';
+	for (char ch: str) {
+		if (ch == '"' || ch == '\\') {
+			out += '\\';
+			out += ch;
+		} else if ((unsigned char)ch < 32) {
+			static const char digits[] = "0123456789abcdef";
+			out += "\\u00";
+			out += digits[(unsigned char)ch >> 4];
+			out += digits[ch & 0x0f];
+		} else {
+			out += ch;
+		}
+	}
+	out += '"';
+}
+
+inline void appendJson(std::string &out, RawValue val) {
+	switch (val.getType()) {
+	case Type::BOOL:
+		out += val.getBool() ? "true" : "false";
+		break;
+	case Type::NIL:
+		out += "null";
+		break;
+	case Type::STRING:
+		appendJsonString(out, val.getString());
+		break;
+	case Type::BINARY:
+		out += '"';
+		appendHex(out, val.getBinary());
+		out += '"';
+		break;
+	case Type::FLOAT:
+		appendNumber(out, val.getFloat());
+		break;
+	case Type::DOUBLE:
+		appendNumber(out, val.getDouble());
+		break;
+	case Type::INT:
+		appendNumber(out, val.getInt());
+		break;
+	case Type::UINT:
+		appendNumber(out, val.getUInt());
+		break;
+	case Type::ARRAY: {
+		out += '[';
+		bool first = true;
+		val.forEachElement([&](RawValue el) {
+			if (!first) {
+				out += ',';
+			}
+			first = false;
+			appendJson(out, el);
+		});
+		out += ']';
+		break;
+	}
+	case Type::OBJECT: {
+		out += '{';
+		bool first = true;
+		val.forEachMember([&](std::string_view key, RawValue el) {
+			if (!first) {
+				out += ',';
+			}
+			first = false;
+			appendJsonString(out, key);
+			out += ':';
+			appendJson(out, el);
+		});
+		out += '}';
+		break;
+	}
+	}
+}
+
+}
+
+// Formats records as CSV or TSV rows.
+class CsvFormatter {
+public:
+	CsvFormatter(std::vector<std::string> columns, CsvOptions opts = {}):
+			columns_(std::move(columns)), opts_(opts) {
+		for (auto &col: columns_) {
+			ids_.push_back(paths_.add(col));
+		}
+
+		if (opts_.delimiter == '\t') {
+			special_[0] = '\t';
+			special_[1] = '\n';
+			special_[2] = '\r';
+			special_[3] = '\\';
+		} else {
+			special_[0] = opts_.delimiter;
+			special_[1] = '\n';
+			special_[2] = '\r';
+			special_[3] = '"';
+		}
+	}
+
+	const CsvOptions &options() const {
+		return opts_;
+	}
+
+	void appendHeader(std::string &out) const {
+		for (size_t i = 0; i < columns_.size(); ++i) {
+			if (i > 0) {
+				out += opts_.delimiter;
+			}
+			appendField(out, columns_[i]);
+		}
+		out += '\n';
+	}
+
+	// Append the row for 'record' to 'out'.
+	void appendRow(std::string &out, Span record) const {
+		std::vector<Span> vals;
+		appendRow(out, record, vals);
+	}
+
+	// Append the row for 'record' to 'out', using 'scratch' for temporary storage.
+	void appendRow(std::string &out, Span record, std::vector<Span> &scratch) const {
+		scratch.assign(paths_.size(), Span{});
+		paths_.visit(record, [&](size_t id, RawValue val) {
+			scratch[id] = val.span();
+			return true;
+		});
+
+		for (size_t i = 0; i < ids_.size(); ++i) {
+			if (i > 0) {
+				out += opts_.delimiter;
+			}
+
+			Span span = scratch[ids_[i]];
+			if (span.begin) {
+				appendValue(out, RawValue(span));
+			}
+		}
+		out += '\n';
+	}
+
+private:
+	void appendField(std::string &out, std::string_view str) const {
+		if (!detail::containsAny(str, special_)) {
+			out += str;
+			return;
+		}
+
+		if (opts_.delimiter == '\t') {
+			for (char ch: str) {
+				switch (ch) {
+				case '\t': out += "\\t"; break;
+				case '\n': out += "\\n"; break;
+				case '\r': out += "\\r"; break;
+				case '\\': out += "\\\\"; break;
+				default: out += ch; break;
+				}
+			}
+			return;
+		}
+
+		out += '"';
+		for (char ch: str) {
+			if (ch == '"') {
+				out += '"';
+			}
+			out += ch;
+		}
+		out += '"';
+	}
+
+	void appendValue(std::string &out, RawValue val) const {
+		switch (val.getType()) {
+		case Type::BOOL:
+			out += val.getBool() ? "true" : "false";
+			break;
+		case Type::NIL:
+			break;
+		case Type::STRING:
+			appendField(out, val.getString());
+			break;
+		case Type::BINARY:
+			detail::appendHex(out, val.getBinary());
+			break;
+		case Type::FLOAT:
+			detail::appendNumber(out, val.getFloat());
+			break;
+		case Type::DOUBLE:
+			detail::appendNumber(out, val.getDouble());
+			break;
+		case Type::INT:
+			detail::appendNumber(out, val.getInt());
+			break;
+		case Type::UINT:
+			detail::appendNumber(out, val.getUInt());
+			break;
+		case Type::ARRAY:
+		case Type::OBJECT: {
+			std::string json;
+			detail::appendJson(json, val);
+			appendField(out, json);
+			break;
+		}
+		}
+	}
+
+	std::vector<std::string> columns_;
+	CsvOptions opts_;
+	PathSet paths_;
+	std::vector<size_t> ids_;
+	char special_[4];
+};
+
+// Convert all records in 'input' to rows written to 'os', using up to 'threads' threads.
+// The input is converted in chunks of about 'chunkSize' bytes; a batch of
+// chunks is converted in parallel, and then written in order.
+inline void writeCsv(
+		const CsvFormatter &fmt, Span input, std::ostream &os,
+		unsigned threads = defaultThreads(), size_t chunkSize = 4 * 1024 * 1024) {
+	if (fmt.options().header) {
+		std::string header;
+		fmt.appendHeader(header);
+		os << header;
+	}
+
+	if (threads == 0) {
+		threads = 1;
+	}
+
+	size_t numChunks = std::max<size_t>(threads, input.size() / chunkSize);
+	std::vector<Span> chunks = splitChunks(input, numChunks);
+
+	size_t batchSize = threads * 2;
+	std::vector<std::string> outputs(batchSize);
+	for (size_t start = 0; start < chunks.size(); start += batchSize) {
+		size_t count = std::min(batchSize, chunks.size() - start);
+		parallelFor(count, threads, [&](size_t i) {
+			std::string &out = outputs[i];
+			out.clear();
+			std::vector<Span> scratch;
+			forEachRecord(chunks[start + i], [&](Span rec) {
+				fmt.appendRow(out, rec, scratch);
+			});
+		});
+
+		for (size_t i = 0; i < count; ++i) {
+			os.write(outputs[i].data(), outputs[i].size());
+		}
+	}
+}
+
+}
+
+#endif
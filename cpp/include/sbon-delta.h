@@ -0,0 +1,398 @@
+#ifndef SBON_DELTA_H
+#define SBON_DELTA_H
+
+// Patches which turn one encoded value into another, for sending
+// only what changed between two versions of a document.
+//
+// A patch is itself an SBON array whose first element is an operation:
+//
+//   [0]                              Keep the old value
+//   [1 value]                        Replace the old value with 'value'
+//   [2 {key: patch...} [S"key"...] {key: value...}]
+//                                    Patch an object: patch the members in the
+//                                    first object, delete the keys in the array,
+//                                    and append the members of the last object
+//   [3 [op...]]                      Patch an array, where each op is either
+//                                    [index patch] to patch the old element at
+//                                    'index', or [index count [value...]]
+//                                    to delete 'count' old elements starting at
+//                                    'index' and insert the values there.
+//                                    Ops are sorted by index.
+//
+// Unchanged subtrees are found by comparing their raw bytes, so they're never
+// decoded. Any patch which would be at least as large as the new value
+// is replaced by a plain replacement.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace sbon {
+
+namespace detail {
+
+inline bool sameBytes(Span a, Span b) {
+	return a.size() == b.size() && std::memcmp(a.begin, b.begin, a.size()) == 0;
+}
+
+inline void appendUInt(std::string &out, uint64_t num) {
+	if (num <= 9) {
+		out += (char)('0' + num);
+		return;
+	}
+
+	out += '+';
+	do {
+		unsigned char ch = num & 0x7f;
+		num >>= 7;
+		if (num) {
+			ch |= 0x80;
+		}
+		out += (char)ch;
+	} while (num);
+}
+
+inline void appendKey(std::string &out, std::string_view key) {
+	out += key;
+	out += '\0';
+}
+
+inline void appendDelta(std::string &out, Span old, Span cur);
+
+using Members = std::vector<std::pair<std::string_view, Span>>;
+
+inline bool collectMembers(Span obj, Members &members,
+		std::unordered_map<std::string_view, size_t> &index) {
+	RawValue(obj).forEachMember([&](std::string_view key, RawValue val) {
+		index.emplace(key, members.size());
+		members.push_back({key, val.span()});
+	});
+
+	// Objects with duplicate keys are always replaced
+	return index.size() == members.size();
+}
+
+inline bool appendObjectDelta(std::string &out, Span old, Span cur) {
+	Members oldMembers, curMembers;
+	std::unordered_map<std::string_view, size_t> oldIndex, curIndex;
+	if (!collectMembers(old, oldMembers, oldIndex) ||
+			!collectMembers(cur, curMembers, curIndex)) {
+		return false;
+	}
+
+	// The applier keeps the old member order and appends new members,
+	// so the patch only works if the new object has that order
+	size_t prev = 0;
+	bool added = false;
+	for (auto &[key, val]: curMembers) {
+		auto it = oldIndex.find(key);
+		if (it == oldIndex.end()) {
+			added = true;
+		} else if (added || it->second < prev) {
+			return false;
+		} else {
+			prev = it->second;
+		}
+	}
+
+	out += "[2{";
+	for (auto &[key, val]: oldMembers) {
+		auto it = curIndex.find(key);
+		if (it != curIndex.end() && !sameBytes(val, curMembers[it->second].second)) {
+			appendKey(out, key);
+			appendDelta(out, val, curMembers[it->second].second);
+		}
+	}
+
+	out += "}[";
+	for (auto &[key, val]: oldMembers) {
+		if (!curIndex.count(key)) {
+			out += 'S';
+			appendKey(out, key);
+		}
+	}
+
+	out += "]{";
+	for (auto &[key, val]: curMembers) {
+		if (!oldIndex.count(key)) {
+			appendKey(out, key);
+			out.append(val.begin, val.size());
+		}
+	}
+
+	out += "}]";
+	return true;
+}
+
+inline std::vector<Span> collectElements(Span arr) {
+	std::vector<Span> elems;
+	RawValue(arr).forEachElement([&](RawValue val) {
+		elems.push_back(val.span());
+	});
+	return elems;
+}
+
+// Elements are aligned by trimming the common prefix and suffix.
+// What remains in the middle is patched pairwise, with a splice for
+// the elements the old and new arrays don't have in common.
+inline void appendArrayDelta(std::string &out, Span old, Span cur) {
+	std::vector<Span> oldElems = collectElements(old);
+	std::vector<Span> curElems = collectElements(cur);
+
+	size_t shorter = std::min(oldElems.size(), curElems.size());
+	size_t prefix = 0;
+	while (prefix < shorter && sameBytes(oldElems[prefix], curElems[prefix])) {
+		prefix += 1;
+	}
+
+	size_t suffix = 0;
+	while (prefix + suffix < shorter && sameBytes(
+			oldElems[oldElems.size() - suffix - 1],
+			curElems[curElems.size() - suffix - 1])) {
+		suffix += 1;
+	}
+
+	size_t oldMid = oldElems.size() - prefix - suffix;
+	size_t curMid = curElems.size() - prefix - suffix;
+	size_t paired = std::min(oldMid, curMid);
+
+	out += "[3[";
+	for (size_t i = prefix; i < prefix + paired; ++i) {
+		if (!sameBytes(oldElems[i], curElems[i])) {
+			out += '[';
+			appendUInt(out, i);
+			appendDelta(out, oldElems[i], curElems[i]);
+			out += ']';
+		}
+	}
+
+	if (oldMid != curMid) {
+		out += '[';
+		appendUInt(out, prefix + paired);
+		appendUInt(out, oldMid - paired);
+		out += '[';
+		for (size_t i = prefix + paired; i < prefix + curMid; ++i) {
+			out.append(curElems[i].begin, curElems[i].size());
+		}
+		out += "]]";
+	}
+
+	out += "]]";
+}
+
+inline void appendDelta(std::string &out, Span old, Span cur) {
+	if (sameBytes(old, cur)) {
+		out += "[0]";
+		return;
+	}
+
+	size_t start = out.size();
+	bool patched = false;
+	if (*old.begin == '{' && *cur.begin == '{') {
+		patched = appendObjectDelta(out, old, cur);
+	} else if (*old.begin == '[' && *cur.begin == '[') {
+		appendArrayDelta(out, old, cur);
+		patched = true;
+	}
+
+	// A replacement costs the new value plus 3 bytes
+	if (!patched || out.size() - start >= cur.size() + 3) {
+		out.resize(start);
+		out += "[1";
+		out.append(cur.begin, cur.size());
+		out += ']';
+	}
+}
+
+inline void applyDelta(std::string &out, Span old, Span patch);
+
+inline void applyObjectDelta(std::string &out, Span old, const Span parts[4], size_t count) {
+	if (count != 4 || *old.begin != '{') {
+		throw ParseError("applyDelta: Bad object patch");
+	}
+
+	std::unordered_map<std::string_view, Span> changed;
+	RawValue(parts[1]).forEachMember([&](std::string_view key, RawValue patch) {
+		changed.emplace(key, patch.span());
+	});
+
+	std::unordered_set<std::string_view> deleted;
+	RawValue(parts[2]).forEachElement([&](RawValue key) {
+		deleted.insert(key.getString());
+	});
+
+	RawValue added(parts[3]);
+	if (added.getType() != Type::OBJECT) {
+		throw ParseError("applyDelta: Bad object patch");
+	}
+
+	out += '{';
+	RawValue(old).forEachMember([&](std::string_view key, RawValue val) {
+		if (deleted.count(key)) {
+			return;
+		}
+
+		appendKey(out, key);
+		auto it = changed.find(key);
+		if (it == changed.end()) {
+			out.append(val.span().begin, val.span().size());
+		} else {
+			applyDelta(out, val.span(), it->second);
+		}
+	});
+
+	out.append(parts[3].begin + 1, parts[3].size() - 2);
+	out += '}';
+}
+
+inline void applyArrayDelta(std::string &out, Span old, const Span parts[4], size_t count) {
+	if (count != 2 || *old.begin != '[') {
+		throw ParseError("applyDelta: Bad array patch");
+	}
+
+	struct Op {
+		uint64_t index;
+		Span parts[3];
+		size_t count;
+	};
+
+	std::vector<Op> ops;
+	RawValue(parts[1]).forEachElement([&](RawValue val) {
+		Op op{};
+		val.forEachElement([&](RawValue part) {
+			if (op.count == 3) {
+				throw ParseError("applyDelta: Bad array op");
+			}
+			op.parts[op.count++] = part.span();
+		});
+
+		if (op.count < 2) {
+			throw ParseError("applyDelta: Bad array op");
+		}
+
+		op.index = RawValue(op.parts[0]).getUInt();
+		if (!ops.empty() && op.index < ops.back().index) {
+			throw ParseError("applyDelta: Array ops out of order");
+		}
+		ops.push_back(op);
+	});
+
+	size_t nextOp = 0;
+	uint64_t deleting = 0;
+
+	// Apply the ops at 'index', and return whether the old element was handled
+	auto applyOps = [&](uint64_t index, Span elem) {
+		bool handled = false;
+		while (nextOp < ops.size() && ops[nextOp].index == index) {
+			Op &op = ops[nextOp++];
+			if (op.count == 2) {
+				if (!elem.begin) {
+					throw ParseError("applyDelta: Array patch index out of range");
+				}
+				applyDelta(out, elem, op.parts[1]);
+				handled = true;
+			} else {
+				deleting += RawValue(op.parts[1]).getUInt();
+				RawValue inserted(op.parts[2]);
+				if (inserted.getType() != Type::ARRAY) {
+					throw ParseError("applyDelta: Bad array op");
+				}
+				out.append(op.parts[2].begin + 1, op.parts[2].size() - 2);
+			}
+		}
+
+		if (deleting > 0 && elem.begin) {
+			deleting -= 1;
+			return true;
+		}
+		return handled;
+	};
+
+	out += '[';
+	uint64_t index = 0;
+	RawValue(old).forEachElement([&](RawValue elem) {
+		if (!applyOps(index++, elem.span())) {
+			out.append(elem.span().begin, elem.span().size());
+		}
+	});
+
+	applyOps(index, Span{});
+	if (nextOp != ops.size() || deleting > 0) {
+		throw ParseError("applyDelta: Array patch index out of range");
+	}
+	out += ']';
+}
+
+inline void applyDelta(std::string &out, Span old, Span patch) {
+	Span parts[4];
+	size_t count = 0;
+	RawValue(patch).forEachElement([&](RawValue part) {
+		if (count == 4) {
+			throw ParseError("applyDelta: Bad patch");
+		}
+		parts[count++] = part.span();
+	});
+
+	if (count == 0) {
+		throw ParseError("applyDelta: Empty patch");
+	}
+
+	uint64_t op = RawValue(parts[0]).getUInt();
+	if (op == 0 && count == 1) {
+		out.append(old.begin, old.size());
+	} else if (op == 1 && count == 2) {
+		out.append(parts[1].begin, parts[1].size());
+	} else if (op == 2) {
+		applyObjectDelta(out, old, parts, count);
+	} else if (op == 3) {
+		applyArrayDelta(out, old, parts, count);
+	} else {
+		throw ParseError("applyDelta: Bad patch");
+	}
+}
+
+}
+
+// Append a patch which turns the value in 'old' into the value in 'cur' to 'out'.
+inline void encodeDelta(Span old, Span cur, std::string &out) {
+	old = RawValue::at(old.begin, old.end).span();
+	cur = RawValue::at(cur.begin, cur.end).span();
+	detail::appendDelta(out, old, cur);
+}
+
+inline std::string encodeDelta(Span old, Span cur) {
+	std::string out;
+	encodeDelta(old, cur, out);
+	return out;
+}
+
+// Apply 'patch' to the value in 'old', and append the new value to 'out'.
+// The old value is read in a single pass.
+inline void applyDelta(Span old, Span patch, std::string &out) {
+	old = RawValue::at(old.begin, old.end).span();
+	patch = RawValue::at(patch.begin, patch.end).span();
+	if (*patch.begin != '[') {
+		throw ParseError("applyDelta: Expected '['");
+	}
+
+	detail::applyDelta(out, old, patch);
+}
+
+inline std::string applyDelta(Span old, Span patch) {
+	std::string out;
+	applyDelta(old, patch, out);
+	return out;
+}
+
+}
+
+#endif
@@ -0,0 +1,511 @@
+#ifndef SBON_DICT_H
+#define SBON_DICT_H
+
+// Dictionary compression for streams of small records.
+//
+// A record of a few hundred bytes compresses poorly on its own, because
+// most of its bytes are keys, type tags and common values which only repeat
+// across records. A Dictionary holds a few kilobytes of such bytes, trained
+// from a sample of records. Each record is compressed with the dictionary
+// as its history, so every record can still be decompressed on its own.
+//
+// A compressed record is its decompressed size as an LEB128,
+// followed by sequences of:
+//
+//   token       A byte with the number of literals in the high nibble and
+//               the match length minus 4 in the low nibble. A nibble of 15
+//               is followed by an LEB128 to add to it, after the token
+//               for the literals and after the offset for the match.
+//   literals    Bytes to copy to the output
+//   offset      An LEB128 distance back from the end of the output to copy
+//               the match from, which may reach back into the end of the
+//               dictionary. Omitted when the output is complete.
+//
+// Matches are at most 256 bytes, and a sequence with a match takes at least
+// 2 bytes, so a record decompresses to at most 128 times its compressed size.
+// Longer repeats take several sequences.
+//
+// A compressed stream stores each compressed record as a binary value,
+// so it can be split, indexed and skipped like any other stream.
+
+#include "sbon.h"
+#include "sbon-buffer.h"
+#include "sbon-records.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sbon {
+
+namespace detail {
+
+inline uint32_t hash4(const char *p, unsigned bits) {
+	uint32_t word;
+	std::memcpy(&word, p, 4);
+	return (word * 2654435761u) >> (32 - bits);
+}
+
+// The number of equal bytes at the start of [a, aEnd) and [b, bEnd)
+inline size_t commonPrefix(const char *a, const char *aEnd, const char *b, const char *bEnd) {
+	size_t max = std::min(aEnd - a, bEnd - b);
+	size_t len = 0;
+	while (len + 8 <= max) {
+		uint64_t x, y;
+		std::memcpy(&x, a + len, 8);
+		std::memcpy(&y, b + len, 8);
+		if (x != y) {
+			return len + __builtin_ctzll(x ^ y) / 8;
+		}
+		len += 8;
+	}
+	while (len < max && a[len] == b[len]) {
+		len += 1;
+	}
+	return len;
+}
+
+}
+
+class Dictionary {
+public:
+	static constexpr size_t DEFAULT_SIZE = 32 * 1024;
+
+	// An empty dictionary, which compresses each record on its own.
+	Dictionary() {
+		index();
+	}
+
+	// A dictionary with the given contents, e.g. as read from a file
+	// written from bytes().
+	explicit Dictionary(std::string bytes): bytes_(std::move(bytes)) {
+		index();
+	}
+
+	// Train a dictionary of at most 'size' bytes from a stream of records.
+	// Only an even sample of about 100 times 'size' bytes of records is used.
+	// Throws LogicError if 'size' is 0.
+	static Dictionary train(Span records, size_t size = DEFAULT_SIZE) {
+		if (size == 0) {
+			throw LogicError();
+		}
+
+		std::vector<Span> all;
+		size_t total = 0;
+		forEachRecord(records, [&](Span rec) {
+			all.push_back(rec);
+			total += rec.size();
+		});
+
+		size_t every = total / size / 100 + 1;
+		std::vector<Span> samples;
+		for (size_t i = 0; i < all.size(); i += every) {
+			samples.push_back(all[i]);
+		}
+		return train(samples, size);
+	}
+
+	// Train a dictionary of at most 'size' bytes from sample records.
+	//
+	// The dictionary is made of segments of the samples, picked by how many
+	// samples contain the short strings ("d-mers") in them: the samples are
+	// split into epochs, and the best segment of each epoch is added in turn.
+	// The d-mers of a picked segment don't count towards later segments,
+	// so that the dictionary doesn't repeat itself. The best segments go
+	// at the end, where matches have the smallest offsets.
+	// Throws LogicError if 'size' is 0.
+	static Dictionary train(const std::vector<Span> &samples, size_t size = DEFAULT_SIZE) {
+		if (size == 0) {
+			throw LogicError();
+		}
+
+		// The number of samples which contain each d-mer, counting each sample once
+		struct Count {
+			uint32_t samples = 0;
+			uint32_t last = UINT32_MAX;
+		};
+		std::unordered_map<uint64_t, Count> counts;
+		for (uint32_t s = 0; s < samples.size(); ++s) {
+			Span sample = samples[s];
+			for (const char *p = sample.begin; p + DMER <= sample.end; ++p) {
+				Count &count = counts[dmer(p)];
+				if (count.last != s) {
+					count.last = s;
+					count.samples += 1;
+				}
+			}
+		}
+
+		// A d-mer which only occurs in one sample is no use to the others
+		auto score = [&](const char *p) -> uint64_t {
+			auto it = counts.find(dmer(p));
+			return it == counts.end() || it->second.samples < 2 ? 0 : it->second.samples;
+		};
+
+		std::vector<Segment> picked;
+		size_t total = 0;
+		size_t epochs = std::clamp<size_t>(size / SEGMENT, 1, std::max<size_t>(samples.size(), 1));
+		while (total < size) {
+			bool found = false;
+			for (size_t e = 0; e < epochs && total < size; ++e) {
+				Segment best = bestSegment(
+					samples.data() + e * samples.size() / epochs,
+					samples.data() + (e + 1) * samples.size() / epochs,
+					score);
+				if (best.score == 0) {
+					continue;
+				}
+
+				// Trim d-mers which add nothing from both ends
+				while (score(best.begin) == 0) {
+					best.begin += 1;
+				}
+				while (score(best.end - DMER) == 0) {
+					best.end -= 1;
+				}
+
+				for (const char *p = best.begin; p + DMER <= best.end; ++p) {
+					counts.erase(dmer(p));
+				}
+				picked.push_back(best);
+				total += best.end - best.begin;
+				found = true;
+			}
+
+			if (!found) {
+				break;
+			}
+		}
+
+		std::stable_sort(picked.begin(), picked.end(), [](const Segment &a, const Segment &b) {
+			return a.score < b.score;
+		});
+
+		std::string bytes;
+		for (const Segment &seg: picked) {
+			bytes.append(seg.begin, seg.end);
+		}
+		if (bytes.size() > size) {
+			bytes.erase(0, bytes.size() - size);
+		}
+		return Dictionary(std::move(bytes));
+	}
+
+	const std::string &bytes() const {
+		return bytes_;
+	}
+
+	size_t size() const {
+		return bytes_.size();
+	}
+
+	// Compress a record, appending it to 'out'.
+	// The match finder's tables are cached per thread.
+	void compress(std::string_view record, std::string &out) const {
+		if (record.size() > UINT32_MAX - bytes_.size()) {
+			throw LogicError();
+		}
+
+		const char *src = record.data();
+		size_t n = record.size();
+		detail::appendLEB128(out, n);
+
+		// Hash chains of the positions in the record so far, 1-based
+		struct Tables {
+			std::vector<uint32_t> head;
+			std::vector<uint32_t> chain;
+		};
+		thread_local Tables tables;
+		unsigned bits = 8;
+		while (bits < 16 && (size_t(1) << bits) < n) {
+			bits += 1;
+		}
+		tables.head.assign(size_t(1) << bits, 0);
+		tables.chain.resize(n);
+
+		const char *dict = bytes_.data();
+		const char *dictEnd = dict + bytes_.size();
+		size_t anchor = 0;
+		size_t i = 0;
+		while (i + MIN_MATCH <= n) {
+			size_t bestLen = 0;
+			size_t bestOffset = 0;
+
+			uint32_t h = detail::hash4(src + i, bits);
+			uint32_t cand = tables.head[h];
+			for (int step = 0; cand && step < RECORD_CHAIN; ++step, cand = tables.chain[cand - 1]) {
+				size_t pos = cand - 1;
+				size_t len = detail::commonPrefix(src + pos, src + n, src + i, src + n);
+				if (len > bestLen) {
+					bestLen = len;
+					bestOffset = i - pos;
+				}
+			}
+
+			cand = dictHead_[detail::hash4(src + i, DICT_HASH_BITS)];
+			for (int step = 0; cand && step < DICT_CHAIN; ++step, cand = dictChain_[cand - 1]) {
+				size_t pos = cand - 1;
+				size_t len = detail::commonPrefix(dict + pos, dictEnd, src + i, src + n);
+				if (pos + len == bytes_.size()) {
+					// The match continues from the end of the dictionary into the record
+					len += detail::commonPrefix(src, src + n, src + i + len, src + n);
+				}
+				if (len > bestLen) {
+					bestLen = len;
+					bestOffset = i + bytes_.size() - pos;
+				}
+			}
+
+			tables.chain[i] = tables.head[h];
+			tables.head[h] = i + 1;
+			if (bestLen < MIN_MATCH) {
+				i += 1;
+				continue;
+			}
+			bestLen = std::min(bestLen, MAX_MATCH);
+
+			appendSequence(out, src + anchor, i - anchor, bestLen, bestOffset);
+			for (size_t j = i + 1; j < i + bestLen && j + MIN_MATCH <= n; ++j) {
+				uint32_t hj = detail::hash4(src + j, bits);
+				tables.chain[j] = tables.head[hj];
+				tables.head[hj] = j + 1;
+			}
+			i += bestLen;
+			anchor = i;
+		}
+
+		if (anchor < n) {
+			appendSequence(out, src + anchor, n - anchor, 0, 0);
+		}
+	}
+
+	// Decompress a record into 'out', replacing its contents.
+	// Throws a ParseError if the record is malformed.
+	void decompress(std::string_view compressed, std::string &out) const {
+		const char *p = compressed.data();
+		const char *end = p + compressed.size();
+		uint64_t size = detail::readLEB128(p, end);
+		if (size > UINT32_MAX || size > (uint64_t)(end - p) * (MAX_MATCH / 2)) {
+			throw ParseError("Dictionary::decompress: Record too large");
+		}
+
+		out.resize(size);
+		char *o = out.data();
+		size_t pos = 0;
+		while (pos < size) {
+			detail::checkAvail(p, end, 1);
+			unsigned token = (unsigned char)*p++;
+
+			uint64_t lit = token >> 4;
+			if (lit == 15) {
+				lit += detail::readLEB128(p, end);
+			}
+			if (lit > size - pos) {
+				throw ParseError("Dictionary::decompress: Too many literals");
+			}
+			detail::checkAvail(p, end, lit);
+			std::memcpy(o + pos, p, lit);
+			p += lit;
+			pos += lit;
+			if (pos == size) {
+				break;
+			}
+
+			uint64_t offset = detail::readLEB128(p, end);
+			uint64_t len = token & 15;
+			if (len == 15) {
+				len += detail::readLEB128(p, end);
+			}
+			if (offset == 0 || offset > pos + bytes_.size() || len > MAX_MATCH - MIN_MATCH ||
+					len + MIN_MATCH > size - pos) {
+				throw ParseError("Dictionary::decompress: Invalid match");
+			}
+			len += MIN_MATCH;
+
+			if (offset > pos) {
+				size_t from = bytes_.size() - (offset - pos);
+				size_t n = std::min<size_t>(len, offset - pos);
+				std::memcpy(o + pos, bytes_.data() + from, n);
+				pos += n;
+				len -= n;
+			}
+
+			// The match may overlap the bytes it produces
+			char *dst = o + pos;
+			const char *from = dst - offset;
+			if (offset >= len) {
+				std::memcpy(dst, from, len);
+			} else {
+				for (size_t k = 0; k < len; ++k) {
+					dst[k] = from[k];
+				}
+			}
+			pos += len;
+		}
+
+		if (p != end) {
+			throw ParseError("Dictionary::decompress: Trailing bytes");
+		}
+	}
+
+	// Decompress a record from a compressed stream, i.e. a binary value,
+	// and call 'func(Reader)' to read it. The buffer it's decompressed into
+	// is cached per thread, so reading records one by one doesn't allocate.
+	template<typename Func>
+	void read(Span record, Func func) const {
+		// A nested read gets a buffer of its own
+		std::string buf = std::move(cachedBuffer());
+		decompress(RawValue(record).getBinary(), buf);
+		MemoryStream ms(buf.data(), buf.size());
+		func(Reader(&ms));
+		cachedBuffer() = std::move(buf);
+	}
+
+private:
+	static constexpr size_t MIN_MATCH = 4;
+	static constexpr size_t MAX_MATCH = 256;
+	static constexpr int RECORD_CHAIN = 8;
+	static constexpr int DICT_CHAIN = 16;
+	static constexpr unsigned DICT_HASH_BITS = 16;
+
+	// The length of the strings which segments are scored by, and of a segment
+	static constexpr size_t DMER = 6;
+	static constexpr size_t SEGMENT = 64;
+
+	struct Segment {
+		const char *begin;
+		const char *end;
+		uint64_t score;
+	};
+
+	static std::string &cachedBuffer() {
+		thread_local std::string buf;
+		return buf;
+	}
+
+	static uint64_t dmer(const char *p) {
+		uint64_t val = 0;
+		std::memcpy(&val, p, DMER);
+		return val;
+	}
+
+	// The segment of the samples in [begin, end) whose distinct d-mers
+	// have the highest total score
+	template<typename Score>
+	static Segment bestSegment(const Span *begin, const Span *end, Score &score) {
+		Segment best{nullptr, nullptr, 0};
+		std::unordered_map<uint64_t, uint32_t> active;
+		for (const Span *sample = begin; sample != end; ++sample) {
+			if (sample->size() < DMER) {
+				continue;
+			}
+
+			// Slide a window of d-mers over the sample
+			size_t window = std::min(SEGMENT, sample->size()) - DMER + 1;
+			const char *last = sample->end - DMER;
+			active.clear();
+			uint64_t total = 0;
+			for (const char *p = sample->begin; p <= last; ++p) {
+				if (active[dmer(p)]++ == 0) {
+					total += score(p);
+				}
+				if ((size_t)(p - sample->begin) >= window) {
+					const char *out = p - window;
+					if (--active[dmer(out)] == 0) {
+						total -= score(out);
+					}
+				}
+
+				if (total > best.score) {
+					const char *start = p + 1 - std::min(window, (size_t)(p + 1 - sample->begin));
+					best = {start, p + DMER, total};
+				}
+			}
+		}
+		return best;
+	}
+
+	static void appendSequence(
+			std::string &out, const char *lit, size_t litLen, size_t matchLen, size_t offset) {
+		size_t extra = matchLen ? matchLen - MIN_MATCH : 0;
+		out += (char)(std::min<size_t>(litLen, 15) << 4 | std::min<size_t>(extra, 15));
+		if (litLen >= 15) {
+			detail::appendLEB128(out, litLen - 15);
+		}
+		out.append(lit, litLen);
+		if (matchLen) {
+			detail::appendLEB128(out, offset);
+			if (extra >= 15) {
+				detail::appendLEB128(out, extra - 15);
+			}
+		}
+	}
+
+	// Hash chains of the dictionary's positions, 1-based, with the
+	// last position first so that matches are found at the smallest offset
+	void index() {
+		dictHead_.assign(size_t(1) << DICT_HASH_BITS, 0);
+		dictChain_.assign(bytes_.size(), 0);
+		for (size_t i = 0; i + MIN_MATCH <= bytes_.size(); ++i) {
+			uint32_t h = detail::hash4(bytes_.data() + i, DICT_HASH_BITS);
+			dictChain_[i] = dictHead_[h];
+			dictHead_[h] = i + 1;
+		}
+	}
+
+	std::string bytes_;
+	std::vector<uint32_t> dictHead_;
+	std::vector<uint32_t> dictChain_;
+};
+
+// Writes records compressed with a dictionary to a stream,
+// each as a binary value.
+class CompressedWriter {
+public:
+	// The dictionary must outlive the writer.
+	CompressedWriter(const Dictionary &dict, std::ostream *os): dict_(dict), os_(os) {}
+
+	// Encode one record by calling 'func' with a Writer, then compress and write it.
+	template<typename Func>
+	void write(Func func) {
+		buf_.reset();
+		func(Writer(&buf_));
+		writeRaw(buf_.view());
+	}
+
+	// Compress and write an already encoded record.
+	void writeRaw(std::string_view record) {
+		compressed_.clear();
+		dict_.compress(record, compressed_);
+		Writer(os_).writeBinary(compressed_.data(), compressed_.size());
+		rawBytes_ += record.size();
+		compressedBytes_ += compressed_.size();
+	}
+
+	// The total sizes of the records written, before and after compression
+	uint64_t rawBytes() const {
+		return rawBytes_;
+	}
+
+	uint64_t compressedBytes() const {
+		return compressedBytes_;
+	}
+
+private:
+	const Dictionary &dict_;
+	std::ostream *os_;
+	BufferStream buf_;
+	std::string compressed_;
+	uint64_t rawBytes_ = 0;
+	uint64_t compressedBytes_ = 0;
+};
+
+}
+
+#endif
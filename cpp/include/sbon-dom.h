@@ -0,0 +1,884 @@
+#ifndef SBON_DOM_H
+#define SBON_DOM_H
+
+// A compact in-memory tree ("DOM") of one decoded document, for when
+// values need to be kept around or visited in arbitrary order.
+//
+// Every value is a 16-byte node: 15 bytes of payload and a tag byte.
+// Booleans, numbers and strings or binaries of up to 14 bytes are stored
+// in the node itself; longer ones point into the document's arena.
+// The children of an array or object are one contiguous array of nodes
+// in the arena, and an object's keys follow its children as 32-bit IDs
+// in a SymbolTable, which documents can share. Arrays of only integers,
+// only floats or only doubles are packed as 8 bytes per element.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <vector>
+
+#include <sys/mman.h>
+
+namespace sbon {
+
+namespace detail {
+
+// Chunks of at least this size are mmap'ed, aligned to and sized in
+// multiples of 2 MiB, and marked for transparent huge pages, so that
+// walking a big document needs fewer TLB entries.
+constexpr size_t HUGE_CHUNK = 2 << 20;
+
+inline char *allocateChunk(size_t size) {
+	if (size < HUGE_CHUNK) {
+		return (char *)::operator new[](size, std::align_val_t(16));
+	}
+
+	// Map an extra huge page's worth, and trim it to an aligned range
+	size_t mapSize = size + HUGE_CHUNK;
+	void *ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+
+	char *start = (char *)ptr;
+	char *aligned = (char *)(((uintptr_t)start + HUGE_CHUNK - 1) & ~(uintptr_t)(HUGE_CHUNK - 1));
+	if (aligned > start) {
+		munmap(start, aligned - start);
+	}
+	if (aligned + size < start + mapSize) {
+		munmap(aligned + size, start + mapSize - (aligned + size));
+	}
+
+#ifdef MADV_HUGEPAGE
+	madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+	return aligned;
+}
+
+inline void freeChunk(char *ptr, size_t size) {
+	if (size < HUGE_CHUNK) {
+		::operator delete[](ptr, std::align_val_t(16));
+	} else {
+		munmap(ptr, size);
+	}
+}
+
+// A bump allocator, which frees everything at once.
+class Arena {
+public:
+	Arena() = default;
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+	~Arena() {
+		clear();
+	}
+
+	void *allocate(size_t size) {
+		size = (size + ALIGN - 1) & ~(ALIGN - 1);
+		if (size > left_) {
+			addChunk(size);
+		}
+
+		void *ptr = pos_;
+		pos_ += size;
+		left_ -= size;
+		used_ += size;
+		return ptr;
+	}
+
+	// Make sure the next 'size' bytes of allocations fit in one chunk.
+	void reserve(size_t size) {
+		if (size > left_) {
+			addChunk(size);
+		}
+	}
+
+	// Forget all allocations, and keep a single chunk of about 'size' bytes
+	// for the next ones. The current chunk is kept if it's big enough
+	// and not much bigger.
+	void reset(size_t size) {
+		size = chunkSize(size);
+		if (chunks_.size() != 1 || chunks_[0].size < size || chunks_[0].size > size * 4) {
+			clear();
+			addChunk(size);
+		}
+
+		pos_ = chunks_[0].data;
+		left_ = chunks_[0].size;
+		used_ = 0;
+	}
+
+	// The total size of the arena's chunks
+	size_t capacity() const {
+		return capacity_;
+	}
+
+	// The bytes handed out by allocate()
+	size_t used() const {
+		return used_;
+	}
+
+private:
+	static constexpr size_t ALIGN = 16;
+	static constexpr size_t MIN_CHUNK = 4096;
+
+	struct Chunk {
+		char *data;
+		size_t size;
+	};
+
+	static size_t chunkSize(size_t size) {
+		size = std::max(size, MIN_CHUNK);
+		size_t align = size >= HUGE_CHUNK ? HUGE_CHUNK : MIN_CHUNK;
+		return (size + align - 1) & ~(align - 1);
+	}
+
+	// Chunks double in size, so that big documents need few of them
+	void addChunk(size_t size) {
+		size_t newSize = chunkSize(std::max(size, capacity_));
+		if (chunks_.empty()) {
+			chunks_.reserve(8);
+		}
+
+		chunks_.push_back({allocateChunk(newSize), newSize});
+		pos_ = chunks_.back().data;
+		left_ = newSize;
+		capacity_ += newSize;
+	}
+
+	void clear() {
+		for (auto &chunk: chunks_) {
+			freeChunk(chunk.data, chunk.size);
+		}
+
+		chunks_.clear();
+		pos_ = nullptr;
+		left_ = 0;
+		capacity_ = 0;
+		used_ = 0;
+	}
+
+	std::vector<Chunk> chunks_;
+	char *pos_ = nullptr;
+	size_t left_ = 0;
+	size_t capacity_ = 0;
+	size_t used_ = 0;
+};
+
+// Convert a stored number to the type the caller asked for,
+// with the same checks as decoding it would do.
+template<typename T, typename U>
+inline T castNumber(U val) {
+	T num(val);
+	if ((U)num != val) {
+		throw ParseError("getNumber: Got unrepresentable number");
+	}
+
+	return num;
+}
+
+}
+
+class Document;
+
+class DomNode {
+private:
+	friend class Document;
+	friend class DomValue;
+
+	static constexpr unsigned char INLINE = 0x10;
+	static constexpr size_t INLINE_MAX = 14;
+
+	// Arrays of only integers, only floats or only doubles are packed
+	// as 8-byte numbers instead of nodes
+	static constexpr unsigned char PACKED = 0x20;
+	static constexpr size_t PACKED_SIZE = 8;
+	static constexpr size_t PACKED_TYPE = 12;
+
+	// Marks a DomValue which doesn't refer to a value
+	static constexpr unsigned char EMPTY = 0xff;
+
+	Type type() const {
+		return (Type)(tag_ & 0x0f);
+	}
+
+	Type packedType() const {
+		return (Type)data_[PACKED_TYPE];
+	}
+
+	template<typename T>
+	T load(size_t offset = 0) const {
+		T val;
+		std::memcpy(&val, data_ + offset, sizeof(T));
+		return val;
+	}
+
+	template<typename T>
+	void store(T val, size_t offset = 0) {
+		std::memcpy(data_ + offset, &val, sizeof(T));
+	}
+
+	// Strings, binaries and containers keep a pointer and a 32-bit count
+	void setRef(Type type, const void *ptr, size_t count) {
+		if (count > UINT32_MAX) {
+			throw ParseError("Document: Value too big");
+		}
+
+		tag_ = (unsigned char)type;
+		store(ptr);
+		store((uint32_t)count, sizeof(ptr));
+	}
+
+	const char *ptr() const {
+		return load<const char *>();
+	}
+
+	uint32_t count() const {
+		return load<uint32_t>(sizeof(const char *));
+	}
+
+	std::string_view bytes() const {
+		if (tag_ & INLINE) {
+			return std::string_view(data_, (unsigned char)data_[INLINE_MAX]);
+		}
+
+		return std::string_view(ptr(), count());
+	}
+
+	// An object's key IDs follow its children
+	const uint32_t *keys() const {
+		return (const uint32_t *)(ptr() + count() * sizeof(DomNode));
+	}
+
+	char data_[15] = {};
+	unsigned char tag_ = 0;
+};
+
+static_assert(sizeof(DomNode) == 16);
+
+// A view of one value in a Document.
+// The accessors mirror those of RawValue.
+class DomValue {
+public:
+	DomValue() {
+		node_.tag_ = DomNode::EMPTY;
+	}
+
+	// False for the value returned by get() for a missing key
+	explicit operator bool() const {
+		return node_.tag_ != DomNode::EMPTY;
+	}
+
+	Type getType() const {
+		return node_.type();
+	}
+
+	bool getBool() const {
+		if (getType() != Type::BOOL) {
+			throw ParseError("getBool: Expected 'T' or 'F'");
+		}
+
+		return node_.load<bool>();
+	}
+
+	std::string_view getString() const {
+		if (getType() != Type::STRING) {
+			throw ParseError("getString: Expected 'S'");
+		}
+
+		return node_.bytes();
+	}
+
+	std::string_view getBinary() const {
+		if (getType() != Type::BINARY) {
+			throw ParseError("getBinary: Expected 'B'");
+		}
+
+		return node_.bytes();
+	}
+
+	float getFloat() const {
+		return getNumber<float>();
+	}
+
+	double getDouble() const {
+		return getNumber<double>();
+	}
+
+	int64_t getInt() const {
+		return getNumber<int64_t>();
+	}
+
+	uint64_t getUInt() const {
+		return getNumber<uint64_t>();
+	}
+
+	template<typename T>
+	T getNumber() const {
+		switch (getType()) {
+		case Type::UINT:
+			return detail::castNumber<T>(node_.load<uint64_t>());
+		case Type::INT:
+			return detail::castNumber<T>(node_.load<int64_t>());
+		case Type::FLOAT:
+			return detail::castNumber<T>(node_.load<float>());
+		case Type::DOUBLE:
+			return detail::castNumber<T>(node_.load<double>());
+		default:
+			throw ParseError("getNumber: Expected number");
+		}
+	}
+
+	// The number of elements of an array or members of an object.
+	size_t size() const {
+		Type type = getType();
+		if (type != Type::ARRAY && type != Type::OBJECT) {
+			throw ParseError("size: Expected '[' or '{'");
+		}
+
+		return node_.count();
+	}
+
+	// Element 'i' of an array, or the value of member 'i' of an object.
+	DomValue operator[](size_t i) const {
+		Type type = getType();
+		if (type != Type::ARRAY && type != Type::OBJECT) {
+			throw ParseError("operator[]: Expected '[' or '{'");
+		}
+
+		if (!(node_.tag_ & DomNode::PACKED)) {
+			return DomValue(node_.ptr() + i * sizeof(DomNode), symbols_);
+		}
+
+		// Elements of packed arrays are unpacked into a node of their own
+		DomValue val;
+		std::memcpy(val.node_.data_, node_.ptr() + i * DomNode::PACKED_SIZE, DomNode::PACKED_SIZE);
+		val.node_.tag_ = (unsigned char)node_.packedType();
+		if (node_.packedType() == Type::INT && val.node_.load<int64_t>() >= 0) {
+			val.node_.tag_ = (unsigned char)Type::UINT;
+		}
+		val.symbols_ = symbols_;
+		return val;
+	}
+
+	// The key of member 'i' of an object.
+	std::string_view key(size_t i) const {
+		return symbols_->name(keyId(i));
+	}
+
+	uint32_t keyId(size_t i) const {
+		if (getType() != Type::OBJECT) {
+			throw ParseError("keyId: Expected '{'");
+		}
+
+		return node_.keys()[i];
+	}
+
+	// The value of the member called 'key', or an empty DomValue.
+	DomValue get(std::string_view key) const {
+		uint32_t id = symbols_->find(key);
+		if (id == SymbolTable::NOT_FOUND) {
+			return DomValue();
+		}
+
+		return get(id);
+	}
+
+	DomValue get(uint32_t keyId) const {
+		if (getType() != Type::OBJECT) {
+			throw ParseError("get: Expected '{'");
+		}
+
+		const uint32_t *keys = node_.keys();
+		for (uint32_t i = 0; i < node_.count(); ++i) {
+			if (keys[i] == keyId) {
+				return DomValue(node_.ptr() + i * sizeof(DomNode), symbols_);
+			}
+		}
+
+		return DomValue();
+	}
+
+	// Call 'func(DomValue)' for each element of an array.
+	template<typename Func>
+	void forEachElement(Func func) const {
+		if (getType() != Type::ARRAY) {
+			throw ParseError("forEachElement: Expected '['");
+		}
+
+		for (size_t i = 0; i < node_.count(); ++i) {
+			func((*this)[i]);
+		}
+	}
+
+	// Call 'func(std::string_view key, DomValue)' for each member of an object.
+	template<typename Func>
+	void forEachMember(Func func) const {
+		size_t count = size();
+		for (size_t i = 0; i < count; ++i) {
+			func(key(i), (*this)[i]);
+		}
+	}
+
+	// Encode the value again.
+	void write(Writer w) const {
+		switch (getType()) {
+		case Type::BOOL:
+			w.writeBool(getBool());
+			break;
+		case Type::NIL:
+			w.writeNull();
+			break;
+		case Type::STRING:
+			w.writeString(getString());
+			break;
+		case Type::BINARY:
+			w.writeBinary(getBinary().data(), getBinary().size());
+			break;
+		case Type::FLOAT:
+			w.writeFloat(getFloat());
+			break;
+		case Type::DOUBLE:
+			w.writeDouble(getDouble());
+			break;
+		case Type::INT:
+			w.writeInt(getInt());
+			break;
+		case Type::UINT:
+			w.writeUInt(getUInt());
+			break;
+		case Type::ARRAY:
+			w.writeArray([&](Writer w) {
+				forEachElement([&](DomValue val) {
+					val.write(w);
+				});
+			});
+			break;
+		case Type::OBJECT:
+			w.writeObject([&](ObjectWriter w) {
+				forEachMember([&](std::string_view key, DomValue val) {
+					val.write(w.key(key));
+				});
+			});
+			break;
+		}
+	}
+
+private:
+	friend class Document;
+
+	DomValue(const void *node, const SymbolTable *symbols): symbols_(symbols) {
+		std::memcpy(&node_, node, sizeof(DomNode));
+	}
+
+	DomNode node_;
+	const SymbolTable *symbols_ = nullptr;
+};
+
+class DocumentPool;
+
+namespace detail {
+
+// Everything a document allocates while it's parsed,
+// which a DocumentPool can hand on to the next document.
+struct DomStorage {
+	Arena arena;
+
+	// Children of the containers being parsed
+	std::vector<DomNode> stack;
+	std::vector<uint32_t> keyStack;
+
+	DocumentPool *pool = nullptr;
+};
+
+struct ReleaseStorage {
+	void operator()(DomStorage *storage) const;
+};
+
+}
+
+// One decoded document. Keys go into 'symbols' if it's given,
+// so that documents which share a table can compare key IDs,
+// and into a table of the document's own otherwise.
+class Document {
+public:
+	explicit Document(SymbolTable *symbols = nullptr): symbols_(symbols) {
+		if (!symbols_) {
+			ownSymbols_ = std::make_unique<SymbolTable>();
+			symbols_ = ownSymbols_.get();
+		}
+	}
+
+	// Decode one value, which must be all of 'input'.
+	// The document doesn't refer to 'input' afterwards.
+	explicit Document(Span input, SymbolTable *symbols = nullptr): Document(symbols) {
+		storage_.reset(new detail::DomStorage());
+		parse(input);
+
+		// Unpooled documents don't need the parse stacks afterwards
+		storage_->stack = {};
+		storage_->keyStack = {};
+	}
+
+	Document(Document &&) = default;
+	Document &operator=(Document &&) = default;
+
+	DomValue root() const {
+		return DomValue(&root_, symbols_);
+	}
+
+	SymbolTable &symbols() const {
+		return *symbols_;
+	}
+
+	// The bytes held by the document, including unused space in its arena
+	// but not its symbol table.
+	size_t memoryUsage() const {
+		return sizeof(Document) + (storage_ ? storage_->arena.capacity() : 0);
+	}
+
+private:
+	friend class DocumentPool;
+
+	Document(Span input, SymbolTable *symbols, detail::DomStorage *storage): symbols_(symbols) {
+		storage_.reset(storage);
+		parse(input);
+	}
+
+	void parse(Span input) {
+		// Nodes take about as much space as the encoded values they replace
+		if (storage_->arena.capacity() == 0) {
+			storage_->arena.reserve(input.size() * 2);
+		}
+
+		const char *p = input.begin;
+		root_ = parseValue(p, input.end, 0);
+		if (p != input.end) {
+			throw ParseError("Document: Unexpected data after the value");
+		}
+	}
+
+	// Containers nest as deep as skipValue allows, so that malicious
+	// input can't overflow the stack
+	static constexpr size_t MAX_DEPTH = 1024;
+
+	DomNode parseValue(const char *&p, const char *end, size_t depth) {
+		detail::checkAvail(p, end, 1);
+		DomNode node;
+		char ch = *p++;
+		auto next = [&] {
+			detail::checkAvail(p, end, 1);
+			return *p++;
+		};
+
+		if (ch == 'T' || ch == 'F') {
+			node.tag_ = (unsigned char)Type::BOOL;
+			node.store(ch == 'T');
+		} else if (ch == 'N') {
+			node.tag_ = (unsigned char)Type::NIL;
+		} else if (ch == 'S') {
+			const char *str = p;
+			p = detail::skipCString(p, end);
+			setBytes(node, Type::STRING, std::string_view(str, p - str - 1));
+		} else if (ch == 'B') {
+			uint64_t size = detail::readLEB128(p, end);
+			detail::checkAvail(p, end, size);
+			setBytes(node, Type::BINARY, std::string_view(p, size));
+			p += size;
+		} else if (ch == 'f') {
+			node.tag_ = (unsigned char)Type::FLOAT;
+			node.store(detail::decodeFloat(next));
+		} else if (ch == 'd') {
+			node.tag_ = (unsigned char)Type::DOUBLE;
+			node.store(detail::decodeDouble(next));
+		} else if (ch == '-') {
+			node.tag_ = (unsigned char)Type::INT;
+			node.store(detail::decodeNumber<int64_t>(ch, next));
+		} else if (ch == '+' || (ch >= '0' && ch <= '9')) {
+			node.tag_ = (unsigned char)Type::UINT;
+			node.store(detail::decodeNumber<uint64_t>(ch, next));
+		} else if ((ch == '[' || ch == '{') && depth >= MAX_DEPTH) {
+			throw ParseError("Maximum nesting depth exceeded");
+		} else if (ch == '[') {
+			size_t base = storage_->stack.size();
+			while (true) {
+				detail::checkAvail(p, end, 1);
+				if (*p == ']') {
+					p += 1;
+					break;
+				}
+
+				DomNode child = parseValue(p, end, depth + 1);
+				storage_->stack.push_back(child);
+			}
+
+			size_t count = storage_->stack.size() - base;
+			Type packedType = packableType(storage_->stack.data() + base, count);
+			if (packedType == Type::ARRAY) {
+				void *children = storage_->arena.allocate(count * sizeof(DomNode));
+				copy(children, storage_->stack.data() + base, count * sizeof(DomNode));
+				node.setRef(Type::ARRAY, children, count);
+			} else {
+				char *children = (char *)storage_->arena.allocate(count * DomNode::PACKED_SIZE);
+				for (size_t i = 0; i < count; ++i) {
+					std::memcpy(children + i * DomNode::PACKED_SIZE,
+						storage_->stack[base + i].data_, DomNode::PACKED_SIZE);
+				}
+				node.setRef(Type::ARRAY, children, count);
+				node.tag_ |= DomNode::PACKED;
+				node.data_[DomNode::PACKED_TYPE] = (char)packedType;
+			}
+			storage_->stack.resize(base);
+		} else if (ch == '#') {
+			// A delta-encoded array decodes straight into a packed one.
+			// Each element takes at least a byte, which bounds the count.
+			uint64_t count = detail::readLEB128(p, end);
+			detail::checkAvail(p, end, count);
+			int64_t *children = (int64_t *)storage_->arena.allocate(count * DomNode::PACKED_SIZE);
+			int64_t *out = children;
+			uint64_t total = 0;
+			while (out != children + count) {
+				p = detail::decodeDeltaRun(p, end, out, children + count, total);
+				if (out != children + count) {
+					total += (uint64_t)detail::unZigZag(detail::readLEB128(p, end));
+					*out++ = (int64_t)total;
+				}
+			}
+
+			node.setRef(Type::ARRAY, children, count);
+			if (count > 0) {
+				node.tag_ |= DomNode::PACKED;
+				node.data_[DomNode::PACKED_TYPE] = (char)Type::INT;
+			}
+		} else if (ch == '{') {
+			size_t base = storage_->stack.size();
+			size_t keyBase = storage_->keyStack.size();
+			while (true) {
+				detail::checkAvail(p, end, 1);
+				if (*p == '}') {
+					p += 1;
+					break;
+				}
+
+				const char *key = p;
+				p = detail::skipCString(p, end);
+				storage_->keyStack.push_back(symbols_->intern(std::string_view(key, p - key - 1)));
+				DomNode child = parseValue(p, end, depth + 1);
+				storage_->stack.push_back(child);
+			}
+
+			size_t count = storage_->stack.size() - base;
+			char *children = (char *)storage_->arena.allocate(
+				count * (sizeof(DomNode) + sizeof(uint32_t)));
+			copy(children, storage_->stack.data() + base, count * sizeof(DomNode));
+			copy(children + count * sizeof(DomNode),
+				storage_->keyStack.data() + keyBase, count * sizeof(uint32_t));
+			storage_->stack.resize(base);
+			storage_->keyStack.resize(keyBase);
+			node.setRef(Type::OBJECT, children, count);
+		} else {
+			throw ParseError("Unexpected character");
+		}
+
+		return node;
+	}
+
+	// The type an array's elements can be packed as, or Type::ARRAY if
+	// they can't be. Integers are packed as INT (which is enough to tell
+	// negative ones from positive ones), so they must all fit in an int64_t.
+	static Type packableType(const DomNode *nodes, size_t count) {
+		if (count == 0) {
+			return Type::ARRAY;
+		}
+
+		Type type = nodes[0].type();
+		if (type == Type::UINT) {
+			type = Type::INT;
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			Type elType = nodes[i].type();
+			if (type == Type::INT) {
+				if (elType != Type::INT && (elType != Type::UINT ||
+						nodes[i].load<uint64_t>() > (uint64_t)INT64_MAX)) {
+					return Type::ARRAY;
+				}
+			} else if ((type != Type::FLOAT && type != Type::DOUBLE) || elType != type) {
+				return Type::ARRAY;
+			}
+		}
+
+		return type;
+	}
+
+	void setBytes(DomNode &node, Type type, std::string_view bytes) {
+		if (bytes.size() <= DomNode::INLINE_MAX) {
+			node.tag_ = (unsigned char)type | DomNode::INLINE;
+			copy(node.data_, bytes.data(), bytes.size());
+			node.data_[DomNode::INLINE_MAX] = (char)bytes.size();
+			return;
+		}
+
+		void *copy = storage_->arena.allocate(bytes.size());
+		std::memcpy(copy, bytes.data(), bytes.size());
+		node.setRef(type, copy, bytes.size());
+	}
+
+	// memcpy() doesn't allow null pointers, even for 0 bytes
+	static void copy(void *dest, const void *src, size_t size) {
+		if (size > 0) {
+			std::memcpy(dest, src, size);
+		}
+	}
+
+	SymbolTable *symbols_;
+	std::unique_ptr<SymbolTable> ownSymbols_;
+	std::unique_ptr<detail::DomStorage, detail::ReleaseStorage> storage_;
+	DomNode root_;
+};
+
+// Recycles the memory of request-scoped documents, so that parsing
+// doesn't allocate once the pool has warmed up. A document parsed by
+// a pool gives its arena and parse stacks back to the pool when it's
+// destroyed, and the pool's documents share its symbol table.
+//
+// Recycled arenas are sized from the documents the pool has seen
+// recently: the estimate follows bigger documents at once, and shrinks
+// slowly after them, so that one huge document doesn't pin its memory.
+//
+// The symbol table only grows while documents use it, so keys which
+// depend on the data, such as IDs used as keys, would grow it without
+// bound. Once it has more than 'maxSymbols' keys, the pool starts a new
+// table for the next document parsed while none of its documents are live.
+// Key IDs from different tables can't be compared.
+//
+// Pools are meant to be used by one thread each (see local()),
+// but documents may be destroyed on any thread.
+// A pool must outlive its documents.
+class DocumentPool {
+public:
+	static constexpr size_t DEFAULT_MAX_SYMBOLS = 64 * 1024;
+
+	explicit DocumentPool(size_t maxFree = 16, size_t maxSymbols = DEFAULT_MAX_SYMBOLS):
+			symbols_(std::make_unique<SymbolTable>()), maxFree_(maxFree), maxSymbols_(maxSymbols) {
+		free_.reserve(maxFree_);
+	}
+
+	DocumentPool(const DocumentPool &) = delete;
+	DocumentPool &operator=(const DocumentPool &) = delete;
+
+	~DocumentPool() {
+		for (auto *storage: free_) {
+			delete storage;
+		}
+	}
+
+	// A pool for the calling thread
+	static DocumentPool &local() {
+		thread_local DocumentPool pool;
+		return pool;
+	}
+
+	Document parse(Span input) {
+		detail::DomStorage *storage = acquire();
+		return Document(input, symbols_.get(), storage);
+	}
+
+	// The symbol table which documents parsed now use.
+	// It's replaced once it's too big and no documents are live.
+	SymbolTable &symbols() {
+		return *symbols_;
+	}
+
+	// The arena size recycled documents currently get
+	size_t expectedSize() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return expected_;
+	}
+
+	// The number of recycled arenas waiting for a document
+	size_t freeCount() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return free_.size();
+	}
+
+private:
+	friend struct detail::ReleaseStorage;
+
+	detail::DomStorage *acquire() {
+		std::unique_lock<std::mutex> lock(mutex_);
+
+		// Documents are only parsed on the pool's thread, so nothing
+		// else can be using the table once no documents are live
+		if (live_ == 0 && symbols_->size() > maxSymbols_) {
+			symbols_ = std::make_unique<SymbolTable>();
+		}
+		live_ += 1;
+
+		if (free_.empty()) {
+			lock.unlock();
+			auto *storage = new detail::DomStorage();
+			storage->pool = this;
+			return storage;
+		}
+
+		auto *storage = free_.back();
+		free_.pop_back();
+		size_t expected = expected_;
+		lock.unlock();
+
+		// Leave some room, so that slightly bigger documents still fit
+		storage->arena.reset(expected + expected / 4);
+		return storage;
+	}
+
+	void release(detail::DomStorage *storage) {
+		// A failed parse can leave children behind
+		storage->stack.clear();
+		storage->keyStack.clear();
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		live_ -= 1;
+		size_t used = storage->arena.used();
+		expected_ = std::max(used, expected_ - expected_ / 8);
+		if (free_.size() < maxFree_) {
+			free_.push_back(storage);
+			return;
+		}
+
+		lock.unlock();
+		delete storage;
+	}
+
+	std::unique_ptr<SymbolTable> symbols_;
+	size_t maxFree_;
+	size_t maxSymbols_;
+
+	mutable std::mutex mutex_;
+	std::vector<detail::DomStorage *> free_;
+	size_t expected_ = 0;
+
+	// The number of documents using the pool's storage
+	size_t live_ = 0;
+};
+
+inline void detail::ReleaseStorage::operator()(DomStorage *storage) const {
+	if (storage->pool) {
+		storage->pool->release(storage);
+	} else {
+		delete storage;
+	}
+}
+
+}
+
+#endif
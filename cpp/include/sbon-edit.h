@@ -0,0 +1,683 @@
+#ifndef SBON_EDIT_H
+#define SBON_EDIT_H
+
+// Editing a large document in memory while keeping its tape up to date,
+// without scanning the whole document again after each edit.
+//
+// The document's bytes are a piece table over the original buffer and
+// the inserted bytes. An edit only re-scans the smallest value which
+// contains it; when an edit replaces whole elements or members of a
+// container, only the new ones are scanned.
+//
+// The tape is kept in blocks. An edit replaces the entries it affects,
+// fixes up the values which contain it, and records how far the entries
+// of later blocks have moved as a delta per block, rather than updating
+// every entry after the edit.
+
+#include "sbon.h"
+#include "sbon-records.h"
+#include "sbon-tape.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace sbon {
+
+class EditableDocument;
+
+// A value in an EditableDocument. Like TapeValue, but values are read
+// through the piece table, and are only valid until the next edit.
+class EditValue {
+public:
+	EditValue() = default;
+
+	// Whether this refers to a value; lookups which find nothing return an invalid EditValue.
+	explicit operator bool() const {
+		return doc_ != nullptr;
+	}
+
+	// The index of the value's tape entry
+	size_t index() const {
+		return index_;
+	}
+
+	uint64_t offset() const {
+		return entry_.offset;
+	}
+
+	uint64_t length() const {
+		return entry_.length;
+	}
+
+	Type getType() const;
+
+	// The key of this value, if it's an object member.
+	std::string key() const;
+
+	// The number of elements or members. As with TapeValue, the elements
+	// of a delta-encoded array have no entries, and are read with raw().
+	size_t size() const;
+
+	// The raw value, for decoding it. If edits have split the value
+	// between pieces, it's copied into 'scratch'.
+	RawValue raw(std::string &scratch) const;
+
+	// The element at 'index' of an array, or the member at 'index' of an object.
+	EditValue at(size_t index) const;
+
+	// The member with key 'key' of an object.
+	EditValue get(std::string_view key) const;
+
+	// Call 'func(EditValue)' for each element or member.
+	template<typename Func>
+	void forEachChild(Func func) const;
+
+	// Find the value at a dot-separated path such as "users.3.name".
+	EditValue find(std::string_view path) const;
+
+private:
+	friend class EditableDocument;
+
+	EditValue(const EditableDocument *doc, size_t index, TapeEntry entry):
+		doc_(doc), index_(index), entry_(entry) {}
+
+	const EditableDocument *doc_ = nullptr;
+	size_t index_ = 0;
+	TapeEntry entry_{};
+};
+
+class EditableDocument {
+public:
+	// Edit the document in 'data', which must stay valid and unchanged
+	// for the lifetime of the EditableDocument (e.g. a MappedFile).
+	explicit EditableDocument(Span data): EditableDocument(data, detail::buildTape(data)) {}
+
+	// Edit a document whose tape has been loaded already.
+	explicit EditableDocument(const TapeDocument &doc):
+		EditableDocument(doc.span(),
+			std::vector<TapeEntry>(doc.entries(), doc.entries() + doc.size())) {}
+
+	EditableDocument(Span data, const std::vector<TapeEntry> &tape) {
+		if (data.size() > 0) {
+			pieces_.push_back({data.begin, data.size()});
+		}
+		byteSize_ = data.size();
+		updatePieceStarts();
+
+		std::vector<Entry> entries = withDepths(tape, 0, 0, 0);
+		count_ = entries.size();
+		blocks_ = splitBlocks(entries);
+		updateBlockStarts(0);
+	}
+
+	EditValue root() const {
+		return value(0);
+	}
+
+	EditValue find(std::string_view path) const {
+		return root().find(path);
+	}
+
+	// The number of values in the document.
+	size_t size() const {
+		return count_;
+	}
+
+	// The size of the document in bytes.
+	uint64_t byteSize() const {
+		return byteSize_;
+	}
+
+	EditValue value(size_t index) const {
+		return EditValue(this, index, get(index).tape);
+	}
+
+	TapeEntry entry(size_t index) const {
+		return get(index).tape;
+	}
+
+	// Replace the 'length' bytes at 'offset' with 'bytes'. The result must
+	// still be a valid document, or a ParseError is thrown and the document
+	// is left unchanged. Only the value containing the edit is scanned again,
+	// or only the new values if the edit replaces whole elements or members.
+	void splice(uint64_t offset, uint64_t length, std::string_view bytes) {
+		uint64_t end = offset + length;
+		if (end < offset || end > byteSize_) {
+			throw ParseError("splice: Range is outside the document");
+		}
+
+		// Find the smallest value containing the edit. An insertion
+		// right before or after a value belongs to its parent.
+		auto contains = [&](const TapeEntry &e) {
+			uint64_t valEnd = e.offset + e.length;
+			return e.offset <= offset && end <= valEnd &&
+				(offset < end || (e.offset < offset && offset < valEnd));
+		};
+
+		size_t last = offset < end ? lowerBound(offset + 1) : lowerBound(offset);
+		if (last == 0) {
+			throw ParseError("splice: Range is outside the document's value");
+		}
+
+		size_t idx = last - 1;
+		Entry val = get(idx);
+		while (!contains(val.tape)) {
+			if (val.depth == 0) {
+				throw ParseError("splice: Range is outside the document's value");
+			}
+
+			idx = parent(idx);
+			val = get(idx);
+		}
+
+		// A whole value is replaced as an element of its container if it
+		// can be, so that it can be removed or replaced by several values
+		if (val.depth > 0 && offset == val.tape.offset && end == offset + val.tape.length) {
+			size_t up = parent(idx);
+			if (replacesChildren(get(up), up, offset, end)) {
+				idx = up;
+				val = get(up);
+			}
+		}
+
+		std::string scratch;
+		char open = *read(val.tape.offset, 1, scratch).begin;
+		int64_t byteDelta = (int64_t)bytes.size() - (int64_t)length;
+
+		std::vector<size_t> ancestors;
+		size_t first;
+		size_t after;
+		std::vector<Entry> entries;
+		int64_t countDelta = 0;
+
+		if (replacesChildren(val, idx, offset, end)) {
+			// Replace whole children; only the new ones are scanned
+			first = lowerBound(offset);
+			after = lowerBound(end);
+			for (size_t i = first; i < after; i = get(i).tape.next) {
+				countDelta -= 1;
+			}
+
+			std::vector<TapeEntry> tape;
+			const char *p = bytes.data();
+			const char *bytesEnd = p + bytes.size();
+			while (p < bytesEnd) {
+				uint32_t keyLen = 0;
+				if (open == '{') {
+					const char *valp = detail::skipCString(p, bytesEnd);
+					keyLen = detail::tapeKeyLen(valp - p - 1);
+					p = valp;
+				}
+
+				detail::appendTape(p, bytesEnd, bytes.data(), keyLen, tape);
+				countDelta += 1;
+			}
+
+			if (val.tape.count + countDelta > UINT32_MAX) {
+				throw ParseError("splice: Too many elements or members");
+			}
+
+			entries = withDepths(tape, val.depth + 1, offset, first);
+			ancestors.push_back(idx);
+		} else {
+			// Scan the whole value again, with the edit applied
+			std::string edited(read(val.tape.offset, val.tape.length, scratch).view());
+			edited.replace(offset - val.tape.offset, length, bytes);
+
+			std::vector<TapeEntry> tape;
+			const char *p = edited.data();
+			detail::appendTape(p, p + edited.size(), p, val.tape.keyLen, tape);
+			if (p != edited.data() + edited.size()) {
+				throw ParseError("splice: Edited value is followed by trailing data");
+			}
+
+			first = idx;
+			after = val.tape.next;
+			entries = withDepths(tape, val.depth, val.tape.offset, first);
+		}
+
+		for (size_t i = idx; get(i).depth > 0;) {
+			i = parent(i);
+			ancestors.push_back(i);
+		}
+
+		// Everything has been checked; from here on, nothing throws
+		// (other than bad_alloc)
+		int64_t entryDelta = (int64_t)entries.size() - (int64_t)(after - first);
+		splicePieces(offset, length, bytes);
+		replaceEntries(first, after, std::move(entries), byteDelta, entryDelta);
+
+		for (size_t i: ancestors) {
+			Entry e = get(i);
+			e.tape.length += byteDelta;
+			e.tape.next += entryDelta;
+			if (i == idx) {
+				e.tape.count += countDelta;
+			}
+			set(i, e);
+		}
+	}
+
+	// Replace a value with another encoded value.
+	void replace(const EditValue &val, std::string_view encoded) {
+		splice(val.offset(), val.length(), encoded);
+	}
+
+	// The 'size' bytes at 'offset'. They're copied into 'scratch'
+	// only if edits have split them between pieces.
+	Span read(uint64_t offset, uint64_t size, std::string &scratch) const {
+		size_t i = pieceAt(offset);
+		uint64_t pos = offset - pieceStarts_[i];
+		if (pos + size <= pieces_[i].size) {
+			const char *begin = pieces_[i].data + pos;
+			return {begin, begin + size};
+		}
+
+		scratch.clear();
+		while (scratch.size() < size) {
+			size_t n = std::min(pieces_[i].size - pos, size - scratch.size());
+			scratch.append(pieces_[i].data + pos, n);
+			i += 1;
+			pos = 0;
+		}
+		return {scratch.data(), scratch.data() + scratch.size()};
+	}
+
+	// Call 'func(Span)' for each piece of the document, in order,
+	// e.g. to write it out.
+	template<typename Func>
+	void forEachPiece(Func func) const {
+		for (auto &piece: pieces_) {
+			func(Span{piece.data, piece.data + piece.size});
+		}
+	}
+
+	std::string contents() const {
+		std::string str;
+		str.reserve(byteSize_);
+		forEachPiece([&](Span span) {
+			str.append(span.begin, span.size());
+		});
+		return str;
+	}
+
+private:
+	struct Entry {
+		TapeEntry tape;
+
+		// The number of containers the value is in
+		uint32_t depth;
+	};
+
+	// The offsets and 'next' indexes of a block's entries are off by
+	// 'offsetDelta' and 'nextDelta', which edits before the block update.
+	struct Block {
+		std::vector<Entry> entries;
+		uint64_t offsetDelta = 0;
+		uint64_t nextDelta = 0;
+		uint32_t minDepth = 0;
+	};
+
+	struct Piece {
+		const char *data;
+		uint64_t size;
+	};
+
+	static constexpr size_t BLOCK_SIZE = 4096;
+
+	// Add depths to the entries of a tape whose first value is at 'depth',
+	// and move them to 'offset' and 'index'.
+	static std::vector<Entry> withDepths(
+			const std::vector<TapeEntry> &tape, uint32_t depth, uint64_t offset, size_t index) {
+		std::vector<Entry> entries;
+		entries.reserve(tape.size());
+		std::vector<uint64_t> ends;
+		for (size_t i = 0; i < tape.size(); ++i) {
+			while (!ends.empty() && ends.back() <= i) {
+				ends.pop_back();
+			}
+
+			Entry e{tape[i], depth + (uint32_t)ends.size()};
+			e.tape.offset += offset;
+			e.tape.next += index;
+			entries.push_back(e);
+			ends.push_back(tape[i].next);
+		}
+
+		return entries;
+	}
+
+	static std::vector<Block> splitBlocks(const std::vector<Entry> &entries) {
+		std::vector<Block> blocks;
+		size_t chunk = entries.size() <= BLOCK_SIZE * 2 ? BLOCK_SIZE * 2 : BLOCK_SIZE;
+		for (size_t i = 0; i < entries.size(); i += chunk) {
+			Block block;
+			size_t n = std::min(chunk, entries.size() - i);
+			block.entries.assign(entries.begin() + i, entries.begin() + i + n);
+			block.minDepth = std::min_element(
+				block.entries.begin(), block.entries.end(),
+				[](const Entry &a, const Entry &b) { return a.depth < b.depth; })->depth;
+			blocks.push_back(std::move(block));
+		}
+
+		return blocks;
+	}
+
+	void updateBlockStarts(size_t from) {
+		blockStarts_.resize(blocks_.size());
+		size_t start = from == 0 ? 0 : blockStarts_[from - 1] + blocks_[from - 1].entries.size();
+		for (size_t b = from; b < blocks_.size(); ++b) {
+			blockStarts_[b] = start;
+			start += blocks_[b].entries.size();
+		}
+	}
+
+	void updatePieceStarts() {
+		pieceStarts_.resize(pieces_.size());
+		uint64_t start = 0;
+		for (size_t i = 0; i < pieces_.size(); ++i) {
+			pieceStarts_[i] = start;
+			start += pieces_[i].size;
+		}
+	}
+
+	size_t blockOf(size_t index) const {
+		return std::upper_bound(blockStarts_.begin(), blockStarts_.end(), index) -
+			blockStarts_.begin() - 1;
+	}
+
+	size_t pieceAt(uint64_t offset) const {
+		return std::upper_bound(pieceStarts_.begin(), pieceStarts_.end(), offset) -
+			pieceStarts_.begin() - 1;
+	}
+
+	Entry get(size_t index) const {
+		const Block &block = blocks_[blockOf(index)];
+		Entry e = block.entries[index - blockStarts_[blockOf(index)]];
+		e.tape.offset += block.offsetDelta;
+		e.tape.next += block.nextDelta;
+		return e;
+	}
+
+	void set(size_t index, Entry e) {
+		size_t b = blockOf(index);
+		Block &block = blocks_[b];
+		e.tape.offset -= block.offsetDelta;
+		e.tape.next -= block.nextDelta;
+		block.entries[index - blockStarts_[b]] = e;
+	}
+
+	// The index of the first value at or after 'offset'
+	size_t lowerBound(uint64_t offset) const {
+		auto blockIt = std::partition_point(blocks_.begin(), blocks_.end(), [&](const Block &block) {
+			return block.entries.back().tape.offset + block.offsetDelta < offset;
+		});
+		if (blockIt == blocks_.end()) {
+			return count_;
+		}
+
+		const Block &block = *blockIt;
+		auto it = std::partition_point(block.entries.begin(), block.entries.end(), [&](const Entry &e) {
+			return e.tape.offset + block.offsetDelta < offset;
+		});
+		return blockStarts_[blockIt - blocks_.begin()] + (it - block.entries.begin());
+	}
+
+	// The index of the container of the value at 'index', which is the
+	// closest value before it with a smaller depth. Blocks without any
+	// smaller depths are skipped.
+	size_t parent(size_t index) const {
+		size_t b = blockOf(index);
+		uint32_t depth = blocks_[b].entries[index - blockStarts_[b]].depth;
+		size_t i = index - blockStarts_[b];
+		while (true) {
+			const Block &block = blocks_[b];
+			if (block.minDepth < depth) {
+				while (i > 0) {
+					i -= 1;
+					if (block.entries[i].depth < depth) {
+						return blockStarts_[b] + i;
+					}
+				}
+			}
+
+			b -= 1;
+			i = blocks_[b].entries.size();
+		}
+	}
+
+	// Whether [offset, end) is a run of whole children of the value 'val'
+	bool replacesChildren(const Entry &val, size_t idx, uint64_t offset, uint64_t end) const {
+		std::string scratch;
+		char open = *read(val.tape.offset, 1, scratch).begin;
+		return (open == '[' || open == '{') &&
+			offset > val.tape.offset && end < val.tape.offset + val.tape.length &&
+			isBoundary(val, idx, open, offset) && isBoundary(val, idx, open, end);
+	}
+
+	// Whether 'offset', inside the container 'val', is where one of its
+	// children (including its key) starts, or where the container ends.
+	bool isBoundary(const Entry &val, size_t idx, char open, uint64_t offset) const {
+		if (offset == val.tape.offset + val.tape.length - 1) {
+			return true;
+		}
+
+		size_t i = lowerBound(offset);
+		if (i >= val.tape.next || i <= idx) {
+			return false;
+		}
+
+		Entry child = get(i);
+		uint64_t start = child.tape.offset;
+		if (open == '{') {
+			start -= child.tape.keyLen + 1;
+		}
+		return child.depth == val.depth + 1 && start == offset;
+	}
+
+	void splicePieces(uint64_t offset, uint64_t length, std::string_view bytes) {
+		Piece inserted{nullptr, bytes.size()};
+		if (!bytes.empty()) {
+			inserted.data = added_.store(bytes).data();
+		}
+
+		uint64_t end = offset + length;
+		std::vector<Piece> pieces;
+		pieces.reserve(pieces_.size() + 2);
+		auto add = [&](Piece piece) {
+			if (piece.size > 0) {
+				pieces.push_back(piece);
+			}
+		};
+
+		bool done = false;
+		uint64_t pos = 0;
+		for (auto &piece: pieces_) {
+			uint64_t begin = pos;
+			pos += piece.size;
+			if (begin < offset) {
+				add({piece.data, std::min(pos, offset) - begin});
+			}
+			if (!done && pos >= offset) {
+				add(inserted);
+				done = true;
+			}
+			if (pos > end) {
+				uint64_t from = std::max(begin, end);
+				add({piece.data + (from - begin), pos - from});
+			}
+		}
+		if (!done) {
+			add(inserted);
+		}
+
+		pieces_ = std::move(pieces);
+		byteSize_ = byteSize_ - length + bytes.size();
+		updatePieceStarts();
+	}
+
+	// Replace the entries [first, after) with 'entries'.
+	void replaceEntries(
+			size_t first, size_t after, std::vector<Entry> entries,
+			int64_t byteDelta, int64_t entryDelta) {
+		size_t firstBlock = first < count_ ? blockOf(first) : blocks_.size() - 1;
+		size_t lastBlock = after > first ? blockOf(after - 1) : firstBlock;
+		for (size_t b = firstBlock; b <= lastBlock; ++b) {
+			normalize(blocks_[b]);
+		}
+
+		const auto &head = blocks_[firstBlock].entries;
+		std::vector<Entry> merged(head.begin(), head.begin() + (first - blockStarts_[firstBlock]));
+		merged.insert(merged.end(), entries.begin(), entries.end());
+
+		const auto &tail = blocks_[lastBlock].entries;
+		for (size_t i = after - blockStarts_[lastBlock]; i < tail.size(); ++i) {
+			Entry e = tail[i];
+			e.tape.offset += byteDelta;
+			e.tape.next += entryDelta;
+			merged.push_back(e);
+		}
+
+		std::vector<Block> replacement = splitBlocks(merged);
+		blocks_.erase(blocks_.begin() + firstBlock, blocks_.begin() + lastBlock + 1);
+		blocks_.insert(blocks_.begin() + firstBlock,
+			std::make_move_iterator(replacement.begin()), std::make_move_iterator(replacement.end()));
+
+		for (size_t b = firstBlock + replacement.size(); b < blocks_.size(); ++b) {
+			blocks_[b].offsetDelta += byteDelta;
+			blocks_[b].nextDelta += entryDelta;
+		}
+
+		count_ += entryDelta;
+		updateBlockStarts(firstBlock);
+	}
+
+	static void normalize(Block &block) {
+		for (auto &e: block.entries) {
+			e.tape.offset += block.offsetDelta;
+			e.tape.next += block.nextDelta;
+		}
+
+		block.offsetDelta = 0;
+		block.nextDelta = 0;
+	}
+
+	std::vector<Piece> pieces_;
+	std::vector<uint64_t> pieceStarts_;
+	uint64_t byteSize_ = 0;
+	detail::StringArena added_;
+
+	std::vector<Block> blocks_;
+	std::vector<size_t> blockStarts_;
+	size_t count_ = 0;
+
+	friend class EditValue;
+};
+
+inline Type EditValue::getType() const {
+	std::string scratch;
+	return RawValue(doc_->read(entry_.offset, 1, scratch)).getType();
+}
+
+inline std::string EditValue::key() const {
+	std::string scratch;
+	if (entry_.keyLen == 0) {
+		return {};
+	}
+
+	Span span = doc_->read(entry_.offset - entry_.keyLen - 1, entry_.keyLen, scratch);
+	return std::string(span.begin, span.size());
+}
+
+inline size_t EditValue::size() const {
+	if (entry_.count > 0) {
+		return entry_.count;
+	}
+
+	std::string scratch;
+	Span span = doc_->read(entry_.offset, std::min<uint64_t>(entry_.length, 11), scratch);
+	if (*span.begin != '#') {
+		return 0;
+	}
+
+	const char *p = span.begin + 1;
+	return (size_t)detail::readLEB128(p, span.end);
+}
+
+inline RawValue EditValue::raw(std::string &scratch) const {
+	return RawValue(doc_->read(entry_.offset, entry_.length, scratch));
+}
+
+inline EditValue EditValue::at(size_t index) const {
+	if (index >= entry_.count) {
+		return {};
+	}
+
+	size_t child = index_ + 1;
+	for (size_t i = 0; i < index; ++i) {
+		child = doc_->get(child).tape.next;
+	}
+	return doc_->value(child);
+}
+
+inline EditValue EditValue::get(std::string_view key) const {
+	if (getType() != Type::OBJECT) {
+		return {};
+	}
+
+	std::string scratch;
+	size_t child = index_ + 1;
+	for (size_t i = 0; i < entry_.count; ++i) {
+		TapeEntry e = doc_->get(child).tape;
+		if (e.keyLen == key.size() &&
+				doc_->read(e.offset - e.keyLen - 1, e.keyLen, scratch).view() == key) {
+			return EditValue(doc_, child, e);
+		}
+		child = e.next;
+	}
+	return {};
+}
+
+template<typename Func>
+inline void EditValue::forEachChild(Func func) const {
+	size_t child = index_ + 1;
+	for (size_t i = 0; i < entry_.count; ++i) {
+		EditValue val = doc_->value(child);
+		func(val);
+		child = val.entry_.next;
+	}
+}
+
+inline EditValue EditValue::find(std::string_view path) const {
+	EditValue val = *this;
+	while (val && !path.empty()) {
+		size_t dot = path.find('.');
+		std::string_view comp = path.substr(0, dot);
+		path = dot == std::string_view::npos ? std::string_view() : path.substr(dot + 1);
+
+		Type type = val.getType();
+		if (type == Type::OBJECT) {
+			val = val.get(comp);
+		} else if (type == Type::ARRAY) {
+			size_t index = 0;
+			auto res = std::from_chars(comp.data(), comp.data() + comp.size(), index);
+			if (res.ec != std::errc() || res.ptr != comp.data() + comp.size()) {
+				return {};
+			}
+			val = val.at(index);
+		} else {
+			return {};
+		}
+	}
+	return val;
+}
+
+}
+
+#endif
@@ -0,0 +1,449 @@
+#ifndef SBON_FILTER_H
+#define SBON_FILTER_H
+
+// Record filtering with expressions like:
+//
+//     status >= 500 && path ~ "/api/"
+//
+// Supported operators, from lowest to highest precedence:
+// '||', '&&', '!', and the comparisons '==', '!=', '<', '<=', '>', '>='
+// and '~' (substring match). Parentheses group sub-expressions.
+// The left hand side of a comparison is a dot-separated key path,
+// and the right hand side is a number, a double-quoted string,
+// 'true', 'false' or 'null'. A bare key path is true when the key exists.
+//
+// Comparisons against keys which are missing from a record are false.
+// Records are only read until the outcome of the expression is known.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sbon {
+
+class FilterError: public std::exception {
+public:
+	FilterError(const char *str, size_t pos) {
+		str_ = "SBON filter error at column ";
+		str_ += std::to_string(pos + 1);
+		str_ += ": ";
+		str_ += str;
+	}
+
+	const char *what() const noexcept override {
+		return str_.c_str();
+	}
+
+private:
+	std::string str_;
+};
+
+class Filter {
+public:
+	explicit Filter(std::string_view expr): src_(expr) {
+		root_ = parseOr();
+		skipSpace();
+		if (pos_ != src_.size()) {
+			throw FilterError("Unexpected trailing characters", pos_);
+		}
+
+		// The expression belongs to the caller
+		src_ = {};
+	}
+
+	// Check whether one record matches.
+	// The record has to be a complete value, such as a Span from forEachRecord.
+	bool matches(Span record) const {
+		// Each comparison is either unknown, true or false,
+		// tracked in the 'known' and 'value' bitmasks.
+		uint64_t known = 0;
+		uint64_t value = 0;
+		if (decided(root_, known, value)) {
+			return evaluate(root_, known, value) == TRUE;
+		}
+
+		paths_.visit(record, [&](size_t pathID, RawValue val) {
+			for (size_t i = 0; i < leaves_.size(); ++i) {
+				if (leaves_[i].path == pathID) {
+					known |= 1ull << i;
+					if (compare(leaves_[i], val)) {
+						value |= 1ull << i;
+					}
+				}
+			}
+
+			return !decided(root_, known, value);
+		});
+
+		// Everything which is still unknown refers to a missing key
+		return evaluate(root_, ~(uint64_t)0, value) == TRUE;
+	}
+
+private:
+	enum class Op {
+		EXISTS, EQ, NEQ, LT, LE, GT, GE, CONTAINS,
+	};
+
+	enum class LiteralType {
+		NIL, BOOL, INT, DOUBLE, STRING,
+	};
+
+	struct Leaf {
+		size_t path;
+		Op op;
+		LiteralType type;
+		bool b = false;
+		int64_t i = 0;
+		double d = 0;
+		std::string str;
+	};
+
+	enum class NodeType {
+		LEAF, NOT, AND, OR,
+	};
+
+	struct Node {
+		NodeType type;
+		size_t a = 0;
+		size_t b = 0;
+	};
+
+	enum Tristate {
+		UNKNOWN, FALSE, TRUE,
+	};
+
+	Tristate evaluate(size_t idx, uint64_t known, uint64_t value) const {
+		const Node &node = nodes_[idx];
+		switch (node.type) {
+		case NodeType::LEAF:
+			if (!(known & (1ull << node.a))) {
+				return UNKNOWN;
+			}
+			return value & (1ull << node.a) ? TRUE : FALSE;
+
+		case NodeType::NOT: {
+			Tristate t = evaluate(node.a, known, value);
+			return t == UNKNOWN ? UNKNOWN : t == TRUE ? FALSE : TRUE;
+		}
+
+		case NodeType::AND: {
+			Tristate l = evaluate(node.a, known, value);
+			if (l == FALSE) {
+				return FALSE;
+			}
+			Tristate r = evaluate(node.b, known, value);
+			if (r == FALSE) {
+				return FALSE;
+			}
+			return l == TRUE && r == TRUE ? TRUE : UNKNOWN;
+		}
+
+		case NodeType::OR: {
+			Tristate l = evaluate(node.a, known, value);
+			if (l == TRUE) {
+				return TRUE;
+			}
+			Tristate r = evaluate(node.b, known, value);
+			if (r == TRUE) {
+				return TRUE;
+			}
+			return l == FALSE && r == FALSE ? FALSE : UNKNOWN;
+		}
+		}
+
+		return UNKNOWN;
+	}
+
+	bool decided(size_t idx, uint64_t known, uint64_t value) const {
+		return evaluate(idx, known, value) != UNKNOWN;
+	}
+
+	template<typename T>
+	static bool compareOrdered(Op op, const T &a, const T &b) {
+		switch (op) {
+		case Op::EQ: return a == b;
+		case Op::NEQ: return a != b;
+		case Op::LT: return a < b;
+		case Op::LE: return a <= b;
+		case Op::GT: return a > b;
+		case Op::GE: return a >= b;
+		default: return false;
+		}
+	}
+
+	static bool compare(const Leaf &leaf, RawValue val) {
+		if (leaf.op == Op::EXISTS) {
+			return true;
+		}
+
+		Type type = val.getType();
+		switch (leaf.type) {
+		case LiteralType::NIL:
+			if (leaf.op == Op::EQ) {
+				return type == Type::NIL;
+			} else if (leaf.op == Op::NEQ) {
+				return type != Type::NIL;
+			}
+			return false;
+
+		case LiteralType::BOOL:
+			if (type != Type::BOOL) {
+				return leaf.op == Op::NEQ;
+			}
+			return compareOrdered(leaf.op, val.getBool(), leaf.b);
+
+		case LiteralType::STRING:
+			if (type != Type::STRING) {
+				return leaf.op == Op::NEQ;
+			} else if (leaf.op == Op::CONTAINS) {
+				return val.getString().find(leaf.str) != std::string_view::npos;
+			}
+			return compareOrdered(leaf.op, val.getString(), std::string_view(leaf.str));
+
+		case LiteralType::INT:
+		case LiteralType::DOUBLE:
+			if (leaf.op == Op::CONTAINS) {
+				return false;
+			} else if (type == Type::INT) {
+				if (leaf.type == LiteralType::INT) {
+					return compareOrdered(leaf.op, val.getInt(), leaf.i);
+				}
+				return compareOrdered(leaf.op, (double)val.getInt(), leaf.d);
+			} else if (type == Type::UINT) {
+				uint64_t u = val.getUInt();
+				if (leaf.type == LiteralType::INT && u <= (uint64_t)INT64_MAX) {
+					return compareOrdered(leaf.op, (int64_t)u, leaf.i);
+				}
+				return compareOrdered(leaf.op, (double)u, leaf.d);
+			} else if (type == Type::FLOAT || type == Type::DOUBLE) {
+				double d = type == Type::FLOAT ? val.getFloat() : val.getDouble();
+				return compareOrdered(leaf.op, d, leaf.d);
+			}
+			return leaf.op == Op::NEQ;
+		}
+
+		return false;
+	}
+
+	void skipSpace() {
+		while (pos_ < src_.size() && (
+				src_[pos_] == ' ' || src_[pos_] == '\t' ||
+				src_[pos_] == '\n' || src_[pos_] == '\r')) {
+			pos_ += 1;
+		}
+	}
+
+	bool eat(std::string_view tok) {
+		skipSpace();
+		if (src_.substr(pos_, tok.size()) == tok) {
+			pos_ += tok.size();
+			return true;
+		}
+
+		return false;
+	}
+
+	size_t addNode(NodeType type, size_t a, size_t b = 0) {
+		nodes_.push_back({type, a, b});
+		return nodes_.size() - 1;
+	}
+
+	size_t parseOr() {
+		size_t lhs = parseAnd();
+		while (eat("||")) {
+			size_t rhs = parseAnd();
+			lhs = addNode(NodeType::OR, lhs, rhs);
+		}
+
+		return lhs;
+	}
+
+	size_t parseAnd() {
+		size_t lhs = parseUnary();
+		while (eat("&&")) {
+			size_t rhs = parseUnary();
+			lhs = addNode(NodeType::AND, lhs, rhs);
+		}
+
+		return lhs;
+	}
+
+	size_t parseUnary() {
+		skipSpace();
+		if (pos_ + 1 < src_.size() && src_[pos_] == '!' && src_[pos_ + 1] != '=') {
+			pos_ += 1;
+			return addNode(NodeType::NOT, parseUnary());
+		}
+
+		if (eat("(")) {
+			size_t node = parseOr();
+			if (!eat(")")) {
+				throw FilterError("Expected ')'", pos_);
+			}
+
+			return node;
+		}
+
+		return parseComparison();
+	}
+
+	static bool isPathChar(char ch) {
+		return
+			(ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+			(ch >= '0' && ch <= '9') || ch == '_' || ch == '-' || ch == '.';
+	}
+
+	size_t parseComparison() {
+		skipSpace();
+		size_t start = pos_;
+		while (pos_ < src_.size() && isPathChar(src_[pos_])) {
+			pos_ += 1;
+		}
+
+		if (pos_ == start) {
+			throw FilterError("Expected key path", pos_);
+		}
+
+		if (leaves_.size() >= 64) {
+			throw FilterError("Too many comparisons", start);
+		}
+
+		Leaf leaf;
+		leaf.path = paths_.add(src_.substr(start, pos_ - start));
+
+		if (eat("==")) {
+			leaf.op = Op::EQ;
+		} else if (eat("!=")) {
+			leaf.op = Op::NEQ;
+		} else if (eat("<=")) {
+			leaf.op = Op::LE;
+		} else if (eat(">=")) {
+			leaf.op = Op::GE;
+		} else if (eat("<")) {
+			leaf.op = Op::LT;
+		} else if (eat(">")) {
+			leaf.op = Op::GT;
+		} else if (eat("~")) {
+			leaf.op = Op::CONTAINS;
+		} else {
+			leaf.op = Op::EXISTS;
+			leaf.type = LiteralType::NIL;
+		}
+
+		if (leaf.op != Op::EXISTS) {
+			parseLiteral(leaf);
+			if (leaf.op == Op::CONTAINS && leaf.type != LiteralType::STRING) {
+				throw FilterError("'~' requires a string", pos_);
+			}
+		}
+
+		leaves_.push_back(std::move(leaf));
+		return addNode(NodeType::LEAF, leaves_.size() - 1);
+	}
+
+	void parseLiteral(Leaf &leaf) {
+		skipSpace();
+		if (eat("true")) {
+			leaf.type = LiteralType::BOOL;
+			leaf.b = true;
+		} else if (eat("false")) {
+			leaf.type = LiteralType::BOOL;
+			leaf.b = false;
+		} else if (eat("null")) {
+			leaf.type = LiteralType::NIL;
+		} else if (eat("\"")) {
+			leaf.type = LiteralType::STRING;
+			while (true) {
+				if (pos_ >= src_.size()) {
+					throw FilterError("Unterminated string", pos_);
+				}
+
+				char ch = src_[pos_++];
+				if (ch == '"') {
+					break;
+				} else if (ch == '\\' && pos_ < src_.size()) {
+					ch = src_[pos_++];
+				}
+
+				leaf.str += ch;
+			}
+		} else {
+			size_t start = pos_;
+			while (pos_ < src_.size() && (
+					(src_[pos_] >= '0' && src_[pos_] <= '9') ||
+					src_[pos_] == '-' || src_[pos_] == '+' || src_[pos_] == '.' ||
+					src_[pos_] == 'e' || src_[pos_] == 'E')) {
+				pos_ += 1;
+			}
+
+			std::string num(src_.substr(start, pos_ - start));
+			if (num.empty()) {
+				throw FilterError("Expected literal", start);
+			}
+
+			size_t len = 0;
+			try {
+				leaf.d = std::stod(num, &len);
+			} catch (std::exception &) {
+				len = 0;
+			}
+
+			if (len != num.size()) {
+				throw FilterError("Invalid number", start);
+			}
+
+			if (num.find_first_of(".eE") == std::string::npos) {
+				leaf.type = LiteralType::INT;
+				const char *begin = num.data() + (num[0] == '+');
+				auto res = std::from_chars(begin, num.data() + num.size(), leaf.i);
+				if (res.ec != std::errc() || res.ptr != num.data() + num.size()) {
+					throw FilterError("Integer out of range", start);
+				}
+			} else {
+				leaf.type = LiteralType::DOUBLE;
+			}
+		}
+	}
+
+	// The expression, while it's parsed
+	std::string_view src_;
+	size_t pos_ = 0;
+
+	PathSet paths_;
+	std::vector<Leaf> leaves_;
+	std::vector<Node> nodes_;
+	size_t root_ = 0;
+};
+
+// Find all records in 'input' which match 'filter', using up to 'threads' threads.
+// The returned spans point into 'input' and are in input order.
+inline std::vector<Span> filterRecords(
+		const Filter &filter, Span input, unsigned threads = defaultThreads()) {
+	// Use more chunks than threads so that uneven chunks even out
+	std::vector<Span> chunks = splitChunks(input, threads > 1 ? threads * 4 : 1);
+	std::vector<std::vector<Span>> results(chunks.size());
+
+	parallelFor(chunks.size(), threads, [&](size_t i) {
+		forEachRecord(chunks[i], [&](Span rec) {
+			if (filter.matches(rec)) {
+				results[i].push_back(rec);
+			}
+		});
+	});
+
+	std::vector<Span> matches;
+	for (auto &res: results) {
+		matches.insert(matches.end(), res.begin(), res.end());
+	}
+
+	return matches;
+}
+
+}
+
+#endif
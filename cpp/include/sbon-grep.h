@@ -0,0 +1,350 @@
+#ifndef SBON_GREP_H
+#define SBON_GREP_H
+
+// Searching the string values (and optionally the keys) of records.
+// Binary data and numbers are never searched, so there are no false positives
+// from bytes which happen to look like text; binaries are skipped by
+// jumping over them using their length.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// GCC 12 warns at -O2 that std::function members of the states which
+// std::regex's compiler copies may be used uninitialized. The warning is a
+// false positive inside libstdc++, so it's silenced for
+// the <regex> header only.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <regex>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace sbon {
+
+// Find the first occurrence of 'needle' in 'hay'.
+// With SSE2, 16 candidate positions are checked at a time by comparing
+// both the first and last byte of the needle, and only positions where
+// both match are verified with memcmp.
+inline const char *findSubstring(std::string_view hay, std::string_view needle) {
+	size_t n = hay.size();
+	size_t m = needle.size();
+	if (m == 0) {
+		return hay.data();
+	} else if (m > n) {
+		return nullptr;
+	} else if (m == 1) {
+		return (const char *)std::memchr(hay.data(), needle[0], n);
+	}
+
+	const char *h = hay.data();
+	size_t i = 0;
+
+#ifdef __SSE2__
+	__m128i first = _mm_set1_epi8(needle[0]);
+	__m128i last = _mm_set1_epi8(needle[m - 1]);
+	for (; i + m - 1 + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(h + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(h + i + m - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+		while (mask) {
+			int bit = __builtin_ctz(mask);
+			if (std::memcmp(h + i + bit + 1, needle.data() + 1, m - 2) == 0) {
+				return h + i + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	for (; i + m <= n; ++i) {
+		if (h[i] == needle[0] && std::memcmp(h + i, needle.data(), m) == 0) {
+			return h + i;
+		}
+	}
+
+	return nullptr;
+}
+
+// A search pattern: either a literal substring or a regular expression.
+// Regular expressions are prefiltered with their longest literal substring,
+// so the regex engine only runs on strings which might match.
+class GrepPattern {
+public:
+	static GrepPattern literal(std::string str) {
+		GrepPattern pat;
+		pat.literal_ = std::move(str);
+		return pat;
+	}
+
+	static GrepPattern regex(const std::string &str) {
+		GrepPattern pat;
+		pat.regex_ = std::regex(str, std::regex::ECMAScript | std::regex::optimize);
+		pat.isRegex_ = true;
+		pat.literal_ = requiredLiteral(str);
+		return pat;
+	}
+
+	bool matches(std::string_view str) const {
+		if (!findSubstring(str, literal_)) {
+			return false;
+		} else if (!isRegex_) {
+			return true;
+		}
+
+		return std::regex_search(str.begin(), str.end(), regex_);
+	}
+
+	// The literal which every match must contain; may be empty.
+	const std::string &prefilter() const {
+		return literal_;
+	}
+
+private:
+	// The number of characters in the escape sequence at the start of 'esc',
+	// after its backslash.
+	static size_t escapeLength(std::string_view esc) {
+		if (esc.empty()) {
+			return 0;
+		}
+
+		auto isHex = [](int ch) { return std::isxdigit(ch) != 0; };
+		auto count = [&](size_t max, auto isValid) {
+			size_t len = 1;
+			while (len < esc.size() && len <= max && isValid((unsigned char)esc[len])) {
+				len += 1;
+			}
+			return len;
+		};
+
+		switch (esc[0]) {
+		case 'x':
+			return count(2, isHex);
+		case 'u':
+			return count(4, isHex);
+		case 'c':
+			return std::min<size_t>(esc.size(), 2);
+		default:
+			// Backreferences, and octal escapes such as '\0'
+			if (esc[0] >= '0' && esc[0] <= '9') {
+				return count(SIZE_MAX, [](int ch) { return std::isdigit(ch) != 0; });
+			}
+			return 1;
+		}
+	}
+
+	// Find the longest run of plain characters which every match has to contain.
+	// This is conservative: any alternation disables the prefilter,
+	// and a character followed by a quantifier isn't required.
+	static std::string requiredLiteral(std::string_view re) {
+		if (re.find('|') != std::string_view::npos) {
+			return "";
+		}
+
+		std::string best;
+		std::string cur;
+		int depth = 0;
+		for (size_t i = 0; i < re.size(); ++i) {
+			char ch = re[i];
+			char next = i + 1 < re.size() ? re[i + 1] : '\0';
+			bool quantified = next == '*' || next == '?' || next == '{' || next == '+';
+
+			if (ch == '(' || ch == '[' || ch == '{') {
+				depth += 1;
+			} else if ((ch == ')' || ch == ']' || ch == '}') && depth > 0) {
+				depth -= 1;
+				quantified = true;
+			}
+
+			bool plain = depth == 0 && !std::strchr("\\^$.*+?()[]{}", ch);
+			if (plain && !quantified) {
+				cur += ch;
+			} else {
+				if (plain && next == '+') {
+					// 'x+' still requires one 'x'
+					cur += ch;
+				}
+				if (cur.size() > best.size()) {
+					best = cur;
+				}
+				cur.clear();
+
+				// Skip the whole escape sequence, which isn't part of any literal
+				if (ch == '\\') {
+					i += escapeLength(re.substr(i + 1));
+				}
+			}
+		}
+
+		if (cur.size() > best.size()) {
+			best = cur;
+		}
+
+		return best;
+	}
+
+	std::string literal_;
+	std::regex regex_;
+	bool isRegex_ = false;
+};
+
+struct GrepMatch {
+	// The index of the record in the input
+	size_t record;
+
+	// The dot-separated path to the matching value, or to the value of the matching key
+	std::string path;
+
+	// The matching string
+	std::string_view text;
+
+	// Whether the match is in a key rather than a string value
+	bool isKey;
+};
+
+namespace detail {
+
+class GrepWalker {
+public:
+	GrepWalker(const GrepPattern &pat, bool keys, std::vector<GrepMatch> &out):
+		pat_(pat), keys_(keys), out_(out) {}
+
+	void walk(size_t record, Span rec) {
+		record_ = record;
+		path_.clear();
+		walkValue(rec.begin, rec.end);
+	}
+
+private:
+	// A path component is either an object key or an array index.
+	struct PathComponent {
+		std::string_view key;
+		size_t index;
+	};
+
+	std::string pathString() const {
+		std::string path;
+		for (auto &comp: path_) {
+			if (!path.empty()) {
+				path += '.';
+			}
+
+			if (comp.key.data()) {
+				path += comp.key;
+			} else {
+				path += std::to_string(comp.index);
+			}
+		}
+		return path;
+	}
+
+	const char *walkValue(const char *p, const char *end) {
+		detail::checkAvail(p, end, 1);
+		char ch = *p;
+		if (ch == 'S') {
+			const char *strEnd = detail::skipCString(p + 1, end);
+			std::string_view str(p + 1, strEnd - p - 2);
+			if (pat_.matches(str)) {
+				out_.push_back({record_, pathString(), str, false});
+			}
+			return strEnd;
+		} else if (ch == '[') {
+			p += 1;
+			size_t index = 0;
+			while (true) {
+				detail::checkAvail(p, end, 1);
+				if (*p == ']') {
+					return p + 1;
+				}
+
+				path_.push_back({{}, index++});
+				p = walkValue(p, end);
+				path_.pop_back();
+			}
+		} else if (ch == '{') {
+			p += 1;
+			while (true) {
+				detail::checkAvail(p, end, 1);
+				if (*p == '}') {
+					return p + 1;
+				}
+
+				const char *valp = detail::skipCString(p, end);
+				std::string_view key(p, valp - p - 1);
+				path_.push_back({key, 0});
+				if (keys_ && pat_.matches(key)) {
+					out_.push_back({record_, pathString(), key, true});
+				}
+
+				p = walkValue(valp, end);
+				path_.pop_back();
+			}
+		} else {
+			// Numbers, booleans, null and binaries are skipped without looking at them
+			return skipValue(p, end);
+		}
+	}
+
+	const GrepPattern &pat_;
+	bool keys_;
+	std::vector<GrepMatch> &out_;
+	size_t record_ = 0;
+	std::vector<PathComponent> path_;
+};
+
+}
+
+// Search all records in 'input', using up to 'threads' threads.
+// If 'keys' is true, object keys are searched too.
+// Matches are returned in input order.
+inline std::vector<GrepMatch> grepRecords(
+		const GrepPattern &pat, Span input, bool keys = false,
+		unsigned threads = defaultThreads()) {
+	std::vector<Span> chunks = splitChunks(input, threads > 1 ? threads * 4 : 1);
+	std::vector<std::vector<GrepMatch>> results(chunks.size());
+	std::vector<size_t> recordCounts(chunks.size());
+
+	parallelFor(chunks.size(), threads, [&](size_t i) {
+		detail::GrepWalker walker(pat, keys, results[i]);
+		size_t index = 0;
+		forEachRecord(chunks[i], [&](Span rec) {
+			// Skip records which can't contain a match at all
+			if (findSubstring(rec.view(), pat.prefilter())) {
+				walker.walk(index, rec);
+			}
+			index += 1;
+		});
+		recordCounts[i] = index;
+	});
+
+	std::vector<GrepMatch> matches;
+	size_t base = 0;
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		for (auto &match: results[i]) {
+			match.record += base;
+			matches.push_back(std::move(match));
+		}
+		base += recordCounts[i];
+	}
+
+	return matches;
+}
+
+}
+
+#endif
@@ -0,0 +1,996 @@
+#ifndef SBON_INFER_H
+#define SBON_INFER_H
+
+// Inferring a schema from a corpus of records, and generating C++ structs
+// with decoders and encoders for it.
+//
+// For every value position (the records, each object key, and the elements
+// of each array), inference counts the value types seen and tracks numeric
+// ranges and lengths. For objects, it counts how often each key is present
+// and which key orders occur. Chunks of the corpus are inferred in parallel
+// and merged.
+//
+// The generated decoders read members in the corpus's most common key order
+// with a single key comparison each, and fall back to looking the key up
+// when the order differs.
+
+#include "sbon.h"
+#include "sbon-records.h"
+#include "sbon-schema.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace sbon {
+
+// What was seen at one value position of the corpus.
+struct InferredValue {
+	struct Member {
+		std::string key;
+
+		// The number of objects the key was present in
+		uint64_t present = 0;
+
+		std::unique_ptr<InferredValue> value;
+	};
+
+	// The number of values seen, and how many of each type
+	uint64_t count = 0;
+	uint64_t nulls = 0;
+	uint64_t bools = 0;
+	uint64_t ints = 0;
+	uint64_t floats = 0;
+	uint64_t strings = 0;
+	uint64_t binaries = 0;
+	uint64_t arrays = 0;
+	uint64_t objects = 0;
+
+	// The range of numbers. Integers above INT64_MAX are only counted in 'bigUInts'.
+	int64_t minInt = std::numeric_limits<int64_t>::max();
+	int64_t maxInt = std::numeric_limits<int64_t>::min();
+	uint64_t bigUInts = 0;
+	double minNumber = std::numeric_limits<double>::infinity();
+	double maxNumber = -std::numeric_limits<double>::infinity();
+
+	// The range of string and binary lengths in bytes, and of array sizes
+	uint64_t minLength = UINT64_MAX;
+	uint64_t maxLength = 0;
+	uint64_t minItems = UINT64_MAX;
+	uint64_t maxItems = 0;
+
+	// What was seen in arrays' elements
+	std::unique_ptr<InferredValue> items;
+
+	// Objects' keys, in the order they were first seen
+	std::vector<Member> members;
+
+	// The key orders seen, as the NUL-separated keys, with how often they
+	// were seen. Once there are MAX_ORDERS, other orders are only counted.
+	std::vector<std::pair<std::string, uint64_t>> orders;
+	uint64_t otherOrders = 0;
+
+	static constexpr size_t MAX_ORDERS = 16;
+
+	void add(RawValue val) {
+		count += 1;
+		switch (val.getType()) {
+		case Type::NIL:
+			nulls += 1;
+			break;
+		case Type::BOOL:
+			bools += 1;
+			break;
+		case Type::STRING:
+			strings += 1;
+			addLength(val.getString().size());
+			break;
+		case Type::BINARY:
+			binaries += 1;
+			addLength(val.getBinary().size());
+			break;
+		case Type::FLOAT:
+		case Type::DOUBLE:
+			floats += 1;
+			addNumber(val.getDouble());
+			break;
+		case Type::INT:
+			ints += 1;
+			addInt(val.getInt());
+			break;
+		case Type::UINT: {
+			ints += 1;
+			uint64_t num = val.getUInt();
+			if (num > (uint64_t)std::numeric_limits<int64_t>::max()) {
+				bigUInts += 1;
+				addNumber((double)num);
+			} else {
+				addInt((int64_t)num);
+			}
+			break;
+		}
+		case Type::ARRAY: {
+			arrays += 1;
+			uint64_t size = 0;
+			val.forEachElement([&](RawValue el) {
+				if (!items) {
+					items = std::make_unique<InferredValue>();
+				}
+				items->add(el);
+				size += 1;
+			});
+			minItems = std::min(minItems, size);
+			maxItems = std::max(maxItems, size);
+			break;
+		}
+		case Type::OBJECT: {
+			objects += 1;
+			std::string order;
+			size_t pos = 0;
+			val.forEachMember([&](std::string_view key, RawValue member) {
+				order += key;
+				order += '\0';
+				Member &m = memberFor(key, pos++);
+				m.present += 1;
+				m.value->add(member);
+			});
+			addOrder(order, 1);
+			break;
+		}
+		}
+	}
+
+	void merge(const InferredValue &other) {
+		count += other.count;
+		nulls += other.nulls;
+		bools += other.bools;
+		ints += other.ints;
+		floats += other.floats;
+		strings += other.strings;
+		binaries += other.binaries;
+		arrays += other.arrays;
+		objects += other.objects;
+		minInt = std::min(minInt, other.minInt);
+		maxInt = std::max(maxInt, other.maxInt);
+		bigUInts += other.bigUInts;
+		minNumber = std::min(minNumber, other.minNumber);
+		maxNumber = std::max(maxNumber, other.maxNumber);
+		minLength = std::min(minLength, other.minLength);
+		maxLength = std::max(maxLength, other.maxLength);
+		minItems = std::min(minItems, other.minItems);
+		maxItems = std::max(maxItems, other.maxItems);
+
+		if (other.items) {
+			if (!items) {
+				items = std::make_unique<InferredValue>();
+			}
+			items->merge(*other.items);
+		}
+
+		for (auto &om: other.members) {
+			Member &m = memberFor(om.key);
+			m.present += om.present;
+			m.value->merge(*om.value);
+		}
+
+		for (auto &[order, n]: other.orders) {
+			addOrder(order, n);
+		}
+		otherOrders += other.otherOrders;
+	}
+
+	// Whether only integers were seen, apart from nulls
+	bool onlyInts() const {
+		return ints > 0 && ints == count - nulls;
+	}
+
+	// Whether only numbers were seen, apart from nulls
+	bool onlyNumbers() const {
+		return ints + floats > 0 && ints + floats == count - nulls;
+	}
+
+	const Member *member(std::string_view key) const {
+		for (auto &m: members) {
+			if (m.key == key) {
+				return &m;
+			}
+		}
+		return nullptr;
+	}
+
+	// The most common key order, and the number of objects with it.
+	std::vector<std::string_view> dominantOrder(uint64_t *seen = nullptr) const {
+		std::vector<std::string_view> keys;
+		auto it = std::max_element(orders.begin(), orders.end(), [](auto &a, auto &b) {
+			return a.second < b.second;
+		});
+		if (seen) {
+			*seen = it == orders.end() ? 0 : it->second;
+		}
+		if (it == orders.end()) {
+			return keys;
+		}
+
+		std::string_view order = it->first;
+		while (!order.empty()) {
+			size_t nul = order.find('\0');
+			keys.push_back(order.substr(0, nul));
+			order.remove_prefix(nul + 1);
+		}
+		return keys;
+	}
+
+	// All the keys: the most common key order, with the other keys after
+	// the key they follow in the most common order they're in.
+	std::vector<std::string_view> keyOrder() const {
+		std::vector<std::string_view> keys = dominantOrder();
+
+		std::vector<const std::pair<std::string, uint64_t> *> byCount;
+		for (auto &order: orders) {
+			byCount.push_back(&order);
+		}
+		std::stable_sort(byCount.begin(), byCount.end(), [](auto *a, auto *b) {
+			return a->second > b->second;
+		});
+
+		for (auto *order: byCount) {
+			std::string_view rest = order->first;
+			auto pos = keys.begin();
+			while (!rest.empty()) {
+				size_t nul = rest.find('\0');
+				std::string_view key = rest.substr(0, nul);
+				rest.remove_prefix(nul + 1);
+
+				auto it = std::find(keys.begin(), keys.end(), key);
+				if (it == keys.end()) {
+					it = keys.insert(pos, key);
+				}
+				pos = it + 1;
+			}
+		}
+
+		// Keys which are only in uncounted orders
+		for (auto &m: members) {
+			if (std::find(keys.begin(), keys.end(), m.key) == keys.end()) {
+				keys.push_back(m.key);
+			}
+		}
+		return keys;
+	}
+
+	// Write the inferred schema, in the form accepted by Schema::compile().
+	void writeSchema(Writer w) const {
+		w.writeObject([&](ObjectWriter w) {
+			std::vector<const char *> types;
+			if (nulls > 0) {
+				types.push_back("null");
+			}
+			if (bools > 0) {
+				types.push_back("boolean");
+			}
+			if (floats > 0) {
+				types.push_back("number");
+			} else if (ints > 0) {
+				types.push_back("integer");
+			}
+			if (strings > 0) {
+				types.push_back("string");
+			}
+			if (binaries > 0) {
+				types.push_back("binary");
+			}
+			if (arrays > 0) {
+				types.push_back("array");
+			}
+			if (objects > 0) {
+				types.push_back("object");
+			}
+
+			if (types.size() == 1) {
+				w.key("type").writeString(types[0]);
+			} else if (types.size() > 1) {
+				w.key("type").writeArray([&](Writer w) {
+					for (auto type: types) {
+						w.writeString(type);
+					}
+				});
+			}
+
+			if (ints + floats > 0) {
+				double min = minNumber;
+				double max = maxNumber;
+				if (ints > bigUInts) {
+					min = std::min(min, (double)minInt);
+					max = std::max(max, (double)maxInt);
+				}
+				w.key("minimum").writeDouble(min);
+				w.key("maximum").writeDouble(max);
+			}
+
+			if (strings + binaries > 0) {
+				w.key("minLength").writeUInt(minLength);
+				w.key("maxLength").writeUInt(maxLength);
+			}
+
+			if (arrays > 0) {
+				w.key("minItems").writeUInt(minItems);
+				w.key("maxItems").writeUInt(maxItems);
+				if (items) {
+					items->writeSchema(w.key("items"));
+				}
+			}
+
+			if (objects > 0) {
+				std::vector<std::string_view> keys = keyOrder();
+				w.key("properties").writeObject([&](ObjectWriter w) {
+					for (auto key: keys) {
+						member(key)->value->writeSchema(w.key(key));
+					}
+				});
+				w.key("required").writeArray([&](Writer w) {
+					for (auto key: keys) {
+						if (member(key)->present == objects) {
+							w.writeString(key);
+						}
+					}
+				});
+			}
+		});
+	}
+
+private:
+	void addLength(uint64_t len) {
+		minLength = std::min(minLength, len);
+		maxLength = std::max(maxLength, len);
+	}
+
+	void addInt(int64_t num) {
+		minInt = std::min(minInt, num);
+		maxInt = std::max(maxInt, num);
+	}
+
+	void addNumber(double num) {
+		minNumber = std::min(minNumber, num);
+		maxNumber = std::max(maxNumber, num);
+	}
+
+	// The member for 'key', which is often at 'hint' if the keys are in the usual order
+	Member &memberFor(std::string_view key, size_t hint = 0) {
+		if (hint < members.size() && members[hint].key == key) {
+			return members[hint];
+		}
+
+		for (auto &m: members) {
+			if (m.key == key) {
+				return m;
+			}
+		}
+
+		members.push_back({std::string(key), 0, std::make_unique<InferredValue>()});
+		return members.back();
+	}
+
+	void addOrder(std::string_view order, uint64_t n) {
+		for (auto &[o, c]: orders) {
+			if (o == order) {
+				c += n;
+				return;
+			}
+		}
+
+		if (orders.size() < MAX_ORDERS) {
+			orders.emplace_back(order, n);
+		} else {
+			otherOrders += n;
+		}
+	}
+};
+
+// Infer the schema of the records in 'input', using up to 'threads' threads.
+inline InferredValue inferSchema(Span input, unsigned threads = defaultThreads()) {
+	std::vector<Span> chunks = splitChunks(input, threads > 1 ? threads * 4 : 1);
+	std::vector<InferredValue> partials(chunks.size());
+
+	parallelFor(chunks.size(), threads, [&](size_t i) {
+		forEachRecord(chunks[i], [&](Span rec) {
+			partials[i].add(RawValue(rec));
+		});
+	});
+
+	InferredValue result;
+	for (auto &partial: partials) {
+		result.merge(partial);
+	}
+
+	return result;
+}
+
+struct BindingOptions {
+	// The name of the records' struct
+	std::string rootName = "Record";
+
+	// The namespace to put everything in, if any
+	std::string ns;
+};
+
+namespace detail {
+
+// Generates the C++ code for an inferred schema whose records are objects.
+class BindingGenerator {
+public:
+	BindingGenerator(const InferredValue &root, const BindingOptions &opts, std::ostream &os):
+		root_(root), opts_(opts), os_(os) {}
+
+	void generate() {
+		if (root_.objects == 0 || root_.objects != root_.count) {
+			throw SchemaError("Bindings can only be generated for records which are all objects");
+		}
+
+		name(root_, opts_.rootName, "");
+
+		os_ << "// Generated by sbon-infer from " << root_.count << " records.\n";
+		os_ << "\n";
+		os_ << "#pragma once\n";
+		os_ << "\n";
+		os_ << "#include <sbon.h>\n";
+		os_ << "\n";
+		os_ << "#include <cstdint>\n";
+		os_ << "#include <optional>\n";
+		os_ << "#include <string>\n";
+		os_ << "#include <string_view>\n";
+		os_ << "#include <vector>\n";
+		os_ << "\n";
+		if (!opts_.ns.empty()) {
+			os_ << "namespace " << opts_.ns << " {\n\n";
+		}
+
+		os_ << "namespace detail {\n";
+		os_ << "\n";
+		os_ << "template<size_t N>\n";
+		os_ << "inline size_t findKey(const std::string_view (&keys)[N], std::string_view key) {\n";
+		os_ << "\tfor (size_t i = 0; i < N; ++i) {\n";
+		os_ << "\t\tif (keys[i] == key) {\n";
+		os_ << "\t\t\treturn i;\n";
+		os_ << "\t\t}\n";
+		os_ << "\t}\n";
+		os_ << "\treturn N;\n";
+		os_ << "}\n";
+		os_ << "\n";
+		os_ << "}\n";
+
+		for (auto *obj: structs_) {
+			os_ << "\n";
+			emitStruct(*obj);
+		}
+		for (auto *obj: structs_) {
+			os_ << "\n";
+			emitDecoder(*obj);
+		}
+		for (auto *obj: structs_) {
+			os_ << "\n";
+			emitEncoder(*obj);
+		}
+
+		if (!opts_.ns.empty()) {
+			os_ << "\n}\n";
+		}
+	}
+
+private:
+	enum class Kind {
+		BOOL,
+		INT,
+		UINT,
+		DOUBLE,
+		STRING,
+		BINARY,
+		ARRAY,
+		OBJECT,
+		UNSUPPORTED,
+	};
+
+	struct Field {
+		std::string_view key;
+		std::string name;
+		const InferredValue *value;
+
+		// Missing from some objects. Such fields are optional, and so are
+		// fields which are sometimes null; a field which is both can't tell
+		// a missing key from a null.
+		bool omittable;
+	};
+
+	static Kind kind(const InferredValue &val) {
+		uint64_t n = val.count - val.nulls;
+		if (n == 0) {
+			return Kind::UNSUPPORTED;
+		} else if (val.bools == n) {
+			return Kind::BOOL;
+		} else if (val.onlyInts()) {
+			if (val.bigUInts > 0) {
+				return val.minInt >= 0 ? Kind::UINT : Kind::DOUBLE;
+			}
+			return Kind::INT;
+		} else if (val.onlyNumbers()) {
+			return Kind::DOUBLE;
+		} else if (val.strings == n) {
+			return Kind::STRING;
+		} else if (val.binaries == n) {
+			return Kind::BINARY;
+		} else if (val.arrays == n) {
+			return val.items && kind(*val.items) != Kind::UNSUPPORTED ? Kind::ARRAY : Kind::UNSUPPORTED;
+		} else if (val.objects == n) {
+			return Kind::OBJECT;
+		}
+		return Kind::UNSUPPORTED;
+	}
+
+	static bool isKeyword(std::string_view id) {
+		static const std::set<std::string_view> keywords = {
+			"alignas", "alignof", "and", "asm", "auto", "bool", "break", "case", "catch",
+			"char", "class", "const", "constexpr", "continue", "default", "delete", "do",
+			"double", "else", "enum", "explicit", "export", "extern", "false", "float", "for",
+			"friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new",
+			"noexcept", "not", "nullptr", "operator", "or", "private", "protected", "public",
+			"register", "return", "short", "signed", "sizeof", "static", "struct", "switch",
+			"template", "this", "throw", "true", "try", "typedef", "typename", "union",
+			"unsigned", "using", "virtual", "void", "volatile", "while", "xor",
+		};
+		return keywords.count(id) > 0;
+	}
+
+	// A valid identifier for a key
+	static std::string identifier(std::string_view key) {
+		std::string id;
+		for (char ch: key) {
+			bool alnum = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9');
+			id += alnum ? ch : '_';
+		}
+		if (id.empty() || (id[0] >= '0' && id[0] <= '9')) {
+			id.insert(0, "_");
+		}
+		if (isKeyword(id)) {
+			id += '_';
+		}
+		return id;
+	}
+
+	// A struct name for a key, in CamelCase
+	static std::string typeName(std::string_view key) {
+		std::string name;
+		bool upper = true;
+		for (char ch: key) {
+			bool alnum = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9');
+			if (!alnum) {
+				upper = true;
+			} else if (upper && ch >= 'a' && ch <= 'z') {
+				name += (char)(ch - 'a' + 'A');
+				upper = false;
+			} else {
+				name += ch;
+				upper = false;
+			}
+		}
+		if (name.empty() || (name[0] >= '0' && name[0] <= '9')) {
+			name.insert(0, "Value");
+		}
+		return name;
+	}
+
+	static std::string literal(std::string_view str) {
+		std::string lit = "\"";
+		for (char ch: str) {
+			unsigned char uch = (unsigned char)ch;
+			if (ch == '"' || ch == '\\') {
+				lit += '\\';
+				lit += ch;
+			} else if (uch < 0x20 || uch >= 0x7f) {
+				// Octal escapes have at most 3 digits, unlike hex escapes
+				lit += '\\';
+				lit += (char)('0' + (uch >> 6));
+				lit += (char)('0' + ((uch >> 3) & 7));
+				lit += (char)('0' + (uch & 7));
+			} else {
+				lit += ch;
+			}
+		}
+		return lit + '"';
+	}
+
+	static std::string percent(uint64_t n, uint64_t total) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.1f%%", total == 0 ? 0.0 : 100.0 * (double)n / (double)total);
+		return buf;
+	}
+
+	// Name the structs for the objects in 'val', children first so that
+	// they're defined before they're used.
+	void name(const InferredValue &val, const std::string &hint, const std::string &parent) {
+		Kind k = kind(val);
+		if (k == Kind::ARRAY) {
+			std::string elem = hint.size() > 1 && hint.back() == 's' ?
+				hint.substr(0, hint.size() - 1) : hint + "Item";
+			name(*val.items, elem, parent);
+			return;
+		} else if (k != Kind::OBJECT) {
+			return;
+		}
+
+		std::string structName = hint;
+		if (names_.count(structName)) {
+			structName = parent + hint;
+		}
+		for (int i = 2; names_.count(structName); ++i) {
+			structName = hint + std::to_string(i);
+		}
+		names_.insert(structName);
+		structNames_[&val] = structName;
+
+		for (auto key: val.keyOrder()) {
+			name(*val.member(key)->value, typeName(key), structName);
+		}
+		structs_.push_back(&val);
+	}
+
+	std::vector<Field> fields(const InferredValue &obj) const {
+		std::vector<Field> result;
+		std::set<std::string> used;
+		for (auto key: obj.keyOrder()) {
+			const InferredValue::Member *m = obj.member(key);
+			std::string name = identifier(key);
+			while (used.count(name)) {
+				name += '_';
+			}
+			used.insert(name);
+			result.push_back({key, name, m->value.get(), m->present < obj.objects});
+		}
+		return result;
+	}
+
+	std::string cppType(const InferredValue &val) const {
+		std::string type;
+		switch (kind(val)) {
+		case Kind::BOOL:
+			type = "bool";
+			break;
+		case Kind::INT:
+			type = "int64_t";
+			break;
+		case Kind::UINT:
+			type = "uint64_t";
+			break;
+		case Kind::DOUBLE:
+			type = "double";
+			break;
+		case Kind::STRING:
+			type = "std::string";
+			break;
+		case Kind::BINARY:
+			type = "std::vector<unsigned char>";
+			break;
+		case Kind::ARRAY:
+			type = "std::vector<" + cppType(*val.items) + ">";
+			break;
+		case Kind::OBJECT:
+			type = structNames_.at(&val);
+			break;
+		case Kind::UNSUPPORTED:
+			break;
+		}
+
+		if (val.nulls > 0) {
+			type = "std::optional<" + type + ">";
+		}
+		return type;
+	}
+
+	// A short description of what was seen, for comments
+	static std::string describe(const InferredValue &val) {
+		std::string desc;
+		auto add = [&](const char *name, uint64_t n) {
+			if (n > 0) {
+				desc += desc.empty() ? "" : ", ";
+				desc += name;
+				if (n < val.count) {
+					desc += " " + percent(n, val.count);
+				}
+			}
+		};
+		add("null", val.nulls);
+		add("bool", val.bools);
+		add("integer", val.ints);
+		add("float", val.floats);
+		add("string", val.strings);
+		add("binary", val.binaries);
+		add("array", val.arrays);
+		add("object", val.objects);
+
+		if (val.onlyInts() && val.bigUInts == 0) {
+			desc += "; " + std::to_string(val.minInt) + " .. " + std::to_string(val.maxInt);
+		} else if (val.onlyNumbers()) {
+			double min = std::min(val.minNumber, val.ints > val.bigUInts ? (double)val.minInt : val.minNumber);
+			double max = std::max(val.maxNumber, val.ints > val.bigUInts ? (double)val.maxInt : val.maxNumber);
+			char buf[64];
+			snprintf(buf, sizeof(buf), "; %g .. %g", min, max);
+			desc += buf;
+		} else if (val.strings + val.binaries == val.count - val.nulls) {
+			desc += "; length " + std::to_string(val.minLength) + " .. " + std::to_string(val.maxLength);
+		} else if (val.arrays == val.count - val.nulls) {
+			desc += "; " + std::to_string(val.minItems) + " .. " + std::to_string(val.maxItems) + " elements";
+		}
+		return desc;
+	}
+
+	void emitStruct(const InferredValue &obj) {
+		uint64_t seen = 0;
+		auto order = obj.dominantOrder(&seen);
+		os_ << "// Most common key order (" << percent(seen, obj.objects) << " of "
+			<< obj.objects << " objects):";
+		for (auto key: order) {
+			os_ << ' ' << key;
+		}
+		os_ << "\n";
+
+		os_ << "struct " << structNames_.at(&obj) << " {\n";
+		bool first = true;
+		for (auto &field: fields(obj)) {
+			if (!first) {
+				os_ << "\n";
+			}
+			first = false;
+
+			os_ << "\t// " << (field.key == field.name ? "" : literal(field.key) + ": ");
+			if (field.omittable) {
+				os_ << "present in " << percent(obj.member(field.key)->present, obj.objects) << "; ";
+			}
+			os_ << describe(*field.value) << "\n";
+
+			if (kind(*field.value) == Kind::UNSUPPORTED) {
+				os_ << "\t// Not decoded: no single type\n";
+				os_ << "\t// " << field.name << "\n";
+				continue;
+			}
+
+			std::string type = cppType(*field.value);
+			if (field.omittable && field.value->nulls == 0) {
+				type = "std::optional<" + type + ">";
+			}
+			os_ << "\t" << type << " " << field.name << "{};\n";
+		}
+		os_ << "};\n";
+	}
+
+	static std::string tabs(int n) {
+		return std::string(n, '\t');
+	}
+
+	// Emit the code to decode the value read by 'reader' into 'target'
+	void emitDecodeValue(
+			const InferredValue &val, bool optional, const std::string &target,
+			const std::string &reader, int indent, int depth) {
+		std::string t = tabs(indent);
+		if (optional) {
+			os_ << t << "if (" << reader << ".getType() == sbon::Type::NIL) {\n";
+			os_ << t << "\t" << reader << ".getNil();\n";
+			os_ << t << "\t" << target << ".reset();\n";
+			os_ << t << "} else {\n";
+			std::string var = "val" + std::to_string(depth);
+			os_ << t << "\tauto &" << var << " = " << target << ".emplace();\n";
+			emitDecodeValue(val, false, var, reader, indent + 1, depth + 1);
+			os_ << t << "}\n";
+			return;
+		}
+
+		switch (kind(val)) {
+		case Kind::BOOL:
+			os_ << t << target << " = " << reader << ".getBool();\n";
+			break;
+		case Kind::INT:
+			os_ << t << target << " = " << reader << ".getInt();\n";
+			break;
+		case Kind::UINT:
+			os_ << t << target << " = " << reader << ".getUInt();\n";
+			break;
+		case Kind::DOUBLE:
+			os_ << t << target << " = " << reader << ".getDouble();\n";
+			break;
+		case Kind::STRING:
+			os_ << t << reader << ".getString(" << target << ");\n";
+			break;
+		case Kind::BINARY:
+			os_ << t << target << " = " << reader << ".getBinary();\n";
+			break;
+		case Kind::OBJECT:
+			os_ << t << "decode(" << reader << ", " << target << ");\n";
+			break;
+		case Kind::ARRAY: {
+			const InferredValue &items = *val.items;
+			if (kind(items) == Kind::INT && items.nulls == 0) {
+				// Integer arrays are decoded in bulk
+				os_ << t << reader << ".getArray([&](sbon::ArrayReader arr) {\n";
+				os_ << t << "\tarr.getInts(" << target << ");\n";
+				os_ << t << "});\n";
+				break;
+			}
+
+			std::string el = "el" + std::to_string(depth);
+			os_ << t << target << ".clear();\n";
+			os_ << t << reader << ".readArray([&](sbon::Reader " << el << ") {\n";
+			os_ << t << "\t" << target << ".emplace_back();\n";
+			emitDecodeValue(items, items.nulls > 0, target + ".back()", el, indent + 1, depth + 1);
+			os_ << t << "});\n";
+			break;
+		}
+		case Kind::UNSUPPORTED:
+			os_ << t << reader << ".skip();\n";
+			break;
+		}
+	}
+
+	void emitDecoder(const InferredValue &obj) {
+		std::vector<Field> all = fields(obj);
+		std::vector<Field> decoded;
+		for (auto &field: all) {
+			if (kind(*field.value) != Kind::UNSUPPORTED) {
+				decoded.push_back(field);
+			}
+		}
+
+		std::string name = structNames_.at(&obj);
+		os_ << "inline void decode(sbon::Reader r, " << name << " &out) {\n";
+		if (decoded.empty()) {
+			os_ << "\tr.skip();\n";
+			os_ << "}\n";
+			return;
+		}
+
+		os_ << "\tstatic constexpr std::string_view keys[] = {\n";
+		for (auto &field: decoded) {
+			os_ << "\t\t" << literal(field.key) << ",\n";
+		}
+		os_ << "\t};\n";
+		os_ << "\n";
+		for (auto &field: decoded) {
+			if (field.omittable) {
+				os_ << "\tout." << field.name << ".reset();\n";
+			}
+		}
+		os_ << "\tr.getObject([&](sbon::ObjectReader obj) {\n";
+		os_ << "\t\tstd::string key;\n";
+		os_ << "\t\tsize_t expected = 0;\n";
+		os_ << "\t\twhile (obj.hasNext()) {\n";
+		os_ << "\t\t\tsbon::Reader val = obj.next(key);\n";
+		os_ << "\n";
+		os_ << "\t\t\t// Keys usually come in this order, so try the next one first\n";
+		os_ << "\t\t\tsize_t field = expected < " << decoded.size() << " && key == keys[expected] ?\n";
+		os_ << "\t\t\t\texpected : detail::findKey(keys, key);\n";
+		os_ << "\t\t\tif (field < " << decoded.size() << ") {\n";
+		os_ << "\t\t\t\t// Keys which aren't decoded don't move the expected key on\n";
+		os_ << "\t\t\t\texpected = field + 1;\n";
+		os_ << "\t\t\t}\n";
+		os_ << "\t\t\tswitch (field) {\n";
+		for (size_t i = 0; i < decoded.size(); ++i) {
+			const Field &field = decoded[i];
+			os_ << "\t\t\tcase " << i << ":\n";
+			bool optional = field.omittable || field.value->nulls > 0;
+			emitDecodeValue(*field.value, optional, "out." + field.name, "val", 4, 0);
+			os_ << "\t\t\t\tbreak;\n";
+		}
+		os_ << "\t\t\tdefault:\n";
+		os_ << "\t\t\t\tval.skip();\n";
+		os_ << "\t\t\t\tbreak;\n";
+		os_ << "\t\t\t}\n";
+		os_ << "\t\t}\n";
+		os_ << "\t});\n";
+		os_ << "}\n";
+	}
+
+	// Emit the code to write 'source' with the writer 'writer'
+	void emitEncodeValue(
+			const InferredValue &val, bool optional, const std::string &source,
+			const std::string &writer, int indent, int depth) {
+		std::string t = tabs(indent);
+		if (optional) {
+			os_ << t << "if (" << source << ") {\n";
+			emitEncodeValue(val, false, "*" + source, writer, indent + 1, depth);
+			os_ << t << "} else {\n";
+			os_ << t << "\t" << writer << ".writeNull();\n";
+			os_ << t << "}\n";
+			return;
+		}
+
+		switch (kind(val)) {
+		case Kind::BOOL:
+			os_ << t << writer << ".writeBool(" << source << ");\n";
+			break;
+		case Kind::INT:
+			os_ << t << writer << ".writeInt(" << source << ");\n";
+			break;
+		case Kind::UINT:
+			os_ << t << writer << ".writeUInt(" << source << ");\n";
+			break;
+		case Kind::DOUBLE:
+			os_ << t << writer << ".writeDouble(" << source << ");\n";
+			break;
+		case Kind::STRING:
+			os_ << t << writer << ".writeString(" << source << ");\n";
+			break;
+		case Kind::BINARY: {
+			std::string bin = source[0] == '*' ? "(" + source + ")" : source;
+			os_ << t << writer << ".writeBinary(" << bin << ".data(), " << bin << ".size());\n";
+			break;
+		}
+		case Kind::OBJECT:
+			os_ << t << "encode(" << writer << ", " << source << ");\n";
+			break;
+		case Kind::ARRAY: {
+			std::string w = "w" + std::to_string(depth);
+			std::string el = "el" + std::to_string(depth);
+			os_ << t << writer << ".writeArray([&](sbon::Writer " << w << ") {\n";
+			os_ << t << "\tfor (auto &" << el << ": " << source << ") {\n";
+			emitEncodeValue(*val.items, val.items->nulls > 0, el, w, indent + 2, depth + 1);
+			os_ << t << "\t}\n";
+			os_ << t << "});\n";
+			break;
+		}
+		case Kind::UNSUPPORTED:
+			break;
+		}
+	}
+
+	void emitEncoder(const InferredValue &obj) {
+		std::string name = structNames_.at(&obj);
+		os_ << "inline void encode(sbon::Writer w, const " << name << " &in) {\n";
+		os_ << "\tw.writeObject([&](sbon::ObjectWriter obj) {\n";
+		for (auto &field: fields(obj)) {
+			if (kind(*field.value) == Kind::UNSUPPORTED) {
+				continue;
+			}
+
+			std::string writer = "obj.key(" + literal(field.key) + ")";
+			std::string source = "in." + field.name;
+			if (field.omittable) {
+				// Missing keys stay missing, and so do nulls if the
+				// key was also missing sometimes
+				os_ << "\t\tif (" << source << ") {\n";
+				emitEncodeValue(*field.value, false, "*" + source, writer, 3, 0);
+				os_ << "\t\t}\n";
+			} else {
+				emitEncodeValue(*field.value, field.value->nulls > 0, source, writer, 2, 0);
+			}
+		}
+		os_ << "\t});\n";
+		os_ << "}\n";
+	}
+
+	const InferredValue &root_;
+	const BindingOptions &opts_;
+	std::ostream &os_;
+
+	std::set<std::string> names_;
+	std::unordered_map<const InferredValue *, std::string> structNames_;
+	std::vector<const InferredValue *> structs_;
+};
+
+}
+
+// Write a C++ header with a struct for the records' schema, and for each
+// object in them, with 'decode(Reader, T &)' and 'encode(Writer, const T &)'
+// functions. Values which were seen with more than one type (apart from
+// null) aren't decoded. Throws SchemaError if the records aren't objects.
+inline void generateBindings(
+		const InferredValue &schema, const BindingOptions &opts, std::ostream &os) {
+	detail::BindingGenerator(schema, opts, os).generate();
+}
+
+}
+
+#endif
@@ -0,0 +1,741 @@
+#ifndef SBON_RECORDS_H
+#define SBON_RECORDS_H
+
+// Tools for working with streams of concatenated top-level SBON values
+// ("records") held in memory, typically an mmap'ed file.
+// Everything in here works on raw bytes: values are located with a cheap
+// structural scan, and only the parts which are actually needed get decoded.
+
+#include "sbon.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sbon {
+
+// A range of encoded bytes, e.g. one record or one value.
+struct Span {
+	const char *begin = nullptr;
+	const char *end = nullptr;
+
+	size_t size() const {
+		return end - begin;
+	}
+
+	std::string_view view() const {
+		return std::string_view(begin, size());
+	}
+};
+
+// A read-only streambuf over a memory range,
+// so that a Reader can decode directly from a buffer.
+class MemoryBuf: public std::streambuf {
+public:
+	MemoryBuf(const char *data, size_t size) {
+		char *p = const_cast<char *>(data);
+		setg(p, p, p + size);
+	}
+
+	size_t offset() const {
+		return gptr() - eback();
+	}
+
+protected:
+	pos_type seekoff(
+			off_type off, std::ios_base::seekdir dir,
+			std::ios_base::openmode which) override {
+		if (!(which & std::ios_base::in)) {
+			return pos_type(off_type(-1));
+		}
+
+		off_type pos;
+		if (dir == std::ios_base::beg) {
+			pos = off;
+		} else if (dir == std::ios_base::cur) {
+			pos = (gptr() - eback()) + off;
+		} else {
+			pos = (egptr() - eback()) + off;
+		}
+
+		if (pos < 0 || pos > egptr() - eback()) {
+			return pos_type(off_type(-1));
+		}
+
+		setg(eback(), eback() + pos, egptr());
+		return pos_type(pos);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+};
+
+// An istream over a memory range.
+class MemoryStream: public std::istream {
+public:
+	MemoryStream(const char *data, size_t size):
+			std::istream(nullptr), buf_(data, size) {
+		rdbuf(&buf_);
+	}
+
+	explicit MemoryStream(Span span): MemoryStream(span.begin, span.size()) {}
+
+	size_t offset() const {
+		return buf_.offset();
+	}
+
+private:
+	MemoryBuf buf_;
+};
+
+namespace detail {
+
+inline void checkAvail(const char *p, const char *end, size_t n) {
+	if ((size_t)(end - p) < n) {
+		throw ParseError("Unexpected EOF");
+	}
+}
+
+inline uint64_t readLEB128(const char *&p, const char *end) {
+	return decodeLEB128([&] {
+		checkAvail(p, end, 1);
+		return *p++;
+	});
+}
+
+// Returns a pointer to the byte after the 0-terminator
+// of the string starting at 'p'.
+inline const char *skipCString(const char *p, const char *end) {
+	const char *nul = (const char *)std::memchr(p, '\0', end - p);
+	if (!nul) {
+		throw ParseError("Unexpected EOF");
+	}
+
+	return nul + 1;
+}
+
+}
+
+// Returns a pointer to the first byte after the value which starts at 'p',
+// without decoding it. Throws a ParseError if the value is malformed
+// or extends past 'end'.
+inline const char *skipValue(const char *p, const char *end) {
+	// One bit per nesting level, set for objects
+	constexpr size_t maxDepth = 1024;
+	uint64_t objects[maxDepth / 64];
+	size_t depth = 0;
+
+	while (true) {
+		if (depth > 0 && objects[(depth - 1) / 64] & (1ull << ((depth - 1) % 64))) {
+			detail::checkAvail(p, end, 1);
+			if (*p == '}') {
+				p += 1;
+				depth -= 1;
+				if (depth == 0) {
+					return p;
+				}
+				continue;
+			}
+
+			p = detail::skipCString(p, end);
+		}
+
+		detail::checkAvail(p, end, 1);
+		char ch = *p++;
+		switch (ch) {
+		case 'T': case 'F': case 'N':
+		case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9':
+			break;
+
+		case 'S':
+			p = detail::skipCString(p, end);
+			break;
+
+		case 'B': {
+			uint64_t size = detail::readLEB128(p, end);
+			detail::checkAvail(p, end, size);
+			p += size;
+			break;
+		}
+
+		case '+': case '-':
+			detail::readLEB128(p, end);
+			break;
+
+		case '#':
+			// A count, then that many LEB128s, which end at bytes without the high bit
+			for (uint64_t count = detail::readLEB128(p, end); count > 0; --count) {
+				do {
+					detail::checkAvail(p, end, 1);
+				} while (*p++ & 0x80);
+			}
+			break;
+
+		case 'f':
+			detail::checkAvail(p, end, 4);
+			p += 4;
+			break;
+
+		case 'd':
+			detail::checkAvail(p, end, 8);
+			p += 8;
+			break;
+
+		case '[': case '{':
+			if (depth >= maxDepth) {
+				throw ParseError("Maximum nesting depth exceeded");
+			}
+
+			if (ch == '{') {
+				objects[depth / 64] |= 1ull << (depth % 64);
+			} else {
+				objects[depth / 64] &= ~(1ull << (depth % 64));
+			}
+			depth += 1;
+			continue;
+
+		case ']':
+			if (depth == 0 || objects[(depth - 1) / 64] & (1ull << ((depth - 1) % 64))) {
+				throw ParseError("Unexpected ']'");
+			}
+
+			depth -= 1;
+			break;
+
+		default:
+			throw ParseError("Unexpected character");
+		}
+
+		// Closing brackets of arrays are only handled after a value,
+		// so check for them here to also handle empty arrays
+		while (depth > 0 && !(objects[(depth - 1) / 64] & (1ull << ((depth - 1) % 64)))) {
+			detail::checkAvail(p, end, 1);
+			if (*p != ']') {
+				break;
+			}
+
+			p += 1;
+			depth -= 1;
+		}
+
+		if (depth == 0) {
+			return p;
+		}
+	}
+}
+
+// One encoded value in memory, with zero-copy accessors.
+// The accessors mirror those of Reader, but return views into the buffer
+// instead of copies.
+class RawValue {
+public:
+	RawValue() = default;
+	explicit RawValue(Span span): span_(span) {}
+
+	// The value which starts at 'p'.
+	static RawValue at(const char *p, const char *end) {
+		return RawValue({p, skipValue(p, end)});
+	}
+
+	Span span() const {
+		return span_;
+	}
+
+	Type getType() const {
+		char ch = *span_.begin;
+		if (ch == 'T' || ch == 'F') {
+			return Type::BOOL;
+		} else if (ch == 'N') {
+			return Type::NIL;
+		} else if (ch == 'f') {
+			return Type::FLOAT;
+		} else if (ch == 'd') {
+			return Type::DOUBLE;
+		} else if (ch == 'S') {
+			return Type::STRING;
+		} else if (ch == 'B') {
+			return Type::BINARY;
+		} else if (ch == '+' || (ch >= '0' && ch <= '9')) {
+			return Type::UINT;
+		} else if (ch == '-') {
+			return Type::INT;
+		} else if (ch == '[' || ch == '#') {
+			return Type::ARRAY;
+		} else if (ch == '{') {
+			return Type::OBJECT;
+		} else {
+			throw ParseError("Unexpected character");
+		}
+	}
+
+	bool getBool() const {
+		char ch = *span_.begin;
+		if (ch == 'T') {
+			return true;
+		} else if (ch == 'F') {
+			return false;
+		} else {
+			throw ParseError("getBool: Expected 'T' or 'F'");
+		}
+	}
+
+	std::string_view getString() const {
+		if (*span_.begin != 'S') {
+			throw ParseError("getString: Expected 'S'");
+		}
+
+		return std::string_view(span_.begin + 1, span_.size() - 2);
+	}
+
+	std::string_view getBinary() const {
+		if (*span_.begin != 'B') {
+			throw ParseError("getBinary: Expected 'B'");
+		}
+
+		const char *p = span_.begin + 1;
+		uint64_t size = detail::readLEB128(p, span_.end);
+		return std::string_view(p, size);
+	}
+
+	float getFloat() const {
+		return getNumber<float>();
+	}
+
+	double getDouble() const {
+		return getNumber<double>();
+	}
+
+	int64_t getInt() const {
+		return getNumber<int64_t>();
+	}
+
+	uint64_t getUInt() const {
+		return getNumber<uint64_t>();
+	}
+
+	template<typename T>
+	T getNumber() const {
+		const char *p = span_.begin;
+		const char *end = span_.end;
+		char ch = *p++;
+		return detail::decodeNumber<T>(ch, [&] {
+			detail::checkAvail(p, end, 1);
+			return *p++;
+		});
+	}
+
+	// Read an array of integers into 'ints', in either encoding.
+	void getInts(std::vector<int64_t> &ints) const {
+		MemoryStream ms(span_);
+		Reader(&ms).getInts(ints);
+	}
+
+	// Call 'func(RawValue)' for each element of an array.
+	// The elements of a delta-encoded array are encoded one at a time
+	// into a buffer, so they're only valid until 'func' returns.
+	template<typename Func>
+	void forEachElement(Func func) const {
+		if (*span_.begin == '#') {
+			std::vector<int64_t> ints;
+			getInts(ints);
+			for (int64_t num: ints) {
+				char buf[16];
+				func(RawValue({buf, detail::encodeInt(num, buf)}));
+			}
+			return;
+		} else if (*span_.begin != '[') {
+			throw ParseError("forEachElement: Expected '['");
+		}
+
+		const char *p = span_.begin + 1;
+		while (*p != ']') {
+			RawValue val = at(p, span_.end);
+			func(val);
+			p = val.span_.end;
+		}
+	}
+
+	// Call 'func(std::string_view key, RawValue)' for each member of an object.
+	template<typename Func>
+	void forEachMember(Func func) const {
+		if (*span_.begin != '{') {
+			throw ParseError("forEachMember: Expected '{'");
+		}
+
+		const char *p = span_.begin + 1;
+		while (*p != '}') {
+			const char *valp = detail::skipCString(p, span_.end);
+			RawValue val = at(valp, span_.end);
+			func(std::string_view(p, valp - p - 1), val);
+			p = val.span_.end;
+		}
+	}
+
+private:
+	Span span_;
+};
+
+// Call 'func(Span)' for each top-level value in the range.
+template<typename Func>
+inline void forEachRecord(Span input, Func func) {
+	const char *p = input.begin;
+	while (p != input.end) {
+		const char *end = skipValue(p, input.end);
+		func(Span{p, end});
+		p = end;
+	}
+}
+
+// Split a stream of records into at most 'count' chunks of roughly equal size,
+// with every chunk boundary on a record boundary.
+inline std::vector<Span> splitChunks(Span input, size_t count) {
+	std::vector<Span> chunks;
+	if (count == 0) {
+		count = 1;
+	}
+
+	size_t target = input.size() / count;
+	const char *chunkStart = input.begin;
+	forEachRecord(input, [&](Span rec) {
+		if (
+				(size_t)(rec.end - chunkStart) >= target &&
+				chunks.size() + 1 < count) {
+			chunks.push_back({chunkStart, rec.end});
+			chunkStart = rec.end;
+		}
+	});
+
+	if (chunkStart != input.end || chunks.empty()) {
+		chunks.push_back({chunkStart, input.end});
+	}
+
+	return chunks;
+}
+
+// The number of worker threads to use when the user doesn't specify one.
+inline unsigned defaultThreads() {
+	unsigned n = std::thread::hardware_concurrency();
+	return n == 0 ? 1 : n;
+}
+
+// Call 'func(size_t index)' for every index in [0, count),
+// spread across up to 'threads' threads.
+// The first exception thrown by 'func' is rethrown once all threads are done.
+template<typename Func>
+inline void parallelFor(size_t count, unsigned threads, Func func) {
+	if (threads <= 1 || count <= 1) {
+		for (size_t i = 0; i < count; ++i) {
+			func(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> nextIndex{0};
+	std::mutex errorMut;
+	std::exception_ptr error;
+
+	auto worker = [&] {
+		while (true) {
+			size_t i = nextIndex.fetch_add(1);
+			if (i >= count) {
+				return;
+			}
+
+			try {
+				func(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(errorMut);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	size_t numWorkers = std::min<size_t>(threads, count);
+	for (size_t i = 0; i < numWorkers; ++i) {
+		workers.emplace_back(worker);
+	}
+
+	for (auto &w: workers) {
+		w.join();
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+// The contents of a file, mmap'ed when possible.
+// Standard input (and anything else which can't be mapped) is read into memory.
+class MappedFile {
+public:
+	// Open 'path', or read standard input if 'path' is null or "-".
+	explicit MappedFile(const char *path) {
+		int fd = 0;
+		if (path && std::string_view(path) != "-") {
+			fd = ::open(path, O_RDONLY);
+			if (fd < 0) {
+				throw std::system_error(errno, std::generic_category(), path);
+			}
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+			void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED) {
+				map_ = ptr;
+				size_ = st.st_size;
+				madvise(map_, size_, MADV_SEQUENTIAL);
+			}
+		}
+
+		if (!map_) {
+			char buf[64 * 1024];
+			ssize_t n;
+			while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+				data_.append(buf, n);
+			}
+
+			if (n < 0) {
+				int err = errno;
+				if (fd != 0) {
+					::close(fd);
+				}
+				throw std::system_error(err, std::generic_category(), "read");
+			}
+		}
+
+		if (fd != 0) {
+			::close(fd);
+		}
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	~MappedFile() {
+		if (map_) {
+			munmap(map_, size_);
+		}
+	}
+
+	const char *data() const {
+		return map_ ? (const char *)map_ : data_.data();
+	}
+
+	size_t size() const {
+		return map_ ? size_ : data_.size();
+	}
+
+	Span span() const {
+		return {data(), data() + size()};
+	}
+
+private:
+	void *map_ = nullptr;
+	size_t size_ = 0;
+	std::string data_;
+};
+
+// A set of key paths such as "user.address.city",
+// which can be located in a record with a single pass over its bytes.
+// Numeric path components also match array indexes.
+class PathSet {
+public:
+	PathSet() {
+		nodes_.emplace_back();
+	}
+
+	// Add a dot-separated path, and return its ID.
+	// Adding the same path twice returns the same ID.
+	size_t add(std::string_view path) {
+		size_t node = 0;
+		while (true) {
+			size_t dot = path.find('.');
+			std::string_view comp = path.substr(0, dot);
+			node = child(node, comp);
+			if (dot == std::string_view::npos) {
+				break;
+			}
+			path = path.substr(dot + 1);
+		}
+
+		if (nodes_[node].id == NONE) {
+			nodes_[node].id = count_++;
+		}
+
+		return nodes_[node].id;
+	}
+
+	size_t size() const {
+		return count_;
+	}
+
+	// Walk the value in 'record', calling 'func(size_t id, RawValue val)'
+	// for every path which is present.
+	// Walking stops once every path has been found,
+	// or when 'func' returns false.
+	// Values which aren't on any path are skipped without being decoded.
+	// Elements of delta-encoded arrays don't exist as bytes in the record,
+	// so the ones on a path are encoded into a buffer of the calling thread,
+	// and are valid until its next visit.
+	template<typename Func>
+	void visit(Span record, Func func) const {
+		auto &values = deltaValues();
+		if (!values.empty()) {
+			values.clear();
+		}
+
+		size_t found = 0;
+		visitNode(0, record.begin, record.end, found, func);
+	}
+
+private:
+	static constexpr size_t NONE = ~(size_t)0;
+
+	struct Node {
+		std::vector<std::pair<std::string, size_t>> children;
+		size_t id = NONE;
+	};
+
+	size_t child(size_t node, std::string_view comp) {
+		for (auto &[key, idx]: nodes_[node].children) {
+			if (key == comp) {
+				return idx;
+			}
+		}
+
+		size_t idx = nodes_.size();
+		nodes_[node].children.emplace_back(comp, idx);
+		nodes_.emplace_back();
+		return idx;
+	}
+
+	size_t findChild(size_t node, std::string_view comp) const {
+		for (auto &[key, idx]: nodes_[node].children) {
+			if (key == comp) {
+				return idx;
+			}
+		}
+
+		return NONE;
+	}
+
+	// Visit the value at 'p' for the path node 'node'.
+	// Returns the pointer past the value, or null if walking should stop.
+	template<typename Func>
+	const char *visitNode(
+			size_t node, const char *p, const char *end,
+			size_t &found, Func &func) const {
+		const Node &n = nodes_[node];
+		if (n.id != NONE) {
+			RawValue val = RawValue::at(p, end);
+			found += 1;
+			if (!func(n.id, val) || found == count_) {
+				return nullptr;
+			}
+
+			if (n.children.empty()) {
+				return val.span().end;
+			}
+		}
+
+		detail::checkAvail(p, end, 1);
+		if (n.children.empty() || (*p != '{' && *p != '[' && *p != '#')) {
+			return skipValue(p, end);
+		} else if (*p == '#') {
+			return visitDeltaNode(node, p + 1, end, found, func);
+		}
+
+		char close = *p == '{' ? '}' : ']';
+		bool isObject = *p == '{';
+		p += 1;
+
+		size_t index = 0;
+		char indexBuf[24];
+		while (true) {
+			detail::checkAvail(p, end, 1);
+			if (*p == close) {
+				return p + 1;
+			}
+
+			std::string_view key;
+			if (isObject) {
+				const char *valp = detail::skipCString(p, end);
+				key = std::string_view(p, valp - p - 1);
+				p = valp;
+			} else {
+				auto res = std::to_chars(indexBuf, indexBuf + sizeof(indexBuf), index++);
+				key = std::string_view(indexBuf, res.ptr - indexBuf);
+			}
+
+			size_t childNode = findChild(node, key);
+			if (childNode == NONE) {
+				p = skipValue(p, end);
+			} else {
+				p = visitNode(childNode, p, end, found, func);
+				if (!p) {
+					return nullptr;
+				}
+			}
+		}
+	}
+
+	static std::deque<std::array<char, 16>> &deltaValues() {
+		thread_local std::deque<std::array<char, 16>> values;
+		return values;
+	}
+
+	// Visit the elements of the delta-encoded array at 'p', after the '#'.
+	template<typename Func>
+	const char *visitDeltaNode(
+			size_t node, const char *p, const char *end,
+			size_t &found, Func &func) const {
+		uint64_t count = detail::readLEB128(p, end);
+		uint64_t total = 0;
+		char indexBuf[24];
+		for (uint64_t index = 0; index < count; ++index) {
+			total += (uint64_t)detail::unZigZag(detail::readLEB128(p, end));
+
+			auto res = std::to_chars(indexBuf, indexBuf + sizeof(indexBuf), index);
+			size_t childNode = findChild(node, std::string_view(indexBuf, res.ptr - indexBuf));
+			if (childNode != NONE) {
+				char *buf = deltaValues().emplace_back().data();
+				char *bufEnd = detail::encodeInt((int64_t)total, buf);
+				if (!visitNode(childNode, buf, bufEnd, found, func)) {
+					return nullptr;
+				}
+			}
+		}
+
+		return p;
+	}
+
+	std::vector<Node> nodes_;
+	size_t count_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,480 @@
+#ifndef SBON_SCHEMA_H
+#define SBON_SCHEMA_H
+
+// Validation of documents against a schema, in a single streaming pass
+// over a Reader.
+//
+// Schemas are SBON objects using a subset of JSON Schema:
+//
+//   type                  A type name, or an array of type names: "null",
+//                         "boolean", "integer", "number", "string", "binary",
+//                         "array" or "object". "number" includes integers.
+//   minimum, maximum      Inclusive bounds for numbers
+//   minLength, maxLength  Bounds on the length of strings and binaries, in bytes
+//   minItems, maxItems    Bounds on the number of array elements
+//   items                 The schema for each array element
+//   properties            An object with the schema for each key
+//   required              An array of keys which must be present
+//   additionalProperties  If false, keys not in 'properties' or 'required'
+//                         are rejected
+//
+// 'title', 'description', '$schema' and '$id' are ignored, and any other
+// keyword is an error.
+//
+// The schema is compiled into a table of nodes, with a hash table per object
+// node for looking up keys. Values which no constraint applies to are skipped
+// without being decoded.
+
+#include "sbon.h"
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sbon {
+
+class SchemaError: public std::exception {
+public:
+	SchemaError(const std::string &str) {
+		str_ = "SBON schema error: ";
+		str_ += str;
+	}
+
+	const char *what() const noexcept override {
+		return str_.c_str();
+	}
+
+private:
+	std::string str_;
+};
+
+struct Violation {
+	// The dot-separated path to the offending value, with array indexes as numbers.
+	// Empty for the top-level value.
+	std::string path;
+
+	std::string message;
+};
+
+class Schema {
+public:
+	// Compile the schema read from 'r'. Throws SchemaError for invalid schemas.
+	static Schema compile(Reader r) {
+		Schema schema;
+		schema.compileNode(r);
+		return schema;
+	}
+
+	// Validate the value read from 'r'. If it violates the schema, returns false
+	// and fills in 'violation' with the first violation found. The stream is
+	// left in the middle of the value in that case.
+	// Malformed input throws a ParseError as usual.
+	bool validate(Reader r, Violation *violation = nullptr) const {
+		Validator v(*this);
+		try {
+			v.value(0, r);
+		} catch (Failure &) {
+			if (violation) {
+				violation->path = std::move(v.failPath);
+				violation->message = std::move(v.message);
+			}
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	enum TypeBits: uint16_t {
+		NIL = 1 << 0,
+		BOOLEAN = 1 << 1,
+		INTEGER = 1 << 2,
+		NUMBER = 1 << 3,
+		STRING = 1 << 4,
+		BINARY = 1 << 5,
+		ARRAY = 1 << 6,
+		OBJECT = 1 << 7,
+		ANY_TYPE = 0xff,
+	};
+
+	// A node index for values without any constraints
+	static constexpr size_t ANY = ~(size_t)0;
+
+	struct Property {
+		size_t node = ANY;
+
+		// The index into the node's required keys, or -1
+		int required = -1;
+	};
+
+	struct Node {
+		uint16_t types = ANY_TYPE;
+
+		double minimum = -std::numeric_limits<double>::infinity();
+		double maximum = std::numeric_limits<double>::infinity();
+		bool hasRange = false;
+
+		uint64_t minLength = 0;
+		uint64_t maxLength = UINT64_MAX;
+		uint64_t minItems = 0;
+		uint64_t maxItems = UINT64_MAX;
+
+		size_t items = ANY;
+		std::unordered_map<std::string, Property> properties;
+		std::vector<std::string> required;
+		bool additionalProperties = true;
+	};
+
+	struct Failure {};
+
+	static uint16_t typeBit(const std::string &name) {
+		if (name == "null") {
+			return NIL;
+		} else if (name == "boolean") {
+			return BOOLEAN;
+		} else if (name == "integer") {
+			return INTEGER;
+		} else if (name == "number") {
+			return NUMBER | INTEGER;
+		} else if (name == "string") {
+			return STRING;
+		} else if (name == "binary") {
+			return BINARY;
+		} else if (name == "array") {
+			return ARRAY;
+		} else if (name == "object") {
+			return OBJECT;
+		} else {
+			throw SchemaError("Unknown type '" + name + "'");
+		}
+	}
+
+	static uint16_t typeBit(Type type) {
+		switch (type) {
+		case Type::BOOL: return BOOLEAN;
+		case Type::NIL: return NIL;
+		case Type::STRING: return STRING;
+		case Type::BINARY: return BINARY;
+		case Type::FLOAT: return NUMBER;
+		case Type::DOUBLE: return NUMBER;
+		case Type::INT: return INTEGER;
+		case Type::UINT: return INTEGER;
+		case Type::ARRAY: return ARRAY;
+		case Type::OBJECT: return OBJECT;
+		}
+		return 0;
+	}
+
+	static std::string typeNames(uint16_t types) {
+		static const char *names[] = {
+			"null", "boolean", "integer", "number", "string", "binary", "array", "object",
+		};
+
+		// "number" already covers integers
+		if (types & NUMBER) {
+			types &= ~INTEGER;
+		}
+
+		std::string str;
+		for (int i = 0; i < 8; ++i) {
+			if (types & (1 << i)) {
+				if (!str.empty()) {
+					str += " or ";
+				}
+				str += names[i];
+			}
+		}
+		return str;
+	}
+
+	static uint64_t compileCount(Reader r, const std::string &key) {
+		Type type = r.getType();
+		if (type != Type::UINT) {
+			throw SchemaError("'" + key + "' must be a non-negative integer");
+		}
+		return r.getUInt();
+	}
+
+	static double compileNumber(Reader r, const std::string &key) {
+		Type type = r.getType();
+		if (type == Type::UINT) {
+			return (double)r.getUInt();
+		} else if (type == Type::INT) {
+			return (double)r.getInt();
+		} else if (type == Type::FLOAT || type == Type::DOUBLE) {
+			return r.getDouble();
+		} else {
+			throw SchemaError("'" + key + "' must be a number");
+		}
+	}
+
+	size_t compileNode(Reader r) {
+		if (r.getType() != Type::OBJECT) {
+			throw SchemaError("Schema must be an object");
+		}
+
+		size_t idx = nodes_.size();
+		nodes_.emplace_back();
+
+		// Compiling child schemas may reallocate 'nodes_',
+		// so always access this node by index
+		std::vector<std::string> required;
+		r.readObject([&](std::string &key, Reader val) {
+			if (key == "type") {
+				uint16_t types = 0;
+				if (val.getType() == Type::ARRAY) {
+					val.readArray([&](Reader name) {
+						types |= typeBit(name.getString());
+					});
+				} else if (val.getType() == Type::STRING) {
+					types = typeBit(val.getString());
+				} else {
+					throw SchemaError("'type' must be a string or an array of strings");
+				}
+				nodes_[idx].types = types;
+			} else if (key == "minimum") {
+				nodes_[idx].minimum = compileNumber(val, key);
+				nodes_[idx].hasRange = true;
+			} else if (key == "maximum") {
+				nodes_[idx].maximum = compileNumber(val, key);
+				nodes_[idx].hasRange = true;
+			} else if (key == "minLength") {
+				nodes_[idx].minLength = compileCount(val, key);
+			} else if (key == "maxLength") {
+				nodes_[idx].maxLength = compileCount(val, key);
+			} else if (key == "minItems") {
+				nodes_[idx].minItems = compileCount(val, key);
+			} else if (key == "maxItems") {
+				nodes_[idx].maxItems = compileCount(val, key);
+			} else if (key == "items") {
+				size_t items = compileNode(val);
+				nodes_[idx].items = items;
+			} else if (key == "properties") {
+				if (val.getType() != Type::OBJECT) {
+					throw SchemaError("'properties' must be an object");
+				}
+				val.readObject([&](std::string &prop, Reader schema) {
+					size_t child = compileNode(schema);
+					nodes_[idx].properties[prop].node = child;
+				});
+			} else if (key == "required") {
+				if (val.getType() != Type::ARRAY) {
+					throw SchemaError("'required' must be an array of strings");
+				}
+				val.readArray([&](Reader name) {
+					required.push_back(name.getString());
+				});
+			} else if (key == "additionalProperties") {
+				if (val.getType() != Type::BOOL) {
+					throw SchemaError("'additionalProperties' must be a boolean");
+				}
+				nodes_[idx].additionalProperties = val.getBool();
+			} else if (key == "title" || key == "description" || key == "$schema" || key == "$id") {
+				val.skip();
+			} else {
+				throw SchemaError("Unknown keyword '" + key + "'");
+			}
+		});
+
+		Node &node = nodes_[idx];
+		for (auto &name: required) {
+			Property &prop = node.properties[name];
+			if (prop.required < 0) {
+				prop.required = (int)node.required.size();
+				node.required.push_back(name);
+			}
+		}
+
+		return idx;
+	}
+
+	// The state of one validation, so that a Schema can be shared between threads.
+	class Validator {
+	public:
+		explicit Validator(const Schema &schema): schema_(schema) {}
+
+		void value(size_t idx, Reader &r) {
+			if (idx == ANY) {
+				r.skip();
+				return;
+			}
+
+			const Node &node = schema_.nodes_[idx];
+			Type type = r.getType();
+			uint16_t bit = typeBit(type);
+			if (!(node.types & bit)) {
+				fail("Expected " + typeNames(node.types));
+			}
+
+			switch (type) {
+			case Type::FLOAT:
+			case Type::DOUBLE:
+			case Type::INT:
+			case Type::UINT:
+				if (node.hasRange) {
+					number(node, r, type);
+				} else {
+					r.skip();
+				}
+				break;
+			case Type::STRING:
+				if (node.minLength > 0 || node.maxLength != UINT64_MAX) {
+					r.getString(str_);
+					length(node, str_.size());
+				} else {
+					r.skipString();
+				}
+				break;
+			case Type::BINARY:
+				if (node.minLength > 0 || node.maxLength != UINT64_MAX) {
+					r.getBinary(bin_);
+					length(node, bin_.size());
+				} else {
+					r.skipBinary();
+				}
+				break;
+			case Type::ARRAY:
+				array(node, r);
+				break;
+			case Type::OBJECT:
+				object(node, r);
+				break;
+			default:
+				r.skip();
+				break;
+			}
+		}
+
+		// The violation, if validation failed
+		std::string failPath;
+		std::string message;
+
+	private:
+		// A path component is either an object key or an array index.
+		// Keys point to the strings owned by the enclosing ObjectReader loops,
+		// so the path string has to be built before the stack unwinds.
+		struct PathComponent {
+			const std::string *key;
+			uint64_t index;
+		};
+
+		[[noreturn]] void fail(std::string msg) {
+			failPath = pathString();
+			message = std::move(msg);
+			throw Failure{};
+		}
+
+		std::string pathString() const {
+			std::string path;
+			for (auto &comp: path_) {
+				if (!path.empty()) {
+					path += '.';
+				}
+
+				if (comp.key) {
+					path += *comp.key;
+				} else {
+					path += std::to_string(comp.index);
+				}
+			}
+			return path;
+		}
+
+		void number(const Node &node, Reader &r, Type type) {
+			double num;
+			if (type == Type::UINT) {
+				num = (double)r.getUInt();
+			} else if (type == Type::INT) {
+				num = (double)r.getInt();
+			} else {
+				num = r.getDouble();
+			}
+
+			if (num < node.minimum) {
+				fail("Number is less than the minimum");
+			} else if (num > node.maximum) {
+				fail("Number is greater than the maximum");
+			}
+		}
+
+		void length(const Node &node, size_t len) {
+			if (len < node.minLength) {
+				fail("Length is less than the minimum");
+			} else if (len > node.maxLength) {
+				fail("Length is greater than the maximum");
+			}
+		}
+
+		void array(const Node &node, Reader &r) {
+			uint64_t count = 0;
+			r.readArray([&](Reader el) {
+				if (count >= node.maxItems) {
+					fail("More than " + std::to_string(node.maxItems) + " items");
+				}
+
+				path_.push_back({nullptr, count});
+				value(node.items, el);
+				path_.pop_back();
+				count += 1;
+			});
+
+			if (count < node.minItems) {
+				fail("Fewer than " + std::to_string(node.minItems) + " items");
+			}
+		}
+
+		void object(const Node &node, Reader &r) {
+			// Which required keys have been seen; most objects need only the first word
+			uint64_t seenSmall = 0;
+			std::vector<bool> seenLarge;
+			if (node.required.size() > 64) {
+				seenLarge.resize(node.required.size());
+			}
+
+			r.readObject([&](std::string &key, Reader val) {
+				auto it = node.properties.find(key);
+				if (it == node.properties.end()) {
+					if (!node.additionalProperties) {
+						path_.push_back({&key, 0});
+						fail("Unexpected key");
+					}
+					val.skip();
+					return;
+				}
+
+				const Property &prop = it->second;
+				if (prop.required >= 0) {
+					if (seenLarge.empty()) {
+						seenSmall |= (uint64_t)1 << prop.required;
+					} else {
+						seenLarge[prop.required] = true;
+					}
+				}
+
+				path_.push_back({&key, 0});
+				value(prop.node, val);
+				path_.pop_back();
+			});
+
+			for (size_t i = 0; i < node.required.size(); ++i) {
+				bool seen = seenLarge.empty() ? (seenSmall >> i) & 1 : seenLarge[i];
+				if (!seen) {
+					fail("Missing required key '" + node.required[i] + "'");
+				}
+			}
+		}
+
+		const Schema &schema_;
+		std::vector<PathComponent> path_;
+		std::string str_;
+		std::vector<unsigned char> bin_;
+	};
+
+	std::vector<Node> nodes_;
+};
+
+}
+
+#endif
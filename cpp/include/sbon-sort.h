@@ -0,0 +1,622 @@
+#ifndef SBON_SORT_H
+#define SBON_SORT_H
+
+// External merge sort of record streams by one or more key paths.
+//
+// The input is cut into runs which fit within the memory limit.
+// For each run, the sort keys are extracted into a compact array of
+// (key, record index) pairs and sorted, and the records are then written
+// to a temporary file in sorted order, copied as raw bytes.
+// Runs are sorted in parallel, and finally merged with a k-way merge.
+// When there are more runs than can be merged at once, groups of them are
+// first merged into longer runs, in as many passes as it takes.
+//
+// Records are ordered by their first key path, then by the second, etc.
+// Records which are missing a key sort first, followed by null, booleans,
+// numbers, strings, and finally binaries, arrays and objects (by raw bytes).
+// The sort is stable.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+namespace sbon {
+
+struct SortOptions {
+	// Key paths to sort by, most significant first
+	std::vector<std::string> keys;
+
+	// The approximate maximum number of record bytes to sort in memory at once
+	size_t memoryLimit = 256 * 1024 * 1024;
+
+	unsigned threads = defaultThreads();
+
+	// The maximum number of runs to merge at once; each merged run
+	// gets a read buffer of about memoryLimit / maxFanIn bytes
+	size_t maxFanIn = 64;
+
+	// Where to put temporary run files; uses $TMPDIR or /tmp if empty
+	std::string tempDir;
+};
+
+namespace detail {
+
+// Map a double to a uint64_t with the same ordering.
+inline uint64_t orderedDouble(double d) {
+	if (d == 0) {
+		d = 0; // Make -0 and 0 equal
+	}
+
+	uint64_t n;
+	std::memcpy(&n, &d, 8);
+	return n & (1ull << 63) ? ~n : n | (1ull << 63);
+}
+
+// Map an int64_t to a uint64_t with the same ordering.
+inline uint64_t orderedInt(int64_t i) {
+	return (uint64_t)i ^ (1ull << 63);
+}
+
+inline void appendBigEndian(std::string &out, uint64_t n) {
+	for (int shift = 56; shift >= 0; shift -= 8) {
+		out += (char)(unsigned char)(n >> shift);
+	}
+}
+
+// Append the key for 'val' to 'out', encoded such that
+// comparing keys with memcmp gives the sort order.
+inline void appendSortKey(std::string &out, RawValue val) {
+	switch (val.getType()) {
+	case Type::NIL:
+		out += '\x01';
+		break;
+
+	case Type::BOOL:
+		out += val.getBool() ? '\x03' : '\x02';
+		break;
+
+	case Type::INT:
+	case Type::UINT:
+	case Type::FLOAT:
+	case Type::DOUBLE: {
+		// Order by the value as a double, with ties between integers
+		// which aren't representable as doubles broken by the exact value
+		Type type = val.getType();
+		double d;
+		int64_t i;
+		if (type == Type::INT) {
+			i = val.getInt();
+			d = (double)i;
+		} else if (type == Type::UINT) {
+			uint64_t u = val.getUInt();
+			i = u > (uint64_t)INT64_MAX ? INT64_MAX : (int64_t)u;
+			d = (double)u;
+		} else {
+			d = type == Type::FLOAT ? val.getFloat() : val.getDouble();
+			i = d >= 9.2e18 ? INT64_MAX : d <= -9.2e18 ? INT64_MIN : (int64_t)d;
+		}
+
+		out += '\x04';
+		appendBigEndian(out, orderedDouble(d));
+		appendBigEndian(out, orderedInt(i));
+		break;
+	}
+
+	case Type::STRING:
+		// Strings can't contain 0, so a 0 terminator gives prefix ordering
+		out += '\x05';
+		out += val.getString();
+		out += '\0';
+		break;
+
+	default:
+		out += '\x06';
+		out += val.span().view();
+		break;
+	}
+}
+
+// Sort (key, index) pairs by key, with a stable LSD radix sort.
+struct RadixItem {
+	uint64_t key;
+	uint64_t index;
+};
+
+inline void radixSort(std::vector<RadixItem> &items) {
+	size_t counts[8][256] = {};
+	for (auto &item: items) {
+		for (int b = 0; b < 8; ++b) {
+			counts[b][(item.key >> (b * 8)) & 0xff] += 1;
+		}
+	}
+
+	std::vector<RadixItem> tmp(items.size());
+	for (int b = 0; b < 8; ++b) {
+		// Skip bytes which are the same for every key
+		size_t *cnt = counts[b];
+		if (cnt[(items[0].key >> (b * 8)) & 0xff] == items.size()) {
+			continue;
+		}
+
+		size_t offsets[256];
+		size_t sum = 0;
+		for (int i = 0; i < 256; ++i) {
+			offsets[i] = sum;
+			sum += cnt[i];
+		}
+
+		for (auto &item: items) {
+			tmp[offsets[(item.key >> (b * 8)) & 0xff]++] = item;
+		}
+
+		items.swap(tmp);
+	}
+}
+
+// A temporary file, removed as soon as it's created.
+class TempFile {
+public:
+	explicit TempFile(const std::string &dir) {
+		std::string path = dir;
+		if (path.empty()) {
+			const char *tmpdir = getenv("TMPDIR");
+			path = tmpdir && tmpdir[0] ? tmpdir : "/tmp";
+		}
+		path += "/sbon-sort-XXXXXX";
+
+		fd_ = mkstemp(path.data());
+		if (fd_ < 0) {
+			throw std::system_error(errno, std::generic_category(), path);
+		}
+
+		unlink(path.c_str());
+	}
+
+	TempFile(const TempFile &) = delete;
+	TempFile &operator=(const TempFile &) = delete;
+
+	~TempFile() {
+		if (fd_ >= 0) {
+			close(fd_);
+		}
+	}
+
+	int fd() const {
+		return fd_;
+	}
+
+	void write(const char *data, size_t size) {
+		while (size > 0) {
+			ssize_t n = ::write(fd_, data, size);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::system_error(errno, std::generic_category(), "write");
+			}
+			data += n;
+			size -= n;
+		}
+	}
+
+	// Read up to 'size' bytes from 'offset', returns the number of bytes read.
+	size_t read(uint64_t offset, char *data, size_t size) const {
+		size_t total = 0;
+		while (total < size) {
+			ssize_t n = ::pread(fd_, data + total, size - total, offset + total);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::system_error(errno, std::generic_category(), "read");
+			}
+			if (n == 0) {
+				break;
+			}
+			total += n;
+		}
+
+		return total;
+	}
+
+private:
+	int fd_ = -1;
+};
+
+// Run files are written and read in blocks of at least this size.
+constexpr size_t MIN_RUN_BLOCK_SIZE = 4096;
+
+// Append an entry to a run file buffer.
+// Each entry is a 64-bit key length, the key, a 64-bit record length,
+// and the record, with lengths in native byte order.
+inline void appendRunEntry(std::string &buf, std::string_view key, std::string_view rec) {
+	uint64_t keyLen = key.size();
+	uint64_t recLen = rec.size();
+	buf.append((const char *)&keyLen, 8);
+	buf.append(key);
+	buf.append((const char *)&recLen, 8);
+	buf.append(rec);
+}
+
+// Sequential reader of the entries in a run file.
+// The buffer grows if an entry doesn't fit in it.
+class RunReader {
+public:
+	RunReader(const TempFile &file, size_t bufferSize): file_(&file) {
+		buf_.resize(std::max(bufferSize, MIN_RUN_BLOCK_SIZE));
+	}
+
+	// Load the next entry; returns false at the end of the run.
+	bool next() {
+		pos_ = entryEnd_;
+		uint64_t keyLen;
+		if (!ensure(8)) {
+			return false;
+		}
+		std::memcpy(&keyLen, &buf_[pos_], 8);
+
+		uint64_t recLen;
+		if (!ensure(8 + keyLen + 8)) {
+			throw ParseError("Truncated run file");
+		}
+		std::memcpy(&recLen, &buf_[pos_ + 8 + keyLen], 8);
+
+		if (!ensure(8 + keyLen + 8 + recLen)) {
+			throw ParseError("Truncated run file");
+		}
+
+		key_ = std::string_view(&buf_[pos_ + 8], keyLen);
+		record_ = std::string_view(&buf_[pos_ + 8 + keyLen + 8], recLen);
+		entryEnd_ = pos_ + 8 + keyLen + 8 + recLen;
+		return true;
+	}
+
+	std::string_view key() const {
+		return key_;
+	}
+
+	std::string_view record() const {
+		return record_;
+	}
+
+private:
+	// Make sure 'size' bytes starting at pos_ are in the buffer.
+	bool ensure(size_t size) {
+		if (fill_ - pos_ >= size) {
+			return true;
+		}
+
+		// Move the partial entry to the start of the buffer and refill
+		std::memmove(buf_.data(), buf_.data() + pos_, fill_ - pos_);
+		fill_ -= pos_;
+		entryEnd_ -= pos_;
+		pos_ = 0;
+		if (buf_.size() < size) {
+			buf_.resize(std::max(size, buf_.size() * 2));
+		}
+
+		size_t n = file_->read(fileOffset_, buf_.data() + fill_, buf_.size() - fill_);
+		fileOffset_ += n;
+		fill_ += n;
+		return fill_ >= size;
+	}
+
+	const TempFile *file_;
+	std::vector<char> buf_;
+	uint64_t fileOffset_ = 0;
+	size_t pos_ = 0;
+	size_t fill_ = 0;
+	size_t entryEnd_ = 0;
+	std::string_view key_;
+	std::string_view record_;
+};
+
+// Merge 'count' sorted runs with a k-way merge, calling 'func(key, record)'
+// for each entry in order. Ties go to the earlier run, to stay stable.
+template<typename Func>
+void mergeRuns(
+		const std::unique_ptr<TempFile> *files, size_t count,
+		size_t bufferSize, Func func) {
+	std::vector<RunReader> readers;
+	readers.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		readers.emplace_back(*files[i], bufferSize);
+	}
+
+	auto greater = [&](size_t a, size_t b) {
+		int cmp = readers[a].key().compare(readers[b].key());
+		return cmp > 0 || (cmp == 0 && a > b);
+	};
+	std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+	for (size_t i = 0; i < readers.size(); ++i) {
+		if (readers[i].next()) {
+			heap.push(i);
+		}
+	}
+
+	while (!heap.empty()) {
+		size_t i = heap.top();
+		heap.pop();
+		func(readers[i].key(), readers[i].record());
+		if (readers[i].next()) {
+			heap.push(i);
+		}
+	}
+}
+
+}
+
+// Sorts one in-memory batch of records.
+class RecordSorter {
+public:
+	explicit RecordSorter(const std::vector<std::string> &keys) {
+		for (auto &key: keys) {
+			ids_.push_back(paths_.add(key));
+		}
+	}
+
+	// Sort the records in 'input', calling 'func(std::string_view key, Span record)'
+	// for each record in sorted order. The key is the memcmp-comparable sort key.
+	template<typename Func>
+	void sort(Span input, Func func) const {
+		std::vector<Span> records;
+		forEachRecord(input, [&](Span rec) {
+			records.push_back(rec);
+		});
+
+		if (records.empty()) {
+			return;
+		}
+
+		std::vector<detail::RadixItem> numeric;
+		std::vector<RawValue> vals;
+		if (numericKeys(records, numeric, vals)) {
+			std::string key;
+			for (auto &item: numeric) {
+				key.clear();
+				detail::appendSortKey(key, vals[item.index]);
+				func(std::string_view(key), records[item.index]);
+			}
+			return;
+		}
+
+		// General case: extract every key into one buffer,
+		// then sort indexes by comparing the keys
+		std::string keyBuf;
+		std::vector<size_t> keyOffsets;
+		std::vector<Span> scratch;
+		keyOffsets.reserve(records.size() + 1);
+		for (auto &rec: records) {
+			keyOffsets.push_back(keyBuf.size());
+			extractKey(rec, keyBuf, scratch);
+		}
+		keyOffsets.push_back(keyBuf.size());
+
+		auto keyOf = [&](size_t i) {
+			return std::string_view(
+				keyBuf.data() + keyOffsets[i], keyOffsets[i + 1] - keyOffsets[i]);
+		};
+
+		std::vector<size_t> order(records.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = i;
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			return keyOf(a) < keyOf(b);
+		});
+
+		for (size_t i: order) {
+			func(keyOf(i), records[i]);
+		}
+	}
+
+	// Append the sort key of 'record' to 'out'.
+	void extractKey(Span record, std::string &out) const {
+		std::vector<Span> scratch;
+		extractKey(record, out, scratch);
+	}
+
+private:
+	void extractKey(Span record, std::string &out, std::vector<Span> &vals) const {
+		vals.assign(ids_.size(), Span{});
+		paths_.visit(record, [&](size_t id, RawValue val) {
+			vals[id] = val.span();
+			return true;
+		});
+
+		for (size_t id: ids_) {
+			if (vals[id].begin) {
+				detail::appendSortKey(out, RawValue(vals[id]));
+			} else {
+				out += '\0';
+			}
+		}
+	}
+
+	// When sorting by a single key which is an integer in every record,
+	// or a number in every record, the key fits in 64 bits
+	// and the records can be radix sorted.
+	bool numericKeys(
+			const std::vector<Span> &records,
+			std::vector<detail::RadixItem> &items,
+			std::vector<RawValue> &vals) const {
+		if (ids_.size() != 1) {
+			return false;
+		}
+
+		vals.resize(records.size());
+		bool allInts = true;
+		for (size_t i = 0; i < records.size(); ++i) {
+			bool found = false;
+			paths_.visit(records[i], [&](size_t, RawValue val) {
+				vals[i] = val;
+				found = true;
+				return true;
+			});
+
+			// Elements of delta-encoded arrays are decoded into a buffer
+			// which only lasts until the next visit, so leave those
+			// to the general case
+			if (!found || vals[i].span().begin < records[i].begin ||
+					vals[i].span().end > records[i].end) {
+				return false;
+			}
+
+			Type type = vals[i].getType();
+			if (type == Type::INT) {
+				continue;
+			} else if (type == Type::UINT) {
+				if (vals[i].getUInt() > (uint64_t)INT64_MAX) {
+					allInts = false;
+				}
+			} else if (type == Type::FLOAT || type == Type::DOUBLE) {
+				allInts = false;
+			} else {
+				return false;
+			}
+		}
+
+		items.resize(records.size());
+		for (size_t i = 0; i < records.size(); ++i) {
+			items[i].index = i;
+			if (allInts) {
+				items[i].key = detail::orderedInt(vals[i].getInt());
+			} else {
+				// Integers which doubles can't represent exactly would throw
+				// from getDouble, so round them like appendSortKey does
+				Type type = vals[i].getType();
+				double d;
+				if (type == Type::INT) {
+					d = (double)vals[i].getInt();
+				} else if (type == Type::UINT) {
+					d = (double)vals[i].getUInt();
+				} else if (type == Type::FLOAT) {
+					d = vals[i].getFloat();
+				} else {
+					d = vals[i].getDouble();
+				}
+				items[i].key = detail::orderedDouble(d);
+			}
+		}
+
+		detail::radixSort(items);
+
+		// Doubles can't tell apart some large integers,
+		// so fall back to the exact comparison if any keys are equal
+		if (!allInts) {
+			for (size_t i = 1; i < items.size(); ++i) {
+				if (items[i].key == items[i - 1].key) {
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	PathSet paths_;
+	std::vector<size_t> ids_;
+};
+
+// Sort all records in 'input', and write them to 'os'.
+inline void sortRecords(Span input, std::ostream &os, const SortOptions &opts) {
+	RecordSorter sorter(opts.keys);
+	unsigned threads = opts.threads == 0 ? 1 : opts.threads;
+
+	// Cut the input into runs, such that all the runs
+	// which are sorted in parallel fit in the memory limit together
+	size_t runSize = std::max<size_t>(opts.memoryLimit / threads, 1);
+	std::vector<Span> runs;
+	const char *runStart = input.begin;
+	forEachRecord(input, [&](Span rec) {
+		if ((size_t)(rec.end - runStart) >= runSize) {
+			runs.push_back({runStart, rec.end});
+			runStart = rec.end;
+		}
+	});
+	if (runStart != input.end) {
+		runs.push_back({runStart, input.end});
+	}
+
+	if (runs.size() <= 1) {
+		if (!runs.empty()) {
+			sorter.sort(runs[0], [&](std::string_view, Span rec) {
+				os.write(rec.begin, rec.size());
+			});
+		}
+		return;
+	}
+
+	// Write each sorted run to a temporary file
+	std::vector<std::unique_ptr<detail::TempFile>> files(runs.size());
+	size_t writeBlock = std::max(runSize / 16, detail::MIN_RUN_BLOCK_SIZE);
+	parallelFor(runs.size(), threads, [&](size_t i) {
+		files[i] = std::make_unique<detail::TempFile>(opts.tempDir);
+		std::string buf;
+		sorter.sort(runs[i], [&](std::string_view key, Span rec) {
+			detail::appendRunEntry(buf, key, rec.view());
+			if (buf.size() >= writeBlock) {
+				files[i]->write(buf.data(), buf.size());
+				buf.clear();
+			}
+		});
+		files[i]->write(buf.data(), buf.size());
+	});
+
+	// While there are too many runs to merge at once, merge consecutive
+	// groups of them into longer runs. Groups are merged in parallel,
+	// so each merge gets its share of the memory limit.
+	size_t fanIn = std::max<size_t>(opts.maxFanIn, 2);
+	while (files.size() > fanIn) {
+		std::vector<std::unique_ptr<detail::TempFile>> merged(
+			(files.size() + fanIn - 1) / fanIn);
+		unsigned mergeThreads = (unsigned)std::min<size_t>(threads, merged.size());
+		size_t bufferSize = opts.memoryLimit / mergeThreads / (fanIn + 1);
+		parallelFor(merged.size(), mergeThreads, [&](size_t i) {
+			size_t begin = i * fanIn;
+			size_t count = std::min(fanIn, files.size() - begin);
+			merged[i] = std::make_unique<detail::TempFile>(opts.tempDir);
+			std::string buf;
+			detail::mergeRuns(&files[begin], count, bufferSize,
+					[&](std::string_view key, std::string_view rec) {
+				detail::appendRunEntry(buf, key, rec);
+				if (buf.size() >= std::max(bufferSize, detail::MIN_RUN_BLOCK_SIZE)) {
+					merged[i]->write(buf.data(), buf.size());
+					buf.clear();
+				}
+			});
+			merged[i]->write(buf.data(), buf.size());
+
+			// Free the disk space of the merged runs early
+			for (size_t j = begin; j < begin + count; ++j) {
+				files[j].reset();
+			}
+		});
+		files.swap(merged);
+	}
+
+	detail::mergeRuns(files.data(), files.size(), opts.memoryLimit / files.size(),
+			[&](std::string_view, std::string_view rec) {
+		os.write(rec.data(), rec.size());
+	});
+}
+
+}
+
+#endif
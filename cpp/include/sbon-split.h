@@ -0,0 +1,160 @@
+#ifndef SBON_SPLIT_H
+#define SBON_SPLIT_H
+
+// Splitting a stream of records, or the elements of one top-level array,
+// into shards. Boundaries are found with a structural scan which never
+// decodes values, and records are copied to the shards as raw bytes.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace sbon {
+
+enum class ShardMode {
+	// Contiguous shards with roughly the same number of bytes
+	BYTES,
+
+	// Contiguous shards with roughly the same number of records
+	COUNT,
+
+	// Records with the same value at a key path go to the same shard
+	HASH,
+};
+
+// Get the elements of the array in 'array'. The elements of a delta-encoded
+// array aren't in its bytes, so they're encoded into 'storage' instead.
+inline std::vector<Span> arrayElements(Span array, std::string &storage) {
+	std::vector<Span> elems;
+	if (array.size() > 0 && *array.begin == '#') {
+		std::vector<int64_t> ints;
+		RawValue(array).getInts(ints);
+
+		// Each element takes at most 11 bytes, and 'storage' mustn't move
+		storage.assign(ints.size() * 11, '\0');
+		char *p = storage.data();
+		for (int64_t num: ints) {
+			char *end = detail::encodeInt(num, p);
+			elems.push_back({p, end});
+			p = end;
+		}
+		return elems;
+	} else if (array.size() == 0 || *array.begin != '[') {
+		throw ParseError("arrayElements: Expected '['");
+	}
+
+	const char *p = array.begin + 1;
+	while (true) {
+		detail::checkAvail(p, array.end, 1);
+		if (*p == ']') {
+			break;
+		}
+
+		const char *end = skipValue(p, array.end);
+		elems.push_back({p, end});
+		p = end;
+	}
+
+	return elems;
+}
+
+// Assign 'records' to 'count' shards.
+// For ShardMode::HASH, 'keyPath' is the path to hash;
+// records without that key go to shard 0.
+inline std::vector<std::vector<Span>> shardRecords(
+		const std::vector<Span> &records, size_t count,
+		ShardMode mode, std::string_view keyPath = {}) {
+	std::vector<std::vector<Span>> shards(count == 0 ? 1 : count);
+	count = shards.size();
+
+	if (mode == ShardMode::HASH) {
+		PathSet paths;
+		paths.add(keyPath);
+		for (auto &rec: records) {
+			uint64_t hash = 0;
+			paths.visit(rec, [&](size_t, RawValue val) {
+				hash = detail::hashBytes(val.span().begin, val.span().size());
+				return true;
+			});
+			shards[hash % count].push_back(rec);
+		}
+
+		return shards;
+	}
+
+	size_t total = 0;
+	if (mode == ShardMode::BYTES) {
+		for (auto &rec: records) {
+			total += rec.size();
+		}
+	} else {
+		total = records.size();
+	}
+
+	// Start a new shard once the records so far pass its share of the total
+	size_t shard = 0;
+	size_t seen = 0;
+	for (auto &rec: records) {
+		size_t weight = mode == ShardMode::BYTES ? rec.size() : 1;
+		while (shard + 1 < count && seen >= total * (shard + 1) / count) {
+			shard += 1;
+		}
+
+		shards[shard].push_back(rec);
+		seen += weight;
+	}
+
+	return shards;
+}
+
+// Write each shard to its own file, in parallel.
+// The shard files are named '<prefix><index><suffix>', with zero-padded indexes.
+// If 'asArray' is true, each shard is written as one array of its records.
+// Returns the file names.
+inline std::vector<std::string> writeShards(
+		const std::vector<std::vector<Span>> &shards,
+		const std::string &prefix, const std::string &suffix,
+		bool asArray, unsigned threads = defaultThreads()) {
+	std::vector<std::string> names;
+	size_t digits = std::to_string(shards.size() - 1).size();
+	for (size_t i = 0; i < shards.size(); ++i) {
+		std::string idx = std::to_string(i);
+		names.push_back(prefix + std::string(digits - idx.size(), '0') + idx + suffix);
+	}
+
+	parallelFor(shards.size(), threads, [&](size_t i) {
+		std::ofstream os(names[i], std::ios::binary);
+		if (!os) {
+			throw std::system_error(errno, std::generic_category(), names[i]);
+		}
+
+		if (asArray) {
+			os << '[';
+		}
+
+		for (auto &rec: shards[i]) {
+			os.write(rec.begin, rec.size());
+		}
+
+		if (asArray) {
+			os << ']';
+		}
+
+		os.close();
+		if (!os) {
+			throw std::system_error(errno, std::generic_category(), names[i]);
+		}
+	});
+
+	return names;
+}
+
+}
+
+#endif
@@ -0,0 +1,525 @@
+#ifndef SBON_TAPE_H
+#define SBON_TAPE_H
+
+// A structural index ("tape") of one large document, which can be saved to
+// a companion file so that later opens only need to mmap the document and
+// its tape instead of scanning the document again.
+//
+// The tape has one entry per value, in document order. Each entry records
+// where the value and its key are, and the index of the entry after its
+// last descendant, so that a value's siblings can be reached without
+// visiting its children.
+//
+// Tape files start with a header which records the size, modification time
+// and a sampled fingerprint of the document it was built from, so that
+// a tape for a changed document is detected as stale and rebuilt.
+// Tape files are in native byte order; a tape from a machine with
+// a different byte order fails the version check and is rebuilt.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sbon {
+
+struct TapeEntry {
+	// The offset of the value in the document
+	uint64_t offset;
+
+	// The size of the encoded value in bytes
+	uint64_t length;
+
+	// The index of the entry after this value's last descendant
+	uint64_t next;
+
+	// The length of the value's key, if it's an object member.
+	// The key ends right before the value, with its NUL terminator.
+	uint32_t keyLen;
+
+	// The number of elements or members, if the value is an array or object.
+	// Building a tape fails for containers with more than UINT32_MAX.
+	uint32_t count;
+};
+
+static_assert(sizeof(TapeEntry) == 32);
+
+namespace detail {
+
+// Key lengths are stored in 32 bits.
+inline uint32_t tapeKeyLen(size_t size) {
+	if (size > UINT32_MAX) {
+		throw ParseError("buildTape: Key too long");
+	}
+	return (uint32_t)size;
+}
+
+// Append the entries for the value at 'p', which has a key of 'keyLen' bytes,
+// to 'entries', and move 'p' past it. Offsets are relative to 'base',
+// and 'next' indexes are indexes into 'entries'.
+inline void appendTape(
+		const char *&p, const char *end, const char *base, uint32_t keyLen,
+		std::vector<TapeEntry> &entries) {
+	std::vector<size_t> stack;
+
+	// Add the entry for the value at 'p', with a key of 'keyLen' bytes
+	auto value = [&](uint32_t keyLen) {
+		checkAvail(p, end, 1);
+		if (!stack.empty()) {
+			TapeEntry &parent = entries[stack.back()];
+			if (parent.count == UINT32_MAX) {
+				throw ParseError("buildTape: Too many elements or members");
+			}
+			parent.count += 1;
+		}
+
+		size_t idx = entries.size();
+		entries.push_back({(uint64_t)(p - base), 0, 0, keyLen, 0});
+		if (*p == '[' || *p == '{') {
+			stack.push_back(idx);
+			p += 1;
+		} else {
+			const char *valEnd = skipValue(p, end);
+			entries[idx].length = valEnd - p;
+			entries[idx].next = idx + 1;
+			p = valEnd;
+		}
+	};
+
+	value(keyLen);
+	while (!stack.empty()) {
+		TapeEntry &top = entries[stack.back()];
+		char open = base[top.offset];
+		checkAvail(p, end, 1);
+		if (*p == (open == '[' ? ']' : '}')) {
+			p += 1;
+			top.length = (p - base) - top.offset;
+			top.next = entries.size();
+			stack.pop_back();
+		} else if (open == '[') {
+			value(0);
+		} else {
+			const char *valp = skipCString(p, end);
+			uint32_t keyLen = tapeKeyLen(valp - p - 1);
+			p = valp;
+			value(keyLen);
+		}
+	}
+}
+
+// Build the tape for the single value in 'data'.
+inline std::vector<TapeEntry> buildTape(Span data) {
+	std::vector<TapeEntry> entries;
+	const char *p = data.begin;
+	appendTape(p, data.end, data.begin, 0, entries);
+	if (p != data.end) {
+		throw ParseError("buildTape: Trailing data after document");
+	}
+
+	return entries;
+}
+
+// Hash 8 bytes at a time, for checksumming tapes quickly.
+inline uint64_t hashWords(const char *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * 0x100000001b3ull;
+		hash ^= hash >> 29;
+	}
+	return hashBytes(data + i, size - i, hash);
+}
+
+// A fingerprint of the document, from its size and 16 sampled 4 KiB blocks
+// spread over the whole document including both ends.
+inline uint64_t fingerprint(Span data) {
+	constexpr size_t SAMPLES = 16;
+	constexpr size_t BLOCK = 4096;
+
+	size_t size = data.size();
+	uint64_t hash = hashWords((const char *)&size, sizeof(size));
+	if (size <= SAMPLES * BLOCK) {
+		return hashWords(data.begin, size, hash);
+	}
+
+	for (size_t i = 0; i < SAMPLES; ++i) {
+		size_t offset = (size - BLOCK) / (SAMPLES - 1) * i;
+		hash = hashWords(data.begin + offset, BLOCK, hash);
+	}
+	return hash;
+}
+
+struct TapeHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t entrySize;
+	uint64_t dataSize;
+	uint64_t dataMtime;
+	uint64_t dataFingerprint;
+	uint64_t entryCount;
+	uint64_t tapeChecksum;
+	uint64_t headerChecksum;
+};
+
+static_assert(sizeof(TapeHeader) == 64);
+
+constexpr char TAPE_MAGIC[8] = {'S', 'B', 'O', 'N', 'T', 'A', 'P', 'E'};
+constexpr uint32_t TAPE_VERSION = 1;
+
+inline uint64_t headerChecksum(const TapeHeader &header) {
+	return hashWords((const char *)&header, offsetof(TapeHeader, headerChecksum));
+}
+
+inline uint64_t mtimeOf(const char *path) {
+	struct stat st;
+	if (::stat(path, &st) < 0) {
+		throw std::system_error(errno, std::generic_category(), path);
+	}
+	return (uint64_t)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+}
+
+}
+
+class TapeDocument;
+
+// A value in a TapeDocument. Navigating only reads the tape;
+// the value itself is only read when it's decoded through raw().
+//
+// A tape file is only checksummed when it's opened with Options::verify,
+// so every entry is checked against the sizes of the document and the tape
+// when it's reached, and a corrupt tape throws a ParseError instead of
+// reading out of bounds.
+class TapeValue {
+public:
+	TapeValue() = default;
+
+	// Whether this refers to a value; lookups which find nothing return an invalid TapeValue.
+	explicit operator bool() const {
+		return entry_ != nullptr;
+	}
+
+	Type getType() const {
+		return raw().getType();
+	}
+
+	// The key of this value, if it's an object member.
+	std::string_view key() const {
+		if (entry_->keyLen == 0) {
+			return {};
+		}
+		return std::string_view(data_ + entry_->offset - entry_->keyLen - 1, entry_->keyLen);
+	}
+
+	// The number of elements or members.
+	// The elements of a delta-encoded array have no entries of their own,
+	// so they're counted from its bytes, and read with raw().getInts().
+	size_t size() const {
+		if (entry_->count == 0 && data_[entry_->offset] == '#') {
+			const char *p = data_ + entry_->offset + 1;
+			return (size_t)detail::readLEB128(p, p + entry_->length - 1);
+		}
+
+		return entry_->count;
+	}
+
+	Span span() const {
+		const char *begin = data_ + entry_->offset;
+		return {begin, begin + entry_->length};
+	}
+
+	// The raw value, for decoding it.
+	RawValue raw() const {
+		return RawValue(span());
+	}
+
+	// The element at 'index' of an array, or the member at 'index' of an object.
+	// If every child is a single entry, such as in arrays of numbers or
+	// strings, this takes constant time. Otherwise, it steps over the
+	// children before 'index', so use forEachChild to visit every child.
+	TapeValue at(size_t index) const {
+		if (index >= entry_->count) {
+			return {};
+		}
+
+		uint64_t first = this->index() + 1;
+		if (entry_->next - first == entry_->count) {
+			return entry(first + index);
+		}
+
+		TapeValue child = entry(first);
+		for (size_t i = 0; i < index; ++i) {
+			child = entry(child.entry_->next);
+		}
+		return child;
+	}
+
+	// The member with key 'key' of an object.
+	// This compares the keys of the members in turn.
+	TapeValue get(std::string_view key) const {
+		if (data_[entry_->offset] != '{') {
+			return {};
+		}
+
+		uint64_t child = index() + 1;
+		for (size_t i = 0; i < entry_->count; ++i) {
+			TapeValue val = entry(child);
+			if (val.key() == key) {
+				return val;
+			}
+			child = val.entry_->next;
+		}
+		return {};
+	}
+
+	// Call 'func(TapeValue)' for each element or member.
+	template<typename Func>
+	void forEachChild(Func func) const {
+		uint64_t child = index() + 1;
+		for (size_t i = 0; i < entry_->count; ++i) {
+			TapeValue val = entry(child);
+			func(val);
+			child = val.entry_->next;
+		}
+	}
+
+	// Find the value at a dot-separated path such as "users.3.name".
+	// As with PathSet, numeric components are array indexes.
+	TapeValue find(std::string_view path) const {
+		TapeValue val = *this;
+		while (val && !path.empty()) {
+			size_t dot = path.find('.');
+			std::string_view comp = path.substr(0, dot);
+			path = dot == std::string_view::npos ? std::string_view() : path.substr(dot + 1);
+
+			char ch = data_[val.entry_->offset];
+			if (ch == '{') {
+				val = val.get(comp);
+			} else if (ch == '[') {
+				size_t index = 0;
+				auto res = std::from_chars(comp.data(), comp.data() + comp.size(), index);
+				if (res.ec != std::errc() || res.ptr != comp.data() + comp.size()) {
+					return {};
+				}
+				val = val.at(index);
+			} else {
+				return {};
+			}
+		}
+		return val;
+	}
+
+private:
+	TapeValue(Span data, const TapeEntry *entries, size_t count, const TapeEntry *entry):
+		data_(data.begin), dataSize_(data.size()), entries_(entries), count_(count),
+		entry_(entry) {}
+
+	uint64_t index() const {
+		return entry_ - entries_;
+	}
+
+	// The value of the entry at 'index', which must be a valid entry:
+	// its value and key must be within the document, and its 'next' index
+	// must be after it and within the tape
+	TapeValue entry(uint64_t index) const {
+		if (index >= count_) {
+			throw ParseError("Corrupt tape: Entry out of range");
+		}
+
+		const TapeEntry *e = entries_ + index;
+		if (e->offset >= dataSize_ || e->length == 0 || e->length > dataSize_ - e->offset ||
+				(e->keyLen > 0 && e->keyLen >= e->offset) ||
+				e->next <= index || e->next > count_) {
+			throw ParseError("Corrupt tape: Entry out of range");
+		}
+
+		TapeValue val = *this;
+		val.entry_ = e;
+		return val;
+	}
+
+	const char *data_ = nullptr;
+	size_t dataSize_ = 0;
+	const TapeEntry *entries_ = nullptr;
+	size_t count_ = 0;
+	const TapeEntry *entry_ = nullptr;
+
+	friend class TapeDocument;
+};
+
+// A document opened together with its tape.
+class TapeDocument {
+public:
+	struct Options {
+		// The tape file; by default the document's path with ".tape" appended
+		std::string tapePath;
+
+		// Verify the checksum of the whole tape when opening it,
+		// rather than trusting the header
+		bool verify = false;
+
+		// Write a new tape file if there's no valid one
+		bool save = true;
+	};
+
+	explicit TapeDocument(const char *path): TapeDocument(path, Options{}) {}
+
+	// Open the document at 'path'. If there's a valid tape file, it's mapped;
+	// otherwise the tape is built, and saved if 'opts.save' is set.
+	TapeDocument(const char *path, Options opts) {
+		std::string tapePath = opts.tapePath.empty() ? std::string(path) + ".tape" : opts.tapePath;
+		uint64_t mtime = detail::mtimeOf(path);
+		data_ = std::make_unique<MappedFile>(path);
+
+		if (loadTape(tapePath.c_str(), mtime, opts.verify)) {
+			return;
+		}
+
+		built_ = detail::buildTape(data_->span());
+		entries_ = built_.data();
+		count_ = built_.size();
+		rebuilt_ = true;
+
+		if (opts.save) {
+			saveTape(tapePath, mtime);
+		}
+	}
+
+	TapeValue root() const {
+		return TapeValue(data_->span(), entries_, count_, nullptr).entry(0);
+	}
+
+	TapeValue find(std::string_view path) const {
+		return root().find(path);
+	}
+
+	// The number of values in the document.
+	size_t size() const {
+		return count_;
+	}
+
+	// The tape itself, with size() entries.
+	const TapeEntry *entries() const {
+		return entries_;
+	}
+
+	Span span() const {
+		return data_->span();
+	}
+
+	// Whether the tape was built when opening, rather than loaded from the tape file.
+	bool rebuilt() const {
+		return rebuilt_;
+	}
+
+private:
+	bool loadTape(const char *tapePath, uint64_t mtime, bool verify) {
+		if (::access(tapePath, R_OK) < 0) {
+			return false;
+		}
+
+		auto tape = std::make_unique<MappedFile>(tapePath);
+		if (tape->size() < sizeof(detail::TapeHeader)) {
+			return false;
+		}
+
+		detail::TapeHeader header;
+		std::memcpy(&header, tape->data(), sizeof(header));
+		Span data = data_->span();
+		bool valid =
+			std::memcmp(header.magic, detail::TAPE_MAGIC, sizeof(header.magic)) == 0 &&
+			header.version == detail::TAPE_VERSION &&
+			header.entrySize == sizeof(TapeEntry) &&
+			header.headerChecksum == detail::headerChecksum(header) &&
+			header.dataSize == data.size() &&
+			header.dataMtime == mtime &&
+			header.entryCount > 0 &&
+			tape->size() == sizeof(header) + header.entryCount * sizeof(TapeEntry) &&
+			header.dataFingerprint == detail::fingerprint(data);
+		if (!valid) {
+			return false;
+		}
+
+		const char *entries = tape->data() + sizeof(header);
+		size_t entriesSize = header.entryCount * sizeof(TapeEntry);
+		if (verify && detail::hashWords(entries, entriesSize) != header.tapeChecksum) {
+			return false;
+		}
+
+		tape_ = std::move(tape);
+		entries_ = (const TapeEntry *)entries;
+		count_ = header.entryCount;
+		return true;
+	}
+
+	// Write the tape to a temporary file and rename it into place,
+	// so that readers never see a partially written tape.
+	// Failing to save isn't an error, since the tape is already built.
+	void saveTape(const std::string &tapePath, uint64_t mtime) {
+		detail::TapeHeader header{};
+		std::memcpy(header.magic, detail::TAPE_MAGIC, sizeof(header.magic));
+		header.version = detail::TAPE_VERSION;
+		header.entrySize = sizeof(TapeEntry);
+		header.dataSize = data_->size();
+		header.dataMtime = mtime;
+		header.dataFingerprint = detail::fingerprint(data_->span());
+		header.entryCount = built_.size();
+		header.tapeChecksum = detail::hashWords(
+			(const char *)built_.data(), built_.size() * sizeof(TapeEntry));
+		header.headerChecksum = detail::headerChecksum(header);
+
+		std::string tmpPath = tapePath + ".tmp";
+		int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd < 0) {
+			return;
+		}
+
+		bool ok = writeAll(fd, (const char *)&header, sizeof(header)) &&
+			writeAll(fd, (const char *)built_.data(), built_.size() * sizeof(TapeEntry));
+		ok = ::close(fd) == 0 && ok;
+		if (!ok || ::rename(tmpPath.c_str(), tapePath.c_str()) < 0) {
+			::unlink(tmpPath.c_str());
+		}
+	}
+
+	static bool writeAll(int fd, const char *data, size_t size) {
+		while (size > 0) {
+			ssize_t n = ::write(fd, data, size);
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+
+			data += n;
+			size -= n;
+		}
+
+		return true;
+	}
+
+	std::unique_ptr<MappedFile> data_;
+	std::unique_ptr<MappedFile> tape_;
+	std::vector<TapeEntry> built_;
+	const TapeEntry *entries_ = nullptr;
+	size_t count_ = 0;
+	bool rebuilt_ = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,723 @@
+#ifndef SBON_VIEW_H
+#define SBON_VIEW_H
+
+// A lazily built outline of a stream of records, for viewing large files
+// one screen at a time.
+//
+// Nothing is scanned up front. The children of a container are found
+// only as lines are visited, by skipping over the ones before them, and
+// only the start of each child seen so far is kept. Collapsed containers
+// are shown with a short preview of their first members, and binaries
+// with a hexdump preview; an expanded binary shows a full hexdump.
+
+#include "sbon.h"
+#include "sbon-records.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace sbon {
+
+class Outline {
+public:
+	enum class Kind {
+		STREAM,
+		ARRAY,
+		OBJECT,
+		BINARY,
+	};
+
+	// An expanded (or previously expanded) value, or the stream of records.
+	struct Node {
+		Kind kind;
+		Node *parent;
+
+		// The index of the value in its parent
+		size_t index;
+
+		// The indentation of the node's children
+		uint32_t depth;
+
+		// The node's contents: after the opening bracket, or the binary data
+		const char *begin;
+		const char *end;
+
+		// Where each child found so far starts, including its key
+		std::vector<const char *> starts;
+
+		// The closing bracket (or the end of the stream), once all children are found
+		const char *close = nullptr;
+		bool complete = false;
+
+		bool expanded = false;
+		std::unordered_map<size_t, std::unique_ptr<Node>> children;
+
+		// For a delta-encoded array: the number of elements not found yet,
+		// and the value of each one found so far
+		bool delta = false;
+		uint64_t left = 0;
+		std::vector<int64_t> ints;
+	};
+
+	// A line of the outline: the child at 'index' of 'node', the closing
+	// bracket of 'node' if 'index' is CLOSE, or a hexdump row of a binary.
+	struct Line {
+		Node *node = nullptr;
+		size_t index = 0;
+
+		explicit operator bool() const {
+			return node != nullptr;
+		}
+
+		bool operator==(const Line &other) const = default;
+	};
+
+	static constexpr size_t CLOSE = SIZE_MAX;
+	static constexpr size_t HEX_ROW = 16;
+
+	// Show the records in 'data', which must outlive the Outline.
+	explicit Outline(Span data) {
+		root_.kind = Kind::STREAM;
+		root_.parent = nullptr;
+		root_.index = 0;
+		root_.depth = 0;
+		root_.begin = data.begin;
+		root_.end = data.end;
+		root_.expanded = true;
+	}
+
+	Outline(const Outline &) = delete;
+	Outline &operator=(const Outline &) = delete;
+
+	// The first line, or an invalid line if there are no records.
+	Line first() {
+		return has(&root_, 0) ? Line{&root_, 0} : Line{};
+	}
+
+	// The last line. This has to skip over every record.
+	Line last() {
+		completeNode(&root_);
+		return root_.starts.empty() ? Line{} : lastLine(&root_, root_.starts.size() - 1);
+	}
+
+	// The line after 'line', or an invalid line at the end.
+	Line next(Line line) {
+		Node *n = line.node;
+		if (line.index == CLOSE) {
+			return after(n->parent, n->index);
+		}
+
+		if (n->kind != Kind::BINARY) {
+			if (Node *child = expandedChild(n, line.index)) {
+				if (has(child, 0)) {
+					return {child, 0};
+				} else if (child->kind != Kind::BINARY) {
+					return {child, CLOSE};
+				}
+			}
+		}
+
+		return after(n, line.index);
+	}
+
+	// The line before 'line', or an invalid line at the start.
+	Line prev(Line line) {
+		Node *n = line.node;
+		if (line.index == CLOSE) {
+			completeNode(n);
+			if (n->starts.empty()) {
+				return {n->parent, n->index};
+			}
+			return lastLine(n, n->starts.size() - 1);
+		}
+
+		if (line.index > 0) {
+			return n->kind == Kind::BINARY ? Line{n, line.index - 1} : lastLine(n, line.index - 1);
+		} else if (n->kind == Kind::STREAM) {
+			return {};
+		}
+
+		return {n->parent, n->index};
+	}
+
+	// The indentation level of a line.
+	uint32_t depth(Line line) const {
+		return line.index == CLOSE ? line.node->depth - 1 : line.node->depth;
+	}
+
+	// Whether the line shows an array or object.
+	bool isContainer(Line line) const {
+		if (line.index == CLOSE || line.node->kind == Kind::BINARY || line.node->delta) {
+			return false;
+		}
+
+		const char *p = valueStart(line.node, line.index);
+		detail::checkAvail(p, line.node->end, 1);
+		return *p == '[' || *p == '{' || *p == '#';
+	}
+
+	// Whether the line shows a container, or a non-empty binary.
+	bool canExpand(Line line) const {
+		if (line.index == CLOSE || line.node->kind == Kind::BINARY || line.node->delta) {
+			return false;
+		}
+
+		const char *p = valueStart(line.node, line.index);
+		detail::checkAvail(p, line.node->end, 1);
+		if (*p == 'B') {
+			p += 1;
+			return detail::readLEB128(p, line.node->end) > 0;
+		}
+		return *p == '[' || *p == '{' || *p == '#';
+	}
+
+	bool isExpanded(Line line) const {
+		return line.index != CLOSE && line.node->kind != Kind::BINARY &&
+			expandedChild(line.node, line.index);
+	}
+
+	// Expand the value on 'line', if it can be expanded.
+	// Children found before it was collapsed are remembered.
+	bool expand(Line line) {
+		if (!canExpand(line)) {
+			return false;
+		}
+
+		Node *n = line.node;
+		auto &child = n->children[line.index];
+		if (!child) {
+			const char *p = valueStart(n, line.index);
+			child = std::make_unique<Node>();
+			child->parent = n;
+			child->index = line.index;
+			child->depth = n->depth + 1;
+			child->end = n->end;
+			if (*p == 'B') {
+				p += 1;
+				uint64_t size = detail::readLEB128(p, n->end);
+				detail::checkAvail(p, n->end, size);
+				child->kind = Kind::BINARY;
+				child->begin = p;
+				child->end = p + size;
+			} else if (*p == '#') {
+				// Its elements are found by decoding the differences in turn
+				p += 1;
+				child->kind = Kind::ARRAY;
+				child->delta = true;
+				child->left = detail::readLEB128(p, n->end);
+				child->begin = p;
+			} else {
+				child->kind = *p == '[' ? Kind::ARRAY : Kind::OBJECT;
+				child->begin = p + 1;
+			}
+		}
+
+		child->expanded = true;
+		return true;
+	}
+
+	void collapse(Line line) {
+		if (line.index == CLOSE || line.node->kind == Kind::BINARY) {
+			return;
+		}
+
+		auto it = line.node->children.find(line.index);
+		if (it != line.node->children.end()) {
+			it->second->expanded = false;
+		}
+	}
+
+	// The line for the value which contains 'line', or an invalid line for a record.
+	Line enclosing(Line line) const {
+		Node *n = line.node;
+		return n->kind == Kind::STREAM ? Line{} : Line{n->parent, n->index};
+	}
+
+	// 'line' if it's visible, or else the line of its outermost collapsed
+	// container, e.g. after collapsing a container with 'line' in it.
+	Line reveal(Line line) const {
+		Line visible = line;
+		for (Node *n = line.node; n->kind != Kind::STREAM; n = n->parent) {
+			if (!n->expanded) {
+				visible = {n->parent, n->index};
+			}
+		}
+		return visible;
+	}
+
+	// Expand the values along a dot-separated path such as "0.users.3",
+	// which starts with the record index, and return the line of the value
+	// at the end of it, or an invalid line if there's no such value.
+	Line find(std::string_view path) {
+		Line line;
+		Node *n = &root_;
+		while (true) {
+			size_t dot = path.find('.');
+			std::string_view comp = path.substr(0, dot);
+			path = dot == std::string_view::npos ? std::string_view() : path.substr(dot + 1);
+
+			size_t index = 0;
+			if (n->kind == Kind::OBJECT) {
+				while (has(n, index) && key(n, index) != comp) {
+					index += 1;
+				}
+			} else {
+				auto res = std::from_chars(comp.data(), comp.data() + comp.size(), index);
+				if (res.ec != std::errc() || res.ptr != comp.data() + comp.size()) {
+					return {};
+				}
+			}
+
+			if (!has(n, index)) {
+				return {};
+			}
+
+			line = {n, index};
+			if (dot == std::string_view::npos) {
+				return line;
+			}
+
+			if (!isContainer(line)) {
+				return {};
+			}
+			expand(line);
+			n = n->children[index].get();
+		}
+	}
+
+	// The path of the value on a line, in the form accepted by find().
+	std::string path(Line line) const {
+		std::vector<std::string> comps;
+		Node *n = line.node;
+		if (line.index != CLOSE && n->kind != Kind::BINARY) {
+			comps.push_back(component(n, line.index));
+		}
+		for (; n->kind != Kind::STREAM; n = n->parent) {
+			comps.push_back(component(n->parent, n->index));
+		}
+
+		std::string str;
+		for (size_t i = comps.size(); i-- > 0;) {
+			str += comps[i];
+			if (i > 0) {
+				str += '.';
+			}
+		}
+		return str;
+	}
+
+	// The offset in the file of what's shown on a line.
+	uint64_t offset(Line line) const {
+		Node *n = line.node;
+		const char *p;
+		if (n->kind == Kind::BINARY) {
+			p = n->begin + line.index * HEX_ROW;
+		} else if (line.index == CLOSE) {
+			p = n->close;
+		} else {
+			p = n->starts[line.index];
+		}
+		return p - root_.begin;
+	}
+
+	// The text of a line, cut to about 'width' bytes. Malformed values
+	// are shown with their parse error.
+	std::string render(Line line, size_t width) const {
+		std::string out(depth(line) * 2, ' ');
+		Node *n = line.node;
+		try {
+			if (n->kind == Kind::BINARY) {
+				appendHexRow(out, n, line.index);
+			} else if (line.index == CLOSE) {
+				out += n->kind == Kind::ARRAY ? ']' : '}';
+			} else {
+				appendEscaped(out, component(n, line.index), width);
+				out += ": ";
+				const char *p = valueStart(n, line.index);
+				if (n->delta) {
+					appendNumber(out, n->ints[line.index]);
+				} else if (Node *child = expandedChild(n, line.index)) {
+					if (child->kind == Kind::BINARY) {
+						out += "<" + std::to_string(child->end - child->begin) + " bytes>";
+					} else {
+						out += *p == '{' ? '{' : '[';
+					}
+				} else {
+					appendPreview(out, p, n->end, width, false);
+				}
+			}
+		} catch (ParseError &err) {
+			out += "<";
+			out += err.what();
+			out += ">";
+		}
+
+		truncate(out, width);
+		return out;
+	}
+
+	// The number of bytes skipped over so far to find children.
+	uint64_t scannedBytes() const {
+		return scanned_;
+	}
+
+private:
+	static constexpr size_t PREVIEW_SKIP = 4096;
+
+	static std::string component(Node *n, size_t index) {
+		return n->kind == Kind::OBJECT ? std::string(key(n, index)) : std::to_string(index);
+	}
+
+	static std::string_view key(Node *n, size_t index) {
+		const char *p = n->starts[index];
+		return std::string_view(p, detail::skipCString(p, n->end) - p - 1);
+	}
+
+	static const char *valueStart(Node *n, size_t index) {
+		const char *p = n->starts[index];
+		if (n->kind == Kind::OBJECT) {
+			p = detail::skipCString(p, n->end);
+		}
+		return p;
+	}
+
+	static size_t rows(Node *n) {
+		return (n->end - n->begin + HEX_ROW - 1) / HEX_ROW;
+	}
+
+	static Node *expandedChild(Node *n, size_t index) {
+		auto it = n->children.find(index);
+		if (it == n->children.end() || !it->second->expanded) {
+			return nullptr;
+		}
+		return it->second.get();
+	}
+
+	// The end of child 'index', skipping over it unless it's already known
+	const char *childEnd(Node *n, size_t index) {
+		if (index + 1 < n->starts.size()) {
+			return n->starts[index + 1];
+		} else if (n->delta) {
+			const char *p = n->starts[index];
+			detail::readLEB128(p, n->end);
+			return p;
+		}
+
+		auto it = n->children.find(index);
+		if (it != n->children.end()) {
+			Node *child = it->second.get();
+			if (child->kind == Kind::BINARY) {
+				return child->end;
+			} else if (child->complete) {
+				// A delta-encoded array has no closing bracket
+				return child->delta ? child->close : child->close + 1;
+			}
+		}
+
+		const char *p = valueStart(n, index);
+		const char *end = skipValue(p, n->end);
+		scanned_ += end - p;
+		return end;
+	}
+
+	// Whether 'n' has a child 'index', finding the children up to it
+	bool has(Node *n, size_t index) {
+		if (n->kind == Kind::BINARY) {
+			return index < rows(n);
+		}
+
+		while (n->starts.size() <= index) {
+			if (n->complete) {
+				return false;
+			}
+
+			const char *p = n->starts.empty() ? n->begin : childEnd(n, n->starts.size() - 1);
+			bool done;
+			if (n->kind == Kind::STREAM) {
+				done = p == n->end;
+			} else if (n->delta) {
+				done = n->left == 0;
+			} else {
+				detail::checkAvail(p, n->end, 1);
+				done = *p == (n->kind == Kind::ARRAY ? ']' : '}');
+			}
+
+			if (done) {
+				n->complete = true;
+				n->close = p;
+				return false;
+			}
+			n->starts.push_back(p);
+
+			if (n->delta) {
+				uint64_t total = n->ints.empty() ? 0 : (uint64_t)n->ints.back();
+				total += (uint64_t)detail::unZigZag(detail::readLEB128(p, n->end));
+				n->ints.push_back((int64_t)total);
+				n->left -= 1;
+			}
+		}
+
+		return true;
+	}
+
+	void completeNode(Node *n) {
+		while (has(n, n->starts.size())) {}
+	}
+
+	Line after(Node *n, size_t index) {
+		if (has(n, index + 1)) {
+			return {n, index + 1};
+		} else if (n->kind == Kind::STREAM) {
+			return {};
+		} else if (n->kind == Kind::BINARY) {
+			return after(n->parent, n->index);
+		}
+		return {n, CLOSE};
+	}
+
+	// The last line of child 'index' of 'n'
+	Line lastLine(Node *n, size_t index) {
+		Node *child = expandedChild(n, index);
+		if (!child) {
+			return {n, index};
+		} else if (child->kind == Kind::BINARY) {
+			return {child, rows(child) - 1};
+		}
+
+		completeNode(child);
+		return {child, CLOSE};
+	}
+
+	static void truncate(std::string &out, size_t width) {
+		if (out.size() <= width) {
+			return;
+		}
+
+		// Don't cut a UTF-8 sequence in half
+		size_t size = width;
+		while (size > 0 && (out[size] & 0xc0) == 0x80) {
+			size -= 1;
+		}
+		out.resize(size);
+	}
+
+	static void appendEscaped(std::string &out, std::string_view str, size_t limit) {
+		static const char hex[] = "0123456789abcdef";
+		for (char ch: str) {
+			if (out.size() >= limit) {
+				return;
+			}
+
+			unsigned char uch = (unsigned char)ch;
+			if (ch == '"' || ch == '\\') {
+				out += '\\';
+				out += ch;
+			} else if (ch == '\n') {
+				out += "\\n";
+			} else if (ch == '\t') {
+				out += "\\t";
+			} else if (uch < 0x20 || uch == 0x7f) {
+				// Control characters would be interpreted by the terminal
+				out += "\\x";
+				out += hex[uch >> 4];
+				out += hex[uch & 0x0f];
+			} else {
+				out += ch;
+			}
+		}
+	}
+
+	static void appendHex(std::string &out, const char *p, size_t size) {
+		static const char hex[] = "0123456789abcdef";
+		for (size_t i = 0; i < size; ++i) {
+			unsigned char uch = (unsigned char)p[i];
+			if (i > 0) {
+				out += ' ';
+			}
+			out += hex[uch >> 4];
+			out += hex[uch & 0x0f];
+		}
+	}
+
+	static void appendHexRow(std::string &out, Node *n, size_t row) {
+		char buf[24];
+		auto res = std::to_chars(buf, buf + sizeof(buf), row * HEX_ROW, 16);
+		out.append(8 - std::min<size_t>(8, res.ptr - buf), '0');
+		out.append(buf, res.ptr);
+		out += "  ";
+
+		const char *p = n->begin + row * HEX_ROW;
+		size_t size = std::min<size_t>(HEX_ROW, n->end - p);
+		appendHex(out, p, size);
+		out.append((HEX_ROW - size) * 3 + 2, ' ');
+		out += '|';
+		for (size_t i = 0; i < size; ++i) {
+			out += p[i] >= 0x20 && p[i] < 0x7f ? p[i] : '.';
+		}
+		out += '|';
+	}
+
+	template<typename T>
+	static void appendNumber(std::string &out, T num) {
+		char buf[32];
+		auto res = std::to_chars(buf, buf + sizeof(buf), num);
+		out.append(buf, res.ptr);
+	}
+
+	// Append a preview of the elements of the delta-encoded array at 'p',
+	// after the '#'. Returns like appendPreview.
+	static const char *appendDeltaPreview(
+			std::string &out, const char *p, const char *end, size_t limit) {
+		uint64_t count = detail::readLEB128(p, end);
+		uint64_t total = 0;
+		out += '[';
+		for (uint64_t i = 0; i < count; ++i) {
+			if (i > 0) {
+				out += ", ";
+			}
+			if (out.size() >= limit) {
+				out += "…";
+				return nullptr;
+			}
+
+			total += (uint64_t)detail::unZigZag(detail::readLEB128(p, end));
+			appendNumber(out, (int64_t)total);
+		}
+		out += ']';
+		return p;
+	}
+
+	// Append a preview of the value at 'p', stopping once 'out' is 'limit'
+	// bytes long. Returns the end of the value, or null if the preview
+	// stopped before it. Containers in containers aren't shown, and are
+	// only skipped if they're small.
+	static const char *appendPreview(
+			std::string &out, const char *p, const char *end, size_t limit, bool nested) {
+		detail::checkAvail(p, end, 1);
+		switch (*p) {
+		case 'T':
+			out += "true";
+			return p + 1;
+		case 'F':
+			out += "false";
+			return p + 1;
+		case 'N':
+			out += "null";
+			return p + 1;
+
+		case 'S': {
+			const char *str = p + 1;
+			size_t avail = std::min<size_t>(end - str, limit > out.size() ? limit - out.size() + 1 : 1);
+			const char *nul = (const char *)std::memchr(str, '\0', avail);
+			out += '"';
+			appendEscaped(out, std::string_view(str, nul ? nul - str : avail), limit);
+			if (!nul) {
+				out += "…";
+				return nullptr;
+			}
+			out += '"';
+			return nul + 1;
+		}
+
+		case 'B': {
+			p += 1;
+			uint64_t size = detail::readLEB128(p, end);
+			detail::checkAvail(p, end, size);
+			out += "<" + std::to_string(size) + " bytes";
+			if (size > 0) {
+				out += ": ";
+				appendHex(out, p, std::min<uint64_t>(size, 8));
+				if (size > 8) {
+					out += " …";
+				}
+			}
+			out += ">";
+			return p + size;
+		}
+
+		case '[': case '{': case '#': {
+			// Delta-encoded arrays are shown like ordinary ones
+			char open = *p == '{' ? '{' : '[';
+			char close = open == '[' ? ']' : '}';
+			if (nested) {
+				const char *valEnd = nullptr;
+				try {
+					valEnd = skipValue(p, std::min<const char *>(end, p + PREVIEW_SKIP));
+				} catch (ParseError &) {}
+				out += open;
+				out += "…";
+				out += close;
+				if (!valEnd) {
+					out += "…";
+				}
+				return valEnd;
+			} else if (*p == '#') {
+				return appendDeltaPreview(out, p + 1, end, limit);
+			}
+
+			bool object = *p == '{';
+			out += *p;
+			p += 1;
+			for (bool first = true;; first = false) {
+				detail::checkAvail(p, end, 1);
+				if (*p == close) {
+					out += close;
+					return p + 1;
+				}
+
+				if (!first) {
+					out += ", ";
+				}
+				if (out.size() >= limit) {
+					out += "…";
+					return nullptr;
+				}
+
+				if (object) {
+					const char *valp = detail::skipCString(p, end);
+					appendEscaped(out, std::string_view(p, valp - p - 1), limit);
+					out += ": ";
+					p = valp;
+				}
+
+				p = appendPreview(out, p, end, limit, true);
+				if (!p) {
+					return nullptr;
+				}
+			}
+		}
+
+		default: {
+			RawValue val = RawValue::at(p, end);
+			switch (val.getType()) {
+			case Type::FLOAT:
+				appendNumber(out, val.getFloat());
+				break;
+			case Type::DOUBLE:
+				appendNumber(out, val.getDouble());
+				break;
+			case Type::INT:
+				appendNumber(out, val.getInt());
+				break;
+			default:
+				appendNumber(out, val.getUInt());
+				break;
+			}
+			return val.span().end;
+		}
+		}
+	}
+
+	Node root_;
+	uint64_t scanned_ = 0;
+};
+
+}
+
+#endif
@@ -1,9 +1,15 @@
 #ifndef SBON_H
 #define SBON_H
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <cstddef>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <cstring>
 #include <cstdint>
 #include <exception>
@@ -11,6 +17,10 @@
 #include <vector>
 #include <string>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace sbon {
 
 class LogicError: public std::exception {
@@ -35,6 +45,814 @@ private:
 	std::string str_;
 };
 
+class CancelledError: public std::exception {
+public:
+	const char *what() const noexcept override {
+		return "SBON decoding cancelled";
+	}
+};
+
+// A cancellation token and optional deadline for readers.
+// Readers check it every 'interval' bytes, and throw a CancelledError
+// once it has been cancelled or the deadline has passed. Values which were
+// already passed to callbacks stay valid, so callers can keep partial results.
+//
+// cancel() may be called from any thread, but a Cancellation must only be
+// used by one reader (and its child readers) at a time.
+class Cancellation {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr uint32_t DEFAULT_INTERVAL = 4096;
+
+	explicit Cancellation(uint32_t interval = DEFAULT_INTERVAL):
+		interval_(interval ? interval : 1), countdown_(interval_) {}
+
+	explicit Cancellation(Clock::time_point deadline, uint32_t interval = DEFAULT_INTERVAL):
+		hasDeadline_(true), deadline_(deadline),
+		interval_(interval ? interval : 1), countdown_(interval_) {}
+
+	template<typename Rep, typename Period>
+	static Cancellation after(
+			std::chrono::duration<Rep, Period> timeout,
+			uint32_t interval = DEFAULT_INTERVAL) {
+		return Cancellation(
+			Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout), interval);
+	}
+
+	Cancellation(const Cancellation &other):
+		hasDeadline_(other.hasDeadline_), deadline_(other.deadline_),
+		interval_(other.interval_), countdown_(interval_),
+		cancelled_(other.cancelled_.load(std::memory_order_relaxed)) {}
+
+	void cancel() {
+		cancelled_.store(true, std::memory_order_relaxed);
+	}
+
+	bool cancelled() const {
+		return cancelled_.load(std::memory_order_relaxed) ||
+			(hasDeadline_ && Clock::now() >= deadline_);
+	}
+
+	// Count 'n' consumed bytes, and check for cancellation
+	// once at least 'interval' bytes have been consumed since the last check.
+	void tick(uint32_t n = 1) {
+		if (countdown_ > n) {
+			countdown_ -= n;
+			return;
+		}
+
+		countdown_ = interval_;
+		if (cancelled()) {
+			throw CancelledError();
+		}
+	}
+
+private:
+	bool hasDeadline_ = false;
+	Clock::time_point deadline_;
+	uint32_t interval_;
+	uint32_t countdown_;
+	std::atomic<bool> cancelled_{false};
+};
+
+namespace detail {
+
+// The decoders below read their input through a 'next' function
+// which returns the next byte as a char, so that they can be shared
+// between the stream based Reader and the in-memory scanners.
+
+template<typename Next>
+inline uint64_t decodeLEB128(Next next) {
+	uint64_t num = 0;
+	uint64_t shift = 0;
+	unsigned char ch;
+	do {
+		ch = (unsigned char)next();
+		num |= (uint64_t)(ch & 0x7f) << shift;
+		shift += 7;
+	} while (ch >= 0x80);
+	return num;
+}
+
+template<typename Next>
+inline float decodeFloat(Next next) {
+	static_assert(sizeof(float) == 4);
+	static_assert(sizeof(std::uint32_t) == 4);
+
+	uint32_t n = 0;
+	n |= (uint32_t)(unsigned char)next() << 0;
+	n |= (uint32_t)(unsigned char)next() << 8;
+	n |= (uint32_t)(unsigned char)next() << 16;
+	n |= (uint32_t)(unsigned char)next() << 24;
+
+	float f;
+	std::memcpy(&f, &n, 4);
+	return f;
+}
+
+template<typename Next>
+inline double decodeDouble(Next next) {
+	static_assert(sizeof(double) == 8);
+	static_assert(sizeof(std::uint64_t) == 8);
+
+	uint64_t n = 0;
+	n |= (uint64_t)(unsigned char)next() << 0;
+	n |= (uint64_t)(unsigned char)next() << 8;
+	n |= (uint64_t)(unsigned char)next() << 16;
+	n |= (uint64_t)(unsigned char)next() << 24;
+	n |= (uint64_t)(unsigned char)next() << 32;
+	n |= (uint64_t)(unsigned char)next() << 40;
+	n |= (uint64_t)(unsigned char)next() << 48;
+	n |= (uint64_t)(unsigned char)next() << 56;
+
+	double d;
+	std::memcpy(&d, &n, 8);
+	return d;
+}
+
+// 64-bit FNV-1a, used for hashing keys and values.
+constexpr uint64_t HASH_SEED = 0xcbf29ce484222325ull;
+
+constexpr uint64_t hashByte(uint64_t hash, char ch) {
+	return (hash ^ (unsigned char)ch) * 0x100000001b3ull;
+}
+
+constexpr uint64_t hashBytes(const char *data, size_t size, uint64_t hash = HASH_SEED) {
+	for (size_t i = 0; i < size; ++i) {
+		hash = hashByte(hash, data[i]);
+	}
+	return hash;
+}
+
+// Decode the number whose tag byte is 'ch'.
+template<typename T, typename Next>
+inline T decodeNumber(char ch, Next next) {
+	if (ch >= '0' && ch <= '9') {
+		unsigned char u = ch - '0';
+		return (T)u;
+	} else if (ch == '+') {
+		uint64_t u = decodeLEB128(next);
+		T num(u);
+		if ((uint64_t)num != u) {
+			throw ParseError("getNumber: Got unrepresentable number");
+		}
+
+		return num;
+	} else if (ch == '-') {
+		uint64_t u = decodeLEB128(next);
+		if (u > (uint64_t)(std::numeric_limits<int64_t>::max())) {
+			throw ParseError("getNumber: Got unrepresentable number");
+		}
+
+		int64_t i = -(int64_t)u;
+		T num(i);
+		if ((int64_t)num != i) {
+			throw ParseError("getNumber: Got unrepresentable number");
+		}
+
+		return num;
+	} else if (ch == 'f') {
+		float f = decodeFloat(next);
+		T num(f);
+		if ((float)num != f) {
+			throw ParseError("getNumber: Got unrepresentable number");
+		}
+
+		return num;
+	} else if (ch == 'd') {
+		double d = decodeDouble(next);
+		T num(d);
+		if ((double)num != d) {
+			throw ParseError("getNumber: Got unrepresentable number");
+		}
+
+		return num;
+	} else {
+		throw ParseError("getNumber: Expected number");
+	}
+}
+
+// Bit 'i' is set if byte 'i' of the 16 bytes at 'p' has its high bit set,
+// i.e. if it's a non-terminal LEB128 byte.
+inline uint32_t continuationMask16(const char *p) {
+#if defined(__SSE2__)
+	__m128i vec = _mm_loadu_si128((const __m128i *)p);
+	return (uint32_t)_mm_movemask_epi8(vec);
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < 16; ++i) {
+		mask |= (uint32_t)((unsigned char)p[i] >> 7) << i;
+	}
+	return mask;
+#endif
+}
+
+// Decode an LEB128 number of 'len' bytes, where 1 <= len <= 8,
+// from the 8 bytes at 'p'. The 7-bit groups are packed in three steps
+// instead of one byte at a time.
+inline uint64_t decodeShortLEB128(const char *p, unsigned len) {
+	uint64_t x;
+	std::memcpy(&x, p, 8);
+	if constexpr (std::endian::native == std::endian::big) {
+		x = __builtin_bswap64(x);
+	}
+
+	x &= ~(uint64_t)0 >> (64 - len * 8);
+	x = ((x & 0x7f007f007f007f00ull) >> 1) | (x & 0x007f007f007f007full);
+	x = ((x & 0x3fff00003fff0000ull) >> 2) | (x & 0x00003fff00003fffull);
+	x = ((x & 0x0fffffff00000000ull) >> 4) | (x & 0x000000000fffffffull);
+	return x;
+}
+
+// Decode a run of integer values (immediate digits, '+' or '-' followed
+// by LEB128) from [p, end) into 'out', a 16-byte window at a time.
+// Returns a pointer to the first byte which wasn't consumed: either a
+// value which isn't an integer, a number which needs more than 8 LEB128
+// bytes, or a value too close to 'end' to decode with whole-window loads.
+// The caller is expected to decode whatever is left the slow way.
+inline const char *decodeIntRun(const char *p, const char *end, std::vector<int64_t> &out) {
+	// Every load in a window must stay within the input:
+	// a 16 byte classification load, plus 8 bytes for a payload
+	// which starts at the window's last byte
+	while (end - p >= 24) {
+		uint32_t cont = continuationMask16(p);
+		unsigned pos = 0;
+		while (pos < 16) {
+			char tag = p[pos];
+			if (tag >= '0' && tag <= '9') {
+				out.push_back(tag - '0');
+				pos += 1;
+				continue;
+			} else if (tag != '+' && tag != '-') {
+				return p + pos;
+			}
+
+			// The payload ends at the first byte without the high bit set,
+			// which has to be inside the window
+			uint32_t rest = ~(cont >> (pos + 1)) & (0xffffu >> (pos + 1));
+			if (rest == 0) {
+				if (15 - pos >= 8) {
+					return p + pos;
+				}
+				break;
+			}
+
+			unsigned len = (unsigned)__builtin_ctz(rest) + 1;
+			if (len > 8) {
+				return p + pos;
+			}
+
+			uint64_t u = decodeShortLEB128(p + pos + 1, len);
+			out.push_back(tag == '+' ? (int64_t)u : -(int64_t)u);
+			pos += 1 + len;
+		}
+
+		p += pos;
+	}
+
+	return p;
+}
+
+// Delta-encoded integer arrays ('#') store each element as the zig-zag
+// encoded difference from the previous one, so that small steps in either
+// direction take one byte.
+inline uint64_t zigZag(int64_t num) {
+	return ((uint64_t)num << 1) ^ (uint64_t)(num >> 63);
+}
+
+inline int64_t unZigZag(uint64_t num) {
+	return (int64_t)(num >> 1) ^ -(int64_t)(num & 1);
+}
+
+inline size_t sizeLEB128(uint64_t num) {
+	return (std::bit_width(num | 1) + 6) / 7;
+}
+
+inline void appendLEB128(std::string &out, uint64_t num) {
+	do {
+		unsigned char ch = num & 0x7f;
+		num >>= 7;
+		if (num) {
+			ch |= 0x80;
+		}
+		out += (char)ch;
+	} while (num);
+}
+
+// Encode 'num' as an ordinary integer value, like Writer::writeInt does,
+// into 'out', which must have room for 11 bytes. Returns the end.
+inline char *encodeInt(int64_t num, char *out) {
+	if (num >= 0 && num <= 9) {
+		*out++ = (char)('0' + num);
+		return out;
+	}
+
+	uint64_t u = num < 0 ? 0 - (uint64_t)num : (uint64_t)num;
+	*out++ = num < 0 ? '-' : '+';
+	do {
+		*out++ = (char)((u & 0x7f) | (u > 0x7f ? 0x80 : 0));
+		u >>= 7;
+	} while (u);
+	return out;
+}
+
+// Decode the zig-zag LEB128 differences of a '#' array from [p, end) into
+// [out, outEnd), adding each to the running 'total', a 16-byte window at
+// a time like decodeIntRun. Advances 'out'. Windows of 16 one-byte or 8
+// two-byte differences, which is what a regular series usually looks like,
+// are decoded without finding the length of each.
+inline const char *decodeDeltaRun(
+		const char *p, const char *end, int64_t *&out, int64_t *outEnd, uint64_t &total) {
+	while (end - p >= 24 && out != outEnd) {
+		uint32_t cont = continuationMask16(p);
+		if (cont == 0 && outEnd - out >= 16) {
+			for (int i = 0; i < 16; ++i) {
+				total += (uint64_t)unZigZag((unsigned char)p[i]);
+				out[i] = (int64_t)total;
+			}
+			out += 16;
+			p += 16;
+			continue;
+		} else if (cont == 0x5555 && outEnd - out >= 8) {
+			for (int i = 0; i < 8; ++i) {
+				uint64_t lo = (unsigned char)p[i * 2] & 0x7f;
+				uint64_t hi = (unsigned char)p[i * 2 + 1];
+				total += (uint64_t)unZigZag(lo | hi << 7);
+				out[i] = (int64_t)total;
+			}
+			out += 8;
+			p += 16;
+			continue;
+		}
+
+		unsigned pos = 0;
+		while (pos < 16 && out != outEnd) {
+			uint32_t rest = ~(cont >> pos) & (0xffffu >> pos);
+			if (rest == 0) {
+				if (16 - pos >= 8) {
+					return p + pos;
+				}
+				break;
+			}
+
+			unsigned len = (unsigned)__builtin_ctz(rest) + 1;
+			if (len > 8) {
+				return p + pos;
+			}
+
+			total += (uint64_t)unZigZag(decodeShortLEB128(p + pos, len));
+			*out++ = (int64_t)total;
+			pos += len;
+		}
+
+		p += pos;
+	}
+
+	return p;
+}
+
+// std::streambuf doesn't let others look at its get area,
+// but a derived class may name the protected member functions,
+// and the resulting member pointers work on any streambuf.
+// This lets the bulk readers decode straight from a stream's buffer.
+struct StreamBufAccess: std::streambuf {
+	static const char *begin(std::streambuf *buf) {
+		return (buf->*&StreamBufAccess::gptr)();
+	}
+
+	static const char *end(std::streambuf *buf) {
+		return (buf->*&StreamBufAccess::egptr)();
+	}
+
+	static void consume(std::streambuf *buf, size_t n) {
+		(buf->*&StreamBufAccess::gbump)((int)n);
+	}
+};
+
+// The state of an ArrayReader over a delta-encoded array.
+// Elements are decoded from the stream one at a time as they're reached,
+// and each is presented to its Reader as an ordinary integer in a buffer.
+class DeltaElements: private std::streambuf {
+public:
+	DeltaElements() = default;
+	DeltaElements(const DeltaElements &) = delete;
+	DeltaElements &operator=(const DeltaElements &) = delete;
+
+	// The stream of the encoded element 'num'
+	std::istream *load(int64_t num) {
+		setg(buf_, buf_, encodeInt(num, buf_));
+		is_.clear();
+		return &is_;
+	}
+
+	uint64_t left = 0;
+
+	// Differences wrap around, so the sum is kept unsigned
+	uint64_t total = 0;
+
+private:
+	char buf_[16];
+	std::istream is_{this};
+};
+
+// Stores copies of strings in large blocks, so that views of them
+// stay valid until the arena is destroyed.
+class StringArena {
+public:
+	// Long strings get a block of their own.
+	std::string_view store(std::string_view str) {
+		if (str.size() > BLOCK_SIZE / 4) {
+			blocks_.push_back(std::make_unique<char[]>(str.size()));
+			std::memcpy(blocks_.back().get(), str.data(), str.size());
+			return std::string_view(blocks_.back().get(), str.size());
+		}
+
+		if (str.size() > blockLeft_) {
+			blocks_.push_back(std::make_unique<char[]>(BLOCK_SIZE));
+			blockPos_ = blocks_.back().get();
+			blockLeft_ = BLOCK_SIZE;
+		}
+
+		std::memcpy(blockPos_, str.data(), str.size());
+		std::string_view view(blockPos_, str.size());
+		blockPos_ += str.size();
+		blockLeft_ -= str.size();
+		return view;
+	}
+
+private:
+	static constexpr size_t BLOCK_SIZE = 4096;
+
+	std::vector<std::unique_ptr<char[]>> blocks_;
+	char *blockPos_ = nullptr;
+	size_t blockLeft_ = 0;
+};
+
+}
+
+// Assigns small, dense IDs to strings, so that low-cardinality string
+// values can be decoded with Reader::getInterned() without allocating,
+// and compared as integers afterwards. The strings are stored once,
+// and views of them stay valid for the table's lifetime.
+class StringTable {
+public:
+	static constexpr uint32_t NOT_FOUND = std::numeric_limits<uint32_t>::max();
+
+	uint32_t intern(std::string_view str) {
+		return intern(str, detail::hashBytes(str.data(), str.size()));
+	}
+
+	// 'hash' must be detail::hashBytes() of 'str'.
+	uint32_t intern(std::string_view str, uint64_t hash) {
+		if ((strings_.size() + 1) * 4 > slots_.size() * 3) {
+			grow();
+		}
+
+		size_t mask = slots_.size() - 1;
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			Slot &slot = slots_[i];
+			if (slot.id == NOT_FOUND) {
+				slot.hash = hash;
+				slot.id = (uint32_t)strings_.size();
+				strings_.push_back(arena_.store(str));
+				return slot.id;
+			} else if (slot.hash == hash && strings_[slot.id] == str) {
+				return slot.id;
+			}
+		}
+	}
+
+	// Returns NOT_FOUND if the string hasn't been interned.
+	uint32_t find(std::string_view str) const {
+		if (slots_.empty()) {
+			return NOT_FOUND;
+		}
+
+		uint64_t hash = detail::hashBytes(str.data(), str.size());
+		size_t mask = slots_.size() - 1;
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			const Slot &slot = slots_[i];
+			if (slot.id == NOT_FOUND ||
+					(slot.hash == hash && strings_[slot.id] == str)) {
+				return slot.id;
+			}
+		}
+	}
+
+	std::string_view view(uint32_t id) const {
+		return strings_[id];
+	}
+
+	size_t size() const {
+		return strings_.size();
+	}
+
+private:
+	friend class Reader;
+
+	struct Slot {
+		uint64_t hash = 0;
+		uint32_t id = NOT_FOUND;
+	};
+
+	void grow() {
+		std::vector<Slot> slots(slots_.empty() ? 16 : slots_.size() * 2);
+		size_t mask = slots.size() - 1;
+		for (auto &slot: slots_) {
+			if (slot.id == NOT_FOUND) {
+				continue;
+			}
+
+			size_t i = slot.hash & mask;
+			while (slots[i].id != NOT_FOUND) {
+				i = (i + 1) & mask;
+			}
+			slots[i] = slot;
+		}
+
+		slots_ = std::move(slots);
+	}
+
+	std::vector<Slot> slots_;
+	std::vector<std::string_view> strings_;
+	detail::StringArena arena_;
+
+	// Reused by Reader::getInterned() to collect the string
+	std::string scratch_;
+};
+
+// A compile-time mapping from string literals to enum values,
+// for Reader::getEnum(). It's meant for a handful of strings,
+// which are found by comparing their precomputed hashes.
+template<typename Enum, size_t N>
+class EnumStrings {
+public:
+	// Longer strings can't be matched without allocating
+	static constexpr size_t MAX_LENGTH = 64;
+
+	struct Entry {
+		std::string_view str;
+		Enum value;
+	};
+
+	constexpr EnumStrings(const Entry (&entries)[N]) {
+		for (size_t i = 0; i < N; ++i) {
+			if (entries[i].str.size() > MAX_LENGTH) {
+				throw LogicError();
+			}
+
+			entries_[i] = entries[i];
+			hashes_[i] = detail::hashBytes(entries[i].str.data(), entries[i].str.size());
+		}
+	}
+
+	constexpr const Entry *find(std::string_view str, uint64_t hash) const {
+		for (size_t i = 0; i < N; ++i) {
+			if (hashes_[i] == hash && entries_[i].str == str) {
+				return &entries_[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	constexpr const Entry *find(std::string_view str) const {
+		return find(str, detail::hashBytes(str.data(), str.size()));
+	}
+
+private:
+	Entry entries_[N] = {};
+	uint64_t hashes_[N] = {};
+};
+
+// A table of object keys with dense 32-bit IDs, shared between threads.
+// Lookups of known keys don't lock: they probe an index which is only
+// replaced (never modified in place) when it grows, and old indexes are
+// kept alive until the table is destroyed. Adding a new key takes a lock.
+class SymbolTable {
+public:
+	static constexpr uint32_t NOT_FOUND = std::numeric_limits<uint32_t>::max();
+
+	SymbolTable() {
+		auto index = std::make_unique<Index>(64);
+		index_.store(index.get(), std::memory_order_relaxed);
+		indexes_.push_back(std::move(index));
+	}
+
+	SymbolTable(const SymbolTable &) = delete;
+	SymbolTable &operator=(const SymbolTable &) = delete;
+
+	uint32_t intern(std::string_view name) {
+		uint64_t hash = detail::hashBytes(name.data(), name.size());
+		uint32_t id = lookup(index_.load(std::memory_order_acquire), name, hash);
+		if (id != NOT_FOUND) {
+			return id;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		Index *index = index_.load(std::memory_order_relaxed);
+		id = lookup(index, name, hash);
+		if (id != NOT_FOUND) {
+			return id;
+		}
+
+		id = (uint32_t)size_.load(std::memory_order_relaxed);
+		if (id == NOT_FOUND) {
+			throw LogicError();
+		}
+
+		// The name must be visible before its slot is
+		auto [segment, offset] = locate(id);
+		if (!segments_[segment].load(std::memory_order_relaxed)) {
+			segmentStorage_[segment] = std::make_unique<std::string_view[]>(segmentSize(segment));
+			segments_[segment].store(segmentStorage_[segment].get(), std::memory_order_release);
+		}
+		segments_[segment].load(std::memory_order_relaxed)[offset] = arena_.store(name);
+
+		if ((size_t)(id + 1) * 4 > (index->mask + 1) * 3) {
+			index = grow(index);
+		}
+
+		insert(index, hash, id);
+		size_.store(id + 1, std::memory_order_release);
+		return id;
+	}
+
+	// Returns NOT_FOUND if the key hasn't been interned.
+	uint32_t find(std::string_view name) const {
+		return lookup(index_.load(std::memory_order_acquire), name,
+			detail::hashBytes(name.data(), name.size()));
+	}
+
+	std::string_view name(uint32_t id) const {
+		auto [segment, offset] = locate(id);
+		return segments_[segment].load(std::memory_order_acquire)[offset];
+	}
+
+	size_t size() const {
+		return size_.load(std::memory_order_acquire);
+	}
+
+private:
+	// Each slot holds the top 32 bits of a key's hash and its ID + 1,
+	// so that 0 is an empty slot.
+	struct Index {
+		explicit Index(size_t size):
+			mask(size - 1), slots(std::make_unique<std::atomic<uint64_t>[]>(size)) {}
+
+		size_t mask;
+		std::unique_ptr<std::atomic<uint64_t>[]> slots;
+	};
+
+	// Names live in segments of doubling size, so that they never move.
+	static constexpr size_t FIRST_SEGMENT = 64;
+	static constexpr size_t SEGMENTS = 27;
+
+	static size_t segmentSize(size_t segment) {
+		return FIRST_SEGMENT << segment;
+	}
+
+	static std::pair<size_t, size_t> locate(uint32_t id) {
+		uint64_t x = (uint64_t)id + FIRST_SEGMENT;
+		size_t segment = std::bit_width(x) - std::bit_width(FIRST_SEGMENT);
+		return {segment, x - segmentSize(segment)};
+	}
+
+	uint32_t lookup(const Index *index, std::string_view name, uint64_t hash) const {
+		uint64_t tag = hash >> 32;
+		for (size_t i = hash & index->mask;; i = (i + 1) & index->mask) {
+			uint64_t slot = index->slots[i].load(std::memory_order_acquire);
+			if (slot == 0) {
+				return NOT_FOUND;
+			}
+
+			uint32_t id = (uint32_t)slot - 1;
+			if ((slot >> 32) == tag && this->name(id) == name) {
+				return id;
+			}
+		}
+	}
+
+	static void insert(Index *index, uint64_t hash, uint32_t id) {
+		size_t i = hash & index->mask;
+		while (index->slots[i].load(std::memory_order_relaxed) != 0) {
+			i = (i + 1) & index->mask;
+		}
+		index->slots[i].store((hash >> 32) << 32 | (id + 1), std::memory_order_release);
+	}
+
+	Index *grow(Index *index) {
+		auto bigger = std::make_unique<Index>((index->mask + 1) * 2);
+		for (size_t i = 0; i <= index->mask; ++i) {
+			uint64_t slot = index->slots[i].load(std::memory_order_relaxed);
+			if (slot != 0) {
+				std::string_view key = name((uint32_t)slot - 1);
+				insert(bigger.get(), detail::hashBytes(key.data(), key.size()), (uint32_t)slot - 1);
+			}
+		}
+
+		index_.store(bigger.get(), std::memory_order_release);
+		indexes_.push_back(std::move(bigger));
+		return indexes_.back().get();
+	}
+
+	std::atomic<Index *> index_;
+	std::atomic<std::string_view *> segments_[SEGMENTS] = {};
+	std::atomic<size_t> size_{0};
+
+	// Only used with the lock held
+	std::mutex mutex_;
+	std::vector<std::unique_ptr<Index>> indexes_;
+	std::unique_ptr<std::string_view[]> segmentStorage_[SEGMENTS];
+	detail::StringArena arena_;
+};
+
+// Decodes object keys to IDs in a SymbolTable, for ObjectReader::next().
+// Records in a stream tend to have the same keys in the same order,
+// so each key is first compared against the key at the same position
+// in the previous document, which needs neither hashing nor locking.
+// Call reset() at the start of each document.
+//
+// A KeyDecoder must only be used by one thread at a time,
+// but any number of them can share a table.
+class KeyDecoder {
+public:
+	explicit KeyDecoder(SymbolTable &table): table_(&table) {}
+
+	SymbolTable &table() {
+		return *table_;
+	}
+
+	void reset() {
+		prev_.swap(seq_);
+		seq_.clear();
+	}
+
+	// How many keys matched the prediction from the previous document
+	size_t predicted() const {
+		return predicted_;
+	}
+
+private:
+	friend class ObjectReader;
+
+	char nextKeyByte(std::istream *is, Cancellation *cancel) {
+		int ch = is->get();
+		if (ch == EOF) {
+			throw ParseError("ObjectReader::next: Unexpected EOF");
+		}
+
+		if (cancel) {
+			cancel->tick();
+		}
+
+		return (char)ch;
+	}
+
+	uint32_t read(std::istream *is, Cancellation *cancel) {
+		size_t pos = seq_.size();
+		char ch = 1;
+		scratch_.clear();
+		if (pos < prev_.size()) {
+			std::string_view expected = table_->name(prev_[pos]);
+			size_t i = 0;
+			while ((ch = nextKeyByte(is, cancel)) &&
+					i < expected.size() && expected[i] == ch) {
+				i += 1;
+			}
+
+			if (ch == 0 && i == expected.size()) {
+				predicted_ += 1;
+				seq_.push_back(prev_[pos]);
+				return prev_[pos];
+			}
+
+			// The bytes read so far matched the prediction
+			scratch_.assign(expected.data(), i);
+			if (ch) {
+				scratch_ += ch;
+			}
+		}
+
+		if (ch) {
+			while ((ch = nextKeyByte(is, cancel))) {
+				scratch_ += ch;
+			}
+		}
+
+		uint32_t id = table_->intern(scratch_);
+		seq_.push_back(id);
+		return id;
+	}
+
+	SymbolTable *table_;
+	std::vector<uint32_t> prev_;
+	std::vector<uint32_t> seq_;
+	std::string scratch_;
+	size_t predicted_ = 0;
+};
+
 class Writer;
 
 class ObjectWriter {
@@ -42,6 +860,7 @@ public:
 	explicit ObjectWriter(std::ostream *os): os_(os) {}
 
 	Writer key(const char *key);
+	Writer key(std::string_view key);
 
 private:
 	std::ostream *os_;
@@ -159,6 +978,13 @@ public:
 		}
 	}
 
+	// Write a value which is already SBON encoded, as-is.
+	void writeRaw(std::string_view encoded) {
+		checkReady();
+
+		os_->write(encoded.data(), encoded.size());
+	}
+
 	template<typename Func>
 	void writeArray(Func func) {
 		checkReady();
@@ -170,6 +996,61 @@ public:
 		*os_ << ']';
 	}
 
+	// Write an array of integers. Series with small steps, like timestamps
+	// or counters, are delta-encoded with '#' if that's smaller than '['.
+	// Only readers which support that extension can read them back.
+	void writeIntArray(const int64_t *data, std::size_t count) {
+		checkReady();
+
+		size_t plainSize = 2;
+		size_t deltaSize = 1 + detail::sizeLEB128(count);
+		uint64_t prev = 0;
+		for (size_t i = 0; i < count; ++i) {
+			uint64_t num = (uint64_t)data[i];
+			if (data[i] < 0 || data[i] > 9) {
+				plainSize += 1 + detail::sizeLEB128(data[i] < 0 ? 0 - num : num);
+			} else {
+				plainSize += 1;
+			}
+			deltaSize += detail::sizeLEB128(detail::zigZag((int64_t)(num - prev)));
+			prev = num;
+		}
+
+		std::string buf;
+		if (deltaSize < plainSize) {
+			buf.reserve(deltaSize);
+			buf += '#';
+			detail::appendLEB128(buf, count);
+			prev = 0;
+			for (size_t i = 0; i < count; ++i) {
+				detail::appendLEB128(buf, detail::zigZag((int64_t)((uint64_t)data[i] - prev)));
+				prev = (uint64_t)data[i];
+			}
+		} else {
+			buf.reserve(plainSize);
+			buf += '[';
+			for (size_t i = 0; i < count; ++i) {
+				int64_t num = data[i];
+				if (num < 0) {
+					buf += '-';
+					detail::appendLEB128(buf, 0 - (uint64_t)num);
+				} else if (num <= 9) {
+					buf += (char)('0' + num);
+				} else {
+					buf += '+';
+					detail::appendLEB128(buf, num);
+				}
+			}
+			buf += ']';
+		}
+
+		os_->write(buf.data(), buf.size());
+	}
+
+	void writeIntArray(const std::vector<int64_t> &ints) {
+		writeIntArray(ints.data(), ints.size());
+	}
+
 	template<typename Func>
 	void writeObject(Func func) {
 		checkReady();
@@ -206,6 +1087,12 @@ inline Writer ObjectWriter::key(const char *key) {
 	return Writer(os_);
 }
 
+inline Writer ObjectWriter::key(std::string_view key) {
+	os_->write(key.data(), key.size());
+	*os_ << '\0';
+	return Writer(os_);
+}
+
 enum class Type {
 	BOOL,
 	NIL,
@@ -224,11 +1111,18 @@ class ObjectMatcher;
 
 class ObjectReader {
 public:
-	explicit ObjectReader(std::istream *is): is_(is) {}
+	explicit ObjectReader(std::istream *is, Cancellation *cancel = nullptr):
+		is_(is), cancel_(cancel) {}
 
 	bool hasNext();
 	Reader next(std::string &key);
 
+	// Read the next key as an ID in the decoder's symbol table.
+	Reader next(KeyDecoder &keys, uint32_t &id);
+
+	// Skip the next key, and return the reader for its value.
+	Reader skipKey();
+
 	template<typename Func>
 	void all(Func func);
 
@@ -236,6 +1130,7 @@ public:
 
 private:
 	std::istream *is_;
+	Cancellation *cancel_;
 };
 
 class ObjectMatcher {
@@ -257,7 +1152,8 @@ private:
 
 class ArrayReader {
 public:
-	explicit ArrayReader(std::istream *is): is_(is) {}
+	explicit ArrayReader(std::istream *is, Cancellation *cancel = nullptr):
+		is_(is), cancel_(cancel) {}
 
 	bool hasNext();
 	Reader next();
@@ -265,14 +1161,29 @@ public:
 	template<typename Func>
 	void all(Func func);
 
+	// Read all the remaining elements, which must be integers, into 'ints'.
+	// This is much faster than reading them one at a time for long arrays,
+	// since runs of integers are decoded straight from the stream's buffer.
+	void getInts(std::vector<int64_t> &ints);
+
 private:
+	friend class Reader;
+
+	ArrayReader(std::istream *is, Cancellation *cancel, detail::DeltaElements *delta):
+		is_(is), cancel_(cancel), delta_(delta) {}
+
 	std::istream *is_;
+	Cancellation *cancel_;
+	detail::DeltaElements *delta_ = nullptr;
 };
 
 class Reader {
 public:
 	Reader() = default;
-	explicit Reader(std::istream *is): is_(is) {}
+
+	// If 'cancel' is given, decoding throws a CancelledError once it's cancelled.
+	explicit Reader(std::istream *is, Cancellation *cancel = nullptr):
+		is_(is), cancel_(cancel) {}
 
 	bool hasNext() {
 		return is_->peek() != EOF;
@@ -302,7 +1213,7 @@ public:
 			return Type::UINT;
 		} else if (ch == '-') {
 			return Type::INT;
-		} else if (ch == '[') {
+		} else if (ch == '[' || ch == '#') {
 			return Type::ARRAY;
 		} else if (ch == '{') {
 			return Type::OBJECT;
@@ -352,6 +1263,58 @@ public:
 		return str;
 	}
 
+	// Read a string and return its ID in 'table', adding it if it's new.
+	// The string is hashed while it's read, and doesn't allocate
+	// unless it's new to the table.
+	uint32_t getInterned(StringTable &table) {
+		checkReady();
+
+		if (is_->get() != 'S') {
+			throw ParseError("getInterned: Expected 'S'");
+		}
+
+		std::string &str = table.scratch_;
+		str.clear();
+		uint64_t hash = detail::HASH_SEED;
+		int ch;
+		while ((ch = next())) {
+			str += ch;
+			hash = detail::hashByte(hash, ch);
+		}
+
+		return table.intern(str, hash);
+	}
+
+	// Read a string and return its value in 'strings',
+	// or 'unknown' if it isn't one of them.
+	template<typename Enum, size_t N>
+	Enum getEnum(const EnumStrings<Enum, N> &strings, Enum unknown) {
+		checkReady();
+
+		if (is_->get() != 'S') {
+			throw ParseError("getEnum: Expected 'S'");
+		}
+
+		char buf[EnumStrings<Enum, N>::MAX_LENGTH];
+		size_t len = 0;
+		uint64_t hash = detail::HASH_SEED;
+		int ch;
+		while ((ch = next())) {
+			if (len < sizeof(buf)) {
+				buf[len] = ch;
+			}
+			len += 1;
+			hash = detail::hashByte(hash, ch);
+		}
+
+		if (len > sizeof(buf)) {
+			return unknown;
+		}
+
+		auto *entry = strings.find(std::string_view(buf, len), hash);
+		return entry ? entry->value : unknown;
+	}
+
 	void skipString() {
 		checkReady();
 
@@ -417,50 +1380,7 @@ public:
 	T getNumber() {
 		checkReady();
 
-		char ch = next();
-		if (ch >= '0' && ch <= '9') {
-			unsigned char u = ch - '0';
-			return (T)u;
-		} else if (ch == '+') {
-			uint64_t u = nextLEB128();
-			T num(u);
-			if ((uint64_t)num != u) {
-				throw ParseError("getNumber: Got unrepresentable number");
-			}
-
-			return num;
-		} else if (ch == '-') {
-			uint64_t u = nextLEB128();
-			if (u > (uint64_t)(std::numeric_limits<int64_t>::max())) {
-				throw ParseError("getNumber: Got unrepresentable number");
-			}
-
-			int64_t i = -(int64_t)u;
-			T num(i);
-			if ((int64_t)num != i) {
-				throw ParseError("getNumber: Got unrepresentable number");
-			}
-
-			return num;
-		} else if (ch == 'f') {
-			float f = nextFloat();
-			T num(f);
-			if ((float)num != f) {
-				throw ParseError("getNumber: Got unrepresentable number");
-			}
-
-			return num;
-		} else if (ch == 'd') {
-			double d = nextDouble();
-			T num(d);
-			if ((double)num != d) {
-				throw ParseError("getNumber: Got unrepresentable number");
-			}
-
-			return num;
-		} else {
-			throw ParseError("getNumber: Expected number");
-		}
+		return detail::decodeNumber<T>(next(), [this] { return next(); });
 	}
 
 	template<typename Func>
@@ -468,12 +1388,26 @@ public:
 		checkReady();
 
 		char ch = next();
-		if (ch != '[') {
+		if (ch == '#') {
+			// Present a delta-encoded array as an ordinary one
+			detail::DeltaElements delta;
+			delta.left = nextLEB128();
+
+			ready_ = false;
+			ArrayReader arr(is_, cancel_, &delta);
+			func(arr);
+			ready_ = true;
+
+			if (delta.left != 0) {
+				throw ParseError("getArray: Expected ']'");
+			}
+			return;
+		} else if (ch != '[') {
 			throw ParseError("getArray: Expected '['");
 		}
 
 		ready_ = false;
-		ArrayReader arr(is_);
+		ArrayReader arr(is_, cancel_);
 		func(arr);
 		ready_ = true;
 
@@ -483,6 +1417,21 @@ public:
 		}
 	}
 
+	// Read an array of integers into 'ints', in either encoding.
+	// Delta-encoded arrays are decoded in bulk from the stream's buffer.
+	void getInts(std::vector<int64_t> &ints) {
+		checkReady();
+
+		if (is_->peek() == '#') {
+			next();
+			readDeltaInts(ints, nextLEB128(), 0);
+		} else {
+			getArray([&](ArrayReader arr) {
+				arr.getInts(ints);
+			});
+		}
+	}
+
 	template<typename Func>
 	void readArray(Func func) {
 		getArray([&](ArrayReader arr) {
@@ -500,7 +1449,7 @@ public:
 		}
 
 		ready_ = false;
-		ObjectReader obj(is_);
+		ObjectReader obj(is_, cancel_);
 		func(obj);
 		ready_ = true;
 
@@ -550,72 +1499,86 @@ public:
 			getUInt();
 			break;
 		case Type::ARRAY:
+			if (is_->peek() == '#') {
+				next();
+				for (uint64_t count = nextLEB128(); count > 0; --count) {
+					nextLEB128();
+				}
+				break;
+			}
+
 			readArray([](Reader r) {
 				r.skip();
 			});
 			break;
 		case Type::OBJECT:
-			readObject([](std::string &, Reader r) {
-				r.skip();
+			getObject([](ObjectReader obj) {
+				while (obj.hasNext()) {
+					obj.skipKey().skip();
+				}
 			});
 			break;
 		}
 	}
 
 private:
+	friend class ArrayReader;
+
+	// Read 'count' zig-zag differences of a '#' array, starting from 'total'.
+	// Differences wrap around, so the sum is kept unsigned.
+	void readDeltaInts(std::vector<int64_t> &ints, uint64_t count, uint64_t total) {
+		ints.clear();
+
+		std::streambuf *buf = is_->rdbuf();
+		size_t done = 0;
+		while (done < count) {
+			// Don't trust the count with the allocation,
+			// and grow the output as the input turns up
+			if (done == ints.size()) {
+				ints.resize((size_t)std::min<uint64_t>(count, done + 65536));
+			}
+
+			// Like ArrayReader::getInts, decode what's buffered in bulk first
+			const char *begin = detail::StreamBufAccess::begin(buf);
+			const char *end = detail::StreamBufAccess::end(buf);
+			if (begin && end - begin > 65536) {
+				end = begin + 65536;
+			}
+
+			if (begin && end - begin >= 24) {
+				int64_t *out = ints.data() + done;
+				const char *p = detail::decodeDeltaRun(
+					begin, end, out, ints.data() + ints.size(), total);
+				if (p != begin) {
+					done = out - ints.data();
+					detail::StreamBufAccess::consume(buf, p - begin);
+					if (cancel_) {
+						cancel_->tick((uint32_t)(p - begin));
+					}
+					continue;
+				}
+			}
+
+			total += (uint64_t)detail::unZigZag(nextLEB128());
+			ints[done++] = (int64_t)total;
+		}
+	}
+
 	char next() {
 		int ch = is_->get();
 		if (ch == EOF) {
 			throw ParseError("Unexpected EOF");
 		}
 
+		if (cancel_) {
+			cancel_->tick();
+		}
+
 		return (char)ch;
 	}
 
 	uint64_t nextLEB128() {
-		uint64_t num = 0;
-		uint64_t shift = 0;
-		unsigned char ch;
-		do {
-			ch = (unsigned char)next();
-			num |= (uint64_t)(ch & 0x7f) << shift;
-			shift += 7;
-		} while (ch >= 0x80);
-		return num;
-	}
-
-	float nextFloat() {
-		static_assert(sizeof(float) == 4);
-		static_assert(sizeof(std::uint32_t) == 4);
-
-		uint32_t n = 0;
-		n |= (uint32_t)(unsigned char)next() << 0;
-		n |= (uint32_t)(unsigned char)next() << 8;
-		n |= (uint32_t)(unsigned char)next() << 16;
-		n |= (uint32_t)(unsigned char)next() << 24;
-
-		float f;
-		std::memcpy(&f, &n, 4);
-		return f;
-	}
-
-	double nextDouble() {
-		static_assert(sizeof(double) == 8);
-		static_assert(sizeof(std::uint64_t) == 8);
-
-		uint64_t n = 0;
-		n |= (uint64_t)(unsigned char)next() << 0;
-		n |= (uint64_t)(unsigned char)next() << 8;
-		n |= (uint64_t)(unsigned char)next() << 16;
-		n |= (uint64_t)(unsigned char)next() << 24;
-		n |= (uint64_t)(unsigned char)next() << 32;
-		n |= (uint64_t)(unsigned char)next() << 40;
-		n |= (uint64_t)(unsigned char)next() << 48;
-		n |= (uint64_t)(unsigned char)next() << 56;
-
-		double d;
-		std::memcpy(&d, &n, 8);
-		return d;
+		return detail::decodeLEB128([this] { return next(); });
 	}
 
 	void checkReady() {
@@ -625,16 +1588,31 @@ private:
 	}
 
 	std::istream *is_;
+	Cancellation *cancel_ = nullptr;
 	bool ready_ = true;
 };
 
 inline bool ArrayReader::hasNext() {
+	if (delta_) {
+		return delta_->left > 0;
+	}
+
 	int ret = is_->peek();
 	return ret != ']' && ret != EOF;
 }
 
 inline Reader ArrayReader::next() {
-	return Reader(is_);
+	if (delta_) {
+		if (delta_->left == 0) {
+			throw ParseError("next: Unexpected end of array");
+		}
+
+		delta_->left -= 1;
+		delta_->total += (uint64_t)detail::unZigZag(Reader(is_, cancel_).nextLEB128());
+		return Reader(delta_->load((int64_t)delta_->total), cancel_);
+	}
+
+	return Reader(is_, cancel_);
 }
 
 template<typename Func>
@@ -645,6 +1623,45 @@ inline void ArrayReader::all(Func func) {
 	}
 }
 
+inline void ArrayReader::getInts(std::vector<int64_t> &ints) {
+	if (delta_) {
+		Reader(is_, cancel_).readDeltaInts(ints, delta_->left, delta_->total);
+		delta_->left = 0;
+		return;
+	}
+
+	ints.clear();
+	std::streambuf *buf = is_->rdbuf();
+	while (true) {
+		// Decode what's buffered in bulk, a bounded amount at a time
+		// so that cancellation is still checked regularly
+		const char *begin = detail::StreamBufAccess::begin(buf);
+		const char *end = detail::StreamBufAccess::end(buf);
+		if (begin && end - begin > 65536) {
+			end = begin + 65536;
+		}
+
+		if (begin && end - begin >= 24) {
+			const char *p = detail::decodeIntRun(begin, end, ints);
+			if (p != begin) {
+				detail::StreamBufAccess::consume(buf, p - begin);
+				if (cancel_) {
+					cancel_->tick((uint32_t)(p - begin));
+				}
+				continue;
+			}
+		}
+
+		// Then a single value the slow way, which also deals with
+		// long numbers, buffer edges and refilling the buffer
+		if (!hasNext()) {
+			break;
+		}
+
+		ints.push_back(next().getInt());
+	}
+}
+
 inline bool ObjectReader::hasNext() {
 	int ret = is_->peek();
 	return ret != '}' && ret != EOF;
@@ -660,10 +1677,36 @@ inline Reader ObjectReader::next(std::string &key) {
 			break;
 		}
 
+		if (cancel_) {
+			cancel_->tick();
+		}
+
 		key += (char)ch;
 	}
 
-	return Reader(is_);
+	return Reader(is_, cancel_);
+}
+
+inline Reader ObjectReader::next(KeyDecoder &keys, uint32_t &id) {
+	id = keys.read(is_, cancel_);
+	return Reader(is_, cancel_);
+}
+
+inline Reader ObjectReader::skipKey() {
+	while (true) {
+		int ch = is_->get();
+		if (ch == EOF) {
+			throw ParseError("ObjectReader::skipKey: Unexpected EOF");
+		} else if (ch == 0) {
+			break;
+		}
+
+		if (cancel_) {
+			cancel_->tick();
+		}
+	}
+
+	return Reader(is_, cancel_);
 }
 
 template<typename Func>
@@ -0,0 +1,117 @@
+#include <sbon-agg.h>
+
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "helpers.h"
+#include "test.h"
+
+struct GroupResult {
+	uint64_t count = 0;
+	double sum = 0;
+	double min = 0;
+	double max = 0;
+	double avg = 0;
+	double p50 = 0;
+};
+
+static std::map<std::string, GroupResult> runAggregation(
+		const std::string &data, unsigned threads) {
+	sbon::Aggregation agg({"method"}, {
+		sbon::AggregateSpec::parse("count"),
+		sbon::AggregateSpec::parse("sum:ms"),
+		sbon::AggregateSpec::parse("min:ms"),
+		sbon::AggregateSpec::parse("max:ms"),
+		sbon::AggregateSpec::parse("avg:ms"),
+		sbon::AggregateSpec::parse("p50:ms"),
+	});
+
+	auto table = sbon::aggregateRecords(
+		agg, span(data), threads);
+
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	table.write(w);
+
+	std::map<std::string, GroupResult> results;
+	sbon::Reader r(&ss);
+	while (r.hasNext()) {
+		std::string method;
+		GroupResult res;
+		r.matchObject({
+			{"method", [&](sbon::Reader val) { method = val.getString(); }},
+			{"count", [&](sbon::Reader val) { res.count = val.getUInt(); }},
+			{"sum(ms)", [&](sbon::Reader val) { res.sum = val.getDouble(); }},
+			{"min(ms)", [&](sbon::Reader val) { res.min = val.getDouble(); }},
+			{"max(ms)", [&](sbon::Reader val) { res.max = val.getDouble(); }},
+			{"avg(ms)", [&](sbon::Reader val) { res.avg = val.getDouble(); }},
+			{"p50(ms)", [&](sbon::Reader val) { res.p50 = val.getDouble(); }},
+		});
+		results[method] = res;
+	}
+
+	return results;
+}
+
+static std::string makeRecords() {
+	return encodeRecords(3000, [](sbon::ObjectWriter w, int i) {
+		w.key("method").writeString(i % 3 == 0 ? "GET" : "POST");
+		w.key("ms").writeInt(i % 100);
+	});
+}
+
+TEST_CASE("Group by with aggregates") {
+	std::string data = makeRecords();
+
+	for (unsigned threads: {1, 4}) {
+		auto results = runAggregation(data, threads);
+		REQUIRE(results.size() == 2);
+
+		auto &get = results["GET"];
+		CHECK(get.count == 1000);
+		CHECK(get.min == 0);
+		CHECK(get.max == 99);
+
+		auto &post = results["POST"];
+		CHECK(post.count == 2000);
+		CHECK(post.min == 0);
+		CHECK(post.max == 99);
+
+		double total = get.sum + post.sum;
+		CHECK(total == 30 * 4950);
+		CHECK(std::abs(get.avg - get.sum / 1000) < 1e-9);
+		CHECK(std::abs(post.p50 - 50) < 2);
+	}
+}
+
+TEST_CASE("Quantile sketch") {
+	sbon::QuantileSketch a;
+	sbon::QuantileSketch b;
+	for (int i = 1; i <= 1000; ++i) {
+		(i % 2 ? a : b).add(i);
+	}
+	a.merge(b);
+
+	CHECK(a.count() == 1000);
+	CHECK(std::abs(a.quantile(0.5) - 500) < 10);
+	CHECK(std::abs(a.quantile(0.99) - 990) < 20);
+	CHECK(std::abs(a.quantile(0) - 1) < 0.1);
+}
+
+TEST_CASE("Aggregate spec parsing") {
+	auto spec = sbon::AggregateSpec::parse("p99.9:req.latency");
+	CHECK(spec.kind == sbon::AggregateSpec::Kind::QUANTILE);
+	CHECK(std::abs(spec.quantile - 0.999) < 1e-9);
+	CHECK(spec.path == "req.latency");
+	CHECK(spec.name() == "p99.9(req.latency)");
+
+	bool threw = false;
+	try {
+		sbon::AggregateSpec::parse("median:x");
+	} catch (sbon::AggregateError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
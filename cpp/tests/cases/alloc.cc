@@ -0,0 +1,139 @@
+#include <sbon.h>
+#include <sbon-buffer.h>
+#include <sbon-records.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+static std::string makeRecord() {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([](sbon::ObjectWriter w) {
+		w.key("a fairly long key name").writeString(std::string(100, 'x'));
+		w.key("number").writeInt(123456);
+		w.key("float").writeDouble(1.5);
+		w.key("data").writeBinary(std::string(50, 7).data(), 50);
+		w.key("list").writeArray([](sbon::Writer w) {
+			w.writeTrue();
+			w.writeNull();
+			w.writeString("short");
+		});
+	});
+
+	return ss.str();
+}
+
+TEST_CASE("Allocation counting") {
+	size_t before = allocationCount();
+	std::string *str = new std::string(1000, 'x');
+	CHECK(allocationCount() > before);
+	delete str;
+
+	int num = 0;
+	CHECK_NO_ALLOC(num += 1);
+	CHECK(num == 1);
+}
+
+TEST_CASE("Reader reuses caller buffers") {
+	std::string rec = makeRecord();
+	std::string key;
+	std::string str;
+	std::vector<unsigned char> bin;
+	key.reserve(64);
+	str.reserve(128);
+	bin.reserve(64);
+
+	for (int i = 0; i < 3; ++i) {
+		sbon::MemoryStream ms(rec.data(), rec.size());
+		sbon::Reader r(&ms);
+		CHECK_NO_ALLOC(r.getObject([&](sbon::ObjectReader obj) {
+			auto val = obj.next(key);
+			val.getString(str);
+			obj.next(key).getInt();
+			obj.next(key).getDouble();
+			obj.next(key).getBinary(bin);
+			obj.next(key).skip();
+		}));
+
+		CHECK(key == "list");
+		CHECK(str == std::string(100, 'x'));
+		CHECK(bin.size() == 50);
+	}
+}
+
+TEST_CASE("Skipping doesn't allocate") {
+	std::string rec = makeRecord();
+	sbon::MemoryStream ms(rec.data(), rec.size());
+	sbon::Reader r(&ms);
+	CHECK_NO_ALLOC(r.skip());
+	CHECK(!r.hasNext());
+}
+
+TEST_CASE("Raw value scanning doesn't allocate") {
+	std::string rec = makeRecord();
+	sbon::Span span{rec.data(), rec.data() + rec.size()};
+	sbon::PathSet paths;
+	paths.add("number");
+	paths.add("list.2");
+
+	int64_t num = 0;
+	std::string_view str;
+	CHECK_NO_ALLOC(paths.visit(span, [&](size_t id, sbon::RawValue val) {
+		if (id == 0) {
+			num = val.getInt();
+		} else {
+			str = val.getString();
+		}
+		return true;
+	}));
+
+	CHECK(num == 123456);
+	CHECK(str == "short");
+
+	size_t count = 0;
+	CHECK_NO_ALLOC(sbon::forEachRecord(span, [&](sbon::Span) {
+		count += 1;
+	}));
+	CHECK(count == 1);
+}
+
+TEST_CASE("Writing to a reused buffer doesn't allocate") {
+	sbon::BufferStream bs;
+	auto write = [&] {
+		bs.reset();
+		sbon::Writer w(&bs);
+		w.writeObject([](sbon::ObjectWriter w) {
+			w.key("name").writeString("a string which is quite a bit longer than 16 bytes");
+			w.key("count").writeInt(1000000);
+			w.key("ratio").writeDouble(0.25);
+			w.key("items").writeArray([](sbon::Writer w) {
+				for (int i = 0; i < 100; ++i) {
+					w.writeInt(i);
+				}
+			});
+		});
+	};
+
+	write();
+	std::string first(bs.view());
+	CHECK_NO_ALLOC(write());
+	CHECK(bs.view() == first);
+}
+
+TEST_CASE("Buffer pool reuse doesn't allocate") {
+	sbon::BufferPool pool;
+	for (int i = 0; i < 2; ++i) {
+		auto buf = pool.acquire();
+		sbon::Writer w(buf.os());
+		w.writeString("warm up");
+	}
+
+	CHECK_NO_ALLOC({
+		auto buf = pool.acquire();
+		sbon::Writer w(buf.os());
+		w.writeString("hello");
+	});
+}
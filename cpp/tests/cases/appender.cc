@@ -0,0 +1,75 @@
+#include <sbon.h>
+#include <sbon-appender.h>
+#include <sbon-records.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test.h"
+
+TEST_CASE("Record appender from many threads") {
+	char path[] = "/tmp/sbon-appender-XXXXXX";
+	int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+
+	const int numThreads = 4;
+	const int perThread = 500;
+	{
+		sbon::RecordAppender appender(fd);
+		appender.appendRaw("T");
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; ++t) {
+			threads.emplace_back([&, t] {
+				for (int i = 0; i < perThread; ++i) {
+					appender.append([&](sbon::Writer &w) {
+						w.writeObject([&](sbon::ObjectWriter w) {
+							w.key("thread").writeInt(t);
+							w.key("seq").writeInt(i);
+							w.key("pad").writeString(std::string(i % 50, 'x'));
+						});
+					});
+				}
+			});
+		}
+
+		for (auto &th: threads) {
+			th.join();
+		}
+	}
+	close(fd);
+
+	// Every record must be intact, and each thread's records in order
+	sbon::MappedFile file(path);
+	std::vector<int> next(numThreads, 0);
+	size_t count = 0;
+	bool ordered = true;
+	sbon::forEachRecord(file.span(), [&](sbon::Span rec) {
+		count += 1;
+		if (count == 1) {
+			CHECK(rec.view() == "T");
+			return;
+		}
+
+		int thread = -1, seq = -1;
+		sbon::RawValue(rec).forEachMember([&](std::string_view key, sbon::RawValue val) {
+			if (key == "thread") {
+				thread = (int)val.getInt();
+			} else if (key == "seq") {
+				seq = (int)val.getInt();
+			}
+		});
+
+		REQUIRE(thread >= 0 && thread < numThreads);
+		ordered = ordered && seq == next[thread];
+		next[thread] = seq + 1;
+	});
+
+	CHECK_EQ(count, (size_t)(numThreads * perThread + 1));
+	CHECK(ordered);
+	unlink(path);
+}
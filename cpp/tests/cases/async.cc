@@ -0,0 +1,71 @@
+#include <sbon.h>
+#include <sbon-async.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test.h"
+
+TEST_CASE("Async file stream") {
+	char path[] = "/tmp/sbon-async-XXXXXX";
+	int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	// Tiny buffers, so that the producer has to wait for free buffers
+	std::stringstream expected;
+	{
+		sbon::AsyncFileStream os(path, {16, 3});
+		sbon::Writer w(&os);
+		sbon::Writer ew(&expected);
+		for (int i = 0; i < 1000; ++i) {
+			auto rec = [&](sbon::ObjectWriter w) {
+				w.key("index").writeInt(i);
+				w.key("name").writeString("record " + std::to_string(i));
+			};
+			w.writeObject(rec);
+			ew.writeObject(rec);
+		}
+		os.finish();
+		CHECK(os.good());
+	}
+
+	std::ifstream is(path, std::ios::binary);
+	std::stringstream actual;
+	actual << is.rdbuf();
+	CHECK(actual.str() == expected.str());
+	unlink(path);
+}
+
+TEST_CASE("Async file buffer reports write errors") {
+	int fd = open("/dev/full", O_WRONLY);
+	REQUIRE(fd >= 0);
+
+	bool threw = false;
+	{
+		sbon::AsyncFileBuf buf(fd, {8, 2});
+		std::ostream os(&buf);
+		sbon::Writer w(&os);
+		for (int i = 0; i < 100; ++i) {
+			w.writeString("hello world");
+		}
+
+		try {
+			buf.finish();
+		} catch (std::system_error &err) {
+			threw = true;
+			CHECK_EQ(err.code().value(), ENOSPC);
+		}
+
+		CHECK(!os.good());
+	}
+
+	CHECK(threw);
+	close(fd);
+}
@@ -0,0 +1,135 @@
+#include <sbon.h>
+#include <sbon-buffer.h>
+
+#include <string>
+#include <thread>
+
+#include "test.h"
+
+TEST_CASE("Output buffer") {
+	sbon::BufferStream bs;
+	sbon::Writer w(&bs);
+
+	w.writeObject([](sbon::ObjectWriter w) {
+		w.key("a").writeString(std::string(1000, 'x'));
+		w.key("b").writeInt(300);
+	});
+
+	std::string expected = "{a" + std::string(1, '\0') + "S" + std::string(1000, 'x');
+	expected += std::string(1, '\0') + "b" + std::string(1, '\0') + "+\xac\x02}";
+	CHECK(bs.view() == expected);
+
+	size_t cap = bs.buffer().capacity();
+	bs.reset();
+	CHECK(bs.view().empty());
+	CHECK(bs.buffer().capacity() == cap);
+
+	w.writeTrue();
+	CHECK(bs.view() == "T");
+
+	bs.buffer().shrink(0);
+	CHECK(bs.buffer().capacity() == 1);
+	CHECK(bs.view() == "T");
+}
+
+TEST_CASE("Buffer pool reuses buffers") {
+	sbon::BufferPool pool;
+
+	const sbon::BufferStream *first;
+	{
+		auto buf = pool.acquire();
+		first = &buf.stream();
+		sbon::Writer w(buf.os());
+		w.writeString("hello");
+		CHECK(buf.view() == std::string_view("Shello\0", 7));
+	}
+
+	auto buf = pool.acquire();
+	CHECK(&buf.stream() == first);
+	CHECK(buf.view().empty());
+}
+
+TEST_CASE("Buffer pool pre-sizes and trims buffers") {
+	sbon::BufferPool pool;
+	CHECK(pool.targetSize() == 256);
+
+	// Before any buffers are released, they're pre-sized to the minimum
+	sbon::BufferPool::Options opts;
+	opts.minSize = 8192;
+	sbon::BufferPool bigPool(opts);
+	CHECK(bigPool.targetSize() == 8192);
+	CHECK(bigPool.acquire().stream().buffer().capacity() >= 8192);
+
+	for (int i = 0; i < 200; ++i) {
+		auto buf = pool.acquire();
+		sbon::Writer w(buf.os());
+		w.writeString(std::string(3000, 'x'));
+	}
+
+	CHECK(pool.targetSize() == 4096);
+	{
+		auto a = pool.acquire();
+		auto b = pool.acquire();
+		CHECK(a.stream().buffer().capacity() >= 4096);
+		CHECK(b.stream().buffer().capacity() >= 4096);
+
+		sbon::Writer w(b.os());
+		w.writeString(std::string(100000, 'x'));
+	}
+
+	// The huge buffer was trimmed back down when it was released
+	auto a = pool.acquire();
+	auto b = pool.acquire();
+	CHECK(a.stream().buffer().capacity() < 100000);
+	CHECK(b.stream().buffer().capacity() < 100000);
+}
+
+TEST_CASE("Buffer pool across threads") {
+	sbon::BufferPool::Options opts;
+	opts.threadCacheSize = 1;
+	sbon::BufferPool pool(opts);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&pool, t] {
+			for (int i = 0; i < 100; ++i) {
+				auto a = pool.acquire();
+				auto b = pool.acquire();
+				sbon::Writer(a.os()).writeInt(t);
+				sbon::Writer(b.os()).writeInt(i);
+				CHECK(a.view().size() == 1);
+			}
+		});
+	}
+
+	for (auto &t: threads) {
+		t.join();
+	}
+}
+
+TEST_CASE("Buffer pool caches forget destroyed pools") {
+	sbon::BufferPool pool;
+	pool.acquire();
+	size_t before = sbon::BufferPool::localCacheSize();
+	for (int i = 0; i < 3; ++i) {
+		sbon::BufferPool dead;
+		auto a = dead.acquire();
+		auto b = dead.acquire();
+	}
+	CHECK(sbon::BufferPool::localCacheSize() == before + 2);
+
+	// Using any pool frees the buffers of the destroyed ones
+	pool.acquire();
+	CHECK(sbon::BufferPool::localCacheSize() == before);
+
+	// Including in other threads
+	std::thread([] {
+		{
+			sbon::BufferPool dead;
+			auto a = dead.acquire();
+		}
+		sbon::BufferPool other;
+		other.acquire();
+		CHECK(sbon::BufferPool::localCacheSize() == 1);
+	}).join();
+}
@@ -0,0 +1,73 @@
+#include <sbon-csv.h>
+
+#include <sstream>
+#include <string>
+
+#include "helpers.h"
+#include "test.h"
+
+static std::string makeRecords() {
+	return encode([](sbon::Writer w) {
+		w.writeObject([](sbon::ObjectWriter w) {
+			w.key("name").writeString("plain");
+			w.key("n").writeInt(-42);
+			w.key("x").writeDouble(0.1);
+			w.key("ok").writeTrue();
+		});
+		w.writeObject([](sbon::ObjectWriter w) {
+			w.key("ok").writeNull();
+			w.key("name").writeString("with, \"quotes\"\tand tab");
+			w.key("tags").writeArray([](sbon::Writer w) {
+				w.writeString("a");
+				w.writeInt(1);
+			});
+			w.key("n").writeUInt(18446744073709551615ull);
+			w.key("bin").writeBinary("\x01\xff", 2);
+		});
+	});
+}
+
+TEST_CASE("CSV output") {
+	std::string data = makeRecords();
+	sbon::CsvFormatter fmt({"name", "n", "x", "ok", "tags", "bin"});
+
+	std::stringstream out;
+	sbon::writeCsv(fmt, span(data), out);
+	CHECK(out.str() ==
+		"name,n,x,ok,tags,bin\n"
+		"plain,-42,0.1,true,,\n"
+		"\"with, \"\"quotes\"\"\tand tab\",18446744073709551615,,,"
+		"\"[\"\"a\"\",1]\",01ff\n");
+}
+
+TEST_CASE("TSV output") {
+	std::string data = makeRecords();
+	sbon::CsvOptions opts;
+	opts.delimiter = '\t';
+	opts.header = false;
+	sbon::CsvFormatter fmt({"name", "missing", "n"}, opts);
+
+	std::stringstream out;
+	sbon::writeCsv(fmt, span(data), out);
+	CHECK(out.str() ==
+		"plain\t\t-42\n"
+		"with, \"quotes\"\\tand tab\t\t18446744073709551615\n");
+}
+
+TEST_CASE("Parallel output keeps order") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	std::string expected = "i\n";
+	for (int i = 0; i < 1000; ++i) {
+		w.writeObject([&](sbon::ObjectWriter w) {
+			w.key("i").writeInt(i);
+		});
+		expected += std::to_string(i) + '\n';
+	}
+
+	std::string data = ss.str();
+	sbon::CsvFormatter fmt({"i"});
+	std::stringstream out;
+	sbon::writeCsv(fmt, span(data), out, 4, 64);
+	CHECK(out.str() == expected);
+}
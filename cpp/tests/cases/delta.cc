@@ -0,0 +1,120 @@
+#include <sbon-delta.h>
+
+#include <sstream>
+#include <string>
+
+#include "test.h"
+
+static sbon::Span span(const std::string &str) {
+	return {str.data(), str.data() + str.size()};
+}
+
+static std::string makeState(int version, bool reordered = false) {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([&](sbon::ObjectWriter w) {
+		if (reordered) {
+			w.key("version").writeInt(version);
+			w.key("name").writeString("server-1");
+		} else {
+			w.key("name").writeString("server-1");
+			w.key("version").writeInt(version);
+		}
+
+		w.key("stats").writeObject([&](sbon::ObjectWriter w) {
+			w.key("requests").writeInt(1000 + version);
+			w.key("errors").writeInt(3);
+			if (version < 2) {
+				w.key("warmup").writeTrue();
+			}
+			if (version >= 2) {
+				w.key("uptime").writeDouble(12.5 * version);
+			}
+		});
+
+		w.key("hosts").writeArray([&](sbon::Writer w) {
+			for (int i = 0; i < 100; ++i) {
+				if (version >= 3 && i == 50) {
+					w.writeString("inserted");
+				}
+				w.writeString("host-" + std::to_string(i) + (version >= 1 && i == 5 ? "!" : ""));
+			}
+		});
+	});
+
+	return ss.str();
+}
+
+static void checkRoundTrip(const std::string &old, const std::string &cur) {
+	std::string patch = sbon::encodeDelta(span(old), span(cur));
+	CHECK(sbon::applyDelta(span(old), span(patch)) == cur);
+}
+
+TEST_CASE("Delta of identical values") {
+	std::string state = makeState(0);
+	std::string patch = sbon::encodeDelta(span(state), span(state));
+	CHECK(patch == "[0]");
+	CHECK(sbon::applyDelta(span(state), span(patch)) == state);
+}
+
+TEST_CASE("Delta of changed documents") {
+	for (int a = 0; a < 4; ++a) {
+		for (int b = 0; b < 4; ++b) {
+			checkRoundTrip(makeState(a), makeState(b));
+		}
+	}
+
+	// Small changes give patches much smaller than the document
+	std::string v0 = makeState(0);
+	std::string v1 = makeState(1);
+	std::string patch = sbon::encodeDelta(span(v0), span(v1));
+	CHECK(patch.size() * 5 < v1.size());
+	CHECK(patch[1] == '2');
+
+	// An inserted array element becomes one splice
+	std::string v2 = makeState(2);
+	std::string v3 = makeState(3);
+	patch = sbon::encodeDelta(span(v2), span(v3));
+	CHECK(patch.find("inserted") != std::string::npos);
+	CHECK(patch.find("host-") == std::string::npos);
+}
+
+TEST_CASE("Delta falls back to replacement") {
+	// Reordered keys can't be patched
+	std::string old = makeState(0);
+	std::string cur = makeState(0, true);
+	std::string patch = sbon::encodeDelta(span(old), span(cur));
+	CHECK(patch == "[1" + cur + "]");
+	CHECK(sbon::applyDelta(span(old), span(patch)) == cur);
+
+	// Neither can values of different types
+	std::string arr = "[123]";
+	std::string str = std::string("Sx") + '\0';
+	checkRoundTrip(arr, str);
+	checkRoundTrip(str, arr);
+	checkRoundTrip("[]", "[123]");
+	checkRoundTrip("[123]", "[]");
+	checkRoundTrip("{}", "{a" + std::string(1, '\0') + "T}");
+}
+
+TEST_CASE("Delta with bad patches") {
+	std::string old = "[123]";
+	const char *bad[] = {
+		"[9]",
+		"[2{}[]{}]",
+		"[3[[5[1T]]]]",
+		"[3[[05[]]]]",
+		"[3[[1T][0[0]]]]",
+		"[3",
+	};
+
+	for (const char *patch: bad) {
+		bool threw = false;
+		try {
+			sbon::applyDelta(span(old), span(patch));
+		} catch (sbon::ParseError &) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+}
@@ -0,0 +1,226 @@
+#include <sbon-dict.h>
+
+#include <sstream>
+#include <string>
+
+#include "helpers.h"
+#include "test.h"
+
+static std::string makeRecords(int count) {
+	static const char *paths[] = {"/api/v1/users", "/api/v1/orders", "/health", "/login"};
+	return encodeRecords(count, [](sbon::ObjectWriter w, int i) {
+		w.key("timestamp").writeInt(1700000000000 + i * 37);
+		w.key("method").writeString(i % 3 ? "GET" : "POST");
+		w.key("path").writeString(paths[i * 7 % 4]);
+		w.key("status").writeInt(i % 10 ? 200 : 404);
+		w.key("duration").writeInt(i * 7919 % 1000);
+		w.key("user").writeString("user" + std::to_string(i * 31 % 1000));
+		w.key("agent").writeString("Mozilla/5.0 (X11; Linux x86_64)");
+	});
+}
+
+static std::string roundTrip(const sbon::Dictionary &dict, const std::string &record) {
+	std::string compressed;
+	dict.compress(record, compressed);
+	std::string out = "stale";
+	dict.decompress(compressed, out);
+	return out;
+}
+
+TEST_CASE("Dictionary compression round trip") {
+	sbon::Dictionary none;
+	sbon::Dictionary dict("0123456789abcdefghijklmnopqrstuvwxyz");
+
+	std::string runs = std::string(1000, 'a') + "b" + std::string(20, 'a');
+	std::string literals;
+	for (int i = 0; i < 300; ++i) {
+		literals += (char)(i * 131 % 251);
+	}
+	for (auto *d: {&none, &dict}) {
+		CHECK_EQ(roundTrip(*d, ""), "");
+		CHECK_EQ(roundTrip(*d, "abc"), "abc");
+		CHECK_EQ(roundTrip(*d, runs), runs);
+		CHECK_EQ(roundTrip(*d, literals), literals);
+		CHECK_EQ(roundTrip(*d, "xyz0123" + literals + "uvwxyz"), "xyz0123" + literals + "uvwxyz");
+	}
+
+	// Matches can start in the dictionary and continue into the record
+	std::string record = "wxyz0123456789abcdefghijklmnopqrstuvwxyz";
+	std::string compressed;
+	dict.compress(record, compressed);
+	CHECK(compressed.size() < 10);
+	CHECK_EQ(roundTrip(dict, record), record);
+
+	// Long repeats take a sequence for every maximum length match
+	std::string zeros(100000, '\0');
+	compressed.clear();
+	none.compress(zeros, compressed);
+	CHECK(compressed.size() < zeros.size() / 50);
+	CHECK_EQ(roundTrip(none, zeros), zeros);
+}
+
+TEST_CASE("Dictionary training") {
+	std::string data = makeRecords(2000);
+	sbon::Dictionary dict = sbon::Dictionary::train(span(data), 4096);
+	CHECK(dict.size() > 0);
+	CHECK(dict.size() <= 4096u);
+
+	// Keys which are in every record are in the dictionary
+	CHECK(dict.bytes().find("timestamp") != std::string::npos);
+	CHECK(dict.bytes().find("Mozilla/5.0") != std::string::npos);
+
+	sbon::Dictionary none;
+	size_t plain = 0;
+	size_t trained = 0;
+	sbon::forEachRecord(span(data), [&](sbon::Span rec) {
+		std::string compressed;
+		none.compress(rec.view(), compressed);
+		plain += compressed.size();
+		compressed.clear();
+		dict.compress(rec.view(), compressed);
+		trained += compressed.size();
+
+		std::string out;
+		dict.decompress(compressed, out);
+		CHECK(out == rec.view());
+	});
+	CHECK(trained * 3 < data.size());
+	CHECK(trained * 2 < plain);
+
+	// A dictionary loaded from its bytes compresses the same way
+	sbon::Dictionary loaded(dict.bytes());
+	std::string a, b;
+	dict.compress(data.substr(0, 100), a);
+	loaded.compress(data.substr(0, 100), b);
+	CHECK(a == b);
+
+	// A dictionary can't be empty
+	for (bool fromSamples: {false, true}) {
+		bool threw = false;
+		try {
+			if (fromSamples) {
+				sbon::Dictionary::train(std::vector<sbon::Span>{span(data)}, 0);
+			} else {
+				sbon::Dictionary::train(span(data), 0);
+			}
+		} catch (sbon::LogicError &) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+}
+
+TEST_CASE("Compressed streams") {
+	std::string data = makeRecords(100);
+	sbon::Dictionary dict = sbon::Dictionary::train(span(data), 1024);
+
+	std::stringstream ss;
+	sbon::CompressedWriter cw(dict, &ss);
+	sbon::forEachRecord(span(data), [&](sbon::Span rec) {
+		cw.writeRaw(rec.view());
+	});
+	cw.write([](sbon::Writer w) {
+		w.writeArray([](sbon::Writer w) {
+			w.writeInt(1);
+			w.writeString("two");
+		});
+	});
+	CHECK_EQ(cw.rawBytes(), data.size() + 8);
+	CHECK(cw.compressedBytes() < cw.rawBytes() / 2);
+
+	// Each record is a binary value, which can be read on its own
+	std::string compressed = ss.str();
+	size_t count = 0;
+	int64_t lastTimestamp = 0;
+	sbon::forEachRecord(span(compressed), [&](sbon::Span rec) {
+		count += 1;
+		if (count == 101) {
+			dict.read(rec, [&](sbon::Reader r) {
+				r.getArray([](sbon::ArrayReader arr) {
+					CHECK_EQ(arr.next().getInt(), 1);
+					CHECK_EQ(arr.next().getString(), "two");
+				});
+			});
+			return;
+		}
+
+		dict.read(rec, [&](sbon::Reader r) {
+			r.getObject([&](sbon::ObjectReader obj) {
+				std::string key;
+				while (obj.hasNext()) {
+					sbon::Reader val = obj.next(key);
+					if (key == "timestamp") {
+						lastTimestamp = val.getInt();
+					} else {
+						val.skip();
+					}
+				}
+			});
+
+			// Reads can nest without clobbering each other's buffers
+			dict.read(rec, [](sbon::Reader r) {
+				CHECK(r.getType() == sbon::Type::OBJECT);
+				r.skip();
+			});
+		});
+	});
+	CHECK_EQ(count, 101u);
+	CHECK_EQ(lastTimestamp, 1700000000000 + 99 * 37);
+}
+
+TEST_CASE("Malformed compressed records") {
+	sbon::Dictionary dict("0123456789");
+	std::string record = "0123456789 and 0123456789 again";
+	std::string compressed;
+	dict.compress(record, compressed);
+
+	auto fails = [&](const std::string &bytes) {
+		std::string out;
+		try {
+			dict.decompress(bytes, out);
+		} catch (sbon::ParseError &) {
+			return true;
+		}
+		return false;
+	};
+
+	CHECK(!fails(compressed));
+	CHECK(fails(compressed.substr(0, compressed.size() - 1)));
+	CHECK(fails(compressed + "x"));
+	CHECK(fails(""));
+
+	// The size says more than the sequences produce
+	std::string longer = compressed;
+	longer[0] += 1;
+	CHECK(fails(longer));
+
+	// A size beyond what the rest of the record could expand to is rejected
+	// before it's allocated
+	CHECK(fails(std::string("\xff\xff\xff\xff\x0f") + "\x40" + "abcd"));
+	CHECK(fails(std::string("\x81\x02") + "\x00" + "\x01"));
+
+	// A match longer than the maximum
+	auto repeat = [](int matchExtra, int literals) {
+		return std::string("\xac\x02") + "\x1f" + "a" + "\x01" +
+			(char)(0x80 | (matchExtra & 0x7f)) + (char)(matchExtra >> 7) + "\xf0" +
+			(char)(literals - 15) + std::string(literals, 'b');
+	};
+	CHECK(!fails(repeat(237, 43)));
+	CHECK(fails(repeat(238, 42)));
+
+	// A match from before the start of the dictionary
+	std::string far = std::string("\x08") + "\x40" + "abcd" + "\x20";
+	CHECK(fails(far));
+	CHECK(!fails(std::string("\x08") + "\x40" + "abcd" + "\x0e"));
+
+	// The same record can't be read with another dictionary
+	sbon::Dictionary none;
+	std::string out;
+	bool threw = false;
+	try {
+		none.decompress(compressed, out);
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
@@ -0,0 +1,400 @@
+#include <sbon.h>
+#include <sbon-dom.h>
+
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "helpers.h"
+#include "test.h"
+
+static std::string reencode(const sbon::Document &doc) {
+	std::stringstream ss;
+	doc.root().write(sbon::Writer(&ss));
+	return ss.str();
+}
+
+TEST_CASE("DOM scalars") {
+	std::string data = encode([](sbon::Writer w) {
+		w.writeArray([](sbon::Writer w) {
+			w.writeTrue();
+			w.writeNull();
+			w.writeString("short");
+			w.writeString("a string which doesn't fit in a node");
+			w.writeBinary("\0\1\2", 3);
+			w.writeFloat(1.5);
+			w.writeDouble(-2.25);
+			w.writeInt(-5);
+			w.writeUInt(std::numeric_limits<uint64_t>::max());
+			w.writeString("");
+		});
+	});
+
+	sbon::Document doc(span(data));
+	auto root = doc.root();
+	REQUIRE(root.getType() == sbon::Type::ARRAY);
+	REQUIRE(root.size() == 10);
+	CHECK(root[0].getBool() == true);
+	CHECK(root[1].getType() == sbon::Type::NIL);
+	CHECK(root[2].getString() == "short");
+	CHECK(root[3].getString() == "a string which doesn't fit in a node");
+	CHECK(root[4].getBinary() == std::string_view("\0\1\2", 3));
+	CHECK(root[5].getType() == sbon::Type::FLOAT);
+	CHECK(root[5].getFloat() == 1.5);
+	CHECK(root[6].getDouble() == -2.25);
+	CHECK(root[7].getType() == sbon::Type::INT);
+	CHECK(root[7].getInt() == -5);
+	CHECK(root[8].getUInt() == std::numeric_limits<uint64_t>::max());
+	CHECK(root[9].getString() == "");
+	CHECK(reencode(doc) == data);
+
+	bool threw = false;
+	try {
+		root[5].getInt();
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+
+	threw = false;
+	try {
+		root[2].getBool();
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+TEST_CASE("DOM objects") {
+	std::string data = encode([](sbon::Writer w) {
+		w.writeObject([](sbon::ObjectWriter w) {
+			w.key("name").writeString("sbon");
+			w.key("tags").writeArray([](sbon::Writer w) {
+				w.writeString("binary");
+				w.writeString("json");
+			});
+			w.key("nested").writeObject([](sbon::ObjectWriter w) {
+				w.key("name").writeString("inner");
+				w.key("empty").writeObject([](sbon::ObjectWriter) {});
+			});
+			w.key("list").writeArray([](sbon::Writer) {});
+		});
+	});
+
+	sbon::Document doc(span(data));
+	auto root = doc.root();
+	REQUIRE(root.size() == 4);
+	CHECK(root.key(0) == "name");
+	CHECK(root.key(3) == "list");
+	CHECK(root.get("name").getString() == "sbon");
+	CHECK(root.get("tags")[1].getString() == "json");
+	CHECK(root.get("nested").get("name").getString() == "inner");
+	CHECK(root.get("nested").get("empty").size() == 0);
+	CHECK(root.get("list").size() == 0);
+	CHECK(!root.get("missing"));
+	CHECK(!root.get("nested").get("tags"));
+
+	// Keys are IDs in the symbol table, so they compare as integers
+	CHECK(root.keyId(0) == root.get("nested").keyId(0));
+	CHECK(doc.symbols().size() == 5);
+
+	std::vector<std::string> keys;
+	root.forEachMember([&](std::string_view key, sbon::DomValue) {
+		keys.emplace_back(key);
+	});
+	CHECK((keys == std::vector<std::string>{"name", "tags", "nested", "list"}));
+	CHECK(reencode(doc) == data);
+}
+
+TEST_CASE("DOM packed arrays") {
+	std::string data = encode([](sbon::Writer w) {
+		w.writeArray([](sbon::Writer w) {
+			w.writeArray([](sbon::Writer w) {
+				for (int i = -50; i < 1000; ++i) {
+					w.writeInt(i * 1001);
+				}
+			});
+			w.writeArray([](sbon::Writer w) {
+				for (int i = 0; i < 100; ++i) {
+					w.writeDouble(i / 4.0);
+				}
+			});
+			w.writeArray([](sbon::Writer w) {
+				w.writeFloat(0.5);
+				w.writeFloat(-0.5);
+			});
+
+			// Mixed and out of range arrays aren't packed
+			w.writeArray([](sbon::Writer w) {
+				w.writeInt(1);
+				w.writeDouble(2);
+			});
+			w.writeArray([](sbon::Writer w) {
+				w.writeInt(-1);
+				w.writeUInt(std::numeric_limits<uint64_t>::max());
+			});
+		});
+	});
+
+	sbon::Document doc(span(data));
+	auto root = doc.root();
+	auto ints = root[0];
+	REQUIRE(ints.size() == 1050);
+	CHECK(ints[0].getType() == sbon::Type::INT);
+	CHECK(ints[0].getInt() == -50 * 1001);
+	CHECK(ints[50].getType() == sbon::Type::UINT);
+	CHECK(ints[1049].getInt() == 999 * 1001);
+	CHECK(root[1][99].getDouble() == 99 / 4.0);
+	CHECK(root[2][1].getType() == sbon::Type::FLOAT);
+	CHECK(root[2][1].getFloat() == -0.5);
+	CHECK(root[3][1].getType() == sbon::Type::DOUBLE);
+	CHECK(root[4][1].getUInt() == std::numeric_limits<uint64_t>::max());
+	CHECK(reencode(doc) == data);
+
+	// Packed integers take 8 bytes each, instead of a 16-byte node
+	CHECK(doc.memoryUsage() < sizeof(sbon::Document) + 2 * data.size() + 4096);
+}
+
+TEST_CASE("DOM delta-encoded arrays") {
+	std::vector<int64_t> series;
+	for (int i = 0; i < 1000; ++i) {
+		series.push_back(1700000000000 + i * 10 - (i % 7) * 3);
+	}
+	series.push_back(std::numeric_limits<int64_t>::min());
+
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([&](sbon::ObjectWriter w) {
+		w.key("ts").writeIntArray(series);
+		w.key("empty").writeIntArray({});
+	});
+	std::string data = ss.str();
+	REQUIRE(data.find('#') != std::string::npos);
+
+	sbon::Document doc(span(data));
+	auto ts = doc.root().get("ts");
+	CHECK(ts.getType() == sbon::Type::ARRAY);
+	REQUIRE(ts.size() == series.size());
+	bool same = true;
+	for (size_t i = 0; i < series.size(); ++i) {
+		same = same && ts[i].getInt() == series[i];
+	}
+	CHECK(same);
+	CHECK(ts[0].getType() == sbon::Type::UINT);
+	CHECK(ts[1000].getType() == sbon::Type::INT);
+	CHECK(doc.root().get("empty").size() == 0);
+
+	// It's written back as the ordinary array of the same integers
+	std::string plain = encode([](sbon::Writer w) {
+		w.writeArray([](sbon::Writer w) {
+			w.writeInt(1);
+			w.writeInt(-2);
+		});
+	});
+	std::string delta = encode([](sbon::Writer w) {
+		w.writeIntArray({1, -2});
+	});
+	CHECK(reencode(sbon::Document(span(delta))) == plain);
+
+	// A truncated array
+	bool threw = false;
+	try {
+		sbon::Document(span(data.substr(0, data.size() / 2)));
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+TEST_CASE("DOM shared symbol tables") {
+	sbon::SymbolTable symbols;
+	std::string a = encode([](sbon::Writer w) {
+		w.writeObject([](sbon::ObjectWriter w) {
+			w.key("x").writeInt(1);
+			w.key("y").writeInt(2);
+		});
+	});
+	std::string b = encode([](sbon::Writer w) {
+		w.writeObject([](sbon::ObjectWriter w) {
+			w.key("y").writeInt(3);
+		});
+	});
+
+	sbon::Document docA(span(a), &symbols);
+	sbon::Document docB(span(b), &symbols);
+	CHECK(symbols.size() == 2);
+	CHECK(docA.root().keyId(1) == docB.root().keyId(0));
+	CHECK(docB.root().get(docA.root().keyId(1)).getInt() == 3);
+}
+
+TEST_CASE("DOM parse errors") {
+	std::string data = encode([](sbon::Writer w) {
+		w.writeObject([](sbon::ObjectWriter w) {
+			w.key("list").writeArray([](sbon::Writer w) {
+				w.writeString("hello");
+				w.writeInt(1000);
+			});
+		});
+	});
+
+	for (size_t size = 0; size < data.size(); ++size) {
+		bool threw = false;
+		try {
+			sbon::Document doc({data.data(), data.data() + size});
+		} catch (sbon::ParseError &) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	std::string trailing = data + "T";
+	bool threw = false;
+	try {
+		sbon::Document doc(span(trailing));
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+
+	// Nesting is limited like skipValue limits it, instead of overflowing the stack
+	auto nested = [](size_t depth) {
+		return std::string(depth, '[') + std::string(depth, ']');
+	};
+	CHECK(sbon::Document(span(nested(1024))).root().size() == 1);
+	for (size_t depth: {1025, 1000000}) {
+		threw = false;
+		try {
+			sbon::Document doc(span(nested(depth)));
+		} catch (sbon::ParseError &) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+}
+
+static std::string makeRequest(int items) {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([&](sbon::ObjectWriter w) {
+		w.key("method").writeString("POST");
+		w.key("path").writeString("/api/v1/orders/submit");
+		w.key("items").writeArray([&](sbon::Writer w) {
+			for (int i = 0; i < items; ++i) {
+				w.writeObject([&](sbon::ObjectWriter w) {
+					w.key("sku").writeString("item-with-a-long-name-" + std::to_string(i));
+					w.key("count").writeInt(i);
+				});
+			}
+		});
+	});
+	return ss.str();
+}
+
+TEST_CASE("Document pools") {
+	sbon::DocumentPool pool;
+	std::string small = makeRequest(10);
+	std::string big = makeRequest(200);
+
+	{
+		auto doc = pool.parse(span(small));
+		CHECK(doc.root().get("method").getString() == "POST");
+		CHECK(doc.root().get("items")[9].get("count").getInt() == 9);
+		CHECK(reencode(doc) == small);
+	}
+	CHECK(pool.freeCount() == 1);
+	size_t smallSize = pool.expectedSize();
+	CHECK(smallSize > 0);
+
+	// The arena size follows bigger documents at once
+	{
+		auto doc = pool.parse(span(big));
+		CHECK(reencode(doc) == big);
+	}
+	CHECK(pool.expectedSize() > smallSize * 10);
+
+	// Once warmed up, parsing doesn't allocate
+	{
+		auto doc = pool.parse(span(big));
+	}
+	CHECK_NO_ALLOC({
+		auto doc = pool.parse(span(big));
+		CHECK(doc.root().get("items").size() == 200);
+	});
+
+	// And shrinks again slowly
+	for (int i = 0; i < 100; ++i) {
+		auto doc = pool.parse(span(small));
+	}
+	CHECK(pool.expectedSize() == smallSize);
+
+	// Documents can be held on to, and released in any order
+	std::vector<sbon::Document> docs;
+	for (int i = 0; i < 20; ++i) {
+		docs.push_back(pool.parse(span(i % 2 ? small : big)));
+	}
+	for (int i = 0; i < 20; ++i) {
+		CHECK(reencode(docs[i]) == (i % 2 ? small : big));
+	}
+	docs.clear();
+	CHECK(pool.freeCount() == 16);
+
+	// A failed parse gives its storage back as well
+	bool threw = false;
+	try {
+		pool.parse({small.data(), small.data() + small.size() - 3});
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+	CHECK(pool.freeCount() == 16);
+	CHECK(reencode(pool.parse(span(small))) == small);
+}
+
+TEST_CASE("Document pools limit their symbol tables") {
+	sbon::DocumentPool pool(16, 100);
+	auto record = [](int i) {
+		return encode([&](sbon::Writer w) {
+			w.writeObject([&](sbon::ObjectWriter w) {
+				w.key("user-" + std::to_string(i)).writeInt(i);
+			});
+		});
+	};
+
+	// The table isn't replaced while a document uses it
+	std::string first = record(0);
+	auto held = pool.parse(span(first));
+	sbon::SymbolTable *table = &pool.symbols();
+	for (int i = 1; i < 200; ++i) {
+		std::string data = record(i);
+		auto doc = pool.parse(span(data));
+	}
+	CHECK(&pool.symbols() == table);
+	CHECK(pool.symbols().size() == 200);
+	CHECK(held.root().get("user-0").getInt() == 0);
+
+	// But it is once none are live
+	held = sbon::Document();
+	for (int i = 200; i < 1000; ++i) {
+		std::string data = record(i);
+		auto doc = pool.parse(span(data));
+		CHECK(doc.root().get("user-" + std::to_string(i)).getInt() == i);
+	}
+	CHECK(pool.symbols().size() <= 101);
+}
+
+TEST_CASE("Huge page chunks") {
+	size_t size = sbon::detail::HUGE_CHUNK * 2;
+	char *chunk = sbon::detail::allocateChunk(size);
+	CHECK((uintptr_t)chunk % sbon::detail::HUGE_CHUNK == 0);
+	chunk[0] = 1;
+	chunk[size - 1] = 1;
+	sbon::detail::freeChunk(chunk, size);
+
+	// Big documents get mmap'ed chunks
+	std::string data = makeRequest(100000);
+	REQUIRE(data.size() > sbon::detail::HUGE_CHUNK);
+	sbon::Document doc(span(data));
+	CHECK(doc.memoryUsage() % sbon::detail::HUGE_CHUNK == sizeof(sbon::Document));
+	CHECK(doc.root().get("items")[99999].get("count").getInt() == 99999);
+}
@@ -0,0 +1,252 @@
+#include <sbon-edit.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "helpers.h"
+#include "test.h"
+
+static std::string makeDocument(int users) {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([&](sbon::ObjectWriter w) {
+		w.key("version").writeInt(3);
+		w.key("users").writeArray([&](sbon::Writer w) {
+			for (int i = 0; i < users; ++i) {
+				w.writeObject([&](sbon::ObjectWriter w) {
+					w.key("id").writeInt(i);
+					w.key("name").writeString("user " + std::to_string(i));
+					w.key("tags").writeArray([&](sbon::Writer w) {
+						w.writeString("a");
+						w.writeString("b");
+					});
+				});
+			}
+		});
+		w.key("").writeObject([](sbon::ObjectWriter) {});
+	});
+
+	return ss.str();
+}
+
+static std::string encodeMember(const std::string &key, const std::string &value) {
+	return key + '\0' + value;
+}
+
+// Check that the document's tape is the same as one built from scratch
+static bool tapeMatches(const sbon::EditableDocument &doc) {
+	std::string data = doc.contents();
+	if (data.size() != doc.byteSize()) {
+		return false;
+	}
+
+	auto tape = sbon::detail::buildTape(span(data));
+	if (tape.size() != doc.size()) {
+		return false;
+	}
+
+	for (size_t i = 0; i < tape.size(); ++i) {
+		sbon::TapeEntry e = doc.entry(i);
+		if (e.offset != tape[i].offset || e.length != tape[i].length ||
+				e.next != tape[i].next || e.keyLen != tape[i].keyLen ||
+				e.count != tape[i].count) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+TEST_CASE("Editable document navigation") {
+	std::string data = makeDocument(3);
+	sbon::EditableDocument doc(span(data));
+	std::string scratch;
+
+	CHECK(doc.root().getType() == sbon::Type::OBJECT);
+	CHECK_EQ(doc.root().size(), 3u);
+	CHECK_EQ(doc.find("version").raw(scratch).getInt(), 3);
+	CHECK_EQ(doc.find("users.2.name").raw(scratch).getString(), "user 2");
+	CHECK_EQ(doc.find("users.1.tags").size(), 2u);
+	CHECK_EQ(doc.find("users.1").at(1).key(), "name");
+	CHECK(doc.root().get("").getType() == sbon::Type::OBJECT);
+	CHECK(!doc.find("users.3"));
+	CHECK(!doc.find("users.x"));
+	CHECK(!doc.find("missing"));
+
+	size_t count = 0;
+	doc.find("users").forEachChild([&](sbon::EditValue val) {
+		CHECK_EQ(val.get("id").raw(scratch).getInt(), (int64_t)count);
+		count += 1;
+	});
+	CHECK_EQ(count, 3u);
+	CHECK(tapeMatches(doc));
+
+	// Delta-encoded arrays have no child entries, but know their size
+	std::string series = encode([](sbon::Writer w) {
+		w.writeObject([](sbon::ObjectWriter w) {
+			w.key("ts").writeIntArray({1700000000, 1700000010, 1700000020});
+		});
+	});
+	sbon::EditableDocument seriesDoc(span(series));
+	CHECK(seriesDoc.find("ts").getType() == sbon::Type::ARRAY);
+	CHECK_EQ(seriesDoc.find("ts").size(), 3u);
+	CHECK(!seriesDoc.find("ts").at(0));
+}
+
+TEST_CASE("Editable document value edits") {
+	std::string data = makeDocument(3);
+	sbon::EditableDocument doc(span(data));
+	std::string scratch;
+
+	// Replace a scalar with a container
+	doc.replace(doc.find("users.1.id"), encode([](sbon::Writer w) {
+		w.writeArray([](sbon::Writer w) {
+			w.writeInt(1);
+			w.writeInt(2);
+		});
+	}));
+	CHECK(tapeMatches(doc));
+	CHECK_EQ(doc.find("users.1.id").size(), 2u);
+	CHECK_EQ(doc.find("users.1.id.1").raw(scratch).getInt(), 2);
+	CHECK_EQ(doc.find("users.2.name").raw(scratch).getString(), "user 2");
+
+	// Edit inside a string, which scans the string again
+	sbon::EditValue name = doc.find("users.0.name");
+	doc.splice(name.offset() + 1, 4, "admin");
+	CHECK(tapeMatches(doc));
+	CHECK_EQ(doc.find("users.0.name").raw(scratch).getString(), "admin 0");
+
+	// Replace the whole document
+	doc.replace(doc.root(), encode([](sbon::Writer w) { w.writeString("hello"); }));
+	CHECK(tapeMatches(doc));
+	CHECK_EQ(doc.size(), 1u);
+	CHECK_EQ(doc.root().raw(scratch).getString(), "hello");
+}
+
+TEST_CASE("Editable document child edits") {
+	std::string data = makeDocument(3);
+	sbon::EditableDocument doc(span(data));
+	std::string scratch;
+
+	// Append an element before the array's end
+	sbon::EditValue users = doc.find("users");
+	std::string user = encode([](sbon::Writer w) {
+		w.writeObject([](sbon::ObjectWriter w) {
+			w.key("id").writeInt(99);
+		});
+	});
+	doc.splice(users.offset() + users.length() - 1, 0, user + user);
+	CHECK(tapeMatches(doc));
+	CHECK_EQ(doc.find("users").size(), 5u);
+	CHECK_EQ(doc.find("users.4.id").raw(scratch).getInt(), 99);
+
+	// Remove the first element
+	sbon::EditValue first = doc.find("users.0");
+	doc.splice(first.offset(), first.length(), "");
+	CHECK(tapeMatches(doc));
+	CHECK_EQ(doc.find("users").size(), 4u);
+	CHECK_EQ(doc.find("users.0.id").raw(scratch).getInt(), 1);
+
+	// Insert a member, including its key
+	sbon::EditValue version = doc.find("version");
+	uint64_t memberStart = version.offset() - version.key().size() - 1;
+	doc.splice(memberStart, 0, encodeMember("first", encode([](sbon::Writer w) { w.writeTrue(); })));
+	CHECK(tapeMatches(doc));
+	CHECK_EQ(doc.root().size(), 4u);
+	CHECK_EQ(doc.root().at(0).key(), "first");
+	CHECK(doc.find("first").raw(scratch).getBool());
+	CHECK_EQ(doc.find("version").raw(scratch).getInt(), 3);
+
+	// Add a member to an empty object
+	sbon::EditValue empty = doc.root().get("");
+	doc.splice(empty.offset() + 1, 0, encodeMember("x", encode([](sbon::Writer w) { w.writeNull(); })));
+	CHECK(tapeMatches(doc));
+	CHECK_EQ(doc.root().get("").size(), 1u);
+	CHECK(doc.root().get("").get("x").getType() == sbon::Type::NIL);
+}
+
+TEST_CASE("Failed edits leave the document unchanged") {
+	std::string data = makeDocument(3);
+	sbon::EditableDocument doc(span(data));
+
+	auto check = [&](uint64_t offset, uint64_t length, std::string_view bytes) {
+		bool threw = false;
+		try {
+			doc.splice(offset, length, bytes);
+		} catch (sbon::ParseError &) {
+			threw = true;
+		}
+		CHECK(threw);
+		CHECK(doc.contents() == data);
+		CHECK(tapeMatches(doc));
+	};
+
+	sbon::EditValue users = doc.find("users");
+	check(users.offset(), 1, "");
+	check(users.offset() + users.length() - 1, 0, "S");
+	check(doc.find("users.0").offset(), 0, "x");
+	check(0, 0, "T");
+	check(data.size(), 0, "T");
+	check(data.size(), 1, "");
+	check(doc.find("version").offset(), 1, "");
+}
+
+TEST_CASE("Random edits of a large editable document") {
+	std::string data = makeDocument(2000);
+	sbon::EditableDocument doc(span(data));
+	REQUIRE(doc.size() > 10000);
+
+	uint64_t state = 1;
+	auto random = [&](uint64_t n) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state % n;
+	};
+
+	std::string scratch;
+	for (int i = 0; i < 300; ++i) {
+		sbon::EditValue users = doc.find("users");
+		sbon::EditValue user = users.at(random(users.size()));
+		switch (random(4)) {
+		case 0: {
+			// Replace a value
+			sbon::EditValue val = doc.value(std::min<size_t>(user.index() + random(6), doc.size() - 1));
+			doc.replace(val, encode([&](sbon::Writer w) {
+				w.writeArray([&](sbon::Writer w) {
+					for (uint64_t j = random(3); j > 0; --j) {
+						w.writeInt(j);
+					}
+				});
+			}));
+			break;
+		}
+		case 1:
+			// Insert elements before a user
+			doc.splice(user.offset(), 0, encode([](sbon::Writer w) {
+				w.writeString("new");
+				w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeFalse(); });
+			}));
+			break;
+		case 2:
+			// Remove a user
+			doc.splice(user.offset(), user.length(), "");
+			break;
+		case 3:
+			// Add a member to a user, if it's still an object
+			if (user.getType() == sbon::Type::OBJECT) {
+				doc.splice(user.offset() + user.length() - 1, 0,
+					encodeMember("n" + std::to_string(i), encode([&](sbon::Writer w) { w.writeInt(i); })));
+			}
+			break;
+		}
+
+		if (i % 50 == 0) {
+			REQUIRE(tapeMatches(doc));
+		}
+	}
+
+	CHECK(tapeMatches(doc));
+	CHECK_EQ(doc.find("version").raw(scratch).getInt(), 3);
+}
@@ -0,0 +1,104 @@
+#include <sbon-filter.h>
+
+#include <memory>
+#include <string>
+
+#include "helpers.h"
+#include "test.h"
+
+static std::string makeRecords() {
+	return encodeRecords(20, [](sbon::ObjectWriter w, int i) {
+		w.key("status").writeInt(i % 2 == 0 ? 200 : 500 + i);
+		w.key("path").writeString(i % 3 == 0 ? "/api/users" : "/index.html");
+		if (i % 5 == 0) {
+			w.key("slow").writeTrue();
+		}
+		w.key("ms").writeDouble(i * 1.5);
+	});
+}
+
+static size_t countMatches(const std::string &data, const char *expr, unsigned threads = 1) {
+	sbon::Filter filter(expr);
+	return sbon::filterRecords(
+		filter, span(data), threads).size();
+}
+
+TEST_CASE("Comparisons") {
+	std::string data = makeRecords();
+
+	CHECK(countMatches(data, "status == 200") == 10);
+	CHECK(countMatches(data, "status != 200") == 10);
+	CHECK(countMatches(data, "status >= 510") == 5);
+	CHECK(countMatches(data, "status < 510") == 15);
+	CHECK(countMatches(data, "path == \"/api/users\"") == 7);
+	CHECK(countMatches(data, "path ~ \"api\"") == 7);
+	CHECK(countMatches(data, "ms > 20.25") == 6);
+	CHECK(countMatches(data, "slow == true") == 4);
+	CHECK(countMatches(data, "slow") == 4);
+	CHECK(countMatches(data, "missing == null") == 0);
+}
+
+TEST_CASE("Boolean operators") {
+	std::string data = makeRecords();
+
+	CHECK(countMatches(data, "status >= 500 && path ~ \"/api/\"") == 3);
+	CHECK(countMatches(data, "status >= 500 || path ~ \"/api/\"") == 14);
+	CHECK(countMatches(data, "!slow") == 16);
+	CHECK(countMatches(data, "!(status == 200 || slow)") == 8);
+	CHECK(countMatches(data, "(status == 200 || slow) && ms < 10") == 5);
+}
+
+TEST_CASE("Parallel filtering keeps record order") {
+	std::string data = makeRecords();
+	sbon::Filter filter("status >= 500");
+	auto matches = sbon::filterRecords(
+		filter, span(data), 4);
+
+	REQUIRE(matches.size() == 10);
+	for (size_t i = 1; i < matches.size(); ++i) {
+		CHECK(matches[i - 1].end <= matches[i].begin);
+	}
+
+	sbon::MemoryStream is(matches[3]);
+	sbon::Reader r(&is);
+	int64_t status = 0;
+	r.matchObject({
+		{"status", [&](sbon::Reader val) {
+			status = val.getInt();
+		}},
+	});
+	CHECK(status == 507);
+}
+
+TEST_CASE("Syntax errors") {
+	const char *bad[] = {
+		"", "status ==", "(status == 1", "status == 1 &&", "path ~ 3", "x == \"abc",
+		"status == 99999999999999999999",
+	};
+
+	for (const char *expr: bad) {
+		bool threw = false;
+		try {
+			sbon::Filter filter(expr);
+		} catch (sbon::FilterError &) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// Out of range integers are reported where they start
+	try {
+		sbon::Filter filter("a == 99999999999999999999");
+	} catch (sbon::FilterError &err) {
+		CHECK(std::string(err.what()) ==
+			"SBON filter error at column 6: Integer out of range");
+	}
+}
+
+TEST_CASE("Filters don't refer to their expression") {
+	std::string data = makeRecords();
+	auto expr = std::make_unique<std::string>("status == +200");
+	sbon::Filter filter(*expr);
+	expr.reset();
+	CHECK(sbon::filterRecords(filter, span(data)).size() == 10);
+}
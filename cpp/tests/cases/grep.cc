@@ -0,0 +1,77 @@
+#include <sbon-grep.h>
+
+#include <sstream>
+#include <string>
+
+#include "test.h"
+
+TEST_CASE("Substring search") {
+	std::string hay = "The quick brown fox jumps over the lazy dog, again and again";
+	for (size_t start = 0; start < hay.size(); ++start) {
+		for (size_t len = 1; start + len <= hay.size() && len < 20; ++len) {
+			std::string needle = hay.substr(start, len);
+			const char *found = sbon::findSubstring(hay, needle);
+			REQUIRE(found);
+			CHECK((size_t)(found - hay.data()) == hay.find(needle));
+		}
+	}
+
+	CHECK(sbon::findSubstring(hay, "cat") == nullptr);
+	CHECK(sbon::findSubstring(hay, "again!") == nullptr);
+	CHECK(sbon::findSubstring("short", "longer than hay") == nullptr);
+}
+
+TEST_CASE("Grep string values with paths") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([](sbon::ObjectWriter w) {
+		w.key("msg").writeString("nothing here");
+	});
+	w.writeObject([](sbon::ObjectWriter w) {
+		w.key("blob").writeBinary("needle", 6);
+		w.key("req").writeObject([](sbon::ObjectWriter w) {
+			w.key("tags").writeArray([](sbon::Writer w) {
+				w.writeString("hay");
+				w.writeString("a needle!");
+			});
+		});
+		w.key("needle").writeInt(1);
+	});
+
+	std::string data = ss.str();
+	sbon::Span input{data.data(), data.data() + data.size()};
+
+	auto matches = sbon::grepRecords(sbon::GrepPattern::literal("needle"), input);
+	REQUIRE(matches.size() == 1);
+	CHECK(matches[0].record == 1);
+	CHECK(matches[0].path == "req.tags.1");
+	CHECK(matches[0].text == "a needle!");
+	CHECK(!matches[0].isKey);
+
+	matches = sbon::grepRecords(sbon::GrepPattern::literal("needle"), input, true);
+	REQUIRE(matches.size() == 2);
+	CHECK(matches[1].path == "needle");
+	CHECK(matches[1].isKey);
+}
+
+TEST_CASE("Regex prefilter") {
+	auto pat = sbon::GrepPattern::regex("GET /api/v[0-9]+/users");
+	CHECK(pat.prefilter() == "GET /api/v");
+	CHECK(pat.matches("GET /api/v12/users/1"));
+	CHECK(!pat.matches("GET /api/vx/users/1"));
+
+	CHECK(sbon::GrepPattern::regex("ab*c").prefilter() == "a");
+	CHECK(sbon::GrepPattern::regex("x{2}y").prefilter() == "y");
+	CHECK(sbon::GrepPattern::regex("foo|bar").prefilter() == "");
+	CHECK(sbon::GrepPattern::regex("foo|bar").matches("a bar"));
+
+	// Escape sequences end the literal, and are skipped as a whole
+	auto hex = sbon::GrepPattern::regex("\\x41BC");
+	CHECK(hex.prefilter() == "BC");
+	CHECK(hex.matches("xABC"));
+	CHECK(!hex.matches("x41BC"));
+	CHECK(sbon::GrepPattern::regex("\\u0041xy").prefilter() == "xy");
+	CHECK(sbon::GrepPattern::regex("\\cJab").prefilter() == "ab");
+	CHECK(sbon::GrepPattern::regex("(a)\\1b").prefilter() == "b");
+	CHECK(sbon::GrepPattern::regex("\\d+xyz").prefilter() == "xyz");
+}
@@ -0,0 +1,230 @@
+#include <sbon-infer.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "helpers.h"
+#include "test.h"
+
+// Bindings generated by the "Generated bindings" test,
+// compiled here to check that the generated code is valid
+#include "fixtures/user-bindings.h"
+
+static std::string makeRecords(int count) {
+	return encodeRecords(count, [](sbon::ObjectWriter w, int i) {
+		auto id = [&] { w.key("id").writeInt(i - 10); };
+		auto name = [&] { w.key("name").writeString(std::string(i % 5 + 1, 'x')); };
+		if (i % 10 == 0) {
+			name();
+			id();
+		} else {
+			id();
+			name();
+		}
+		if (i % 4 == 0) {
+			w.key("nick").writeString("n");
+		}
+		if (i % 3 == 0) {
+			w.key("score").writeNull();
+		} else {
+			w.key("score").writeDouble(i * 0.5);
+		}
+		w.key("samples").writeArray([&](sbon::Writer w) {
+			for (int j = 0; j < i % 4; ++j) {
+				w.writeInt(j);
+			}
+		});
+		w.key("users").writeArray([&](sbon::Writer w) {
+			w.writeObject([&](sbon::ObjectWriter w) {
+				w.key("role").writeString("admin");
+			});
+		});
+		if (i % 2) {
+			w.key("mixed").writeString("x");
+		} else {
+			w.key("mixed").writeInt(2);
+		}
+		w.key("class").writeBool(i % 2);
+	});
+}
+
+TEST_CASE("Schema inference") {
+	std::string data = makeRecords(100);
+	sbon::InferredValue schema = sbon::inferSchema(span(data), 1);
+
+	CHECK_EQ(schema.count, 100u);
+	CHECK_EQ(schema.objects, 100u);
+
+	auto id = schema.member("id");
+	REQUIRE(id);
+	CHECK_EQ(id->present, 100u);
+	CHECK(id->value->onlyInts());
+	CHECK_EQ(id->value->minInt, -10);
+	CHECK_EQ(id->value->maxInt, 89);
+
+	auto name = schema.member("name");
+	REQUIRE(name);
+	CHECK_EQ(name->value->strings, 100u);
+	CHECK_EQ(name->value->minLength, 1u);
+	CHECK_EQ(name->value->maxLength, 5u);
+
+	CHECK_EQ(schema.member("nick")->present, 25u);
+	CHECK_EQ(schema.member("score")->value->nulls, 34u);
+	CHECK(schema.member("score")->value->onlyNumbers());
+	CHECK_EQ(schema.member("samples")->value->maxItems, 3u);
+	CHECK_EQ(schema.member("users")->value->items->objects, 100u);
+	CHECK(!schema.member("missing"));
+
+	// The most common order, with 'nick' where it usually is
+	uint64_t seen = 0;
+	auto order = schema.dominantOrder(&seen);
+	CHECK_EQ(seen, 70u);
+	CHECK((order == std::vector<std::string_view>{
+		"id", "name", "score", "samples", "users", "mixed", "class"}));
+	CHECK((schema.keyOrder() == std::vector<std::string_view>{
+		"id", "name", "nick", "score", "samples", "users", "mixed", "class"}));
+}
+
+TEST_CASE("Parallel schema inference") {
+	std::string data = makeRecords(1000);
+
+	std::stringstream single;
+	sbon::inferSchema(span(data), 1).writeSchema(sbon::Writer(&single));
+	std::stringstream parallel;
+	sbon::inferSchema(span(data), 4).writeSchema(sbon::Writer(&parallel));
+	CHECK(single.str() == parallel.str());
+}
+
+TEST_CASE("Inferred schemas validate their corpus") {
+	std::string data = makeRecords(100);
+	std::stringstream ss;
+	sbon::inferSchema(span(data), 1).writeSchema(sbon::Writer(&ss));
+
+	sbon::Schema schema = sbon::Schema::compile(sbon::Reader(&ss));
+	size_t valid = 0;
+	sbon::forEachRecord(span(data), [&](sbon::Span rec) {
+		sbon::MemoryStream ms(rec);
+		valid += schema.validate(sbon::Reader(&ms));
+	});
+	CHECK_EQ(valid, 100u);
+
+	// Something outside the inferred ranges doesn't
+	std::stringstream rec;
+	sbon::Writer w(&rec);
+	w.writeObject([&](sbon::ObjectWriter w) {
+		w.key("id").writeInt(1000);
+	});
+	sbon::Violation violation;
+	CHECK(!schema.validate(sbon::Reader(&rec), &violation));
+}
+
+TEST_CASE("Generated bindings") {
+	std::string data = makeRecords(100);
+	sbon::InferredValue schema = sbon::inferSchema(span(data), 1);
+
+	sbon::BindingOptions opts;
+	opts.rootName = "User";
+	opts.ns = "gen";
+	std::stringstream ss;
+	sbon::generateBindings(schema, opts, ss);
+	std::string code = ss.str();
+
+	auto has = [&](const std::string &str) {
+		return code.find(str) != std::string::npos;
+	};
+	CHECK(has("namespace gen {"));
+	CHECK(has("struct User {"));
+	CHECK(has("\tint64_t id{};"));
+	CHECK(has("\tstd::optional<std::string> nick{};"));
+	CHECK(has("\tstd::optional<double> score{};"));
+	CHECK(has("\tstd::vector<int64_t> samples{};"));
+	CHECK(has("struct UserUser {"));
+	CHECK(has("\tstd::vector<UserUser> users{};"));
+	CHECK(has("\tbool class_{};"));
+	CHECK(has("// Not decoded: no single type"));
+
+	// Keys are decoded in the usual order
+	CHECK(has("\"id\",\n\t\t\"name\",\n\t\t\"nick\",\n\t\t\"score\","));
+	CHECK(has("arr.getInts(out.samples);"));
+
+	// Skipping "mixed", which isn't decoded, keeps "class" the expected key
+	CHECK(has("\t\t\tif (field < 7) {\n\t\t\t\t// Keys which aren't decoded don't move the expected key on\n\t\t\t\texpected = field + 1;\n\t\t\t}"));
+	CHECK(has("inline void encode(sbon::Writer w, const User &in) {"));
+	CHECK(has("\t\tif (in.nick) {\n\t\t\tobj.key(\"nick\").writeString(*in.nick);\n\t\t}"));
+
+	// Bindings are only for objects
+	std::stringstream ints;
+	sbon::Writer w(&ints);
+	w.writeInt(1);
+	w.writeInt(2);
+	std::string intData = ints.str();
+
+	bool threw = false;
+	try {
+		sbon::generateBindings(sbon::inferSchema(span(intData), 1), opts, ss);
+	} catch (sbon::SchemaError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+TEST_CASE("Generated bindings compile and round-trip their corpus") {
+	std::string data = makeRecords(100);
+
+	// The compiled fixture is what the generator writes now
+	sbon::BindingOptions opts;
+	opts.rootName = "User";
+	opts.ns = "gen";
+	std::stringstream code;
+	sbon::generateBindings(sbon::inferSchema(span(data), 1), opts, code);
+	std::ifstream fixture("tests/fixtures/user-bindings.h");
+	REQUIRE(fixture);
+	std::stringstream fixtureCode;
+	fixtureCode << fixture.rdbuf();
+	CHECK(fixtureCode.str() == code.str());
+
+	std::vector<gen::User> users;
+	std::stringstream encoded;
+	sbon::forEachRecord(span(data), [&](sbon::Span rec) {
+		sbon::MemoryStream ms(rec);
+		gen::decode(sbon::Reader(&ms), users.emplace_back());
+		gen::encode(sbon::Writer(&encoded), users.back());
+	});
+	REQUIRE(users.size() == 100);
+
+	for (int i = 0; i < 100; ++i) {
+		auto &user = users[i];
+		CHECK(user.id == i - 10);
+		CHECK(user.name == std::string(i % 5 + 1, 'x'));
+		CHECK(user.nick.has_value() == (i % 4 == 0));
+		CHECK(user.score.has_value() == (i % 3 != 0));
+		CHECK(user.samples.size() == (size_t)(i % 4));
+		REQUIRE(user.users.size() == 1);
+		CHECK(user.users[0].role == "admin");
+		CHECK(user.class_ == (bool)(i % 2));
+	}
+
+	// Decoding the encoded records gives the same records,
+	// which encode to the same bytes again
+	std::string first = encoded.str();
+	std::stringstream reencoded;
+	size_t index = 0;
+	sbon::forEachRecord(span(first), [&](sbon::Span rec) {
+		sbon::MemoryStream ms(rec);
+		gen::User user;
+		gen::decode(sbon::Reader(&ms), user);
+		REQUIRE(index < users.size());
+		auto &orig = users[index++];
+		CHECK(user.id == orig.id);
+		CHECK(user.name == orig.name);
+		CHECK(user.nick == orig.nick);
+		CHECK(user.score == orig.score);
+		CHECK(user.samples == orig.samples);
+		CHECK(user.users.size() == orig.users.size());
+		CHECK(user.class_ == orig.class_);
+		gen::encode(sbon::Writer(&reencoded), user);
+	});
+	CHECK(index == users.size());
+	CHECK(reencoded.str() == first);
+}
@@ -0,0 +1,120 @@
+#include <sbon.h>
+#include <sbon-records.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+TEST_CASE("String table") {
+	sbon::StringTable table;
+	CHECK(table.find("GET") == sbon::StringTable::NOT_FOUND);
+
+	uint32_t get = table.intern("GET");
+	uint32_t post = table.intern("POST");
+	CHECK(get != post);
+	CHECK(table.intern("GET") == get);
+	CHECK(table.find("POST") == post);
+	CHECK(table.view(get) == "GET");
+	CHECK(table.size() == 2);
+
+	// Views stay valid as the table grows
+	std::string_view first = table.view(get);
+	std::vector<uint32_t> ids;
+	for (int i = 0; i < 2000; ++i) {
+		ids.push_back(table.intern("string number " + std::to_string(i)));
+	}
+	uint32_t big = table.intern(std::string(10000, 'x'));
+
+	CHECK(first.data() == table.view(get).data());
+	CHECK(table.size() == 2003);
+	for (int i = 0; i < 2000; ++i) {
+		CHECK(ids[i] == (uint32_t)i + 2);
+		CHECK(table.view(ids[i]) == "string number " + std::to_string(i));
+	}
+	CHECK(table.view(big) == std::string(10000, 'x'));
+	CHECK(table.intern("") == 2003);
+	CHECK(table.find("") == 2003);
+}
+
+TEST_CASE("Interned string values") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeArray([](sbon::Writer w) {
+		for (int i = 0; i < 100; ++i) {
+			w.writeString(i % 3 == 0 ? "GET" : i % 3 == 1 ? "POST" : "a method name longer than 16 bytes");
+		}
+	});
+	std::string doc = ss.str();
+
+	sbon::StringTable table;
+	std::vector<uint32_t> ids;
+	ids.reserve(100);
+	auto read = [&] {
+		ids.clear();
+		sbon::MemoryStream ms(doc.data(), doc.size());
+		sbon::Reader r(&ms);
+		r.readArray([&](sbon::Reader r) {
+			ids.push_back(r.getInterned(table));
+		});
+	};
+
+	read();
+	CHECK(table.size() == 3);
+	CHECK(ids[0] == ids[3]);
+	CHECK(table.view(ids[1]) == "POST");
+	CHECK(table.view(ids[2]) == "a method name longer than 16 bytes");
+
+	// Once the strings are known, decoding them doesn't allocate
+	CHECK_NO_ALLOC(read());
+	CHECK(table.size() == 3);
+
+	std::stringstream bad{"T"};
+	sbon::Reader r(&bad);
+	bool threw = false;
+	try {
+		r.getInterned(table);
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+enum class Method {
+	GET,
+	POST,
+	PUT,
+	OTHER,
+};
+
+static constexpr sbon::EnumStrings<Method, 3> methods({
+	{"GET", Method::GET},
+	{"POST", Method::POST},
+	{"PUT", Method::PUT},
+});
+
+static_assert(methods.find("POST")->value == Method::POST);
+static_assert(methods.find("PATCH") == nullptr);
+
+TEST_CASE("Enum string values") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeString("PUT");
+	w.writeString("GET");
+	w.writeString("DELETE");
+	w.writeString("");
+	w.writeString(std::string(100, 'G'));
+	w.writeString("POST");
+
+	sbon::Reader r(&ss);
+	CHECK_NO_ALLOC({
+		CHECK(r.getEnum(methods, Method::OTHER) == Method::PUT);
+		CHECK(r.getEnum(methods, Method::OTHER) == Method::GET);
+		CHECK(r.getEnum(methods, Method::OTHER) == Method::OTHER);
+		CHECK(r.getEnum(methods, Method::OTHER) == Method::OTHER);
+		CHECK(r.getEnum(methods, Method::OTHER) == Method::OTHER);
+		CHECK(r.getEnum(methods, Method::OTHER) == Method::POST);
+	});
+	CHECK(!r.hasNext());
+}
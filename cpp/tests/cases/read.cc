@@ -1,7 +1,12 @@
 #include <sbon.h>
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
 #include <sstream>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include "test.h"
 
@@ -209,3 +214,288 @@ TEST_CASE("Object matching") {
 
 	CHECK(remaining == 0);
 }
+
+TEST_CASE("Cancellation") {
+	std::string doc = "[";
+	for (int i = 0; i < 1000; ++i) {
+		doc += "SHello World!";
+		doc += '\0';
+	}
+	doc += "]";
+
+	// Without cancellation, the whole array is read
+	{
+		std::stringstream ss{doc};
+		sbon::Cancellation cancel(16);
+		sbon::Reader r(&ss, &cancel);
+		size_t count = 0;
+		r.readArray([&](sbon::Reader r) {
+			r.skip();
+			count += 1;
+		});
+		CHECK(count == 1000);
+	}
+
+	// Cancelling in a callback stops decoding soon after,
+	// and the values read so far stay valid
+	{
+		std::stringstream ss{doc};
+		sbon::Cancellation cancel(16);
+		sbon::Reader r(&ss, &cancel);
+		std::vector<std::string> strs;
+		bool cancelled = false;
+		try {
+			r.readArray([&](sbon::Reader r) {
+				strs.push_back(r.getString());
+				if (strs.size() == 10) {
+					cancel.cancel();
+				}
+			});
+		} catch (sbon::CancelledError &) {
+			cancelled = true;
+		}
+
+		CHECK(cancelled);
+		CHECK(strs.size() >= 10 && strs.size() <= 12);
+		CHECK(strs[9] == "Hello World!");
+	}
+
+	// A deadline in the past cancels on the first check, including in keys
+	{
+		std::string obj = "{" + std::string(100, 'k') + std::string(1, '\0') + "T}";
+		std::stringstream ss{obj};
+		auto cancel = sbon::Cancellation::after(std::chrono::seconds(-1), 16);
+		sbon::Reader r(&ss, &cancel);
+		bool cancelled = false;
+		try {
+			r.readObject([](std::string &, sbon::Reader r) {
+				r.skip();
+			});
+		} catch (sbon::CancelledError &) {
+			cancelled = true;
+		}
+
+		CHECK(cancelled);
+	}
+}
+
+// Hands out its data a few bytes at a time, like a slow file or socket
+class TrickleBuf: public std::streambuf {
+public:
+	TrickleBuf(std::string data, size_t chunk): data_(std::move(data)), chunk_(chunk) {}
+
+protected:
+	int_type underflow() override {
+		if (pos_ >= data_.size()) {
+			return traits_type::eof();
+		}
+
+		size_t n = std::min(chunk_, data_.size() - pos_);
+		setg(data_.data() + pos_, data_.data() + pos_, data_.data() + pos_ + n);
+		pos_ += n;
+		return traits_type::to_int_type(*gptr());
+	}
+
+private:
+	std::string data_;
+	size_t chunk_;
+	size_t pos_ = 0;
+};
+
+TEST_CASE("Bulk integer arrays") {
+	std::vector<int64_t> expected;
+	uint64_t state = 1;
+	for (int i = 0; i < 5000; ++i) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+
+		// Mix immediate digits and every LEB128 length
+		int64_t num = (int64_t)(state >> (state % 64)) >> 1;
+		if (i % 7 == 0) {
+			num = i % 10;
+		}
+		if (state % 3 == 0) {
+			num = -num;
+		}
+		expected.push_back(num);
+	}
+	expected.push_back(std::numeric_limits<int64_t>::max());
+	expected.push_back(-std::numeric_limits<int64_t>::max());
+
+	std::stringstream doc;
+	sbon::Writer w(&doc);
+	w.writeArray([&](sbon::Writer w) {
+		for (auto num: expected) {
+			w.writeInt(num);
+		}
+	});
+	w.writeTrue();
+
+	for (size_t chunk: {(size_t)1, (size_t)23, (size_t)100, (size_t)-1}) {
+		TrickleBuf buf(doc.str(), chunk);
+		std::istream is(&buf);
+		sbon::Reader r(&is);
+		std::vector<int64_t> ints;
+		r.getArray([&](sbon::ArrayReader arr) {
+			arr.getInts(ints);
+		});
+		CHECK(ints == expected);
+		CHECK(r.getBool() == true);
+		CHECK(!r.hasNext());
+	}
+
+	// Integral floats are accepted like getInt does, other values aren't
+	{
+		std::stringstream ss;
+		sbon::Writer w(&ss);
+		w.writeArray([](sbon::Writer w) {
+			w.writeInt(1);
+			w.writeDouble(2);
+			w.writeInt(300);
+		});
+
+		sbon::Reader r(&ss);
+		std::vector<int64_t> ints{5, 6};
+		r.getArray([&](sbon::ArrayReader arr) {
+			arr.getInts(ints);
+		});
+		CHECK((ints == std::vector<int64_t>{1, 2, 300}));
+	}
+
+	{
+		std::string big(100, '5');
+		big.insert(50, "SHi");
+		big += '\0';
+		std::stringstream ss{"[" + big + "]"};
+		sbon::Reader r(&ss);
+		std::vector<int64_t> ints;
+		bool threw = false;
+		try {
+			r.getArray([&](sbon::ArrayReader arr) {
+				arr.getInts(ints);
+			});
+		} catch (sbon::ParseError &) {
+			threw = true;
+		}
+		CHECK(threw);
+		CHECK(ints.size() == 50);
+	}
+
+	{
+		std::stringstream ss{"[]"};
+		sbon::Reader r(&ss);
+		std::vector<int64_t> ints{1};
+		r.getArray([&](sbon::ArrayReader arr) {
+			arr.getInts(ints);
+		});
+		CHECK(ints.empty());
+	}
+}
+
+TEST_CASE("Delta-encoded integer arrays") {
+	std::vector<int64_t> expected;
+	uint64_t state = 1;
+	int64_t num = 1700000000000;
+	for (int i = 0; i < 5000; ++i) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+
+		// Mostly small steps in either direction, with some jumps
+		if (i % 500 == 0) {
+			num += (int64_t)(state >> 20);
+		} else {
+			num += (int64_t)(state % 100) - 20;
+		}
+		expected.push_back(num);
+	}
+	expected.push_back(std::numeric_limits<int64_t>::min());
+	expected.push_back(std::numeric_limits<int64_t>::max());
+
+	std::stringstream doc;
+	sbon::Writer w(&doc);
+	w.writeIntArray(expected);
+	w.writeTrue();
+	CHECK(doc.str()[0] == '#');
+
+	for (size_t chunk: {(size_t)1, (size_t)23, (size_t)100, (size_t)-1}) {
+		TrickleBuf buf(doc.str(), chunk);
+		std::istream is(&buf);
+		sbon::Reader r(&is);
+		CHECK(r.getType() == sbon::Type::ARRAY);
+		std::vector<int64_t> ints{1};
+		r.getInts(ints);
+		CHECK(ints == expected);
+		CHECK(r.getBool() == true);
+		CHECK(!r.hasNext());
+	}
+
+	// It can be read and skipped like an ordinary array
+	{
+		std::stringstream ss;
+		sbon::Writer w(&ss);
+		w.writeIntArray({1700000000, 1700000010, 1700000020, 1700000015});
+		w.writeIntArray({1700000000, 1700000010, 1700000020, 1700000015});
+		w.writeIntArray({1, 2, 3});
+		w.writeNull();
+
+		sbon::Reader r(&ss);
+		std::vector<int64_t> ints;
+		r.readArray([&](sbon::Reader r) {
+			ints.push_back(r.getInt());
+		});
+		CHECK((ints == std::vector<int64_t>{1700000000, 1700000010, 1700000020, 1700000015}));
+		r.skip();
+		r.getInts(ints);
+		CHECK((ints == std::vector<int64_t>{1, 2, 3}));
+		r.getNil();
+		CHECK(!r.hasNext());
+	}
+
+	// Elements are decoded as they're reached, and the rest can be read in bulk
+	{
+		std::stringstream ss{doc.str()};
+		sbon::Reader r(&ss);
+		std::vector<int64_t> ints;
+		r.getArray([&](sbon::ArrayReader arr) {
+			CHECK(arr.next().getType() == sbon::Type::UINT);
+			CHECK_EQ(arr.next().getInt(), expected[1]);
+			arr.next().skip();
+			arr.getInts(ints);
+			CHECK(!arr.hasNext());
+		});
+		CHECK(ints == std::vector<int64_t>(expected.begin() + 3, expected.end()));
+		CHECK(r.getBool() == true);
+	}
+
+	// Leaving elements unread is an error, like with an ordinary array
+	{
+		std::stringstream ss{doc.str()};
+		sbon::Reader r(&ss);
+		bool threw = false;
+		try {
+			r.getArray([&](sbon::ArrayReader arr) {
+				arr.next().getInt();
+			});
+		} catch (sbon::ParseError &) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	// A truncated array
+	{
+		std::string str = doc.str();
+		std::stringstream ss{str.substr(0, str.size() / 2)};
+		sbon::Reader r(&ss);
+		std::vector<int64_t> ints;
+		bool threw = false;
+		try {
+			r.getInts(ints);
+		} catch (sbon::ParseError &) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+}
@@ -0,0 +1,197 @@
+#include <sbon-records.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+TEST_CASE("Skip values") {
+	char buf[] =
+		"{a\0[1[]{}]b\0{c\0B\x03\0\0\0}d\0+\x80\x01}"
+		"[Sx\0f\0\0\0\0d\0\0\0\0\0\0\0\0-\x05]"
+		"T";
+	std::string_view sv(buf, sizeof(buf) - 1);
+
+	const char *p = sbon::skipValue(sv.data(), sv.data() + sv.size());
+	CHECK(p - sv.data() == 27);
+	p = sbon::skipValue(p, sv.data() + sv.size());
+	CHECK(p - sv.data() == 48);
+	p = sbon::skipValue(p, sv.data() + sv.size());
+	CHECK(p == sv.data() + sv.size());
+
+	bool threw = false;
+	try {
+		sbon::skipValue(sv.data(), sv.data() + 10);
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+TEST_CASE("Skip delta-encoded arrays") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([](sbon::ObjectWriter w) {
+		w.key("ts").writeIntArray({1700000000, 1700000010, 1700000020, 1700000015});
+		w.key("n").writeInt(1);
+	});
+	std::string str = ss.str();
+	REQUIRE(str.find('#') != std::string::npos);
+
+	auto val = sbon::RawValue::at(str.data(), str.data() + str.size());
+	CHECK(val.span().size() == str.size());
+
+	val.forEachMember([&](std::string_view key, sbon::RawValue val) {
+		if (key != "ts") {
+			return;
+		}
+
+		CHECK(val.getType() == sbon::Type::ARRAY);
+		std::vector<int64_t> ints;
+		val.getInts(ints);
+		CHECK((ints == std::vector<int64_t>{1700000000, 1700000010, 1700000020, 1700000015}));
+
+		std::vector<int64_t> elements;
+		val.forEachElement([&](sbon::RawValue el) {
+			elements.push_back(el.getInt());
+		});
+		CHECK(elements == ints);
+	});
+
+	bool threw = false;
+	try {
+		sbon::skipValue(str.data(), str.data() + 10);
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+TEST_CASE("Split into chunks") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	for (int i = 0; i < 100; ++i) {
+		w.writeObject([&](sbon::ObjectWriter w) {
+			w.key("i").writeInt(i);
+		});
+	}
+
+	std::string str = ss.str();
+	sbon::Span input{str.data(), str.data() + str.size()};
+	auto chunks = sbon::splitChunks(input, 7);
+	CHECK(chunks.size() == 7);
+
+	const char *p = input.begin;
+	int records = 0;
+	for (auto &chunk: chunks) {
+		CHECK(chunk.begin == p);
+		sbon::forEachRecord(chunk, [&](sbon::Span) {
+			records += 1;
+		});
+		p = chunk.end;
+	}
+	CHECK(p == input.end);
+	CHECK(records == 100);
+}
+
+TEST_CASE("Raw values") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([](sbon::ObjectWriter w) {
+		w.key("name").writeString("Bob");
+		w.key("age").writeInt(56);
+		w.key("data").writeBinary("\0\1", 2);
+		w.key("list").writeArray([](sbon::Writer w) {
+			w.writeDouble(1.5);
+			w.writeInt(-3);
+		});
+	});
+
+	std::string str = ss.str();
+	auto val = sbon::RawValue::at(str.data(), str.data() + str.size());
+	CHECK(val.getType() == sbon::Type::OBJECT);
+	CHECK(val.span().size() == str.size());
+
+	int members = 0;
+	val.forEachMember([&](std::string_view key, sbon::RawValue val) {
+		members += 1;
+		if (key == "name") {
+			CHECK(val.getString() == "Bob");
+		} else if (key == "age") {
+			CHECK(val.getInt() == 56);
+		} else if (key == "data") {
+			CHECK(val.getBinary() == std::string_view("\0\1", 2));
+		} else if (key == "list") {
+			std::vector<double> nums;
+			val.forEachElement([&](sbon::RawValue el) {
+				nums.push_back(el.getDouble());
+			});
+			CHECK(nums == std::vector<double>({1.5, -3}));
+		}
+	});
+	CHECK(members == 4);
+}
+
+TEST_CASE("Path sets") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([](sbon::ObjectWriter w) {
+		w.key("skipped").writeString("xxx");
+		w.key("req").writeObject([](sbon::ObjectWriter w) {
+			w.key("path").writeString("/api/x");
+			w.key("tags").writeArray([](sbon::Writer w) {
+				w.writeString("a");
+				w.writeString("b");
+			});
+		});
+		w.key("status").writeInt(404);
+	});
+
+	sbon::PathSet paths;
+	size_t status = paths.add("status");
+	size_t path = paths.add("req.path");
+	size_t tag = paths.add("req.tags.1");
+	size_t missing = paths.add("req.missing");
+	CHECK(paths.add("status") == status);
+	CHECK(paths.size() == 4);
+
+	std::string str = ss.str();
+	std::vector<std::string> found(paths.size());
+	paths.visit({str.data(), str.data() + str.size()}, [&](size_t id, sbon::RawValue val) {
+		if (id == status) {
+			found[id] = std::to_string(val.getInt());
+		} else {
+			found[id] = val.getString();
+		}
+		return true;
+	});
+
+	CHECK(found[status] == "404");
+	CHECK(found[path] == "/api/x");
+	CHECK(found[tag] == "b");
+	CHECK(found[missing] == "");
+
+	// Elements of delta-encoded arrays are found too,
+	// and stay valid until the next visit
+	std::stringstream series;
+	sbon::Writer(&series).writeObject([](sbon::ObjectWriter w) {
+		w.key("ts").writeIntArray({1700000000, 1700000010, 1700000020, 1700000015});
+		w.key("n").writeInt(1);
+	});
+	str = series.str();
+	REQUIRE(str.find('#') != std::string::npos);
+
+	sbon::PathSet seriesPaths;
+	size_t second = seriesPaths.add("ts.1");
+	size_t last = seriesPaths.add("ts.3");
+	size_t n = seriesPaths.add("n");
+	std::vector<sbon::RawValue> vals(seriesPaths.size());
+	seriesPaths.visit({str.data(), str.data() + str.size()}, [&](size_t id, sbon::RawValue val) {
+		vals[id] = val;
+		return true;
+	});
+	CHECK(vals[second].getInt() == 1700000010);
+	CHECK(vals[last].getInt() == 1700000015);
+	CHECK(vals[n].getInt() == 1);
+}
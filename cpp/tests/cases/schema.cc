@@ -0,0 +1,181 @@
+#include <sbon-schema.h>
+
+#include <sstream>
+#include <string>
+
+#include "test.h"
+
+static sbon::Schema makeSchema() {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([](sbon::ObjectWriter w) {
+		w.key("type").writeString("object");
+		w.key("required").writeArray([](sbon::Writer w) {
+			w.writeString("id");
+			w.writeString("tags");
+		});
+		w.key("additionalProperties").writeFalse();
+		w.key("properties").writeObject([](sbon::ObjectWriter w) {
+			w.key("id").writeObject([](sbon::ObjectWriter w) {
+				w.key("type").writeString("integer");
+				w.key("minimum").writeInt(1);
+			});
+			w.key("name").writeObject([](sbon::ObjectWriter w) {
+				w.key("type").writeArray([](sbon::Writer w) {
+					w.writeString("string");
+					w.writeString("null");
+				});
+				w.key("maxLength").writeInt(8);
+			});
+			w.key("score").writeObject([](sbon::ObjectWriter w) {
+				w.key("type").writeString("number");
+				w.key("minimum").writeDouble(0.0);
+				w.key("maximum").writeDouble(1.0);
+			});
+			w.key("tags").writeObject([](sbon::ObjectWriter w) {
+				w.key("type").writeString("array");
+				w.key("maxItems").writeInt(3);
+				w.key("items").writeObject([](sbon::ObjectWriter w) {
+					w.key("type").writeString("string");
+					w.key("minLength").writeInt(1);
+				});
+			});
+			w.key("extra").writeObject([](sbon::ObjectWriter w) {
+				w.key("description").writeString("Anything goes");
+			});
+		});
+	});
+
+	return sbon::Schema::compile(sbon::Reader(&ss));
+}
+
+template<typename Func>
+static bool validate(const sbon::Schema &schema, Func func, sbon::Violation *v = nullptr) {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject(func);
+	return schema.validate(sbon::Reader(&ss), v);
+}
+
+TEST_CASE("Schema validation") {
+	sbon::Schema schema = makeSchema();
+
+	CHECK(validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeInt(10);
+		w.key("name").writeString("alice");
+		w.key("score").writeDouble(0.5);
+		w.key("tags").writeArray([](sbon::Writer w) {
+			w.writeString("a");
+			w.writeString("b");
+		});
+		w.key("extra").writeArray([](sbon::Writer w) {
+			w.writeNull();
+		});
+	}));
+
+	CHECK(validate(schema, [](sbon::ObjectWriter w) {
+		w.key("tags").writeArray([](sbon::Writer) {});
+		w.key("name").writeNull();
+		w.key("score").writeInt(1);
+		w.key("id").writeInt(1);
+	}));
+}
+
+TEST_CASE("Schema violations") {
+	sbon::Schema schema = makeSchema();
+	sbon::Violation v;
+
+	CHECK(!validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeInt(10);
+	}, &v));
+	CHECK(v.path == "");
+	CHECK(v.message == "Missing required key 'tags'");
+
+	CHECK(!validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeInt(0);
+		w.key("tags").writeArray([](sbon::Writer) {});
+	}, &v));
+	CHECK(v.path == "id");
+	CHECK(v.message == "Number is less than the minimum");
+
+	CHECK(!validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeDouble(2.5);
+		w.key("tags").writeArray([](sbon::Writer) {});
+	}, &v));
+	CHECK(v.path == "id");
+	CHECK(v.message == "Expected integer");
+
+	CHECK(!validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeInt(1);
+		w.key("name").writeTrue();
+		w.key("tags").writeArray([](sbon::Writer) {});
+	}, &v));
+	CHECK(v.path == "name");
+	CHECK(v.message == "Expected null or string");
+
+	CHECK(!validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeInt(1);
+		w.key("name").writeString("much too long");
+		w.key("tags").writeArray([](sbon::Writer) {});
+	}, &v));
+	CHECK(v.path == "name");
+
+	CHECK(!validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeInt(1);
+		w.key("tags").writeArray([](sbon::Writer w) {
+			w.writeString("a");
+			w.writeString("");
+		});
+	}, &v));
+	CHECK(v.path == "tags.1");
+	CHECK(v.message == "Length is less than the minimum");
+
+	CHECK(!validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeInt(1);
+		w.key("tags").writeArray([](sbon::Writer w) {
+			for (int i = 0; i < 4; ++i) {
+				w.writeString("x");
+			}
+		});
+	}, &v));
+	CHECK(v.path == "tags");
+	CHECK(v.message == "More than 3 items");
+
+	CHECK(!validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeInt(1);
+		w.key("score").writeFloat(1.5);
+		w.key("tags").writeArray([](sbon::Writer) {});
+	}, &v));
+	CHECK(v.path == "score");
+	CHECK(v.message == "Number is greater than the maximum");
+
+	CHECK(!validate(schema, [](sbon::ObjectWriter w) {
+		w.key("id").writeInt(1);
+		w.key("tags").writeArray([](sbon::Writer) {});
+		w.key("bogus").writeTrue();
+	}, &v));
+	CHECK(v.path == "bogus");
+	CHECK(v.message == "Unexpected key");
+}
+
+TEST_CASE("Invalid schemas") {
+	const char *bad[] = {
+		"T",
+		"{type\0Sfoo\0}",
+		"{minItems\0-\x01}",
+		"{frobnicate\0T}",
+		"{properties\0{a\0N}}",
+	};
+	const size_t sizes[] = {1, 12, 13, 14, 18};
+
+	for (size_t i = 0; i < sizeof(bad) / sizeof(*bad); ++i) {
+		std::stringstream ss{std::string(bad[i], sizes[i])};
+		bool threw = false;
+		try {
+			sbon::Schema::compile(sbon::Reader(&ss));
+		} catch (sbon::SchemaError &) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+}
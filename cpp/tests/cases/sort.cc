@@ -0,0 +1,189 @@
+#include <sbon-sort.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "helpers.h"
+#include "test.h"
+
+struct Row {
+	int64_t ts;
+	std::string user;
+	int seq;
+};
+
+static std::string encodeRows(const std::vector<Row> &rows) {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	for (auto &row: rows) {
+		w.writeObject([&](sbon::ObjectWriter w) {
+			w.key("user").writeString(row.user);
+			w.key("ts").writeInt(row.ts);
+			w.key("seq").writeInt(row.seq);
+		});
+	}
+
+	return ss.str();
+}
+
+static std::vector<Row> decode(std::stringstream &ss) {
+	std::vector<Row> rows;
+	sbon::Reader r(&ss);
+	while (r.hasNext()) {
+		Row row;
+		r.matchObject({
+			{"user", [&](sbon::Reader val) { row.user = val.getString(); }},
+			{"ts", [&](sbon::Reader val) { row.ts = val.getInt(); }},
+			{"seq", [&](sbon::Reader val) { row.seq = val.getInt(); }},
+		});
+		rows.push_back(row);
+	}
+
+	return rows;
+}
+
+static std::vector<Row> makeRows() {
+	std::vector<Row> rows;
+	uint64_t state = 12345;
+	for (int i = 0; i < 500; ++i) {
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		int64_t ts = (int64_t)(state >> 40) % 200 - 50;
+		rows.push_back({ts, "u" + std::to_string((state >> 20) % 7), i});
+	}
+
+	return rows;
+}
+
+static std::vector<Row> sortRows(
+		const std::vector<Row> &rows, std::vector<std::string> keys,
+		size_t memoryLimit, size_t maxFanIn = 64) {
+	std::string data = encodeRows(rows);
+	sbon::SortOptions opts;
+	opts.keys = keys;
+	opts.memoryLimit = memoryLimit;
+	opts.threads = 3;
+	opts.maxFanIn = maxFanIn;
+
+	std::stringstream out;
+	sbon::sortRecords(span(data), out, opts);
+	return decode(out);
+}
+
+TEST_CASE("Sort by numeric key") {
+	auto rows = makeRows();
+	for (size_t limit: {1024 * 1024, 1024}) {
+		auto sorted = sortRows(rows, {"ts"}, limit);
+		REQUIRE(sorted.size() == rows.size());
+		for (size_t i = 1; i < sorted.size(); ++i) {
+			CHECK(sorted[i - 1].ts <= sorted[i].ts);
+			if (sorted[i - 1].ts == sorted[i].ts) {
+				CHECK(sorted[i - 1].seq < sorted[i].seq);
+			}
+		}
+	}
+}
+
+TEST_CASE("Sort with multiple merge passes") {
+	// Many small runs with a small fan-in take several passes to merge
+	auto rows = makeRows();
+	for (size_t fanIn: {2, 3, 1000}) {
+		auto sorted = sortRows(rows, {"user", "ts"}, 512, fanIn);
+		REQUIRE(sorted.size() == rows.size());
+		for (size_t i = 1; i < sorted.size(); ++i) {
+			auto &a = sorted[i - 1];
+			auto &b = sorted[i];
+			CHECK(a.user <= b.user);
+			if (a.user == b.user) {
+				CHECK(a.ts <= b.ts);
+				if (a.ts == b.ts) {
+					CHECK(a.seq < b.seq);
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE("Sort by multiple keys") {
+	auto rows = makeRows();
+	for (size_t limit: {1024 * 1024, 1024}) {
+		auto sorted = sortRows(rows, {"user", "ts"}, limit);
+		REQUIRE(sorted.size() == rows.size());
+		for (size_t i = 1; i < sorted.size(); ++i) {
+			auto &a = sorted[i - 1];
+			auto &b = sorted[i];
+			CHECK(a.user <= b.user);
+			if (a.user == b.user) {
+				CHECK(a.ts <= b.ts);
+				if (a.ts == b.ts) {
+					CHECK(a.seq < b.seq);
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE("Sort keys of mixed types") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeString("b"); });
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeDouble(2.5); });
+	w.writeObject([](sbon::ObjectWriter w) { w.key("x").writeNull(); });
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeInt(-3); });
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeString("a"); });
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeNull(); });
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeUInt(2); });
+
+	std::string data = ss.str();
+	sbon::SortOptions opts;
+	opts.keys = {"k"};
+	std::stringstream out;
+	sbon::sortRecords(span(data), out, opts);
+
+	std::vector<std::string> order;
+	sbon::Reader r(&out);
+	while (r.hasNext()) {
+		r.readObject([&](const std::string &key, sbon::Reader val) {
+			switch (val.getType()) {
+			case sbon::Type::NIL: val.getNil(); order.push_back(key + "=null"); break;
+			case sbon::Type::STRING: order.push_back(val.getString()); break;
+			default: order.push_back(std::to_string(val.getDouble())); break;
+			}
+		});
+	}
+
+	CHECK(order == std::vector<std::string>({
+		"x=null", "k=null", "-3.000000", "2.000000", "2.500000", "a", "b",
+	}));
+}
+
+TEST_CASE("Sort mixed integer and float keys which doubles can't represent") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeUInt(UINT64_MAX); });
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeInt((1ll << 53) + 1); });
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeDouble(1.5); });
+	w.writeObject([](sbon::ObjectWriter w) { w.key("k").writeInt(-(1ll << 53) - 1); });
+
+	std::string data = ss.str();
+	sbon::SortOptions opts;
+	opts.keys = {"k"};
+	std::stringstream out;
+	sbon::sortRecords(span(data), out, opts);
+
+	std::vector<std::string> order;
+	sbon::Reader r(&out);
+	while (r.hasNext()) {
+		r.readObject([&](const std::string &, sbon::Reader val) {
+			switch (val.getType()) {
+			case sbon::Type::INT: order.push_back(std::to_string(val.getInt())); break;
+			case sbon::Type::UINT: order.push_back(std::to_string(val.getUInt())); break;
+			default: order.push_back(std::to_string(val.getDouble())); break;
+			}
+		});
+	}
+
+	CHECK(order == std::vector<std::string>({
+		"-9007199254740993", "1.500000", "9007199254740993", "18446744073709551615",
+	}));
+}
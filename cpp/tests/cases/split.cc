@@ -0,0 +1,104 @@
+#include <sbon-split.h>
+
+#include <sstream>
+#include <string>
+
+#include "helpers.h"
+#include "test.h"
+
+static std::string makeRecords(int count) {
+	return encodeRecords(count, [](sbon::ObjectWriter w, int i) {
+		w.key("user").writeString("u" + std::to_string(i % 5));
+		w.key("pad").writeString(std::string(i % 10, 'x'));
+	});
+}
+
+static std::vector<sbon::Span> records(const std::string &data) {
+	std::vector<sbon::Span> recs;
+	sbon::forEachRecord(span(data), [&](sbon::Span rec) {
+		recs.push_back(rec);
+	});
+	return recs;
+}
+
+TEST_CASE("Shard by count") {
+	std::string data = makeRecords(100);
+	auto recs = records(data);
+	auto shards = sbon::shardRecords(recs, 3, sbon::ShardMode::COUNT);
+
+	REQUIRE(shards.size() == 3);
+	CHECK(shards[0].size() == 33);
+	CHECK(shards[1].size() == 33);
+	CHECK(shards[2].size() == 34);
+	CHECK(shards[0][0].begin == recs[0].begin);
+	CHECK(shards[2].back().end == recs.back().end);
+}
+
+TEST_CASE("Shard by bytes") {
+	std::string data = makeRecords(1000);
+	auto shards = sbon::shardRecords(records(data), 4, sbon::ShardMode::BYTES);
+
+	REQUIRE(shards.size() == 4);
+	const char *p = data.data();
+	for (auto &shard: shards) {
+		size_t bytes = shard.back().end - shard.front().begin;
+		CHECK(shard.front().begin == p);
+		CHECK(bytes > data.size() / 4 - 30 && bytes < data.size() / 4 + 30);
+		p = shard.back().end;
+	}
+}
+
+TEST_CASE("Shard by hash") {
+	std::string data = makeRecords(100);
+	auto shards = sbon::shardRecords(records(data), 3, sbon::ShardMode::HASH, "user");
+
+	size_t total = 0;
+	for (auto &shard: shards) {
+		total += shard.size();
+	}
+	CHECK(total == 100);
+
+	// Every user must end up in exactly one shard
+	for (int u = 0; u < 5; ++u) {
+		std::string user = "u" + std::to_string(u);
+		int shardsWithUser = 0;
+		for (auto &shard: shards) {
+			for (auto &rec: shard) {
+				if (rec.view().find("S" + user + '\0') != std::string_view::npos) {
+					shardsWithUser += 1;
+					break;
+				}
+			}
+		}
+		CHECK(shardsWithUser == 1);
+	}
+}
+
+TEST_CASE("Array elements") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeArray([](sbon::Writer w) {
+		w.writeInt(1);
+		w.writeArray([](sbon::Writer) {});
+		w.writeString("x");
+	});
+
+	std::string data = ss.str();
+	std::string storage;
+	auto elems = sbon::arrayElements(span(data), storage);
+	REQUIRE(elems.size() == 3);
+	CHECK(elems[0].view() == "1");
+	CHECK(elems[1].view() == "[]");
+	CHECK(elems[2].view() == std::string_view("Sx\0", 3));
+
+	// The elements of a delta-encoded array are encoded one by one
+	std::stringstream ints;
+	sbon::Writer(&ints).writeIntArray({1700000000, 1700000010, 3});
+	data = ints.str();
+	REQUIRE(data[0] == '#');
+	elems = sbon::arrayElements(span(data), storage);
+	REQUIRE(elems.size() == 3);
+	CHECK(sbon::RawValue(elems[0]).getInt() == 1700000000);
+	CHECK(sbon::RawValue(elems[1]).getInt() == 1700000010);
+	CHECK(elems[2].view() == "3");
+}
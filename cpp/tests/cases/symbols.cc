@@ -0,0 +1,178 @@
+#include <sbon.h>
+#include <sbon-records.h>
+
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+
+TEST_CASE("Symbol table") {
+	sbon::SymbolTable table;
+	CHECK(table.find("id") == sbon::SymbolTable::NOT_FOUND);
+
+	uint32_t id = table.intern("id");
+	uint32_t name = table.intern("name");
+	CHECK(id == 0);
+	CHECK(name == 1);
+	CHECK(table.intern("id") == id);
+	CHECK(table.find("name") == name);
+	CHECK(table.name(name) == "name");
+
+	// Names stay put as the table grows
+	std::string_view first = table.name(id);
+	for (int i = 0; i < 5000; ++i) {
+		CHECK(table.intern("key" + std::to_string(i)) == (uint32_t)i + 2);
+	}
+	CHECK(table.size() == 5002);
+	CHECK(table.name(id).data() == first.data());
+	for (int i = 0; i < 5000; ++i) {
+		CHECK(table.find("key" + std::to_string(i)) == (uint32_t)i + 2);
+		CHECK(table.name(i + 2) == "key" + std::to_string(i));
+	}
+}
+
+TEST_CASE("Symbol table shared between threads") {
+	sbon::SymbolTable table;
+	std::vector<std::vector<uint32_t>> ids(4);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t) {
+		threads.emplace_back([&, t] {
+			for (int i = 0; i < 2000; ++i) {
+				// Each thread sees the keys in a different order
+				int key = (i * (t * 2 + 1)) % 2000;
+				ids[t].push_back(table.intern("key" + std::to_string(key)));
+			}
+		});
+	}
+	for (auto &thread: threads) {
+		thread.join();
+	}
+
+	CHECK(table.size() == 2000);
+	for (int t = 0; t < 4; ++t) {
+		for (int i = 0; i < 2000; ++i) {
+			int key = (i * (t * 2 + 1)) % 2000;
+			CHECK(table.name(ids[t][i]) == "key" + std::to_string(key));
+		}
+	}
+}
+
+static void writeRecord(sbon::Writer w, int i) {
+	w.writeObject([&](sbon::ObjectWriter w) {
+		w.key("id").writeInt(i);
+		if (i % 10 == 5) {
+			w.key("extra").writeTrue();
+		}
+		w.key("name").writeString("record");
+		w.key("tags").writeObject([&](sbon::ObjectWriter w) {
+			w.key("a").writeInt(1);
+			w.key(i % 10 == 7 ? "bee" : "b").writeInt(2);
+		});
+	});
+}
+
+TEST_CASE("Object keys as IDs") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	for (int i = 0; i < 20; ++i) {
+		writeRecord(w, i);
+	}
+	std::string doc = ss.str();
+
+	sbon::SymbolTable table;
+	sbon::KeyDecoder keys(table);
+	std::vector<std::string> names;
+	names.reserve(200);
+	std::vector<int64_t> ints;
+	ints.reserve(100);
+
+	std::function<void(sbon::Reader)> visit = [&](sbon::Reader r) {
+		if (r.getType() == sbon::Type::OBJECT) {
+			r.getObject([&](sbon::ObjectReader obj) {
+				uint32_t id;
+				while (obj.hasNext()) {
+					auto val = obj.next(keys, id);
+					names.emplace_back(table.name(id));
+					visit(val);
+				}
+			});
+		} else if (r.getType() == sbon::Type::UINT) {
+			ints.push_back(r.getInt());
+		} else {
+			r.skip();
+		}
+	};
+
+	sbon::MemoryStream ms(doc.data(), doc.size());
+	sbon::Reader r(&ms);
+	size_t count = 0;
+	while (r.hasNext()) {
+		keys.reset();
+		visit(r);
+		count += 1;
+	}
+
+	CHECK(count == 20);
+	CHECK(table.size() == 7);
+	CHECK(names.size() == 20 * 5 + 2);
+	CHECK(names[0] == "id");
+	CHECK(names[5] == "id");
+	CHECK(names[26] == "extra");
+	CHECK(names[36] == "id");
+	CHECK(names[40] == "bee");
+	CHECK(names[77] == "extra");
+	CHECK(names[101] == "b");
+	CHECK(ints[0] == 0);
+	CHECK(ints[1] == 1);
+
+	// Everything but the first record, the new keys and the records
+	// after the ones with different shapes is predicted
+	CHECK(keys.predicted() > 20 * 5 / 2);
+	CHECK(keys.predicted() < 20 * 5);
+
+	// Once every key is known, reading records of the same shape
+	// doesn't allocate
+	std::string rec;
+	{
+		std::stringstream ss;
+		sbon::Writer w(&ss);
+		writeRecord(w, 1);
+		rec = ss.str();
+	}
+
+	auto readKeys = [&] {
+		sbon::MemoryStream ms(rec.data(), rec.size());
+		sbon::Reader r(&ms);
+		keys.reset();
+		uint32_t sum = 0;
+		r.getObject([&](sbon::ObjectReader obj) {
+			uint32_t id;
+			while (obj.hasNext()) {
+				auto val = obj.next(keys, id);
+				sum += id;
+				if (id == table.find("tags")) {
+					val.getObject([&](sbon::ObjectReader obj) {
+						while (obj.hasNext()) {
+							obj.next(keys, id).skip();
+							sum += id;
+						}
+					});
+				} else {
+					val.skip();
+				}
+			}
+		});
+		return sum;
+	};
+
+	readKeys();
+	size_t before = keys.predicted();
+	uint32_t sum = 0;
+	CHECK_NO_ALLOC(sum = readKeys());
+	CHECK(keys.predicted() == before + 5);
+	CHECK(sum == table.find("id") + table.find("name") + table.find("tags") +
+		table.find("a") + table.find("b"));
+}
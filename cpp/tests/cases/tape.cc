@@ -0,0 +1,144 @@
+#include <sbon-tape.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test.h"
+
+static std::string makeDocument(int users) {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([&](sbon::ObjectWriter w) {
+		w.key("version").writeInt(3);
+		w.key("users").writeArray([&](sbon::Writer w) {
+			for (int i = 0; i < users; ++i) {
+				w.writeObject([&](sbon::ObjectWriter w) {
+					w.key("id").writeInt(i);
+					w.key("name").writeString("user " + std::to_string(i));
+					w.key("tags").writeArray([&](sbon::Writer w) {
+						w.writeString("a");
+						w.writeString("b");
+					});
+				});
+			}
+		});
+		w.key("empty").writeObject([](sbon::ObjectWriter) {});
+		w.key("series").writeIntArray({1700000000, 1700000010, 1700000020});
+	});
+
+	return ss.str();
+}
+
+static void writeFile(const std::string &path, const std::string &data) {
+	std::ofstream os(path, std::ios::binary);
+	os << data;
+}
+
+TEST_CASE("Tape navigation") {
+	std::string doc = makeDocument(100);
+	sbon::Span data{doc.data(), doc.data() + doc.size()};
+	auto entries = sbon::detail::buildTape(data);
+
+	// The root, 4 members, 100 users with 3 members and 2 tags each
+	CHECK_EQ(entries.size(), (size_t)(1 + 4 + 100 * 6));
+	CHECK(entries[0].length == doc.size());
+	CHECK(entries[0].next == entries.size());
+	CHECK(entries[0].count == 4);
+
+	bool threw = false;
+	try {
+		sbon::detail::buildTape({data.begin, data.end - 1});
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+TEST_CASE("Tape document") {
+	char dir[] = "/tmp/sbon-tape-XXXXXX";
+	REQUIRE(mkdtemp(dir));
+	std::string path = std::string(dir) + "/doc.sbon";
+	std::string tapePath = path + ".tape";
+	writeFile(path, makeDocument(1000));
+
+	{
+		sbon::TapeDocument doc(path.c_str());
+		CHECK(doc.rebuilt());
+		CHECK(doc.root().size() == 4);
+		CHECK(doc.find("version").raw().getInt() == 3);
+		CHECK(doc.find("users").size() == 1000);
+		CHECK(doc.find("users.567.name").raw().getString() == "user 567");
+		CHECK(doc.find("users.567.name").key() == "name");
+		CHECK(doc.find("users.999.tags.1").raw().getString() == "b");
+		CHECK(doc.find("empty").getType() == sbon::Type::OBJECT);
+		CHECK(!doc.find("users.1000"));
+		CHECK(!doc.find("users.x"));
+		CHECK(!doc.find("version.a"));
+		CHECK(!doc.find("missing"));
+
+		// A delta-encoded array is one entry, which still knows its size
+		CHECK(doc.find("series").getType() == sbon::Type::ARRAY);
+		CHECK(doc.find("series").size() == 3);
+		CHECK(!doc.find("series.0"));
+		std::vector<int64_t> ints;
+		doc.find("series").raw().getInts(ints);
+		CHECK(ints.size() == 3);
+
+		size_t count = 0;
+		doc.find("users.0").forEachChild([&](sbon::TapeValue val) {
+			count += 1;
+			CHECK(!val.key().empty());
+		});
+		CHECK(count == 3);
+	}
+
+	// The saved tape is used when opening again
+	{
+		sbon::TapeDocument doc(path.c_str(), {"", true, true});
+		CHECK(!doc.rebuilt());
+		CHECK(doc.find("users.567.name").raw().getString() == "user 567");
+	}
+
+	// A changed document makes the tape stale
+	writeFile(path, makeDocument(10));
+	{
+		sbon::TapeDocument doc(path.c_str());
+		CHECK(doc.rebuilt());
+		CHECK(doc.find("users").size() == 10);
+	}
+
+	// So does a corrupted tape, if it's verified
+	{
+		std::fstream fs(tapePath, std::ios::in | std::ios::out | std::ios::binary);
+		fs.seekp(100);
+		fs.put('x');
+	}
+	{
+		sbon::TapeDocument doc(path.c_str(), {"", true, false});
+		CHECK(doc.rebuilt());
+		CHECK(doc.find("users.9.id").raw().getInt() == 9);
+	}
+
+	// If it isn't verified, the corrupt entry is caught when it's reached
+	{
+		sbon::TapeDocument doc(path.c_str(), {"", false, false});
+		CHECK(!doc.rebuilt());
+		CHECK(doc.root().size() == 4);
+
+		bool threw = false;
+		try {
+			doc.find("version");
+		} catch (sbon::ParseError &) {
+			threw = true;
+		}
+		CHECK(threw);
+	}
+
+	unlink(tapePath.c_str());
+	unlink(path.c_str());
+	rmdir(dir);
+}
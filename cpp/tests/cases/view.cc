@@ -0,0 +1,199 @@
+#include <sbon-view.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "helpers.h"
+#include "test.h"
+
+static std::string makeRecords(int count) {
+	return encodeRecords(count, [](sbon::ObjectWriter w, int i) {
+		w.key("id").writeInt(i);
+		w.key("name").writeString("user " + std::to_string(i));
+		w.key("tags").writeArray([&](sbon::Writer w) {
+			w.writeString("a");
+			w.writeArray([](sbon::Writer) {});
+		});
+		w.key("blob").writeBinary("0123456789abcdefXYZ", 19);
+	});
+}
+
+static std::vector<std::string> renderAll(sbon::Outline &outline) {
+	std::vector<std::string> lines;
+	for (auto line = outline.first(); line; line = outline.next(line)) {
+		lines.push_back(outline.render(line, 120));
+	}
+	return lines;
+}
+
+TEST_CASE("Outline rendering") {
+	std::string data = makeRecords(2);
+	sbon::Outline outline(span(data));
+
+	auto lines = renderAll(outline);
+	REQUIRE(lines.size() == 2);
+	CHECK_EQ(lines[0],
+		"0: {id: 0, name: \"user 0\", tags: […], blob: <19 bytes: 30 31 32 33 34 35 36 37 …>}");
+
+	auto tags = outline.find("1.tags");
+	REQUIRE(tags);
+	CHECK_EQ(outline.path(tags), "1.tags");
+	CHECK(outline.expand(tags));
+	CHECK(outline.expand(outline.find("1.blob")));
+
+	lines = renderAll(outline);
+	std::vector<std::string> expected = {
+		lines[0],
+		"1: {",
+		"  id: 1",
+		"  name: \"user 1\"",
+		"  tags: [",
+		"    0: \"a\"",
+		"    1: []",
+		"  ]",
+		"  blob: <19 bytes>",
+		"    00000000  30 31 32 33 34 35 36 37 38 39 61 62 63 64 65 66  |0123456789abcdef|",
+		"    00000010  58 59 5a                                         |XYZ|",
+		"}",
+	};
+	CHECK(lines == expected);
+
+	// Cut lines, and keep control characters out of the terminal
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeString("a\x1b[2Jb\nc");
+	std::string str = ss.str();
+	sbon::Outline other(span(str));
+	CHECK_EQ(other.render(other.first(), 80), "0: \"a\\x1b[2Jb\\nc\"");
+	CHECK_EQ(other.render(other.first(), 6), "0: \"a\\");
+}
+
+TEST_CASE("Outline of delta-encoded arrays") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+	w.writeObject([](sbon::ObjectWriter w) {
+		w.key("ts").writeIntArray({1700000000, 1700000010, 1700000020, 1700000015});
+		w.key("n").writeArray([](sbon::Writer w) {
+			w.writeIntArray({-1, 3000000, 0});
+		});
+	});
+	std::string data = ss.str();
+	REQUIRE(data.find('#') != std::string::npos);
+	sbon::Outline outline(span(data));
+
+	CHECK_EQ(outline.render(outline.first(), 120), "0: {ts: […], n: […]}");
+
+	auto ts = outline.find("0.ts");
+	REQUIRE(ts);
+	CHECK_EQ(outline.render(ts, 120), "  ts: [1700000000, 1700000010, 1700000020, 1700000015]");
+	CHECK_EQ(outline.render(ts, 24), "  ts: [1700000000, 17000");
+	CHECK(outline.isContainer(ts));
+	CHECK(outline.expand(ts));
+	CHECK(outline.expand(outline.find("0.n")));
+	CHECK(outline.expand(outline.find("0.n.0")));
+	CHECK(!outline.canExpand(outline.find("0.ts.1")));
+	CHECK(!outline.find("0.ts.4"));
+
+	auto lines = renderAll(outline);
+	std::vector<std::string> expected = {
+		"0: {",
+		"  ts: [",
+		"    0: 1700000000",
+		"    1: 1700000010",
+		"    2: 1700000020",
+		"    3: 1700000015",
+		"  ]",
+		"  n: [",
+		"    0: [",
+		"      0: -1",
+		"      1: 3000000",
+		"      2: 0",
+		"    ]",
+		"  ]",
+		"}",
+	};
+	CHECK(lines == expected);
+	CHECK_EQ(outline.render(outline.prev(outline.find("0.n")), 120), "  ]");
+
+	// The value after an expanded array is found from where it ends
+	sbon::Outline other(span(data));
+	other.expand(other.first());
+	other.expand(other.find("0.ts"));
+	lines = renderAll(other);
+	REQUIRE(lines.size() == 9);
+	CHECK_EQ(lines[7], "  n: [[…]]");
+}
+
+TEST_CASE("Outline navigation") {
+	std::string data = makeRecords(3);
+	sbon::Outline outline(span(data));
+	outline.expand(outline.find("1"));
+	outline.expand(outline.find("1.tags"));
+	outline.expand(outline.find("2.blob"));
+
+	// Walking backwards visits the same lines
+	std::vector<sbon::Outline::Line> forward;
+	for (auto line = outline.first(); line; line = outline.next(line)) {
+		forward.push_back(line);
+	}
+
+	std::vector<sbon::Outline::Line> backward;
+	for (auto line = outline.last(); line; line = outline.prev(line)) {
+		backward.insert(backward.begin(), line);
+	}
+	CHECK(forward == backward);
+	CHECK_EQ(forward.size(), 18u);
+
+	// Collapsing moves lines inside to the collapsed value
+	auto tag = outline.find("1.tags.1");
+	REQUIRE(tag);
+	CHECK_EQ(outline.depth(tag), 2u);
+	outline.collapse(outline.find("1"));
+	CHECK(outline.reveal(tag) == outline.find("1"));
+	CHECK(outline.enclosing(tag) == outline.find("1.tags"));
+	CHECK(!outline.enclosing(outline.find("1")));
+
+	CHECK(!outline.find("3"));
+	CHECK(!outline.find("1.missing"));
+	CHECK(!outline.find("1.id.0"));
+	CHECK(!outline.find("1.tags.x"));
+}
+
+TEST_CASE("Outline only scans what's shown") {
+	std::string data = makeRecords(10000);
+	sbon::Outline outline(span(data));
+
+	auto line = outline.first();
+	for (int i = 0; i < 50; ++i) {
+		outline.render(line, 80);
+		line = outline.next(line);
+	}
+	CHECK(outline.scannedBytes() < data.size() / 100);
+
+	// Going to a record skips the ones before it without expanding them
+	REQUIRE(outline.find("5000.name"));
+	CHECK(outline.scannedBytes() < data.size() / 2 + 100);
+
+	REQUIRE(outline.last());
+	CHECK_EQ(outline.path(outline.last()), "9999");
+}
+
+TEST_CASE("Outline of a malformed file") {
+	std::string data = makeRecords(2);
+	data.resize(data.size() - 3);
+	sbon::Outline outline(span(data));
+
+	auto line = outline.find("1");
+	REQUIRE(line);
+	CHECK_EQ(outline.render(line, 200).substr(0, 6), "1: {id");
+	CHECK(outline.render(line, 200).find("Unexpected EOF") != std::string::npos);
+
+	bool threw = false;
+	try {
+		outline.next(line);
+	} catch (sbon::ParseError &) {
+		threw = true;
+	}
+	CHECK(threw);
+}
@@ -2,6 +2,7 @@
 
 #include <limits>
 #include <sstream>
+#include <vector>
 
 #include "test.h"
 
@@ -181,6 +182,34 @@ TEST_CASE("Arrays") {
 	checkEq(ss.str(), "[TF[FT]N]");
 }
 
+TEST_CASE("Integer arrays") {
+	std::stringstream ss;
+	sbon::Writer w(&ss);
+
+	// Delta-encoded when that's smaller
+	w.writeIntArray({1700000000, 1700000010, 1700000020, 1700000015});
+	checkEq(ss.str(), "#<04><80><c4><9f><d5><0c><14><14><09>");
+
+	// Otherwise, and on ties, an ordinary array
+	ss.str("");
+	w.writeIntArray({1, 2, 3});
+	w.writeIntArray({});
+	w.writeIntArray({-1, 3000000, 0});
+	checkEq(ss.str(), "[123][][-<01>+<c0><8d><b7><01>0]");
+
+	// Differences wrap around
+	ss.str("");
+	std::vector<int64_t> extremes;
+	for (int i = 0; i < 10; ++i) {
+		extremes.push_back(std::numeric_limits<int64_t>::min() + i);
+	}
+	extremes.push_back(std::numeric_limits<int64_t>::max());
+	w.writeIntArray(extremes);
+	checkEq(ss.str(),
+		"#<0b><ff><ff><ff><ff><ff><ff><ff><ff><ff><01>"
+		"<02><02><02><02><02><02><02><02><02><13>");
+}
+
 TEST_CASE("Objects") {
 	std::stringstream ss;
 	sbon::Writer w(&ss);
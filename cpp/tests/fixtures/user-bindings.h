@@ -0,0 +1,198 @@
+// Generated by sbon-infer from 100 records.
+
+#pragma once
+
+#include <sbon.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gen {
+
+namespace detail {
+
+template<size_t N>
+inline size_t findKey(const std::string_view (&keys)[N], std::string_view key) {
+	for (size_t i = 0; i < N; ++i) {
+		if (keys[i] == key) {
+			return i;
+		}
+	}
+	return N;
+}
+
+}
+
+// Most common key order (100.0% of 100 objects): role
+struct UserUser {
+	// string; length 5 .. 5
+	std::string role{};
+};
+
+// Most common key order (70.0% of 100 objects): id name score samples users mixed class
+struct User {
+	// integer; -10 .. 89
+	int64_t id{};
+
+	// string; length 1 .. 5
+	std::string name{};
+
+	// present in 25.0%; string; length 1 .. 1
+	std::optional<std::string> nick{};
+
+	// null 34.0%, float 66.0%; 0.5 .. 49
+	std::optional<double> score{};
+
+	// array; 0 .. 3 elements
+	std::vector<int64_t> samples{};
+
+	// array; 1 .. 1 elements
+	std::vector<UserUser> users{};
+
+	// integer 50.0%, string 50.0%
+	// Not decoded: no single type
+	// mixed
+
+	// "class": bool
+	bool class_{};
+};
+
+inline void decode(sbon::Reader r, UserUser &out) {
+	static constexpr std::string_view keys[] = {
+		"role",
+	};
+
+	r.getObject([&](sbon::ObjectReader obj) {
+		std::string key;
+		size_t expected = 0;
+		while (obj.hasNext()) {
+			sbon::Reader val = obj.next(key);
+
+			// Keys usually come in this order, so try the next one first
+			size_t field = expected < 1 && key == keys[expected] ?
+				expected : detail::findKey(keys, key);
+			if (field < 1) {
+				// Keys which aren't decoded don't move the expected key on
+				expected = field + 1;
+			}
+			switch (field) {
+			case 0:
+				val.getString(out.role);
+				break;
+			default:
+				val.skip();
+				break;
+			}
+		}
+	});
+}
+
+inline void decode(sbon::Reader r, User &out) {
+	static constexpr std::string_view keys[] = {
+		"id",
+		"name",
+		"nick",
+		"score",
+		"samples",
+		"users",
+		"class",
+	};
+
+	out.nick.reset();
+	r.getObject([&](sbon::ObjectReader obj) {
+		std::string key;
+		size_t expected = 0;
+		while (obj.hasNext()) {
+			sbon::Reader val = obj.next(key);
+
+			// Keys usually come in this order, so try the next one first
+			size_t field = expected < 7 && key == keys[expected] ?
+				expected : detail::findKey(keys, key);
+			if (field < 7) {
+				// Keys which aren't decoded don't move the expected key on
+				expected = field + 1;
+			}
+			switch (field) {
+			case 0:
+				out.id = val.getInt();
+				break;
+			case 1:
+				val.getString(out.name);
+				break;
+			case 2:
+				if (val.getType() == sbon::Type::NIL) {
+					val.getNil();
+					out.nick.reset();
+				} else {
+					auto &val0 = out.nick.emplace();
+					val.getString(val0);
+				}
+				break;
+			case 3:
+				if (val.getType() == sbon::Type::NIL) {
+					val.getNil();
+					out.score.reset();
+				} else {
+					auto &val0 = out.score.emplace();
+					val0 = val.getDouble();
+				}
+				break;
+			case 4:
+				val.getArray([&](sbon::ArrayReader arr) {
+					arr.getInts(out.samples);
+				});
+				break;
+			case 5:
+				out.users.clear();
+				val.readArray([&](sbon::Reader el0) {
+					out.users.emplace_back();
+					decode(el0, out.users.back());
+				});
+				break;
+			case 6:
+				out.class_ = val.getBool();
+				break;
+			default:
+				val.skip();
+				break;
+			}
+		}
+	});
+}
+
+inline void encode(sbon::Writer w, const UserUser &in) {
+	w.writeObject([&](sbon::ObjectWriter obj) {
+		obj.key("role").writeString(in.role);
+	});
+}
+
+inline void encode(sbon::Writer w, const User &in) {
+	w.writeObject([&](sbon::ObjectWriter obj) {
+		obj.key("id").writeInt(in.id);
+		obj.key("name").writeString(in.name);
+		if (in.nick) {
+			obj.key("nick").writeString(*in.nick);
+		}
+		if (in.score) {
+			obj.key("score").writeDouble(*in.score);
+		} else {
+			obj.key("score").writeNull();
+		}
+		obj.key("samples").writeArray([&](sbon::Writer w0) {
+			for (auto &el0: in.samples) {
+				w0.writeInt(el0);
+			}
+		});
+		obj.key("users").writeArray([&](sbon::Writer w0) {
+			for (auto &el0: in.users) {
+				encode(w0, el0);
+			}
+		});
+		obj.key("class").writeBool(in.class_);
+	});
+}
+
+}
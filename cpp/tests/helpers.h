@@ -0,0 +1,34 @@
+#pragma once
+
+// Helpers for making the data which test cases read.
+
+#include <sbon.h>
+
+#include <sstream>
+#include <string>
+
+// The bytes of 'str'.
+inline sbon::Span span(const std::string &str) {
+	return {str.data(), str.data() + str.size()};
+}
+
+// The values which 'func(sbon::Writer)' writes, encoded.
+template<typename Func>
+std::string encode(Func func) {
+	std::stringstream ss;
+	func(sbon::Writer(&ss));
+	return ss.str();
+}
+
+// A stream of 'count' records which are objects,
+// whose members 'func(sbon::ObjectWriter, int index)' writes.
+template<typename Func>
+std::string encodeRecords(int count, Func func) {
+	return encode([&](sbon::Writer w) {
+		for (int i = 0; i < count; ++i) {
+			w.writeObject([&](sbon::ObjectWriter w) {
+				func(w, i);
+			});
+		}
+	});
+}
@@ -3,7 +3,9 @@
 #include <algorithm>
 #include <vector>
 #include <iostream>
+#include <cstdlib>
 #include <cstring>
+#include <new>
 
 static std::vector<TestCase *> testCases;
 
@@ -13,6 +15,67 @@ TestCase::TestCase(
 	testCases.push_back(this);
 }
 
+// Allocations are counted per thread, so that threads started by one test
+// can't affect another test's counts
+static thread_local size_t allocations = 0;
+
+size_t allocationCount() {
+	return allocations;
+}
+
+static void *allocate(size_t size) {
+	allocations += 1;
+	void *ptr = std::malloc(size ? size : 1);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+static void *allocateAligned(size_t size, std::align_val_t align) {
+	allocations += 1;
+	size_t alignment = std::max((size_t)align, sizeof(void *));
+	size = (size + alignment - 1) / alignment * alignment;
+	void *ptr = std::aligned_alloc(alignment, size ? size : alignment);
+	if (!ptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+// Every form of new and delete is replaced, so that none of them
+// mix with the sanitizer runtime's versions
+void *operator new(size_t size) { return allocate(size); }
+void *operator new[](size_t size) { return allocate(size); }
+void *operator new(size_t size, std::align_val_t align) { return allocateAligned(size, align); }
+void *operator new[](size_t size, std::align_val_t align) { return allocateAligned(size, align); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	try { return allocate(size); } catch (std::bad_alloc &) { return nullptr; }
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	try { return allocate(size); } catch (std::bad_alloc &) { return nullptr; }
+}
+void *operator new(size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+	try { return allocateAligned(size, align); } catch (std::bad_alloc &) { return nullptr; }
+}
+void *operator new[](size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+	try { return allocateAligned(size, align); } catch (std::bad_alloc &) { return nullptr; }
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept { std::free(ptr); }
+
 static bool currentTestFailed = false;
 
 static void breakpoint() {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <exception>
 #include <string>
 
@@ -41,6 +42,18 @@ void onCheckFailure(const char *file, int line, const char *msg);
 #define CHECK_EQ(a, b) CHECK((a) == (b))
 #define CHECK_NEQ(a, b) CHECK((a) != (b))
 
+// The number of heap allocations made by the current thread so far.
+// The test binary replaces the global operator new to count them.
+size_t allocationCount();
+
+#define CHECK_NO_ALLOC(expr) do { \
+	size_t allocsBefore_ = allocationCount(); \
+	expr; \
+	if (allocationCount() != allocsBefore_) { \
+		onCheckFailure(__FILE__, __LINE__, "Allocation in (" #expr ")"); \
+	} \
+} while (0)
+
 #define REQUIRE(expr) do { \
 	if (!(expr)) { \
 		throw TestFailure(__FILE__, __LINE__, "Assertion failure: (" #expr ")"); \